@@ -0,0 +1,246 @@
+#include "allocation_statistics.h"
+
+#include "dvc/log.h"
+
+namespace spk {
+namespace {
+
+std::atomic<uint64_t> next_collector_id{1};
+
+size_t bucket(size_t size) {
+  size_t width = 0;
+  while (size) {
+    ++width;
+    size >>= 1;
+  }
+  return std::min(width, num_allocation_size_buckets - 1);
+}
+
+size_t index(spk::system_allocation_scope scope) {
+  DVC_ASSERT_LT(size_t(scope), num_system_allocation_scopes);
+  return size_t(scope);
+}
+
+size_t index(spk::internal_allocation_type type) {
+  DVC_ASSERT_LT(size_t(type), num_internal_allocation_types);
+  return size_t(type);
+}
+
+void increment(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+  // Only the owning thread writes, so a load and store is enough.
+  counter.store(counter.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+}
+
+}  // namespace
+
+struct allocation_statistics_collector::counters {
+  std::atomic<uint64_t> allocations{0};
+  std::atomic<uint64_t> reallocations{0};
+  std::atomic<uint64_t> frees{0};
+  std::atomic<uint64_t> bytes_allocated{0};
+  std::atomic<uint64_t> bytes_freed{0};
+  std::array<std::atomic<uint64_t>, num_allocation_size_buckets>
+      size_histogram = {};
+
+  void add_to(allocation_scope_statistics& s) const {
+    s.allocations += allocations.load(std::memory_order_relaxed);
+    s.reallocations += reallocations.load(std::memory_order_relaxed);
+    s.frees += frees.load(std::memory_order_relaxed);
+    s.bytes_allocated += bytes_allocated.load(std::memory_order_relaxed);
+    s.bytes_freed += bytes_freed.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < num_allocation_size_buckets; ++i)
+      s.size_histogram[i] += size_histogram[i].load(std::memory_order_relaxed);
+  }
+};
+
+struct allocation_statistics_collector::thread_counters {
+  std::array<counters, num_system_allocation_scopes> scopes;
+  std::array<std::array<counters, num_system_allocation_scopes>,
+             num_internal_allocation_types>
+      internal;
+};
+
+void allocation_statistics_collector::live_counter::add(int64_t bytes) {
+  int64_t now = live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  int64_t high = high_water.load(std::memory_order_relaxed);
+  while (now > high && !high_water.compare_exchange_weak(
+                           high, now, std::memory_order_relaxed)) {
+  }
+}
+
+allocation_statistics_collector::allocation_statistics_collector()
+    : id_(next_collector_id++) {}
+
+allocation_statistics_collector::~allocation_statistics_collector() = default;
+
+allocation_statistics_collector::thread_counters&
+allocation_statistics_collector::local_thread() {
+  // Collectors are identified by id rather than address, so a stale entry
+  // left by a destroyed collector can never match a new one.
+  thread_local std::vector<std::pair<uint64_t, thread_counters*>> cache;
+  for (const auto& [id, counters] : cache)
+    if (id == id_) return *counters;
+
+  auto counters = std::make_unique<thread_counters>();
+  thread_counters* result = counters.get();
+  {
+    std::lock_guard lock(mu_);
+    threads_.push_back(std::move(counters));
+  }
+  cache.emplace_back(id_, result);
+  return *result;
+}
+
+allocation_statistics_collector::counters&
+allocation_statistics_collector::local(spk::system_allocation_scope scope) {
+  return local_thread().scopes[index(scope)];
+}
+
+allocation_statistics_collector::counters&
+allocation_statistics_collector::local_internal(
+    spk::internal_allocation_type type, spk::system_allocation_scope scope) {
+  return local_thread().internal[index(type)][index(scope)];
+}
+
+void allocation_statistics_collector::record_allocation(
+    spk::system_allocation_scope scope, size_t size) {
+  counters& c = local(scope);
+  increment(c.allocations);
+  increment(c.bytes_allocated, size);
+  increment(c.size_histogram[bucket(size)]);
+  live_[index(scope)].add(size);
+}
+
+void allocation_statistics_collector::record_reallocation(
+    spk::system_allocation_scope scope, size_t old_size, size_t new_size) {
+  counters& c = local(scope);
+  increment(c.reallocations);
+  increment(c.bytes_freed, old_size);
+  increment(c.bytes_allocated, new_size);
+  increment(c.size_histogram[bucket(new_size)]);
+  live_[index(scope)].add(int64_t(new_size) - int64_t(old_size));
+}
+
+void allocation_statistics_collector::record_free(
+    spk::system_allocation_scope scope, size_t size) {
+  counters& c = local(scope);
+  increment(c.frees);
+  increment(c.bytes_freed, size);
+  live_[index(scope)].add(-int64_t(size));
+}
+
+void allocation_statistics_collector::record_internal_allocation(
+    spk::internal_allocation_type type, spk::system_allocation_scope scope,
+    size_t size) {
+  counters& c = local_internal(type, scope);
+  increment(c.allocations);
+  increment(c.bytes_allocated, size);
+  increment(c.size_histogram[bucket(size)]);
+  internal_live_[index(type)][index(scope)].add(size);
+}
+
+void allocation_statistics_collector::record_internal_free(
+    spk::internal_allocation_type type, spk::system_allocation_scope scope,
+    size_t size) {
+  counters& c = local_internal(type, scope);
+  increment(c.frees);
+  increment(c.bytes_freed, size);
+  internal_live_[index(type)][index(scope)].add(-int64_t(size));
+}
+
+allocation_statistics allocation_statistics_collector::snapshot() const {
+  allocation_statistics s;
+  {
+    std::lock_guard lock(mu_);
+    for (const auto& thread : threads_) {
+      for (size_t i = 0; i < num_system_allocation_scopes; ++i)
+        thread->scopes[i].add_to(s.scopes[i]);
+      for (size_t t = 0; t < num_internal_allocation_types; ++t)
+        for (size_t i = 0; i < num_system_allocation_scopes; ++i)
+          thread->internal[t][i].add_to(s.internal[t][i]);
+    }
+  }
+  for (size_t i = 0; i < num_system_allocation_scopes; ++i) {
+    s.scopes[i].live_bytes = live_[i].live.load(std::memory_order_relaxed);
+    s.scopes[i].high_water_bytes =
+        live_[i].high_water.load(std::memory_order_relaxed);
+  }
+  for (size_t t = 0; t < num_internal_allocation_types; ++t) {
+    for (size_t i = 0; i < num_system_allocation_scopes; ++i) {
+      s.internal[t][i].live_bytes =
+          internal_live_[t][i].live.load(std::memory_order_relaxed);
+      s.internal[t][i].high_water_bytes =
+          internal_live_[t][i].high_water.load(std::memory_order_relaxed);
+    }
+  }
+  return s;
+}
+
+namespace {
+
+void subtract(allocation_scope_statistics& s,
+              const allocation_scope_statistics& earlier) {
+  s.allocations -= earlier.allocations;
+  s.reallocations -= earlier.reallocations;
+  s.frees -= earlier.frees;
+  s.bytes_allocated -= earlier.bytes_allocated;
+  s.bytes_freed -= earlier.bytes_freed;
+  for (size_t i = 0; i < num_allocation_size_buckets; ++i)
+    s.size_histogram[i] -= earlier.size_histogram[i];
+}
+
+void print(std::ostream& o, const allocation_scope_statistics& s) {
+  o << " allocations=" << s.allocations
+    << " reallocations=" << s.reallocations << " frees=" << s.frees
+    << " bytes_allocated=" << s.bytes_allocated
+    << " bytes_freed=" << s.bytes_freed << " live=" << s.live_bytes
+    << " high_water=" << s.high_water_bytes << " sizes=";
+  bool first = true;
+  for (size_t i = 0; i < num_allocation_size_buckets; ++i) {
+    if (!s.size_histogram[i]) continue;
+    if (!first) o << ",";
+    first = false;
+    o << "<" << (uint64_t(1) << i) << ":" << s.size_histogram[i];
+  }
+  if (first) o << "-";
+}
+
+bool empty(const allocation_scope_statistics& s) {
+  return !s.allocations && !s.reallocations && !s.frees && !s.live_bytes &&
+         !s.high_water_bytes;
+}
+
+}  // namespace
+
+allocation_statistics allocation_statistics::since(
+    const allocation_statistics& earlier) const {
+  allocation_statistics s = *this;
+  for (size_t i = 0; i < num_system_allocation_scopes; ++i)
+    subtract(s.scopes[i], earlier.scopes[i]);
+  for (size_t t = 0; t < num_internal_allocation_types; ++t)
+    for (size_t i = 0; i < num_system_allocation_scopes; ++i)
+      subtract(s.internal[t][i], earlier.internal[t][i]);
+  return s;
+}
+
+std::ostream& operator<<(std::ostream& o, const allocation_statistics& s) {
+  for (size_t i = 0; i < num_system_allocation_scopes; ++i) {
+    if (empty(s.scopes[i])) continue;
+    o << spk::system_allocation_scope(i) << ":";
+    print(o, s.scopes[i]);
+    o << std::endl;
+  }
+  for (size_t t = 0; t < num_internal_allocation_types; ++t) {
+    for (size_t i = 0; i < num_system_allocation_scopes; ++i) {
+      if (empty(s.internal[t][i])) continue;
+      o << "internal " << spk::internal_allocation_type(t) << " "
+        << spk::system_allocation_scope(i) << ":";
+      print(o, s.internal[t][i]);
+      o << std::endl;
+    }
+  }
+  return o;
+}
+
+}  // namespace spk
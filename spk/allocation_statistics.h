@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "spk/allocators.h"
+#include "spk/loader.h"
+
+namespace spk {
+
+constexpr size_t num_system_allocation_scopes = 5;
+constexpr size_t num_internal_allocation_types = 1;
+// Bucket i counts sizes whose bit width is i, so bucket 0 is size 0 and
+// bucket 12 is [2048, 4096).
+constexpr size_t num_allocation_size_buckets = 33;
+
+// Totals for one system_allocation_scope, or for the internal allocation
+// notifications of one internal_allocation_type within a scope.
+struct allocation_scope_statistics {
+  uint64_t allocations = 0;
+  uint64_t reallocations = 0;
+  uint64_t frees = 0;
+  uint64_t bytes_allocated = 0;
+  uint64_t bytes_freed = 0;
+  int64_t live_bytes = 0;
+  int64_t high_water_bytes = 0;
+  std::array<uint64_t, num_allocation_size_buckets> size_histogram = {};
+};
+
+struct allocation_statistics {
+  std::array<allocation_scope_statistics, num_system_allocation_scopes> scopes;
+  std::array<std::array<allocation_scope_statistics,
+                        num_system_allocation_scopes>,
+             num_internal_allocation_types>
+      internal;
+
+  // Counters accumulated since an earlier snapshot.  Live and high-water
+  // bytes are kept from this snapshot.
+  allocation_statistics since(const allocation_statistics& earlier) const;
+};
+
+std::ostream& operator<<(std::ostream& o, const allocation_statistics& s);
+
+// Aggregates allocation events.  Counters are per-thread relaxed atomics
+// written only by their thread, so recording is lock-free and uncontended;
+// snapshot() sums them.  Live bytes and high-water marks need a global view
+// and are one shared atomic per scope.
+class allocation_statistics_collector {
+ public:
+  allocation_statistics_collector();
+  allocation_statistics_collector(const allocation_statistics_collector&) =
+      delete;
+  allocation_statistics_collector& operator=(
+      const allocation_statistics_collector&) = delete;
+  ~allocation_statistics_collector();
+
+  void record_allocation(spk::system_allocation_scope scope, size_t size);
+  void record_reallocation(spk::system_allocation_scope scope,
+                           size_t old_size, size_t new_size);
+  void record_free(spk::system_allocation_scope scope, size_t size);
+  void record_internal_allocation(spk::internal_allocation_type type,
+                                  spk::system_allocation_scope scope,
+                                  size_t size);
+  void record_internal_free(spk::internal_allocation_type type,
+                            spk::system_allocation_scope scope, size_t size);
+
+  allocation_statistics snapshot() const;
+
+ private:
+  struct counters;
+  struct thread_counters;
+  struct live_counter {
+    std::atomic<int64_t> live{0};
+    std::atomic<int64_t> high_water{0};
+    void add(int64_t bytes);
+  };
+
+  counters& local(spk::system_allocation_scope scope);
+  counters& local_internal(spk::internal_allocation_type type,
+                           spk::system_allocation_scope scope);
+  thread_counters& local_thread();
+
+  const uint64_t id_;
+  mutable std::mutex mu_;
+  std::vector<std::unique_ptr<thread_counters>> threads_;
+  std::array<live_counter, num_system_allocation_scopes> live_;
+  std::array<std::array<live_counter, num_system_allocation_scopes>,
+             num_internal_allocation_types>
+      internal_live_;
+};
+
+// Wraps another allocator (by default the system allocator) and records every
+// call in an allocation_statistics_collector.  Each allocation is prefixed
+// with its size and scope so frees can be attributed.
+//
+//   spk::statistics_allocator<spk::scoped_allocator> allocator;
+//   auto callbacks = spk::create_allocation_callbacks(&allocator);
+//   ...
+//   std::cout << allocator.snapshot().since(last_frame);
+template <typename Inner = spk::system_allocator>
+class statistics_allocator {
+ public:
+  template <typename... Args>
+  explicit statistics_allocator(Args&&... args)
+      : inner_(std::forward<Args>(args)...) {}
+
+  void* allocate(size_t size, size_t alignment,
+                 spk::system_allocation_scope allocation_scope) {
+    void* memory = allocate_(size, alignment, allocation_scope);
+    if (memory) collector_.record_allocation(allocation_scope, size);
+    return memory;
+  }
+
+  void* reallocate(void* original, size_t size, size_t alignment,
+                   spk::system_allocation_scope allocation_scope) {
+    if (!original) return allocate(size, alignment, allocation_scope);
+    if (size == 0) {
+      free(original);
+      return nullptr;
+    }
+    prefix old = *prefix_of(original);
+    size_t pad = padding(alignment);
+    void* user;
+    if (pad == old.pad) {
+      // Same layout, so the inner allocator preserves the prefix and data.
+      void* memory = inner_.reallocate(static_cast<char*>(original) - pad,
+                                       size + pad, pad, allocation_scope);
+      if (!memory) return nullptr;
+      user = static_cast<char*>(memory) + pad;
+    } else {
+      user = allocate_(size, alignment, old.scope);
+      if (!user) return nullptr;
+      std::memcpy(user, original, std::min<size_t>(old.size, size));
+      inner_.free(static_cast<char*>(original) - old.pad);
+    }
+    prefix_of(user)->size = size;
+    collector_.record_reallocation(old.scope, old.size, size);
+    return user;
+  }
+
+  void free(void* memory) {
+    if (!memory) return;
+    prefix p = *prefix_of(memory);
+    collector_.record_free(p.scope, p.size);
+    inner_.free(static_cast<char*>(memory) - p.pad);
+  }
+
+  void notify_internal_allocation(
+      size_t size, spk::internal_allocation_type allocation_type,
+      spk::system_allocation_scope allocation_scope) {
+    collector_.record_internal_allocation(allocation_type, allocation_scope,
+                                          size);
+    inner_.notify_internal_allocation(size, allocation_type, allocation_scope);
+  }
+
+  void notify_internal_free(size_t size,
+                            spk::internal_allocation_type allocation_type,
+                            spk::system_allocation_scope allocation_scope) {
+    collector_.record_internal_free(allocation_type, allocation_scope, size);
+    inner_.notify_internal_free(size, allocation_type, allocation_scope);
+  }
+
+  allocation_statistics snapshot() const { return collector_.snapshot(); }
+
+  Inner& inner() { return inner_; }
+
+ private:
+  struct alignas(16) prefix {
+    uint64_t size;
+    uint32_t pad;
+    spk::system_allocation_scope scope;
+  };
+  static_assert(sizeof(prefix) == 16);
+
+  static size_t padding(size_t alignment) {
+    return std::max(alignment, sizeof(prefix));
+  }
+  static prefix* prefix_of(void* memory) {
+    return static_cast<prefix*>(memory) - 1;
+  }
+
+  void* allocate_(size_t size, size_t alignment,
+                  spk::system_allocation_scope allocation_scope) {
+    size_t pad = padding(alignment);
+    void* memory = inner_.allocate(size + pad, pad, allocation_scope);
+    if (!memory) return nullptr;
+    void* user = static_cast<char*>(memory) + pad;
+    *prefix_of(user) = {size, uint32_t(pad), allocation_scope};
+    return user;
+  }
+
+  Inner inner_;
+  allocation_statistics_collector collector_;
+};
+
+}  // namespace spk
@@ -0,0 +1,314 @@
+#include "allocators.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "dvc/log.h"
+
+namespace spk {
+namespace {
+
+enum class source : uint16_t { system, pool, arena };
+
+struct alignas(16) allocation_header {
+  uint64_t size;
+  uint32_t offset;  // from the start of the underlying block
+  source from;
+  uint16_t size_class;
+};
+static_assert(sizeof(allocation_header) == 16);
+
+constexpr size_t header_size = sizeof(allocation_header);
+
+// Bytes of underlying storage, starting at any 16 byte aligned address, that
+// always fit a header plus size bytes at the given alignment.
+size_t storage_size(size_t size, size_t alignment) {
+  return size + std::max(alignment, header_size);
+}
+
+allocation_header* header_of(void* memory) {
+  return reinterpret_cast<allocation_header*>(memory) - 1;
+}
+
+char* block_of(void* memory) {
+  return static_cast<char*>(memory) - header_of(memory)->offset;
+}
+
+// Places a header and an aligned allocation of size bytes inside the 16 byte
+// aligned block starting at raw.
+void* place(char* raw, size_t size, size_t alignment, source from,
+            uint16_t size_class = 0) {
+  DVC_ASSERT((alignment & (alignment - 1)) == 0, "alignment ", alignment,
+             " is not a power of two");
+  uintptr_t a = std::max(alignment, header_size);
+  uintptr_t user = (uintptr_t(raw) + header_size + a - 1) & ~(a - 1);
+  allocation_header* header = reinterpret_cast<allocation_header*>(user) - 1;
+  header->size = size;
+  header->offset = uint32_t(user - uintptr_t(raw));
+  header->from = from;
+  header->size_class = size_class;
+  return reinterpret_cast<void*>(user);
+}
+
+void* system_allocate(size_t size, size_t alignment) {
+  char* raw = static_cast<char*>(std::malloc(storage_size(size, alignment)));
+  if (!raw) return nullptr;
+  return place(raw, size, alignment, source::system);
+}
+
+// Generic pfnReallocation in terms of allocate and free.
+template <typename Allocator>
+void* reallocate_by_copy(Allocator& allocator, void* original, size_t size,
+                         size_t alignment,
+                         spk::system_allocation_scope allocation_scope) {
+  if (!original) return allocator.allocate(size, alignment, allocation_scope);
+  if (size == 0) {
+    allocator.free(original);
+    return nullptr;
+  }
+  void* memory = allocator.allocate(size, alignment, allocation_scope);
+  // On failure the original allocation must be left untouched.
+  if (!memory) return nullptr;
+  std::memcpy(memory, original,
+              std::min<size_t>(size, header_of(original)->size));
+  allocator.free(original);
+  return memory;
+}
+
+std::atomic<uint64_t> next_pool_id{1};
+
+size_t class_size(size_t size_class) {
+  return pool_allocator::min_class_size << size_class;
+}
+
+}  // namespace
+
+// system_allocator
+
+void* system_allocator::allocate(size_t size, size_t alignment,
+                                 spk::system_allocation_scope) {
+  return system_allocate(size, alignment);
+}
+
+void* system_allocator::reallocate(
+    void* original, size_t size, size_t alignment,
+    spk::system_allocation_scope allocation_scope) {
+  return reallocate_by_copy(*this, original, size, alignment,
+                            allocation_scope);
+}
+
+void system_allocator::free(void* memory) {
+  if (!memory) return;
+  DVC_ASSERT(header_of(memory)->from == source::system);
+  std::free(block_of(memory));
+}
+
+// pool_allocator
+
+struct pool_allocator::thread_cache {
+  uint64_t owner = 0;
+  void* free_lists[num_classes] = {};
+  char* bump = nullptr;
+  char* bump_end = nullptr;
+};
+
+pool_allocator::pool_allocator() : id_(next_pool_id++) {}
+
+pool_allocator::~pool_allocator() {
+  for (char* slab : slabs_) std::free(slab);
+}
+
+pool_allocator::thread_cache& pool_allocator::cache() {
+  thread_local thread_cache cache;
+  if (cache.owner != id_) cache = thread_cache{id_};
+  return cache;
+}
+
+char* pool_allocator::new_slab() {
+  char* slab = static_cast<char*>(std::aligned_alloc(header_size, slab_size));
+  if (!slab) return nullptr;
+  std::lock_guard lock(mu_);
+  slabs_.push_back(slab);
+  return slab;
+}
+
+void* pool_allocator::allocate(size_t size, size_t alignment,
+                               spk::system_allocation_scope) {
+  size_t needed = storage_size(size, alignment);
+  size_t size_class = 0;
+  while (size_class < num_classes && class_size(size_class) < needed)
+    ++size_class;
+  if (size_class == num_classes) return system_allocate(size, alignment);
+
+  thread_cache& c = cache();
+  char* block = static_cast<char*>(c.free_lists[size_class]);
+  if (block) {
+    c.free_lists[size_class] = *reinterpret_cast<void**>(block);
+  } else {
+    size_t bytes = class_size(size_class);
+    if (size_t(c.bump_end - c.bump) < bytes) {
+      c.bump = new_slab();
+      if (!c.bump) return nullptr;
+      c.bump_end = c.bump + slab_size;
+    }
+    block = c.bump;
+    c.bump += bytes;
+  }
+  return place(block, size, alignment, source::pool, size_class);
+}
+
+void* pool_allocator::reallocate(
+    void* original, size_t size, size_t alignment,
+    spk::system_allocation_scope allocation_scope) {
+  if (original && size) {
+    allocation_header* header = header_of(original);
+    // Grow or shrink in place when the block still fits and the existing
+    // placement already satisfies the alignment.
+    if (header->from == source::pool &&
+        uintptr_t(original) % alignment == 0 &&
+        header->offset + size <= class_size(header->size_class)) {
+      header->size = size;
+      return original;
+    }
+  }
+  return reallocate_by_copy(*this, original, size, alignment,
+                            allocation_scope);
+}
+
+void pool_allocator::free(void* memory) {
+  if (!memory) return;
+  allocation_header* header = header_of(memory);
+  if (header->from == source::system) {
+    std::free(block_of(memory));
+    return;
+  }
+  DVC_ASSERT(header->from == source::pool);
+  thread_cache& c = cache();
+  size_t size_class = header->size_class;
+  void** block = reinterpret_cast<void**>(block_of(memory));
+  *block = c.free_lists[size_class];
+  c.free_lists[size_class] = block;
+}
+
+// linear_arena
+
+linear_arena::linear_arena(size_t chunk_size) : chunk_size_(chunk_size) {}
+
+linear_arena::~linear_arena() {
+  for (const chunk& c : chunks_) std::free(c.data);
+}
+
+void* linear_arena::allocate(size_t size, size_t alignment,
+                             spk::system_allocation_scope) {
+  size_t needed = storage_size(size, alignment);
+  std::lock_guard lock(mu_);
+  while (current_ < chunks_.size() &&
+         chunks_[current_].size - offset_ < needed) {
+    ++current_;
+    offset_ = 0;
+  }
+  if (current_ == chunks_.size()) {
+    size_t bytes =
+        (std::max(chunk_size_, needed) + header_size - 1) & ~(header_size - 1);
+    char* data = static_cast<char*>(std::aligned_alloc(header_size, bytes));
+    if (!data) return nullptr;
+    chunks_.push_back({data, bytes});
+    offset_ = 0;
+  }
+  void* memory = place(chunks_[current_].data + offset_, size, alignment,
+                       source::arena);
+  // Keep the bump pointer 16 byte aligned for the next header.
+  size_t end = static_cast<char*>(memory) + size - chunks_[current_].data;
+  size_t next = (end + header_size - 1) & ~(header_size - 1);
+  used_ += next - offset_;
+  offset_ = next;
+  last_ = memory;
+  return memory;
+}
+
+void* linear_arena::reallocate(void* original, size_t size, size_t alignment,
+                               spk::system_allocation_scope allocation_scope) {
+  if (original && size) {
+    std::lock_guard lock(mu_);
+    allocation_header* header = header_of(original);
+    // The most recent allocation can be resized in place.
+    if (original == last_ && uintptr_t(original) % alignment == 0) {
+      const chunk& c = chunks_[current_];
+      size_t begin = static_cast<char*>(original) - c.data;
+      size_t next = (begin + size + header_size - 1) & ~(header_size - 1);
+      if (next <= c.size) {
+        used_ = used_ - offset_ + next;
+        offset_ = next;
+        header->size = size;
+        return original;
+      }
+    }
+  }
+  return reallocate_by_copy(*this, original, size, alignment,
+                            allocation_scope);
+}
+
+void linear_arena::reset() {
+  std::lock_guard lock(mu_);
+  current_ = 0;
+  offset_ = 0;
+  used_ = 0;
+  last_ = nullptr;
+}
+
+size_t linear_arena::bytes_used() const {
+  std::lock_guard lock(mu_);
+  return used_;
+}
+
+// scoped_allocator
+
+void* scoped_allocator::allocate(
+    size_t size, size_t alignment,
+    spk::system_allocation_scope allocation_scope) {
+  switch (allocation_scope) {
+    case spk::system_allocation_scope::command:
+      return command_pool_.allocate(size, alignment, allocation_scope);
+    case spk::system_allocation_scope::object:
+      if (object_arena_)
+        return object_arena_->allocate(size, alignment, allocation_scope);
+      break;
+    default:
+      break;
+  }
+  return system_.allocate(size, alignment, allocation_scope);
+}
+
+void* scoped_allocator::reallocate(
+    void* original, size_t size, size_t alignment,
+    spk::system_allocation_scope allocation_scope) {
+  if (!original) return allocate(size, alignment, allocation_scope);
+  // Keep the allocation with the allocator that made it.
+  switch (header_of(original)->from) {
+    case source::pool:
+      return command_pool_.reallocate(original, size, alignment,
+                                      allocation_scope);
+    case source::arena:
+      return object_arena_->reallocate(original, size, alignment,
+                                       allocation_scope);
+    case source::system:
+      return system_.reallocate(original, size, alignment, allocation_scope);
+  }
+  DVC_FATAL("corrupt allocation header");
+}
+
+void scoped_allocator::free(void* memory) {
+  if (!memory) return;
+  switch (header_of(memory)->from) {
+    case source::pool:
+      return command_pool_.free(memory);
+    case source::arena:
+      return object_arena_->free(memory);
+    case source::system:
+      return system_.free(memory);
+  }
+  DVC_FATAL("corrupt allocation header");
+}
+
+}  // namespace spk
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "spk/loader.h"
+
+// Host allocators for spk::create_allocation_callbacks.  Each of them has the
+// interface of spk::Allocator, honors the requested alignment, and
+// implements reallocate with the semantics of pfnReallocation (a null
+// original allocates, a zero size frees, contents are preserved up to the
+// smaller size).
+//
+// Every allocation is preceded by a 16 byte header recording its size and
+// which allocator it came from, so free and reallocate never need the scope
+// and an allocation can be released through any allocator in this file.
+
+namespace spk {
+
+// Aligned allocations straight from malloc.
+class system_allocator {
+ public:
+  void* allocate(size_t size, size_t alignment,
+                 spk::system_allocation_scope allocation_scope);
+  void* reallocate(void* original, size_t size, size_t alignment,
+                   spk::system_allocation_scope allocation_scope);
+  void free(void* memory);
+  void notify_internal_allocation(
+      size_t size, spk::internal_allocation_type allocation_type,
+      spk::system_allocation_scope allocation_scope) {}
+  void notify_internal_free(size_t size,
+                            spk::internal_allocation_type allocation_type,
+                            spk::system_allocation_scope allocation_scope) {}
+};
+
+// Power-of-two size classes served from thread-local free lists, for the
+// short-lived, same-thread allocations drivers make during a command.  Blocks
+// are carved from 64KiB slabs owned by the pool and only returned to the
+// system when the pool is destroyed.  Requests larger than the largest class
+// fall back to malloc.
+//
+// Each thread caches free blocks for one pool at a time; using a second pool
+// from the same thread abandons the first pool's cached blocks until that pool
+// is destroyed.  One pool per device is the intended use.
+class pool_allocator {
+ public:
+  static constexpr size_t min_class_size = 32;
+  static constexpr size_t num_classes = 8;  // 32 .. 4096
+  static constexpr size_t slab_size = 64 * 1024;
+
+  pool_allocator();
+  pool_allocator(const pool_allocator&) = delete;
+  pool_allocator& operator=(const pool_allocator&) = delete;
+  ~pool_allocator();
+
+  void* allocate(size_t size, size_t alignment,
+                 spk::system_allocation_scope allocation_scope);
+  void* reallocate(void* original, size_t size, size_t alignment,
+                   spk::system_allocation_scope allocation_scope);
+  void free(void* memory);
+  void notify_internal_allocation(
+      size_t size, spk::internal_allocation_type allocation_type,
+      spk::system_allocation_scope allocation_scope) {}
+  void notify_internal_free(size_t size,
+                            spk::internal_allocation_type allocation_type,
+                            spk::system_allocation_scope allocation_scope) {}
+
+ private:
+  struct thread_cache;
+  thread_cache& cache();
+  char* new_slab();
+
+  const uint64_t id_;
+  std::mutex mu_;
+  std::vector<char*> slabs_;
+};
+
+// Bump allocator over a list of chunks.  free is a no-op; reset() makes all
+// memory reusable at once and keeps the chunks.  Suitable for object scope
+// allocations of transient objects (per-level or per-frame resources) that
+// are all destroyed before reset() is called.
+class linear_arena {
+ public:
+  explicit linear_arena(size_t chunk_size = 1024 * 1024);
+  linear_arena(const linear_arena&) = delete;
+  linear_arena& operator=(const linear_arena&) = delete;
+  ~linear_arena();
+
+  void* allocate(size_t size, size_t alignment,
+                 spk::system_allocation_scope allocation_scope);
+  void* reallocate(void* original, size_t size, size_t alignment,
+                   spk::system_allocation_scope allocation_scope);
+  void free(void* memory) {}
+  void notify_internal_allocation(
+      size_t size, spk::internal_allocation_type allocation_type,
+      spk::system_allocation_scope allocation_scope) {}
+  void notify_internal_free(size_t size,
+                            spk::internal_allocation_type allocation_type,
+                            spk::system_allocation_scope allocation_scope) {}
+
+  void reset();
+  size_t bytes_used() const;
+
+ private:
+  struct chunk {
+    char* data;
+    size_t size;
+  };
+
+  const size_t chunk_size_;
+  mutable std::mutex mu_;
+  std::vector<chunk> chunks_;
+  size_t current_ = 0;
+  size_t offset_ = 0;
+  size_t used_ = 0;
+  void* last_ = nullptr;
+};
+
+// Routes command scope to a pool_allocator, object scope to an optional
+// linear_arena, and everything else to the system allocator.
+class scoped_allocator {
+ public:
+  explicit scoped_allocator(linear_arena* object_arena = nullptr)
+      : object_arena_(object_arena) {}
+
+  void* allocate(size_t size, size_t alignment,
+                 spk::system_allocation_scope allocation_scope);
+  void* reallocate(void* original, size_t size, size_t alignment,
+                   spk::system_allocation_scope allocation_scope);
+  void free(void* memory);
+  void notify_internal_allocation(
+      size_t size, spk::internal_allocation_type allocation_type,
+      spk::system_allocation_scope allocation_scope) {}
+  void notify_internal_free(size_t size,
+                            spk::internal_allocation_type allocation_type,
+                            spk::system_allocation_scope allocation_scope) {}
+
+ private:
+  pool_allocator command_pool_;
+  linear_arena* object_arena_;
+  system_allocator system_;
+};
+
+}  // namespace spk
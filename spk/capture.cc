@@ -0,0 +1,293 @@
+#include "capture.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "dvc/log.h"
+#include "spk/spock_capture.h"
+
+namespace spk {
+namespace {
+
+constexpr size_t page_size = 4096;
+
+capture_writer* active_writer = nullptr;
+
+// The commands that need bookkeeping beyond their record.
+
+VKAPI_ATTR VkResult VKAPI_CALL allocate_memory(
+    VkDevice device, const VkMemoryAllocateInfo* allocate_info,
+    const VkAllocationCallbacks* allocator, VkDeviceMemory* memory) {
+  VkResult result = capture_commands::vkAllocateMemory(device, allocate_info,
+                                                       allocator, memory);
+  if (result == VK_SUCCESS)
+    capture_writer::active().track_allocation(*memory,
+                                              allocate_info->allocationSize);
+  return result;
+}
+
+VKAPI_ATTR void VKAPI_CALL free_memory(VkDevice device, VkDeviceMemory memory,
+                                       const VkAllocationCallbacks* allocator) {
+  capture_writer::active().untrack_mapping(memory);
+  capture_writer::active().untrack_allocation(memory);
+  capture_commands::vkFreeMemory(device, memory, allocator);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL map_memory(VkDevice device,
+                                          VkDeviceMemory memory,
+                                          VkDeviceSize offset,
+                                          VkDeviceSize size,
+                                          VkMemoryMapFlags flags,
+                                          void** data) {
+  VkResult result = capture_commands::vkMapMemory(device, memory, offset,
+                                                  size, flags, data);
+  if (result == VK_SUCCESS)
+    capture_writer::active().track_mapping(memory, offset, size, *data);
+  return result;
+}
+
+VKAPI_ATTR void VKAPI_CALL unmap_memory(VkDevice device,
+                                        VkDeviceMemory memory) {
+  capture_writer::active().flush_mapping(memory);
+  capture_writer::active().untrack_mapping(memory);
+  capture_commands::vkUnmapMemory(device, memory);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL queue_submit(VkQueue queue,
+                                            uint32_t submit_count,
+                                            const VkSubmitInfo* submits,
+                                            VkFence fence) {
+  // vk.xml 1.2.154 predates VK_KHR_synchronization2.  Once it is updated,
+  // vkQueueSubmit2 and vkQueueSubmit2KHR need this hook too.
+  capture_writer::active().flush_mappings();
+  return capture_commands::vkQueueSubmit(queue, submit_count, submits,
+                                         fence);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL flush_mapped_memory_ranges(
+    VkDevice device, uint32_t range_count, const VkMappedMemoryRange* ranges) {
+  for (uint32_t i = 0; i < range_count; ++i)
+    capture_writer::active().flush_mapping(ranges[i].memory);
+  return capture_commands::vkFlushMappedMemoryRanges(device, range_count,
+                                                     ranges);
+}
+
+}  // namespace
+
+capture_writer::capture_writer(const std::filesystem::path& path)
+    : file_(std::fopen(path.c_str(), "wb")), file_buffer_(1 << 20) {
+  DVC_ASSERT(file_, "unable to open capture file ", path);
+  std::setvbuf(file_, file_buffer_.data(), _IOFBF, file_buffer_.size());
+  std::fwrite(capture_magic, sizeof(capture_magic), 1, file_);
+}
+
+capture_writer::~capture_writer() {
+  flush_mappings();
+  std::fclose(file_);
+  if (active_writer == this) active_writer = nullptr;
+}
+
+capture_writer& capture_writer::active() {
+  DVC_ASSERT(active_writer, "no capture is active");
+  return *active_writer;
+}
+
+void capture_writer::append(uint16_t command,
+                            const std::vector<uint8_t>& payload) {
+  uint32_t size = payload.size();
+  std::lock_guard lock(mu_);
+  std::fwrite(&command, sizeof(command), 1, file_);
+  std::fwrite(&size, sizeof(size), 1, file_);
+  std::fwrite(payload.data(), 1, payload.size(), file_);
+  ++records_;
+  bytes_ += sizeof(command) + sizeof(size) + payload.size();
+}
+
+uint64_t capture_writer::records() const {
+  std::lock_guard lock(mu_);
+  return records_;
+}
+
+uint64_t capture_writer::bytes() const {
+  std::lock_guard lock(mu_);
+  return bytes_;
+}
+
+void capture_writer::track_allocation(VkDeviceMemory memory,
+                                      VkDeviceSize size) {
+  std::lock_guard lock(memory_mu_);
+  allocation_sizes_[memory] = size;
+}
+
+void capture_writer::untrack_allocation(VkDeviceMemory memory) {
+  std::lock_guard lock(memory_mu_);
+  allocation_sizes_.erase(memory);
+}
+
+void capture_writer::track_mapping(VkDeviceMemory memory,
+                                   VkDeviceSize offset, VkDeviceSize size,
+                                   void* data) {
+  std::lock_guard lock(memory_mu_);
+  if (size == VK_WHOLE_SIZE) size = allocation_sizes_.at(memory) - offset;
+  mapping& m = mappings_[memory];
+  m.offset = offset;
+  m.data = static_cast<uint8_t*>(data);
+  m.shadow.assign(size, 0);
+  m.fresh = true;
+}
+
+void capture_writer::untrack_mapping(VkDeviceMemory memory) {
+  std::lock_guard lock(memory_mu_);
+  mappings_.erase(memory);
+}
+
+void capture_writer::flush_mapping(VkDeviceMemory memory) {
+  std::lock_guard lock(memory_mu_);
+  auto it = mappings_.find(memory);
+  if (it != mappings_.end()) flush_mapping(memory, it->second);
+}
+
+void capture_writer::flush_mappings() {
+  std::lock_guard lock(memory_mu_);
+  for (auto& [memory, m] : mappings_) flush_mapping(memory, m);
+}
+
+// Records each run of changed pages as one memory record.  The first flush
+// after mapping records everything, as the replay's memory need not hold
+// what the capture's did.
+void capture_writer::flush_mapping(VkDeviceMemory memory, mapping& m) {
+  const size_t size = m.shadow.size();
+  size_t page = 0;
+  while (page < size) {
+    auto changed = [&](size_t begin) {
+      size_t n = std::min(page_size, size - begin);
+      return m.fresh ||
+             std::memcmp(m.data + begin, m.shadow.data() + begin, n) != 0;
+    };
+    if (!changed(page)) {
+      page += page_size;
+      continue;
+    }
+    size_t end = page;
+    while (end < size && changed(end)) end += page_size;
+    end = std::min(end, size);
+
+    std::memcpy(m.shadow.data() + page, m.data + page, end - page);
+    capture_record record(*this, capture_memory_record);
+    record.encoder().value(memory);
+    record.encoder().value(VkDeviceSize(m.offset + page));
+    record.encoder().value(uint64_t(end - page));
+    record.encoder().bytes(m.shadow.data() + page, end - page);
+    page = end;
+  }
+  m.fresh = false;
+}
+
+void install_capture(spk::device_dispatch_table& table,
+                     spk::capture_writer& writer) {
+  DVC_ASSERT(!active_writer, "a capture is already active");
+  writer.next_ = table;
+  active_writer = &writer;
+  {
+    capture_record record(writer, capture_device_record);
+    record.encoder().value(table.device);
+  }
+  capture_commands::install(table);
+  table.vkAllocateMemory = allocate_memory;
+  table.vkFreeMemory = free_memory;
+  table.vkMapMemory = map_memory;
+  table.vkUnmapMemory = unmap_memory;
+  table.vkQueueSubmit = queue_submit;
+  table.vkFlushMappedMemoryRanges = flush_mapped_memory_ranges;
+}
+
+capture_record::capture_record(capture_writer& writer, uint16_t command)
+    : writer_(writer), command_(command), encoder_(buffer()) {
+  buffer().data().clear();
+}
+
+capture_record::~capture_record() {
+  writer_.append(command_, buffer().data());
+}
+
+spk::vector_sink& capture_record::buffer() {
+  thread_local spk::vector_sink sink;
+  return sink;
+}
+
+replayer::replayer(spk::device& device)
+    : table_(device.context().dispatch_table()),
+      device_(device.context().device()) {}
+
+void replayer::map_memory(VkDeviceMemory memory, VkDeviceSize offset,
+                          void* data) {
+  mappings_[memory] = {offset, static_cast<uint8_t*>(data)};
+}
+
+void replayer::unmap_memory(VkDeviceMemory memory) {
+  mappings_.erase(memory);
+}
+
+void replayer::update_memory() {
+  VkDeviceMemory memory;
+  VkDeviceSize offset;
+  uint64_t size;
+  const void* data;
+  decoder_->value(memory);
+  decoder_->value(offset);
+  decoder_->value(size);
+  decoder_->bytes(data, size);
+  auto it = mappings_.find(memory);
+  if (it == mappings_.end()) {
+    ++stats_.skipped;
+    return;
+  }
+  std::memcpy(it->second.data + (offset - it->second.offset), data, size);
+  ++stats_.memory_updates;
+}
+
+replay_statistics replayer::replay(const std::filesystem::path& path) {
+  std::unique_ptr<std::FILE, int (*)(std::FILE*)> file(
+      std::fopen(path.c_str(), "rb"), std::fclose);
+  DVC_ASSERT(file, "unable to open capture file ", path);
+  char magic[sizeof(capture_magic)];
+  DVC_ASSERT(std::fread(magic, sizeof(magic), 1, file.get()) == 1 &&
+                 std::memcmp(magic, capture_magic, sizeof(magic)) == 0,
+             path, " is not a capture file");
+
+  stats_ = {};
+  std::vector<uint8_t> payload;
+  uint16_t command;
+  uint32_t size;
+  while (std::fread(&command, sizeof(command), 1, file.get()) == 1) {
+    DVC_ASSERT(std::fread(&size, sizeof(size), 1, file.get()) == 1,
+               "truncated capture record");
+    payload.resize(size);
+    DVC_ASSERT(std::fread(payload.data(), 1, size, file.get()) == size,
+               "truncated capture record");
+
+    arena_.reset();
+    spk::byte_reader in(payload.data(), payload.size());
+    spk::canonical_decoder decoder(in, arena_, &handles_);
+    decoder_ = &decoder;
+    if (command == capture_device_record) {
+      decoder.set_handles(nullptr);
+      VkDevice device;
+      decoder.value(device);
+      handles_.add(device, device_);
+    } else if (command == capture_memory_record) {
+      update_memory();
+    } else if (replay_command(command, *this)) {
+      ++stats_.commands;
+    } else {
+      ++stats_.skipped;
+      continue;
+    }
+    in.finish();
+  }
+  decoder_ = nullptr;
+  stats_.unknown_handles = handles_.unknown();
+  return stats_;
+}
+
+}  // namespace spk
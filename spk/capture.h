@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "spk/serialization.h"
+#include "spk/spock.h"
+
+namespace spk {
+
+// A capture file starts with capture_magic.  Each record that follows is a
+// uint16_t command, a uint32_t payload size and the payload: the canonical
+// encoding of the command's inputs, then its return value, then the handles
+// it created.  Commands are numbered by their spk::command_id, so captures
+// only replay with builds from the same vk.xml; the two highest numbers are
+// reserved for the records below.
+inline constexpr char capture_magic[8] = {'S', 'P', 'K', 'C',
+                                          'A', 'P', '0', '1'};
+// The handle of the captured device.
+inline constexpr uint16_t capture_device_record = 0xfffe;
+// Bytes the application wrote to mapped memory: the memory, an offset into
+// it, a size and the bytes.
+inline constexpr uint16_t capture_memory_record = 0xffff;
+
+// Records every command called through a device_dispatch_table to a file.
+// install_capture() points the table's entries at generated functions that
+// call the original entries and then append a record.  Records are encoded
+// into a thread-local buffer and the writer's lock is only taken to append
+// them, so they are in the order the commands returned.  Destroy and free
+// commands are recorded before they are called instead, so a handle value
+// the driver reuses is never recorded before its previous object's end.
+//
+// Memory the application writes through vkMapMemory is compared against a
+// shadow copy in 4KiB pages at every vkQueueSubmit, and at vkUnmapMemory and
+// vkFlushMappedMemoryRanges for the memory they name.  Changed pages become
+// memory records ahead of the command's record; this costs a memcmp of every
+// mapping per submit.  Only one capture may be active in a process, and the
+// writer must outlive every call through the table it is installed in.
+class capture_writer : nomove {
+ public:
+  explicit capture_writer(const std::filesystem::path& path);
+  ~capture_writer();
+
+  static capture_writer& active();
+  // The entries the table had before install_capture().
+  const spk::device_dispatch_table& next() const { return next_; }
+
+  // Appends a record; thread safe.
+  void append(uint16_t command, const std::vector<uint8_t>& payload);
+
+  void track_allocation(VkDeviceMemory memory, VkDeviceSize size);
+  void untrack_allocation(VkDeviceMemory memory);
+  void track_mapping(VkDeviceMemory memory, VkDeviceSize offset,
+                     VkDeviceSize size, void* data);
+  void untrack_mapping(VkDeviceMemory memory);
+  // Records what changed in one or all mappings since they were last
+  // flushed.
+  void flush_mapping(VkDeviceMemory memory);
+  void flush_mappings();
+
+  uint64_t records() const;
+  uint64_t bytes() const;
+
+ private:
+  friend void install_capture(spk::device_dispatch_table& table,
+                              spk::capture_writer& writer);
+
+  struct mapping {
+    VkDeviceSize offset;
+    uint8_t* data;
+    std::vector<uint8_t> shadow;
+    // Nothing has been recorded since the memory was mapped.
+    bool fresh = true;
+  };
+  void flush_mapping(VkDeviceMemory memory, mapping& m);
+
+  std::FILE* file_;
+  std::vector<char> file_buffer_;
+  spk::device_dispatch_table next_;
+
+  mutable std::mutex mu_;
+  uint64_t records_ = 0;
+  uint64_t bytes_ = 0;
+
+  std::mutex memory_mu_;
+  std::unordered_map<VkDeviceMemory, VkDeviceSize> allocation_sizes_;
+  std::unordered_map<VkDeviceMemory, mapping> mappings_;
+};
+
+// Routes every command called through table via writer.  To capture a
+// device from its creation, call this from the spk::device_layer passed to
+// physical_device::create_device.
+void install_capture(spk::device_dispatch_table& table,
+                     spk::capture_writer& writer);
+
+// Encodes one record into a thread-local buffer and appends it to the
+// writer when destroyed.
+class capture_record : nomove {
+ public:
+  capture_record(capture_writer& writer, uint16_t command);
+  ~capture_record();
+
+  spk::canonical_encoder<spk::vector_sink>& encoder() { return encoder_; }
+
+ private:
+  static spk::vector_sink& buffer();
+
+  capture_writer& writer_;
+  const uint16_t command_;
+  spk::canonical_encoder<spk::vector_sink> encoder_;
+};
+
+struct replay_statistics {
+  uint64_t commands = 0;
+  // Commands the replayer cannot issue, such as those with opaque pointers
+  // or that need a swapchain.
+  uint64_t skipped = 0;
+  uint64_t memory_updates = 0;
+  // Handles that were used but never created in the capture.
+  uint64_t unknown_handles = 0;
+};
+
+// Reissues the commands of a capture file against another device,
+// translating every recorded handle to the one created in its place.
+// Allocation callbacks are not replayed, and commands that only query
+// state are issued with scratch outputs.
+class replayer : nomove {
+ public:
+  explicit replayer(spk::device& device);
+
+  replay_statistics replay(const std::filesystem::path& path);
+
+  // For the generated replay_command.
+  spk::canonical_decoder& decoder() { return *decoder_; }
+  const spk::device_dispatch_table& table() const { return table_; }
+  template <typename T>
+  T* scratch(size_t count) {
+    return arena_.allocate_array<T>(count);
+  }
+  // Reads handles created by the captured command, which have nothing to
+  // translate to yet.
+  template <typename T>
+  void read_new_handles(T*& handles) {
+    decoder_->set_handles(nullptr);
+    decoder_->array(handles, 0);
+    decoder_->set_handles(&handles_);
+  }
+  template <typename T>
+  void add_handles(const T* recorded, const T* replayed, size_t count) {
+    if (!recorded || !replayed) return;
+    for (size_t i = 0; i < count; ++i) handles_.add(recorded[i], replayed[i]);
+  }
+  void map_memory(VkDeviceMemory memory, VkDeviceSize offset, void* data);
+  void unmap_memory(VkDeviceMemory memory);
+
+ private:
+  void update_memory();
+
+  const spk::device_dispatch_table& table_;
+  VkDevice device_;
+  spk::handle_map handles_;
+  spk::decode_arena arena_;
+  spk::canonical_decoder* decoder_ = nullptr;
+  struct mapping {
+    VkDeviceSize offset;
+    uint8_t* data;
+  };
+  std::unordered_map<VkDeviceMemory, mapping> mappings_;
+  replay_statistics stats_;
+};
+
+}  // namespace spk
@@ -0,0 +1,47 @@
+#include "deep_hash.h"
+
+#include "dvc/log.h"
+
+namespace spk {
+namespace {
+
+constexpr uint64_t multiplier = 0xff51afd7ed558ccdull;
+
+uint64_t mix(uint64_t state, uint64_t word) {
+  state ^= word;
+  state *= multiplier;
+  return state ^ (state >> 29);
+}
+
+}  // namespace
+
+void unknown_structure_type(VkStructureType type) {
+  DVC_FATAL("no spk struct for pNext structure of type ", int(type));
+}
+
+void hash_sink::write(const void* data, size_t size) {
+  auto bytes = static_cast<const uint8_t*>(data);
+  size_ += size;
+  while (size >= 8) {
+    uint64_t word;
+    std::memcpy(&word, bytes, 8);
+    state_ = mix(state_, word);
+    bytes += 8;
+    size -= 8;
+  }
+  if (size > 0) {
+    uint64_t word = 0;
+    std::memcpy(&word, bytes, size);
+    state_ = mix(state_, word);
+  }
+}
+
+// Folds in the total size so that trailing partial words are unambiguous.
+uint64_t hash_sink::hash() const {
+  uint64_t h = mix(state_, size_);
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  return h ^ (h >> 33);
+}
+
+}  // namespace spk
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "spk/spock_fwd.h"
+
+// Deep hashing and comparison of the structs in spk/spock.h, which includes
+// this header and defines the visit_members and visit_structure_type used
+// here.
+
+namespace spk {
+
+// Calls v with a null pointer to the spk struct whose sType is type, or
+// returns false if there is none.  Defined in spk/spock.h.
+template <typename Visitor>
+bool visit_structure_type(VkStructureType type, Visitor&& v);
+
+template <typename T, typename = void>
+struct is_visitable : std::false_type {};
+template <typename T>
+struct is_visitable<T, std::void_t<typename T::underlying_type>>
+    : std::true_type {};
+
+template <typename T>
+struct is_std_array : std::false_type {};
+template <typename T, size_t N>
+struct is_std_array<std::array<T, N>> : std::true_type {};
+
+[[noreturn]] void unknown_structure_type(VkStructureType type);
+
+// Writes a canonical encoding of a spk struct to a Sink, which has a
+// write(const void* data, size_t size) member.  The encoding follows the
+// visit_members emitted by vkxmlc: counted arrays, arrays of pointers,
+// strings and single pointees are encoded by value, as is every structure on
+// a pNext chain, so two structs encode equally exactly when they describe the
+// same state.  Handles, opaque pointers such as pUserData, and unions are
+// encoded by their bits.
+template <typename Sink>
+class canonical_encoder {
+ public:
+  explicit canonical_encoder(Sink& sink) : sink_(sink) {}
+
+  template <typename T>
+  void value(const T& x) {
+    if constexpr (is_visitable<T>::value) {
+      T::visit_members(x, *this);
+    } else if constexpr (is_std_array<T>::value) {
+      for (const auto& element : x) value(element);
+    } else {
+      static_assert(std::is_trivially_copyable_v<T>);
+      sink_.write(&x, sizeof(x));
+    }
+  }
+
+  void next(const void* p) {
+    if (!present(p)) return;
+    VkStructureType type = static_cast<const VkBaseInStructure*>(p)->sType;
+    value(type);
+    bool known = spk::visit_structure_type(type, [&](auto* tag) {
+      using S = std::remove_pointer_t<decltype(tag)>;
+      S::visit_members(*static_cast<const S*>(p), *this);
+    });
+    if (!known) unknown_structure_type(type);
+  }
+
+  void string(const char* s) {
+    if (!present(s)) return;
+    size_t size = std::strlen(s);
+    value(size);
+    sink_.write(s, size);
+  }
+
+  void strings(const char* const* p, size_t count) {
+    if (!present(p)) return;
+    value(count);
+    for (size_t i = 0; i < count; ++i) string(p[i]);
+  }
+
+  void bytes(const void* p, size_t size) {
+    if (!present(p)) return;
+    value(size);
+    sink_.write(p, size);
+  }
+
+  template <typename T>
+  void array(const T* p, size_t count) {
+    if (!present(p)) return;
+    value(count);
+    if constexpr (std::is_arithmetic_v<T>) {
+      sink_.write(p, count * sizeof(T));
+    } else {
+      for (size_t i = 0; i < count; ++i) value(p[i]);
+    }
+  }
+
+  template <typename T>
+  void pointer(const T* p) {
+    if (present(p)) value(*p);
+  }
+
+  // An array of count pointers, each to one T.
+  template <typename T>
+  void pointers(const T* const* p, size_t count) {
+    if (!present(p)) return;
+    value(count);
+    for (size_t i = 0; i < count; ++i) pointer(p[i]);
+  }
+
+  template <typename T>
+  void opaque(const T& x) {
+    sink_.write(&x, sizeof(x));
+  }
+
+  template <typename T>
+  void raw(const T& x) {
+    sink_.write(&x, sizeof(x));
+  }
+
+ private:
+  bool present(const void* p) {
+    uint8_t flag = (p != nullptr);
+    sink_.write(&flag, 1);
+    return flag;
+  }
+
+  Sink& sink_;
+};
+
+// A 64-bit hash of everything written, consumed a word at a time.
+class hash_sink {
+ public:
+  void write(const void* data, size_t size);
+  uint64_t hash() const;
+
+ private:
+  uint64_t state_ = 0x9e3779b97f4a7c15ull;
+  uint64_t size_ = 0;
+};
+
+class vector_sink {
+ public:
+  void write(const void* data, size_t size) {
+    auto bytes = static_cast<const uint8_t*>(data);
+    data_.insert(data_.end(), bytes, bytes + size);
+  }
+  std::vector<uint8_t>& data() { return data_; }
+
+ private:
+  std::vector<uint8_t> data_;
+};
+
+template <typename T>
+uint64_t deep_hash(const T& x) {
+  hash_sink sink;
+  canonical_encoder<hash_sink>(sink).value(x);
+  return sink.hash();
+}
+
+template <typename T>
+std::vector<uint8_t> canonical_encoding(const T& x) {
+  vector_sink sink;
+  canonical_encoder<vector_sink>(sink).value(x);
+  return std::move(sink.data());
+}
+
+// Checks that everything written matches an expected encoding.
+class compare_sink {
+ public:
+  compare_sink(const uint8_t* data, size_t size) : data_(data), left_(size) {}
+
+  void write(const void* data, size_t size) {
+    if (!equal_ || size == 0) return;
+    if (size > left_ || std::memcmp(data, data_, size) != 0) {
+      equal_ = false;
+      return;
+    }
+    data_ += size;
+    left_ -= size;
+  }
+  bool equal() const { return equal_ && left_ == 0; }
+
+ private:
+  const uint8_t* data_;
+  size_t left_;
+  bool equal_ = true;
+};
+
+// Compares the state a and b describe, rather than their pointers.
+template <typename T>
+bool deep_equal(const T& a, const T& b) {
+  std::vector<uint8_t> encoding = canonical_encoding(a);
+  compare_sink sink(encoding.data(), encoding.size());
+  canonical_encoder<compare_sink>(sink).value(b);
+  return sink.equal();
+}
+
+// Every spk struct compares by deep_equal.  These are templates, rather than
+// one overload per struct, so only the comparisons a program uses are
+// instantiated.
+template <typename T,
+          typename = std::enable_if_t<spk::is_visitable<T>::value>>
+bool operator==(const T& a, const T& b) {
+  return spk::deep_equal(a, b);
+}
+template <typename T,
+          typename = std::enable_if_t<spk::is_visitable<T>::value>>
+bool operator!=(const T& a, const T& b) {
+  return !spk::deep_equal(a, b);
+}
+
+// The std::hash of every spk struct, specialized in spk/spock.h.
+template <typename T>
+struct deep_hasher {
+  size_t operator()(const T& x) const { return spk::deep_hash(x); }
+};
+
+}  // namespace spk
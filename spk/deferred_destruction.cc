@@ -0,0 +1,82 @@
+#include "deferred_destruction.h"
+
+#include <algorithm>
+
+namespace spk {
+
+deferred_destruction::deferred_destruction(const spk::device_context& context,
+                                           VkSemaphore timeline)
+    : context_(context), timeline_(timeline) {
+  DVC_ASSERT(timeline == VK_NULL_HANDLE ||
+                 context.dispatch_table().vkGetSemaphoreCounterValue,
+             "timeline semaphores need an instance created for Vulkan 1.2");
+}
+
+deferred_destruction::~deferred_destruction() { drain(); }
+
+void deferred_destruction::push(node* n) {
+  n->next = head_.load(std::memory_order_relaxed);
+  while (!head_.compare_exchange_weak(n->next, n, std::memory_order_release,
+                                      std::memory_order_relaxed)) {
+  }
+}
+
+void deferred_destruction::take() {
+  node* n = head_.exchange(nullptr, std::memory_order_acquire);
+  // The stack is newest-first; reverse so handles retire in push order.
+  size_t first = pending_.size();
+  for (; n; n = n->next) pending_.push_back(n);
+  std::reverse(pending_.begin() + first, pending_.end());
+}
+
+size_t deferred_destruction::collect() {
+  take();
+  if (pending_.empty()) return 0;
+
+  const spk::device_dispatch_table& dispatch_table = context_.dispatch_table();
+  VkDevice device = context_.device();
+
+  uint64_t completed = 0;
+  if (timeline_ != VK_NULL_HANDLE)
+    DVC_ASSERT_EQ(dispatch_table.vkGetSemaphoreCounterValue(device, timeline_,
+                                                            &completed),
+                  VK_SUCCESS);
+
+  // Poll each distinct fence once, however many handles wait on it.
+  std::vector<std::pair<VkFence, bool>> fences;
+  auto signaled = [&](VkFence fence) {
+    for (const auto& [f, s] : fences)
+      if (f == fence) return s;
+    VkResult res = dispatch_table.vkGetFenceStatus(device, fence);
+    if (res != VK_SUCCESS && res != VK_NOT_READY)
+      DVC_FATAL("unexpected result ", spk::result(res),
+                " from vkGetFenceStatus");
+    fences.emplace_back(fence, res == VK_SUCCESS);
+    return res == VK_SUCCESS;
+  };
+
+  size_t destroyed = 0;
+  auto ready_end = std::stable_partition(
+      pending_.begin(), pending_.end(), [&](const node* n) {
+        if (n->fence != VK_NULL_HANDLE) return !signaled(n->fence);
+        return n->value == idle || n->value > completed;
+      });
+  for (auto it = ready_end; it != pending_.end(); ++it, ++destroyed)
+    delete *it;
+  pending_.erase(ready_end, pending_.end());
+  return destroyed;
+}
+
+void deferred_destruction::drain() {
+  take();
+  if (pending_.empty()) return;
+
+  // Everything still pending is about to be destroyed, so a single idle wait
+  // covers fences, timeline values and retire_at_idle entries alike.
+  DVC_ASSERT_EQ(context_.dispatch_table().vkDeviceWaitIdle(context_.device()),
+                VK_SUCCESS);
+  for (node* n : pending_) delete n;
+  pending_.clear();
+}
+
+}  // namespace spk
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "dvc/log.h"
+#include "spk/spock.h"
+
+namespace spk {
+
+// Per-device queue of handles whose destruction is deferred until the GPU has
+// passed a retire point: a fence being signaled, a timeline semaphore reaching
+// a value, or (at shutdown) the device going idle.
+//
+// Any thread may retire or defer concurrently; pushes are a lock-free
+// multi-producer stack.  collect() and drain() must only be called from one
+// thread at a time (typically the frame loop).  collect() polls each distinct
+// fence once and the timeline semaphore once, then destroys every ready handle
+// in bulk without blocking.
+class deferred_destruction : nomove {
+ public:
+  // timeline is the semaphore that *_on_timeline values are compared against.
+  explicit deferred_destruction(const spk::device_context& context,
+                                VkSemaphore timeline = VK_NULL_HANDLE);
+  ~deferred_destruction();
+
+  // Destroys handle (by running its destructor) once fence is signaled.
+  template <typename Handle>
+  void retire_on_fence(Handle handle, spk::fence_ref fence) {
+    push(new handle_node<Handle>(std::move(handle), fence, 0));
+  }
+
+  // Destroys handle once the timeline semaphore reaches value.
+  template <typename Handle>
+  void retire_on_timeline(Handle handle, uint64_t value) {
+    DVC_ASSERT(timeline_ != VK_NULL_HANDLE,
+               "deferred_destruction has no timeline semaphore");
+    push(new handle_node<Handle>(std::move(handle), VK_NULL_HANDLE, value));
+  }
+
+  // Destroys handle at the next drain(), after the device is idle.
+  template <typename Handle>
+  void retire_at_idle(Handle handle) {
+    push(new handle_node<Handle>(std::move(handle), VK_NULL_HANDLE, idle));
+  }
+
+  // Runs f instead of a handle destructor, for resources such as
+  // device_memory that are released by an explicit call.
+  template <typename F>
+  void defer_on_fence(F f, spk::fence_ref fence) {
+    push(new function_node<F>(std::move(f), fence, 0));
+  }
+  template <typename F>
+  void defer_on_timeline(F f, uint64_t value) {
+    DVC_ASSERT(timeline_ != VK_NULL_HANDLE,
+               "deferred_destruction has no timeline semaphore");
+    push(new function_node<F>(std::move(f), VK_NULL_HANDLE, value));
+  }
+  template <typename F>
+  void defer_at_idle(F f) {
+    push(new function_node<F>(std::move(f), VK_NULL_HANDLE, idle));
+  }
+
+  // Destroys everything whose retire point has passed.  Never blocks.
+  // Returns the number of entries destroyed.
+  size_t collect();
+
+  // Waits for the device to go idle and destroys everything.
+  void drain();
+
+  // Entries retired but not yet destroyed, as of the last collect().
+  size_t pending() const { return pending_.size(); }
+
+ private:
+  static constexpr uint64_t idle = UINT64_MAX;
+
+  struct node {
+    node(VkFence fence, uint64_t value) : fence(fence), value(value) {}
+    virtual ~node() = default;
+
+    node* next = nullptr;
+    VkFence fence;
+    uint64_t value;
+  };
+
+  template <typename Handle>
+  struct handle_node : node {
+    handle_node(Handle&& handle, VkFence fence, uint64_t value)
+        : node(fence, value), handle(std::move(handle)) {}
+    Handle handle;
+  };
+
+  template <typename F>
+  struct function_node : node {
+    function_node(F&& f, VkFence fence, uint64_t value)
+        : node(fence, value), f(std::move(f)) {}
+    ~function_node() override { f(); }
+    F f;
+  };
+
+  void push(node* n);
+
+  // Moves everything pushed since the last call into pending_.
+  void take();
+
+  const spk::device_context& context_;
+  VkSemaphore timeline_;
+  std::atomic<node*> head_{nullptr};
+  std::vector<node*> pending_;
+};
+
+}  // namespace spk
@@ -0,0 +1,191 @@
+#include "frame_scheduler.h"
+
+#include <algorithm>
+#include <iomanip>
+
+#include "dvc/log.h"
+#include "spk/trace.h"
+
+namespace spk {
+namespace {
+
+spk::semaphore create_timeline(spk::device& device) {
+  spk::semaphore_type_create_info type_info;
+  type_info.set_semaphore_type(spk::semaphore_type::timeline);
+  type_info.set_initial_value(0);
+  spk::semaphore_create_info create_info;
+  create_info.set_next(&type_info);
+  return device.create_semaphore(create_info);
+}
+
+spk::command_pool create_command_pool(spk::device& device,
+                                      uint32_t queue_family) {
+  spk::command_pool_create_info create_info;
+  create_info.set_flags(spk::command_pool_create_flags::reset_command_buffer);
+  create_info.set_queue_family_index(queue_family);
+  return device.create_command_pool(create_info);
+}
+
+spk::command_buffer_array allocate_command_buffers(
+    spk::device& device, spk::command_pool& command_pool, uint32_t count) {
+  spk::command_buffer_allocate_info allocate_info;
+  allocate_info.set_command_pool(command_pool);
+  allocate_info.set_level(spk::command_buffer_level::primary);
+  allocate_info.set_command_buffer_count(count);
+  return device.allocate_command_buffers(allocate_info);
+}
+
+}  // namespace
+
+std::ostream& operator<<(std::ostream& o, const frame_pacing_statistics& s) {
+  auto ms = [](std::chrono::nanoseconds t) { return t.count() / 1e6; };
+  o << s.frames << " frames";
+  if (s.frames == 0) return o;
+  return o << std::fixed << std::setprecision(2) << ", " << s.mean_in_flight
+           << " in flight, " << std::setprecision(3)
+           << ms(s.recording) / s.frames << " ms recording and "
+           << ms(s.blocked) / s.frames << " ms blocked per frame, "
+           << s.misses << " misses";
+}
+
+frame_scheduler::frame_scheduler(spk::device& device, spk::queue& queue,
+                                 uint32_t queue_family,
+                                 size_t frames_in_flight)
+    : device_(device),
+      queue_(queue),
+      frames_in_flight_(frames_in_flight),
+      timeline_(create_timeline(device)),
+      command_pool_(create_command_pool(device, queue_family)),
+      command_buffers_(
+          allocate_command_buffers(device, command_pool_, frames_in_flight)) {
+  DVC_ASSERT_GT(frames_in_flight, 0u);
+  DVC_ASSERT(device_.context().dispatch_table().vkWaitSemaphores &&
+                 device_.context().dispatch_table().vkGetSemaphoreCounterValue,
+             "timeline semaphores need an instance created for Vulkan 1.2");
+}
+
+frame_scheduler::~frame_scheduler() { wait_idle(); }
+
+uint64_t frame_scheduler::completed() const {
+  uint64_t value = 0;
+  DVC_ASSERT_EQ(device_.context().dispatch_table().vkGetSemaphoreCounterValue(
+                    device_.context().device(), timeline_, &value),
+                VK_SUCCESS);
+  return value;
+}
+
+void frame_scheduler::wait(uint64_t number) const {
+  if (number == 0) return;
+  VkSemaphore semaphore = timeline_;
+  VkSemaphoreWaitInfo wait_info = {};
+  wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  wait_info.semaphoreCount = 1;
+  wait_info.pSemaphores = &semaphore;
+  wait_info.pValues = &number;
+  DVC_ASSERT_EQ(device_.context().dispatch_table().vkWaitSemaphores(
+                    device_.context().device(), &wait_info, UINT64_MAX),
+                VK_SUCCESS);
+}
+
+// Frame n reuses the slot of frame n - frames_in_flight, which must have
+// completed.
+frame frame_scheduler::begin_frame() {
+  DVC_ASSERT(!recording_, "begin_frame before end_frame");
+  uint64_t number = submitted_ + 1;
+  uint64_t done = completed();
+  if (number > frames_in_flight_ && done < number - frames_in_flight_) {
+    trace_zone zone("wait_for_slot");
+    auto start = std::chrono::steady_clock::now();
+    wait(number - frames_in_flight_);
+    blocked_ += std::chrono::steady_clock::now() - start;
+    done = number - frames_in_flight_;
+  }
+  return start_frame(done);
+}
+
+std::optional<frame> frame_scheduler::try_begin_frame() {
+  DVC_ASSERT(!recording_, "try_begin_frame before end_frame");
+  uint64_t number = submitted_ + 1;
+  uint64_t done = completed();
+  if (number > frames_in_flight_ && done < number - frames_in_flight_) {
+    ++misses_;
+    return std::nullopt;
+  }
+  return start_frame(done);
+}
+
+frame frame_scheduler::start_frame(uint64_t done) {
+  recording_ = true;
+  frame_start_ = std::chrono::steady_clock::now();
+  ++frames_;
+  uint64_t in_flight = submitted_ - std::min(done, submitted_);
+  in_flight_sum_ += in_flight;
+  trace_counter("frames_in_flight", in_flight);
+
+  uint64_t number = submitted_ + 1;
+  size_t slot = number % frames_in_flight_;
+  frame result{number, slot, command_buffers_.handle(slot)};
+  spk::command_buffer_begin_info begin_info;
+  begin_info.set_flags(spk::command_buffer_usage_flags::one_time_submit);
+  result.command_buffer.begin(begin_info);
+  return result;
+}
+
+void frame_scheduler::end_frame(frame& current,
+                                const std::vector<frame_wait>& waits) {
+  DVC_ASSERT(recording_, "end_frame without begin_frame");
+  DVC_ASSERT_EQ(current.number, submitted_ + 1);
+  current.command_buffer.end();
+
+  std::vector<spk::semaphore_ref> wait_semaphores;
+  std::vector<uint64_t> wait_values;
+  std::vector<spk::pipeline_stage_flags> wait_stages;
+  for (const frame_wait& w : waits) {
+    wait_semaphores.push_back(w.semaphore);
+    wait_values.push_back(w.value);
+    wait_stages.push_back(w.stages);
+  }
+
+  uint64_t value = current.number;
+  spk::timeline_semaphore_submit_info timeline_info;
+  timeline_info.set_wait_semaphore_values(
+      {wait_values.data(), wait_values.size()});
+  timeline_info.set_signal_semaphore_values({&value, 1});
+  spk::submit_info submit_info;
+  submit_info.set_next(&timeline_info);
+  submit_info.set_wait_semaphores(
+      {wait_semaphores.data(), wait_semaphores.size()});
+  submit_info.set_wait_dst_stage_mask({wait_stages.data(), wait_stages.size()});
+  spk::command_buffer_ref command_buffer_ref = current.command_buffer;
+  submit_info.set_command_buffers({&command_buffer_ref, 1});
+  spk::semaphore_ref signal = timeline_;
+  submit_info.set_signal_semaphores({&signal, 1});
+  {
+    trace_zone zone("submit");
+    queue_.submit({&submit_info, 1}, VK_NULL_HANDLE);
+  }
+
+  submitted_ = value;
+  recording_ = false;
+  recording_time_ += std::chrono::steady_clock::now() - frame_start_;
+}
+
+frame_pacing_statistics frame_scheduler::statistics() const {
+  frame_pacing_statistics s;
+  s.frames = frames_;
+  s.misses = misses_;
+  s.mean_in_flight = frames_ ? double(in_flight_sum_) / frames_ : 0;
+  s.blocked = blocked_;
+  s.recording = recording_time_;
+  return s;
+}
+
+void frame_scheduler::reset_statistics() {
+  frames_ = 0;
+  misses_ = 0;
+  in_flight_sum_ = 0;
+  blocked_ = std::chrono::nanoseconds(0);
+  recording_time_ = std::chrono::nanoseconds(0);
+}
+
+}  // namespace spk
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+#include "spk/spock.h"
+
+namespace spk {
+
+// A semaphore a frame's submission waits on, such as the timeline of an
+// upload_scheduler.  value is ignored for binary semaphores.
+struct frame_wait {
+  spk::semaphore_ref semaphore = VK_NULL_HANDLE;
+  uint64_t value = 0;
+  spk::pipeline_stage_flags stages = spk::pipeline_stage_flags::all_commands;
+};
+
+// A frame being recorded.  number counts from 1 and is the timeline value
+// signaled when the frame's commands complete.  slot is number modulo the
+// frames in flight, and selects the frame's copy of per-frame resources.
+struct frame {
+  uint64_t number = 0;
+  size_t slot = 0;
+  spk::command_buffer command_buffer;
+};
+
+// How well the CPU and GPU overlap.  in_flight is sampled as each frame
+// begins: near 0 means the GPU waits for the CPU, near frames_in_flight
+// means the CPU waits for the GPU, and blocked says for how long.
+struct frame_pacing_statistics {
+  uint64_t frames = 0;
+  // try_begin_frame calls that found no free slot.
+  uint64_t misses = 0;
+  double mean_in_flight = 0;
+  // In begin_frame, waiting for a slot.
+  std::chrono::nanoseconds blocked{0};
+  // From beginning a frame to submitting it.
+  std::chrono::nanoseconds recording{0};
+};
+
+std::ostream& operator<<(std::ostream& o, const frame_pacing_statistics& s);
+
+// Paces frames on one queue with a single timeline semaphore in place of a
+// fence per frame.  Frame n signals value n, so frame n may begin once
+// value n - frames_in_flight is reached, and its slot's command buffer and
+// resources are free again.
+//
+//   spk::frame_scheduler scheduler(device, queue, family, 3);
+//   while (running) {
+//     std::optional<spk::frame> frame = scheduler.try_begin_frame();
+//     if (!frame) {
+//       world.update(dt);  // Run ahead instead of stalling.
+//       continue;
+//     }
+//     record(frame->command_buffer, resources[frame->slot]);
+//     scheduler.end_frame(*frame);
+//   }
+//
+// Frames begin and end in order, one at a time, on one thread.  Requires an
+// instance created for Vulkan 1.2 and the timelineSemaphore device feature.
+class frame_scheduler : nomove {
+ public:
+  static constexpr size_t default_frames_in_flight = 2;
+
+  frame_scheduler(spk::device& device, spk::queue& queue,
+                  uint32_t queue_family,
+                  size_t frames_in_flight = default_frames_in_flight);
+  // Waits for every submitted frame.
+  ~frame_scheduler();
+
+  // Waits for the next frame's slot, then begins its command buffer.
+  frame begin_frame();
+  // As begin_frame, but returns nothing if the slot is still in use.
+  std::optional<frame> try_begin_frame();
+  // Ends the frame's command buffer and submits it after waits.
+  void end_frame(frame& current, const std::vector<frame_wait>& waits = {});
+
+  size_t frames_in_flight() const { return frames_in_flight_; }
+  spk::semaphore_ref timeline() const { return timeline_; }
+  // The number of the last frame submitted and of the last completed.
+  uint64_t submitted() const { return submitted_; }
+  uint64_t completed() const;
+  void wait(uint64_t number) const;
+  void wait_idle() const { wait(submitted_); }
+
+  frame_pacing_statistics statistics() const;
+  void reset_statistics();
+
+ private:
+  frame start_frame(uint64_t done);
+
+  spk::device& device_;
+  spk::queue& queue_;
+  const size_t frames_in_flight_;
+
+  spk::semaphore timeline_;
+  spk::command_pool command_pool_;
+  spk::command_buffer_array command_buffers_;
+
+  uint64_t submitted_ = 0;
+  bool recording_ = false;
+  std::chrono::steady_clock::time_point frame_start_;
+
+  uint64_t frames_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t in_flight_sum_ = 0;
+  std::chrono::nanoseconds blocked_{0};
+  std::chrono::nanoseconds recording_time_{0};
+};
+
+}  // namespace spk
@@ -0,0 +1,281 @@
+#include "gpu_particles.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+
+#include "dvc/log.h"
+
+namespace spk {
+namespace {
+
+spk::buffer create_buffer(spk::device& device, uint64_t size,
+                          spk::buffer_usage_flags usage) {
+  spk::buffer_create_info create_info;
+  create_info.set_size(size);
+  create_info.set_usage(usage);
+  create_info.set_sharing_mode(spk::sharing_mode::exclusive);
+  return device.create_buffer(create_info);
+}
+
+spk::descriptor_set_layout create_descriptor_set_layout(spk::device& device) {
+  // Binding 0 is the state read, binding 1 the state written.
+  spk::descriptor_set_layout_binding bindings[2];
+  for (uint32_t i = 0; i < 2; ++i) {
+    bindings[i].set_binding(i);
+    bindings[i].set_descriptor_type(spk::descriptor_type::storage_buffer);
+    bindings[i].set_descriptor_count(1);
+    bindings[i].set_stage_flags(spk::shader_stage_flags::compute);
+  }
+  spk::descriptor_set_layout_create_info create_info;
+  create_info.set_bindings({bindings, 2});
+  return device.create_descriptor_set_layout(create_info);
+}
+
+spk::descriptor_pool create_descriptor_pool(spk::device& device) {
+  spk::descriptor_pool_size size;
+  size.set_type(spk::descriptor_type::storage_buffer);
+  size.set_descriptor_count(4);
+  spk::descriptor_pool_create_info create_info;
+  create_info.set_flags(
+      spk::descriptor_pool_create_flags::free_descriptor_set);
+  create_info.set_max_sets(2);
+  create_info.set_pool_sizes({&size, 1});
+  return device.create_descriptor_pool(create_info);
+}
+
+spk::descriptor_set_array allocate_descriptor_sets(
+    spk::device& device, spk::descriptor_pool& pool,
+    spk::descriptor_set_layout& layout) {
+  spk::descriptor_set_layout_ref layouts[2] = {layout, layout};
+  spk::descriptor_set_allocate_info allocate_info;
+  allocate_info.set_descriptor_pool(pool);
+  allocate_info.set_set_layouts({layouts, 2});
+  return device.allocate_descriptor_sets(allocate_info);
+}
+
+spk::pipeline_layout create_pipeline_layout(
+    spk::device& device, spk::descriptor_set_layout& descriptor_set_layout,
+    uint32_t push_constants_size) {
+  spk::descriptor_set_layout_ref descriptor_set_layout_ref =
+      descriptor_set_layout;
+  spk::push_constant_range range;
+  range.set_stage_flags(spk::shader_stage_flags::compute);
+  range.set_offset(0);
+  range.set_size(push_constants_size);
+  spk::pipeline_layout_create_info create_info;
+  create_info.set_set_layouts({&descriptor_set_layout_ref, 1});
+  create_info.set_push_constant_ranges({&range, 1});
+  return device.create_pipeline_layout(create_info);
+}
+
+spk::pipeline create_pipeline(spk::device& device,
+                              spk::shader_module_ref compute_shader,
+                              spk::pipeline_layout& pipeline_layout) {
+  spk::pipeline_shader_stage_create_info stage;
+  stage.set_module(compute_shader);
+  stage.set_name("main");
+  stage.set_stage(spk::shader_stage_flags::compute);
+  spk::compute_pipeline_create_info create_info;
+  create_info.set_stage(stage);
+  create_info.set_layout(pipeline_layout);
+  return device.create_compute_pipeline(VK_NULL_HANDLE, create_info);
+}
+
+}  // namespace
+
+gpu_particles::gpu_particles(spk::device& device,
+                             spk::memory_allocator& memory_allocator,
+                             spk::shader_module_ref compute_shader,
+                             size_t count)
+    : device_(device),
+      memory_allocator_(memory_allocator),
+      count_(count),
+      descriptor_set_layout_(create_descriptor_set_layout(device)),
+      descriptor_pool_(create_descriptor_pool(device)),
+      descriptor_sets_(allocate_descriptor_sets(device, descriptor_pool_,
+                                                descriptor_set_layout_)),
+      pipeline_layout_(create_pipeline_layout(device, descriptor_set_layout_,
+                                              sizeof(step_constants))),
+      pipeline_(create_pipeline(device, compute_shader, pipeline_layout_)) {
+  DVC_ASSERT_GT(count, 0u);
+  DVC_ASSERT(count <= UINT32_MAX, "too many particles: ", count);
+  for (size_t i = 0; i < 2; ++i) {
+    spk::buffer buffer =
+        create_buffer(device, count * sizeof(gpu_particle),
+                      spk::buffer_usage_flags::storage_buffer |
+                          spk::buffer_usage_flags::vertex_buffer |
+                          spk::buffer_usage_flags::transfer_src |
+                          spk::buffer_usage_flags::transfer_dst);
+    spk::memory_allocation memory = memory_allocator.allocate_for(
+        buffer, spk::memory_property_flags::device_local);
+    DVC_ASSERT(memory, "no device local memory for ", count, " particles");
+    buffers_.push_back({std::move(memory), std::move(buffer)});
+  }
+
+  spk::descriptor_buffer_info buffer_infos[4];
+  spk::write_descriptor_set writes[4];
+  for (size_t i = 0; i < 4; ++i) {
+    // Set s reads buffers_[s] at binding 0 and writes the other at 1.
+    size_t set = i / 2;
+    size_t binding = i % 2;
+    buffer_infos[i].set_buffer(buffers_[set ^ binding].buffer);
+    buffer_infos[i].set_offset(0);
+    buffer_infos[i].set_range(VK_WHOLE_SIZE);
+    writes[i].set_buffer_info({&buffer_infos[i], 1});
+    writes[i].set_descriptor_type(spk::descriptor_type::storage_buffer);
+    writes[i].set_dst_array_element(0);
+    writes[i].set_dst_binding(binding);
+    writes[i].set_dst_set(descriptor_sets_[set]);
+    writes[i].set_image_info({nullptr, 1});
+    writes[i].set_texel_buffer_view({nullptr, 1});
+  }
+  device.update_descriptor_sets({writes, 4}, {nullptr, 0});
+}
+
+void gpu_particles::upload(spk::upload_scheduler& uploads,
+                           const spk::particles& state) {
+  DVC_ASSERT_EQ(state.size(), count_);
+  std::vector<gpu_particle> data(count_);
+  for (size_t i = 0; i < count_; ++i) {
+    for (size_t k = 0; k < 3; ++k) {
+      data[i].position[k] = state.position(k)[i];
+      data[i].color[k] = state.color(k)[i];
+      data[i].velocity[k] = state.velocity(k)[i];
+    }
+  }
+  uploads.upload(buffers_[current_].buffer, 0, data.data(),
+                 data.size() * sizeof(gpu_particle));
+}
+
+void gpu_particles::record_step(spk::command_buffer& command_buffer,
+                                const spk::particle_step& step) {
+  // The dispatch reads the state an upload or the last step wrote, and
+  // overwrites the state the draws and reads before that last step read.
+  spk::memory_barrier before;
+  before.set_src_access_mask(spk::access_flags::shader_write |
+                             spk::access_flags::transfer_write);
+  before.set_dst_access_mask(spk::access_flags::shader_read |
+                             spk::access_flags::shader_write);
+  command_buffer.pipeline_barrier(
+      spk::pipeline_stage_flags::compute_shader |
+          spk::pipeline_stage_flags::vertex_input |
+          spk::pipeline_stage_flags::transfer,
+      spk::pipeline_stage_flags::compute_shader, spk::dependency_flags(0),
+      {&before, 1}, {nullptr, 0}, {nullptr, 0});
+
+  step_constants constants;
+  constants.alpha = step.alpha;
+  constants.beta = step.beta;
+  constants.gamma = step.gamma;
+  constants.count = uint32_t(count_);
+  std::copy_n(step.target, 3, constants.target);
+
+  command_buffer.bind_pipeline(spk::pipeline_bind_point::compute, pipeline_);
+  spk::descriptor_set_ref descriptor_set_ref = descriptor_sets_[current_];
+  command_buffer.bind_descriptor_sets(spk::pipeline_bind_point::compute,
+                                      pipeline_layout_, 0,
+                                      {&descriptor_set_ref, 1}, {nullptr, 0});
+  device_.context().dispatch_table().vkCmdPushConstants(
+      command_buffer, pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+      sizeof(constants), &constants);
+  command_buffer.dispatch((count_ + workgroup_size - 1) / workgroup_size, 1,
+                          1);
+
+  spk::memory_barrier after;
+  after.set_src_access_mask(spk::access_flags::shader_write);
+  after.set_dst_access_mask(spk::access_flags::vertex_attribute_read |
+                            spk::access_flags::transfer_read);
+  command_buffer.pipeline_barrier(spk::pipeline_stage_flags::compute_shader,
+                                  spk::pipeline_stage_flags::vertex_input |
+                                      spk::pipeline_stage_flags::transfer,
+                                  spk::dependency_flags(0), {&after, 1},
+                                  {nullptr, 0}, {nullptr, 0});
+  current_ ^= 1;
+}
+
+void gpu_particles::bind_vertex_buffer(
+    spk::command_buffer& command_buffer) const {
+  spk::buffer_ref buffer = buffers_[current_].buffer;
+  uint64_t offset = 0;
+  command_buffer.bind_vertex_buffers(0, 1, &buffer, &offset);
+}
+
+spk::vertex_input_binding_description gpu_particles::vertex_binding() {
+  spk::vertex_input_binding_description binding;
+  binding.set_binding(0);
+  binding.set_input_rate(spk::vertex_input_rate::vertex);
+  binding.set_stride(sizeof(gpu_particle));
+  return binding;
+}
+
+std::vector<spk::vertex_input_attribute_description>
+gpu_particles::vertex_attributes(particle_vertex_format format) {
+  std::vector<spk::vertex_input_attribute_description> result(2);
+  result[0].set_binding(0);
+  result[0].set_location(0);
+  result[0].set_format(format == particle_vertex_format::xyz_rgb
+                           ? spk::format::r32g32b32_sfloat
+                           : spk::format::r32g32_sfloat);
+  result[0].set_offset(offsetof(gpu_particle, position));
+  result[1].set_binding(0);
+  result[1].set_location(1);
+  result[1].set_format(spk::format::r32g32b32_sfloat);
+  result[1].set_offset(offsetof(gpu_particle, color));
+  return result;
+}
+
+void gpu_particles::record_read(spk::command_buffer& command_buffer) {
+  const uint64_t size = count_ * sizeof(gpu_particle);
+  if (!read_buffer_) {
+    spk::buffer buffer =
+        create_buffer(device_, size, spk::buffer_usage_flags::transfer_dst);
+    spk::memory_allocation memory = memory_allocator_.allocate_for(
+        buffer,
+        spk::memory_property_flags::host_visible |
+            spk::memory_property_flags::host_coherent,
+        spk::memory_property_flags::host_cached);
+    DVC_ASSERT(memory, "no host visible memory to read particles");
+    DVC_ASSERT(memory.mapped());
+    read_buffer_.emplace(state_buffer{std::move(memory), std::move(buffer)});
+  }
+
+  // record_step's last barrier made the state readable by transfer, unless
+  // it was uploaded and never stepped.
+  spk::memory_barrier before;
+  before.set_src_access_mask(spk::access_flags::transfer_write);
+  before.set_dst_access_mask(spk::access_flags::transfer_read);
+  command_buffer.pipeline_barrier(
+      spk::pipeline_stage_flags::transfer, spk::pipeline_stage_flags::transfer,
+      spk::dependency_flags(0), {&before, 1}, {nullptr, 0}, {nullptr, 0});
+
+  spk::buffer_copy copy;
+  copy.set_src_offset(0);
+  copy.set_dst_offset(0);
+  copy.set_size(size);
+  command_buffer.copy_buffer(buffers_[current_].buffer, read_buffer_->buffer,
+                             {&copy, 1});
+
+  spk::memory_barrier after;
+  after.set_src_access_mask(spk::access_flags::transfer_write);
+  after.set_dst_access_mask(spk::access_flags::host_read);
+  command_buffer.pipeline_barrier(
+      spk::pipeline_stage_flags::transfer, spk::pipeline_stage_flags::host,
+      spk::dependency_flags(0), {&after, 1}, {nullptr, 0}, {nullptr, 0});
+}
+
+void gpu_particles::read(spk::particles& state) const {
+  DVC_ASSERT(read_buffer_, "read() before record_read()");
+  DVC_ASSERT_EQ(state.size(), count_);
+  const auto* data =
+      static_cast<const gpu_particle*>(read_buffer_->memory.mapped());
+  for (size_t i = 0; i < count_; ++i) {
+    for (size_t k = 0; k < 3; ++k) {
+      state.position(k)[i] = data[i].position[k];
+      state.color(k)[i] = data[i].color[k];
+      state.velocity(k)[i] = data[i].velocity[k];
+    }
+  }
+}
+
+}  // namespace spk
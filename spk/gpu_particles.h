@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "spk/memory_allocator.h"
+#include "spk/particles.h"
+#include "spk/spock.h"
+#include "spk/upload_scheduler.h"
+
+namespace spk {
+
+// A particle as gpu_particles stores it, and as the vertex stage reads it:
+// position and color first, so that a point-list pipeline takes them
+// straight from the state as a vertex with a stride of gpu_particle.
+struct gpu_particle {
+  float position[3];
+  float color[3];
+  float velocity[3];
+};
+static_assert(sizeof(gpu_particle) == 36);
+
+// spk::particles simulated on the GPU instead.  The state lives in two
+// device local storage buffers; each step is a dispatch of
+// spk/particles.comp, which reads one and writes the other, the same
+// operations in the same order as particles::step, after which the two swap.
+// The buffer written last is bound as vertex buffer 0 of a point-list
+// pipeline, so that a frame records a step and a draw and the host writes
+// nothing:
+//
+//   spk::gpu_particles particles(device, allocator, compute_shader, count);
+//   particles.upload(uploads, initial);
+//   uploads.wait(uploads.flush());
+//   ...
+//   particles.record_step(command_buffer, step);
+//   command_buffer.begin_render_pass(begin_info, ...);
+//   command_buffer.bind_pipeline(spk::pipeline_bind_point::graphics, ...);
+//   particles.bind_vertex_buffer(command_buffer);
+//   command_buffer.draw(particles.size(), 1, 0, 0);
+//
+// Steps and draws must be recorded on one queue, in the order they are to
+// execute; record_step's barriers order each step after the draws and steps
+// before it.
+class gpu_particles : nomove {
+ public:
+  // local_size_x of spk/particles.comp.
+  static constexpr uint32_t workgroup_size = 64;
+
+  // compute_shader is spk/particles.comp, and is used only while
+  // constructing.  The state is undefined until upload().
+  gpu_particles(spk::device& device, spk::memory_allocator& memory_allocator,
+                spk::shader_module_ref compute_shader, size_t count);
+
+  size_t size() const { return count_; }
+
+  // Queues the upload of state, of size() particles, as the current state.
+  // Steps recorded after must execute after the uploads flushed, and after
+  // uploads.record_acquires() if it uploads on another queue family.
+  void upload(spk::upload_scheduler& uploads, const spk::particles& state);
+
+  // Records one step into command_buffer, outside a render pass, and makes
+  // its result the current state, readable as vertex input and by transfer.
+  void record_step(spk::command_buffer& command_buffer,
+                   const spk::particle_step& step);
+
+  // The buffer holding the current state, which the next record_step()
+  // changes.
+  spk::buffer_ref vertex_buffer() const { return buffers_[current_].buffer; }
+  void bind_vertex_buffer(spk::command_buffer& command_buffer) const;
+
+  // The vertex input of a pipeline drawing the particles from
+  // vertex_buffer(): binding 0, with the position at location 0 in two or
+  // three floats by format and the color at location 1.
+  static spk::vertex_input_binding_description vertex_binding();
+  static std::vector<spk::vertex_input_attribute_description>
+  vertex_attributes(particle_vertex_format format);
+
+  // Records a copy of the current state into host memory, which read()
+  // returns once the command buffer has completed.  For checking against
+  // spk::particles.
+  void record_read(spk::command_buffer& command_buffer);
+  void read(spk::particles& state) const;
+
+ private:
+  struct step_constants {
+    float alpha;
+    float beta;
+    float gamma;
+    uint32_t count;
+    float target[3];
+  };
+  struct state_buffer {
+    spk::memory_allocation memory;
+    spk::buffer buffer;
+  };
+
+  spk::device& device_;
+  spk::memory_allocator& memory_allocator_;
+  const size_t count_;
+
+  // The two states, of which buffers_[current_] is the current one.
+  std::vector<state_buffer> buffers_;
+  size_t current_ = 0;
+
+  spk::descriptor_set_layout descriptor_set_layout_;
+  spk::descriptor_pool descriptor_pool_;
+  // Set i reads buffers_[i] and writes the other.
+  spk::descriptor_set_array descriptor_sets_;
+  spk::pipeline_layout pipeline_layout_;
+  spk::pipeline pipeline_;
+
+  // Host visible, for record_read().
+  std::optional<state_buffer> read_buffer_;
+};
+
+}  // namespace spk
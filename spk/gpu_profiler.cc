@@ -0,0 +1,181 @@
+#include "gpu_profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <string>
+
+#include "dvc/log.h"
+#include "spk/trace.h"
+
+namespace spk {
+namespace {
+
+constexpr uint32_t unmeasured = UINT32_MAX;
+
+spk::query_pool create_query_pool(spk::device& device, uint32_t count) {
+  spk::query_pool_create_info create_info;
+  create_info.set_query_type(spk::query_type::timestamp);
+  create_info.set_query_count(count);
+  return device.create_query_pool(create_info);
+}
+
+uint32_t timestamp_valid_bits(spk::physical_device& physical_device,
+                              uint32_t queue_family) {
+  return physical_device.queue_family_properties()
+      .at(queue_family)
+      .timestamp_valid_bits();
+}
+
+}  // namespace
+
+std::ostream& operator<<(std::ostream& o, const gpu_frame_timing& t) {
+  o << "frame " << t.frame << "\n";
+  for (const gpu_scope_timing& scope : t.scopes)
+    o << std::string(2 * (scope.depth + 1), ' ') << scope.name << " "
+      << (scope.end - scope.begin).count() / 1000.0 << " us\n";
+  return o;
+}
+
+void write_chrome_trace_events(std::ostream& o,
+                               const std::vector<gpu_frame_timing>& frames,
+                               uint32_t pid) {
+  // Real thread ids are never 0.
+  constexpr uint32_t tid = 0;
+  // Nanosecond resolution.
+  o << std::fixed << std::setprecision(3);
+  o << R"({"name":"thread_name","ph":"M","pid":)" << pid << R"(,"tid":)"
+    << tid << R"(,"args":{"name":"GPU"}})";
+  for (const gpu_frame_timing& t : frames) {
+    double frame_us = std::chrono::duration<double, std::micro>(
+                          t.submitted.time_since_epoch())
+                          .count();
+    for (const gpu_scope_timing& scope : t.scopes) {
+      o << ",\n" << R"({"name":)";
+      write_json_string(o, scope.name);
+      o << R"(,"cat":"gpu","ph":"X","ts":)"
+        << frame_us + scope.begin.count() / 1000.0 << R"(,"dur":)"
+        << (scope.end - scope.begin).count() / 1000.0 << R"(,"pid":)" << pid
+        << R"(,"tid":)" << tid << R"(,"args":{"frame":)" << t.frame << "}}";
+    }
+  }
+}
+
+gpu_profiler::gpu_profiler(spk::physical_device& physical_device,
+                           spk::device& device, uint32_t queue_family,
+                           size_t frame_slots, uint32_t max_scopes)
+    : device_(device),
+      max_scopes_(max_scopes),
+      timestamp_period_(
+          physical_device.properties().limits().timestamp_period()),
+      valid_bits_(timestamp_valid_bits(physical_device, queue_family)) {
+  DVC_ASSERT_GT(frame_slots, 0u);
+  if (!enabled()) return;
+  for (size_t i = 0; i < frame_slots; ++i)
+    slots_.push_back({create_query_pool(device, 2 * max_scopes)});
+}
+
+void gpu_profiler::begin_frame(spk::command_buffer& command_buffer,
+                               uint64_t frame, size_t slot) {
+  DVC_ASSERT(!current_, "begin_frame before end_frame");
+  if (!enabled()) return;
+  current_ = &slots_.at(slot);
+  read(*current_, false);
+  current_->frame = frame;
+  current_->scopes.clear();
+  command_buffer.reset_query_pool(current_->query_pool, 0, 2 * max_scopes_);
+}
+
+void gpu_profiler::begin_scope(spk::command_buffer& command_buffer,
+                               const char* name) {
+  if (!enabled()) return;
+  DVC_ASSERT(current_, "begin_scope outside a frame");
+  std::vector<gpu_scope_timing>& scopes = current_->scopes;
+  if (scopes.size() == max_scopes_) {
+    open_scopes_.push_back(unmeasured);
+    return;
+  }
+  uint32_t index = scopes.size();
+  scopes.push_back({name, uint32_t(open_scopes_.size()),
+                    std::chrono::nanoseconds(0), std::chrono::nanoseconds(0)});
+  open_scopes_.push_back(index);
+  command_buffer.write_timestamp(spk::pipeline_stage_flags::top_of_pipe,
+                                 current_->query_pool, 2 * index);
+}
+
+void gpu_profiler::end_scope(spk::command_buffer& command_buffer) {
+  if (!enabled()) return;
+  DVC_ASSERT(!open_scopes_.empty(), "end_scope without begin_scope");
+  uint32_t index = open_scopes_.back();
+  open_scopes_.pop_back();
+  if (index == unmeasured) return;
+  command_buffer.write_timestamp(spk::pipeline_stage_flags::bottom_of_pipe,
+                                 current_->query_pool, 2 * index + 1);
+}
+
+void gpu_profiler::end_frame(spk::command_buffer&) {
+  if (!enabled()) return;
+  DVC_ASSERT(current_, "end_frame without begin_frame");
+  DVC_ASSERT(open_scopes_.empty(), "end_frame with open scopes");
+  current_->submitted = std::chrono::steady_clock::now();
+  current_ = nullptr;
+}
+
+// Also picks up frames that completed before their slots were reused, such
+// as the last frames after the device is idle.  Slots are read in frame
+// order so that results stay oldest first.
+std::vector<gpu_frame_timing> gpu_profiler::collect() {
+  std::vector<slot*> pending;
+  for (slot& s : slots_)
+    if (s.frame && &s != current_) pending.push_back(&s);
+  std::sort(pending.begin(), pending.end(),
+            [](slot* a, slot* b) { return a->frame < b->frame; });
+  for (slot* s : pending)
+    if (!read(*s, true)) break;
+
+  std::vector<gpu_frame_timing> results = std::move(results_);
+  results_.clear();
+  return results;
+}
+
+// Reads without VK_QUERY_RESULT_WAIT_BIT: each query is followed by its
+// availability.  A frame with any query unavailable is dropped, or kept for
+// a later read if keep_pending.  Returns whether the slot was read.
+bool gpu_profiler::read(slot& s, bool keep_pending) {
+  if (s.frame == 0) return true;
+  uint32_t queries = 2 * s.scopes.size();
+  std::vector<uint64_t> data(2 * queries);
+  if (queries) {
+    VkResult result = device_.context().dispatch_table().vkGetQueryPoolResults(
+        device_.context().device(), s.query_pool, 0, queries,
+        data.size() * sizeof(uint64_t), data.data(), 2 * sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    DVC_ASSERT(result == VK_SUCCESS || result == VK_NOT_READY,
+               "vkGetQueryPoolResults failed: ", result);
+  }
+  for (uint32_t q = 0; q < queries; ++q) {
+    if (!data[2 * q + 1]) {
+      if (keep_pending) return false;
+      ++dropped_frames_;
+      s.frame = 0;
+      return true;
+    }
+  }
+
+  gpu_frame_timing timing{s.frame, s.submitted, std::move(s.scopes)};
+  s.frame = 0;
+  const uint64_t mask =
+      valid_bits_ >= 64 ? ~uint64_t(0) : (uint64_t(1) << valid_bits_) - 1;
+  const uint64_t origin = queries ? data[0] : 0;
+  auto time = [&](uint32_t q) {
+    uint64_t ticks = (data[2 * q] - origin) & mask;
+    return std::chrono::nanoseconds(int64_t(ticks * timestamp_period_));
+  };
+  for (uint32_t i = 0; i < timing.scopes.size(); ++i) {
+    timing.scopes[i].begin = time(2 * i);
+    timing.scopes[i].end = time(2 * i + 1);
+  }
+  results_.push_back(std::move(timing));
+  return true;
+}
+
+}  // namespace spk
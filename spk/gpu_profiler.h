@@ -0,0 +1,128 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "spk/spock.h"
+
+namespace spk {
+
+// A scope's GPU time, relative to the first timestamp of its frame.
+struct gpu_scope_timing {
+  const char* name;
+  // 0 for outermost scopes.
+  uint32_t depth;
+  std::chrono::nanoseconds begin;
+  std::chrono::nanoseconds end;
+};
+
+// The scopes of one frame in the order they began, which lists each scope
+// before the scopes nested in it.
+struct gpu_frame_timing {
+  uint64_t frame;
+  // When end_frame was called, which places the frame on the CPU timeline.
+  std::chrono::steady_clock::time_point submitted;
+  std::vector<gpu_scope_timing> scopes;
+};
+
+// An indented tree of the frame's scopes.
+std::ostream& operator<<(std::ostream& o, const gpu_frame_timing& t);
+
+// Writes frames as Chrome trace events (chrome://tracing, Perfetto), for the
+// traceEvents array of a trace: comma separated, with no brackets.  They are
+// on a "GPU" thread of process pid, in steady_clock microseconds.  GPU and
+// CPU clocks are not calibrated against each other, so each frame is placed
+// at the time it was submitted: its GPU work started no earlier.
+void write_chrome_trace_events(std::ostream& o,
+                               const std::vector<gpu_frame_timing>& frames,
+                               uint32_t pid = 1);
+
+// Measures GPU time per pass with timestamp queries written around scopes
+// of command buffer recording:
+//
+//   spk::gpu_profiler profiler(physical_device, device, queue_family,
+//                              scheduler.frames_in_flight());
+//   spk::frame frame = scheduler.begin_frame();
+//   profiler.begin_frame(frame.command_buffer, frame.number, frame.slot);
+//   {
+//     spk::gpu_scope scope(profiler, frame.command_buffer, "shadows");
+//     ...
+//   }
+//   profiler.end_frame(frame.command_buffer);
+//   scheduler.end_frame(frame);
+//   for (const spk::gpu_frame_timing& t : profiler.collect()) ...
+//
+// Each frame slot has its own query pool.  A slot's results are read when
+// it is next begun, when the frame that last used it must have completed,
+// so results arrive frames_in_flight frames late and reading them never
+// waits.  Frames whose results are not available then are dropped.
+// collect() also reads slots that have completed early.  Scopes
+// beyond max_scopes in a frame are not measured.  Names must outlive the
+// results, eg string literals.  Not thread-safe.
+class gpu_profiler : nomove {
+ public:
+  static constexpr uint32_t default_max_scopes = 256;
+
+  gpu_profiler(spk::physical_device& physical_device, spk::device& device,
+               uint32_t queue_family, size_t frame_slots,
+               uint32_t max_scopes = default_max_scopes);
+
+  // Whether the queue family supports timestamps.  If not, the profiler
+  // records nothing.
+  bool enabled() const { return valid_bits_ != 0; }
+
+  // Records the query pool reset, so must come first in the frame.
+  void begin_frame(spk::command_buffer& command_buffer, uint64_t frame,
+                   size_t slot);
+  void begin_scope(spk::command_buffer& command_buffer, const char* name);
+  void end_scope(spk::command_buffer& command_buffer);
+  void end_frame(spk::command_buffer& command_buffer);
+
+  // Timings of the frames completed since the last collect, oldest first.
+  std::vector<gpu_frame_timing> collect();
+
+  uint64_t dropped_frames() const { return dropped_frames_; }
+
+ private:
+  struct slot {
+    spk::query_pool query_pool;
+    uint64_t frame = 0;
+    std::chrono::steady_clock::time_point submitted;
+    // Scopes in the order they began; scope i wrote queries 2i and 2i+1.
+    std::vector<gpu_scope_timing> scopes;
+  };
+
+  bool read(slot& s, bool keep_pending);
+
+  spk::device& device_;
+  const uint32_t max_scopes_;
+  const double timestamp_period_;
+  const uint32_t valid_bits_;
+
+  std::vector<slot> slots_;
+  slot* current_ = nullptr;
+  // Indices into current_->scopes, or unmeasured.
+  std::vector<uint32_t> open_scopes_;
+
+  std::vector<gpu_frame_timing> results_;
+  uint64_t dropped_frames_ = 0;
+};
+
+// Measures the GPU time of the commands recorded during its lifetime.
+class gpu_scope : nomove {
+ public:
+  gpu_scope(gpu_profiler& profiler, spk::command_buffer& command_buffer,
+            const char* name)
+      : profiler_(profiler), command_buffer_(command_buffer) {
+    profiler_.begin_scope(command_buffer_, name);
+  }
+  ~gpu_scope() { profiler_.end_scope(command_buffer_); }
+
+ private:
+  gpu_profiler& profiler_;
+  spk::command_buffer& command_buffer_;
+};
+
+}  // namespace spk
@@ -0,0 +1,188 @@
+#include "headless_presenter.h"
+
+#include <algorithm>
+#include <iomanip>
+
+#include "dvc/log.h"
+#include "spk/trace.h"
+
+namespace spk {
+namespace {
+
+spk::render_pass create_render_pass(spk::device& device, spk::format format) {
+  spk::attachment_description color_attachment;
+  color_attachment.set_format(format);
+  color_attachment.set_samples(spk::sample_count_flags::n1);
+  color_attachment.set_load_op(spk::attachment_load_op::clear);
+  color_attachment.set_store_op(spk::attachment_store_op::store);
+  color_attachment.set_stencil_load_op(spk::attachment_load_op::dont_care);
+  color_attachment.set_stencil_store_op(spk::attachment_store_op::dont_care);
+  color_attachment.set_initial_layout(spk::image_layout::undefined);
+  color_attachment.set_final_layout(spk::image_layout::transfer_src_optimal);
+
+  spk::attachment_reference color_attachment_ref;
+  color_attachment_ref.set_attachment(0);
+  color_attachment_ref.set_layout(spk::image_layout::color_attachment_optimal);
+
+  spk::subpass_description subpass;
+  subpass.set_pipeline_bind_point(spk::pipeline_bind_point::graphics);
+  subpass.set_color_attachments({&color_attachment_ref, 1});
+
+  // Makes the color writes available to transfers after the render pass.
+  spk::subpass_dependency dependency;
+  dependency.set_src_subpass(0);
+  dependency.set_dst_subpass(VK_SUBPASS_EXTERNAL);
+  dependency.set_src_stage_mask(
+      spk::pipeline_stage_flags::color_attachment_output);
+  dependency.set_dst_stage_mask(spk::pipeline_stage_flags::transfer);
+  dependency.set_src_access_mask(
+      spk::access_flags::color_attachment_write);
+  dependency.set_dst_access_mask(spk::access_flags::transfer_read);
+
+  spk::render_pass_create_info create_info;
+  create_info.set_attachments({&color_attachment, 1});
+  create_info.set_subpasses({&subpass, 1});
+  create_info.set_dependencies({&dependency, 1});
+  return device.create_render_pass(create_info);
+}
+
+spk::image create_image(spk::device& device, spk::extent_2d extent,
+                        spk::format format) {
+  spk::extent_3d image_extent;
+  image_extent.set_width(extent.width());
+  image_extent.set_height(extent.height());
+  image_extent.set_depth(1);
+
+  spk::image_create_info create_info;
+  create_info.set_image_type(spk::image_type::n2d);
+  create_info.set_format(format);
+  create_info.set_extent(image_extent);
+  create_info.set_mip_levels(1);
+  create_info.set_array_layers(1);
+  create_info.set_samples(spk::sample_count_flags::n1);
+  create_info.set_tiling(spk::image_tiling::optimal);
+  create_info.set_usage(spk::image_usage_flags::color_attachment |
+                        spk::image_usage_flags::transfer_src);
+  create_info.set_sharing_mode(spk::sharing_mode::exclusive);
+  create_info.set_initial_layout(spk::image_layout::undefined);
+  return device.create_image(create_info);
+}
+
+spk::image_view create_image_view(spk::device& device, spk::image& image,
+                                  spk::format format) {
+  spk::image_view_create_info create_info;
+  create_info.set_image(image);
+  create_info.set_view_type(spk::image_view_type::n2d);
+  create_info.set_format(format);
+  spk::image_subresource_range range;
+  range.set_aspect_mask(spk::image_aspect_flags::color);
+  range.set_base_mip_level(0);
+  range.set_level_count(1);
+  range.set_base_array_layer(0);
+  range.set_layer_count(1);
+  create_info.set_subresource_range(range);
+  return device.create_image_view(create_info);
+}
+
+spk::framebuffer create_framebuffer(spk::device& device,
+                                    spk::render_pass& render_pass,
+                                    spk::image_view& image_view,
+                                    spk::extent_2d extent) {
+  spk::framebuffer_create_info create_info;
+  create_info.set_render_pass(render_pass);
+  spk::image_view_ref attachment = image_view;
+  create_info.set_attachments({&attachment, 1});
+  create_info.set_width(extent.width());
+  create_info.set_height(extent.height());
+  create_info.set_layers(1);
+  return device.create_framebuffer(create_info);
+}
+
+}  // namespace
+
+std::ostream& operator<<(std::ostream& o, const frame_statistics& s) {
+  auto ms = [](std::chrono::nanoseconds t) { return t.count() / 1e6; };
+  o << s.frames << " frames";
+  if (s.frames == 0) return o;
+  double fps = s.frames / (s.total.count() / 1e9);
+  return o << " in " << std::fixed << std::setprecision(3) << ms(s.total)
+           << " ms (" << std::setprecision(1) << fps << " fps)"
+           << std::setprecision(3) << ": min " << ms(s.min) << " ms, mean "
+           << ms(s.mean) << " ms, median " << ms(s.median) << " ms, p99 "
+           << ms(s.p99) << " ms, max " << ms(s.max) << " ms, blocked "
+           << ms(s.blocked) << " ms";
+}
+
+headless_presenter::headless_presenter(spk::device& device,
+                                       spk::memory_allocator& memory_allocator,
+                                       spk::queue& queue,
+                                       uint32_t queue_family,
+                                       spk::extent_2d extent,
+                                       spk::format format,
+                                       size_t num_renderings)
+    : extent_(extent),
+      format_(format),
+      render_pass_(create_render_pass(device, format)),
+      scheduler_(device, queue, queue_family, num_renderings) {
+  for (size_t i = 0; i < num_renderings; ++i) {
+    spk::image image = create_image(device, extent, format);
+    spk::memory_allocation memory = memory_allocator.allocate_for(
+        image, spk::memory_property_flags::device_local);
+    DVC_ASSERT(memory, "no device local memory for headless rendering");
+    spk::image_view image_view = create_image_view(device, image, format);
+    spk::framebuffer framebuffer =
+        create_framebuffer(device, render_pass_, image_view, extent);
+    renderings_.push_back({std::move(memory), std::move(image),
+                           std::move(image_view), std::move(framebuffer)});
+  }
+}
+
+size_t headless_presenter::render(const prepare_rendering& prepare) {
+  trace_zone zone("frame");
+  auto start = std::chrono::steady_clock::now();
+  if (last_frame_ != std::chrono::steady_clock::time_point())
+    frame_times_.push_back(start - last_frame_);
+  last_frame_ = start;
+
+  spk::frame frame = scheduler_.begin_frame();
+  rendering& r = renderings_[frame.slot];
+
+  spk::render_pass_begin_info render_pass_begin_info;
+  render_pass_begin_info.set_render_pass(render_pass_);
+  render_pass_begin_info.set_framebuffer(r.framebuffer);
+  spk::rect_2d render_area;
+  render_area.set_extent(extent_);
+  render_pass_begin_info.set_render_area(render_area);
+  {
+    trace_zone record("record");
+    prepare(frame.command_buffer, frame.slot, render_pass_begin_info);
+  }
+
+  scheduler_.end_frame(frame);
+  return frame.slot;
+}
+
+frame_statistics headless_presenter::statistics() const {
+  frame_statistics s;
+  s.frames = frame_times_.size();
+  s.blocked = scheduler_.statistics().blocked;
+  if (frame_times_.empty()) return s;
+
+  std::vector<std::chrono::nanoseconds> sorted = frame_times_;
+  std::sort(sorted.begin(), sorted.end());
+  for (std::chrono::nanoseconds t : sorted) s.total += t;
+  s.min = sorted.front();
+  s.max = sorted.back();
+  s.mean = s.total / s.frames;
+  s.median = sorted[s.frames / 2];
+  s.p99 = sorted[std::min(s.frames - 1, s.frames * 99 / 100)];
+  return s;
+}
+
+void headless_presenter::reset_statistics() {
+  frame_times_.clear();
+  scheduler_.reset_statistics();
+  last_frame_ = std::chrono::steady_clock::time_point();
+}
+
+}  // namespace spk
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+#include "spk/frame_scheduler.h"
+#include "spk/memory_allocator.h"
+#include "spk/spock.h"
+
+namespace spk {
+
+// Frame times of a headless_presenter: the interval between the starts of
+// consecutive frames, which includes waiting for the GPU.
+struct frame_statistics {
+  size_t frames = 0;
+  std::chrono::nanoseconds total{0};
+  std::chrono::nanoseconds min{0};
+  std::chrono::nanoseconds mean{0};
+  std::chrono::nanoseconds median{0};
+  std::chrono::nanoseconds p99{0};
+  std::chrono::nanoseconds max{0};
+  // Time spent in render() waiting for a rendering to complete.
+  std::chrono::nanoseconds blocked{0};
+};
+
+std::ostream& operator<<(std::ostream& o, const frame_statistics& s);
+
+// Stands in for a window and swapchain so that demos and benchmarks run in
+// CI and on servers with no display, on any driver including lavapipe and
+// spk's null driver.  Each rendering renders into its own device local
+// color image instead of a swapchain image, and render() never waits for a
+// display, so frames run as fast as the device completes them.  Frames are
+// paced by a frame_scheduler with one rendering per frame in flight.
+//
+//   spk::headless_presenter presenter(device, allocator, queue, family,
+//                                     extent);
+//   for (size_t i = 0; i < frames; ++i)
+//     presenter.render([&](spk::command_buffer& command_buffer,
+//                          size_t rendering_index,
+//                          spk::render_pass_begin_info& begin_info) {
+//       command_buffer.begin_render_pass(begin_info, ...);
+//       ...
+//     });
+//   std::cout << presenter.statistics();
+//
+// The callback has the signature of prepare_rendering in the windowed game
+// loop: the command buffer is begun before and ended and submitted after.
+// Requires Vulkan 1.2 and the timelineSemaphore device feature, for the
+// frame_scheduler.
+// Images end the render pass in transfer_src_optimal, ready to be read back.
+class headless_presenter : nomove {
+ public:
+  static constexpr size_t default_num_renderings = 2;
+
+  using prepare_rendering =
+      std::function<void(spk::command_buffer& command_buffer,
+                         size_t rendering_index,
+                         spk::render_pass_begin_info& render_pass_begin_info)>;
+
+  headless_presenter(spk::device& device,
+                     spk::memory_allocator& memory_allocator,
+                     spk::queue& queue, uint32_t queue_family,
+                     spk::extent_2d extent,
+                     spk::format format = spk::format::r8g8b8a8_unorm,
+                     size_t num_renderings = default_num_renderings);
+
+  spk::render_pass_ref render_pass() const { return render_pass_; }
+  spk::extent_2d extent() const { return extent_; }
+  spk::format format() const { return format_; }
+  size_t num_renderings() const { return renderings_.size(); }
+  const spk::frame_scheduler& scheduler() const { return scheduler_; }
+  spk::image_ref image(size_t rendering_index) const {
+    return renderings_.at(rendering_index).image;
+  }
+
+  // Waits for the next rendering to complete, then records and submits it.
+  // Returns its index.
+  size_t render(const prepare_rendering& prepare);
+
+  void wait_idle() const { scheduler_.wait_idle(); }
+
+  frame_statistics statistics() const;
+  void reset_statistics();
+
+ private:
+  struct rendering {
+    spk::memory_allocation memory;
+    spk::image image;
+    spk::image_view image_view;
+    spk::framebuffer framebuffer;
+  };
+
+  const spk::extent_2d extent_;
+  const spk::format format_;
+
+  spk::render_pass render_pass_;
+  std::vector<rendering> renderings_;
+  // Last, so that it waits for the renderings in flight before they are
+  // destroyed.
+  spk::frame_scheduler scheduler_;
+
+  std::vector<std::chrono::nanoseconds> frame_times_;
+  std::chrono::steady_clock::time_point last_frame_;
+};
+
+}  // namespace spk
@@ -0,0 +1,93 @@
+#include "instrumentation.h"
+
+#include <algorithm>
+#include <iomanip>
+
+#include "dvc/log.h"
+#include "spk/spock_instrumentation.h"
+
+namespace spk {
+namespace {
+
+std::atomic<uint64_t> next_instrumentation_id{1};
+
+}  // namespace
+
+command_statistics command_statistics::since(
+    const command_statistics& earlier) const {
+  command_statistics result;
+  for (size_t i = 0; i < spk::command_count; ++i) {
+    result.commands[i].calls = commands[i].calls - earlier.commands[i].calls;
+    result.commands[i].time = commands[i].time - earlier.commands[i].time;
+  }
+  return result;
+}
+
+std::ostream& operator<<(std::ostream& o, const command_statistics& s) {
+  std::vector<size_t> called;
+  for (size_t i = 0; i < spk::command_count; ++i)
+    if (s.commands[i].calls) called.push_back(i);
+  std::sort(called.begin(), called.end(), [&](size_t a, size_t b) {
+    return s.commands[a].time > s.commands[b].time;
+  });
+  for (size_t i : called) {
+    const command_counts& c = s.commands[i];
+    o << std::setw(48) << std::left << spk::command_name(i) << std::right
+      << std::setw(10) << c.calls << " calls " << std::setw(12)
+      << c.time.count() / 1000 << " us " << std::setw(10)
+      << c.time.count() / c.calls << " ns/call\n";
+  }
+  return o;
+}
+
+command_instrumentation::command_instrumentation()
+    : id_(next_instrumentation_id++),
+      start_ticks_(instrumentation_ticks()),
+      start_time_(std::chrono::steady_clock::now()) {}
+
+command_instrumentation::~command_instrumentation() {
+  if (active_ == this) active_ = nullptr;
+}
+
+void command_instrumentation::install(spk::device_dispatch_table& table) {
+  DVC_ASSERT(!active_, "an instrumentation is already installed");
+  next_ = table;
+  active_ = this;
+  instrumented_commands::install(table);
+}
+
+command_instrumentation::counters* command_instrumentation::register_thread() {
+  auto local = std::make_unique<thread_counters>();
+  counters* result = local->data();
+  std::lock_guard lock(mu_);
+  threads_.push_back(std::move(local));
+  return result;
+}
+
+command_statistics command_instrumentation::snapshot() const {
+  std::array<uint64_t, spk::command_count> ticks = {};
+  command_statistics result;
+  {
+    std::lock_guard lock(mu_);
+    for (const auto& thread : threads_) {
+      for (size_t i = 0; i < spk::command_count; ++i) {
+        result.commands[i].calls +=
+            (*thread)[i].calls.load(std::memory_order_relaxed);
+        ticks[i] += (*thread)[i].ticks.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Calibrates ticks against steady_clock over the instrumentation's life.
+  double elapsed_ticks = instrumentation_ticks() - start_ticks_;
+  double elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - start_time_)
+                          .count();
+  double ns_per_tick = elapsed_ticks > 0 ? elapsed_ns / elapsed_ticks : 1;
+  for (size_t i = 0; i < spk::command_count; ++i)
+    result.commands[i].time =
+        std::chrono::nanoseconds(int64_t(ticks[i] * ns_per_tick));
+  return result;
+}
+
+}  // namespace spk
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "spk/spock.h"
+
+namespace spk {
+
+struct command_counts {
+  uint64_t calls = 0;
+  std::chrono::nanoseconds time{0};
+};
+
+// CPU time spent in each device command, indexed by spk::command_id.
+struct command_statistics {
+  std::array<command_counts, spk::command_count> commands;
+
+  // Counters accumulated since an earlier snapshot.
+  command_statistics since(const command_statistics& earlier) const;
+};
+
+// The commands that were called, most expensive first.
+std::ostream& operator<<(std::ostream& o, const command_statistics& s);
+
+// A cheap monotonic counter: the TSC where there is one, which is invariant
+// on every x86 that runs Vulkan, and steady_clock elsewhere.
+inline uint64_t instrumentation_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Counts calls and the time spent in every command of a device dispatch
+// table.  install() points the table's entries at functions vkxmlc
+// generates, which forward to the original entries; a device created
+// without it calls the driver directly and pays nothing.
+//
+//   spk::command_instrumentation instrumentation;
+//   spk::device device = physical_device.create_device(
+//       create_info, [&](spk::device_dispatch_table& table) {
+//         instrumentation.install(table);
+//       });
+//   ...
+//   std::cout << instrumentation.snapshot().since(last_frame);
+//
+// Counters are per-thread relaxed atomics written only by their thread, so
+// recording takes no lock.  Only one instrumentation may be installed in a
+// process, and it must outlive every call through the table.
+class command_instrumentation : nomove {
+ public:
+  command_instrumentation();
+  ~command_instrumentation();
+
+  void install(spk::device_dispatch_table& table);
+
+  command_statistics snapshot() const;
+
+  // For the generated wrappers.
+  static const spk::device_dispatch_table& next() { return active_->next_; }
+  static void record(uint16_t command, uint64_t ticks) {
+    thread_local uint64_t id = 0;
+    thread_local counters* local = nullptr;
+    command_instrumentation* active = active_;
+    if (id != active->id_) {
+      local = active->register_thread();
+      id = active->id_;
+    }
+    increment(local[command].calls, 1);
+    increment(local[command].ticks, ticks);
+  }
+
+ private:
+  struct counters {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> ticks{0};
+  };
+  using thread_counters = std::array<counters, spk::command_count>;
+
+  static void increment(std::atomic<uint64_t>& counter, uint64_t n) {
+    // Only the owning thread writes, so a load and store is enough.
+    counter.store(counter.load(std::memory_order_relaxed) + n,
+                  std::memory_order_relaxed);
+  }
+
+  counters* register_thread();
+
+  inline static command_instrumentation* active_ = nullptr;
+
+  const uint64_t id_;
+  spk::device_dispatch_table next_;
+  // Pairs a tick count with a time, to convert ticks to nanoseconds.
+  const uint64_t start_ticks_;
+  const std::chrono::steady_clock::time_point start_time_;
+
+  mutable std::mutex mu_;
+  std::vector<std::unique_ptr<thread_counters>> threads_;
+};
+
+// Times one call for command_instrumentation.
+class command_timer : nomove {
+ public:
+  explicit command_timer(uint16_t command)
+      : command_(command), start_(instrumentation_ticks()) {}
+  ~command_timer() {
+    command_instrumentation::record(command_,
+                                    instrumentation_ticks() - start_);
+  }
+
+ private:
+  const uint16_t command_;
+  const uint64_t start_;
+};
+
+}  // namespace spk
@@ -0,0 +1,287 @@
+#include "job_system.h"
+
+#include <algorithm>
+
+#include "dvc/log.h"
+#include "spk/trace.h"
+
+namespace spk {
+namespace {
+
+// The job_system a worker belongs to, so that nested calls use its deque.
+struct worker_identity {
+  const job_system* jobs = nullptr;
+  size_t index = 0;
+};
+thread_local worker_identity this_worker;
+
+}  // namespace
+
+// The deque of Lê, Pop, Cohen and Zappa Nardelli, "Correct and Efficient
+// Work-Stealing for Weak Memory Models" (PPoPP 2013), with a fixed capacity.
+// Only its owner pushes and pops; any thread steals.
+class job_system::deque {
+ public:
+  bool push(task* t) {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t top = top_.load(std::memory_order_acquire);
+    if (b - top >= int64_t(deque_capacity)) return false;
+    tasks_[b % deque_capacity].store(t, std::memory_order_relaxed);
+    bottom_.store(b + 1, std::memory_order_release);
+    return true;
+  }
+
+  task* pop() {
+    int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_relaxed);
+    if (top > b) {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    task* t = tasks_[b % deque_capacity].load(std::memory_order_relaxed);
+    if (top == b) {
+      // The last task, which a thief may be taking too.
+      if (!top_.compare_exchange_strong(top, top + 1,
+                                        std::memory_order_seq_cst,
+                                        std::memory_order_relaxed))
+        t = nullptr;
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return t;
+  }
+
+  task* steal() {
+    int64_t top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom_.load(std::memory_order_acquire);
+    if (top >= b) return nullptr;
+    task* t = tasks_[top % deque_capacity].load(std::memory_order_relaxed);
+    if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed))
+      return nullptr;
+    return t;
+  }
+
+ private:
+  // On separate cache lines, as the owner writes bottom_ and thieves top_.
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  std::atomic<task*> tasks_[deque_capacity] = {};
+};
+
+// A job of a graph.  A parallel_for job splits into ranges when it runs.
+struct job_graph::node : job_system::task {
+  void execute(job_system& jobs) override;
+  void finish(job_system& jobs);
+
+  job_graph* graph = nullptr;
+  const char* name = nullptr;
+  std::function<void()> function;
+  job_system::range_function range_function;
+  size_t count = 0;
+  size_t grain = 1;
+  std::vector<job_id> successors;
+  uint32_t predecessors = 0;
+
+  // For the current run.
+  std::atomic<uint32_t> pending{0};
+  std::atomic<size_t> ranges_left{0};
+  std::vector<range> ranges;
+};
+
+struct job_graph::range : job_system::task {
+  void execute(job_system& jobs) override {
+    {
+      trace_zone zone(owner->name);
+      owner->range_function(begin, end);
+    }
+    if (owner->ranges_left.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      owner->finish(jobs);
+  }
+
+  node* owner = nullptr;
+  size_t begin = 0;
+  size_t end = 0;
+};
+
+void job_graph::node::execute(job_system& jobs) {
+  if (!range_function) {
+    {
+      trace_zone zone(name);
+      function();
+    }
+    finish(jobs);
+    return;
+  }
+  size_t n = (count + grain - 1) / grain;
+  if (n == 0) {
+    finish(jobs);
+    return;
+  }
+  ranges.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    ranges[i].owner = this;
+    ranges[i].begin = i * grain;
+    ranges[i].end = std::min(count, (i + 1) * grain);
+  }
+  ranges_left.store(n, std::memory_order_relaxed);
+  // Pushed last first, so that thieves take the later ranges while this
+  // thread pops the earlier ones.
+  for (size_t i = n; i-- > 1;) jobs.push(&ranges[i]);
+  ranges[0].execute(jobs);
+}
+
+// Last touches the graph by decrementing unfinished_, after which run() may
+// return.
+void job_graph::node::finish(job_system& jobs) {
+  for (job_id s : successors) {
+    node& successor = *graph->nodes_[s];
+    if (successor.pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      jobs.push(&successor);
+  }
+  graph->unfinished_.fetch_sub(1, std::memory_order_release);
+}
+
+job_graph::job_graph() = default;
+job_graph::~job_graph() = default;
+
+job_graph::job_id job_graph::add(const char* name,
+                                 std::function<void()> function) {
+  DVC_ASSERT(function, "empty job function");
+  auto n = std::make_unique<node>();
+  n->graph = this;
+  n->name = name;
+  n->function = std::move(function);
+  nodes_.push_back(std::move(n));
+  return nodes_.size() - 1;
+}
+
+job_graph::job_id job_graph::add_parallel_for(
+    const char* name, size_t count, size_t grain,
+    job_system::range_function function) {
+  DVC_ASSERT(function, "empty job function");
+  DVC_ASSERT_GT(grain, 0u);
+  auto n = std::make_unique<node>();
+  n->graph = this;
+  n->name = name;
+  n->range_function = std::move(function);
+  n->count = count;
+  n->grain = grain;
+  nodes_.push_back(std::move(n));
+  return nodes_.size() - 1;
+}
+
+void job_graph::precede(job_id before, job_id after) {
+  DVC_ASSERT(before < nodes_.size() && after < nodes_.size(), "no job ",
+             std::max(before, after));
+  DVC_ASSERT(before != after, "job ", before, " precedes itself");
+  nodes_[before]->successors.push_back(after);
+  ++nodes_[after]->predecessors;
+}
+
+job_system::job_system(size_t num_threads) {
+  num_threads = std::max<size_t>(num_threads, 1);
+  for (size_t i = 0; i < num_threads; ++i)
+    deques_.push_back(std::make_unique<deque>());
+  for (size_t i = 1; i < num_threads; ++i)
+    workers_.emplace_back([this, i] { worker(i); });
+}
+
+job_system::~job_system() {
+  {
+    std::lock_guard lock(mu_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& worker : workers_) worker.join();
+}
+
+size_t job_system::thread_index() const {
+  return this_worker.jobs == this ? this_worker.index : 0;
+}
+
+void job_system::run(job_graph& graph) {
+  if (graph.nodes_.empty()) return;
+  DVC_ASSERT_EQ(graph.unfinished_.load(std::memory_order_relaxed), 0u);
+  graph.unfinished_.store(graph.nodes_.size(), std::memory_order_relaxed);
+  for (const std::unique_ptr<job_graph::node>& n : graph.nodes_)
+    n->pending.store(n->predecessors, std::memory_order_relaxed);
+  size_t roots = 0;
+  for (const std::unique_ptr<job_graph::node>& n : graph.nodes_) {
+    if (n->predecessors) continue;
+    push(n.get());
+    ++roots;
+  }
+  DVC_ASSERT_GT(roots, 0u);
+  help_until([&] {
+    return graph.unfinished_.load(std::memory_order_acquire) == 0;
+  });
+}
+
+void job_system::parallel_for(size_t count, size_t grain,
+                              const range_function& function) {
+  DVC_ASSERT_GT(grain, 0u);
+  if (count <= grain) {
+    if (count) function(0, count);
+    return;
+  }
+  job_graph graph;
+  graph.add_parallel_for("parallel_for", count, grain, function);
+  run(graph);
+}
+
+void job_system::push(task* t) {
+  if (!deques_[thread_index()]->push(t)) {
+    t->execute(*this);
+    return;
+  }
+  epoch_.fetch_add(1, std::memory_order_seq_cst);
+  if (sleeping_.load(std::memory_order_seq_cst)) {
+    std::lock_guard lock(mu_);
+    wake_.notify_all();
+  }
+}
+
+job_system::task* job_system::find_task(size_t index) {
+  if (task* t = deques_[index]->pop()) return t;
+  for (size_t i = 1; i < deques_.size(); ++i)
+    if (task* t = deques_[(index + i) % deques_.size()]->steal()) return t;
+  return nullptr;
+}
+
+// Waiting threads run jobs rather than sleep, as the jobs they wait for may
+// be in their own deque.
+template <typename Done>
+void job_system::help_until(Done done) {
+  size_t index = thread_index();
+  while (!done()) {
+    if (task* t = find_task(index))
+      t->execute(*this);
+    else
+      std::this_thread::yield();
+  }
+}
+
+void job_system::worker(size_t index) {
+  this_worker = {this, index};
+  while (!stopping_.load(std::memory_order_relaxed)) {
+    uint64_t epoch = epoch_.load(std::memory_order_seq_cst);
+    if (task* t = find_task(index)) {
+      t->execute(*this);
+      continue;
+    }
+    std::unique_lock lock(mu_);
+    sleeping_.fetch_add(1, std::memory_order_seq_cst);
+    wake_.wait(lock, [&] {
+      return stopping_.load(std::memory_order_relaxed) ||
+             epoch_.load(std::memory_order_seq_cst) != epoch;
+    });
+    sleeping_.fetch_sub(1, std::memory_order_seq_cst);
+    lock.unlock();
+    tracer::set_thread_name("job worker");
+  }
+}
+
+}  // namespace spk
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "spk/spock_fwd.h"
+
+namespace spk {
+
+class job_graph;
+
+// Runs jobs on a pool of worker threads, each with its own Chase-Lev deque:
+// a thread pushes and pops jobs at the bottom of its deque, and idle threads
+// steal from the top of others'.  Threads that wait in run() or
+// parallel_for() run jobs too, so jobs may themselves call parallel_for.
+//
+// Thread 0 is the thread outside the pool that calls run() or
+// parallel_for(), and only one such thread may do so at a time.  Idle
+// workers sleep until jobs are pushed.  When a deque is full, the job is run
+// immediately instead.
+class job_system : nomove {
+ public:
+  using range_function = std::function<void(size_t begin, size_t end)>;
+
+  static constexpr size_t deque_capacity = 4096;
+
+  // num_threads includes the calling thread.
+  explicit job_system(
+      size_t num_threads = std::thread::hardware_concurrency());
+  ~job_system();
+
+  size_t num_threads() const { return workers_.size() + 1; }
+  // The calling thread's index, in [0, num_threads).
+  size_t thread_index() const;
+
+  // Runs every job of graph, each once its predecessors have finished, and
+  // returns when all have.
+  void run(job_graph& graph);
+
+  // Calls function on ranges of at most grain indices covering [0, count),
+  // in parallel, and returns when all have finished.
+  void parallel_for(size_t count, size_t grain,
+                    const range_function& function);
+
+ private:
+  friend class job_graph;
+
+  struct task {
+    virtual void execute(job_system& jobs) = 0;
+
+   protected:
+    ~task() = default;
+  };
+  class deque;
+
+  void push(task* t);
+  task* find_task(size_t index);
+  template <typename Done>
+  void help_until(Done done);
+  void worker(size_t index);
+
+  std::vector<std::unique_ptr<deque>> deques_;
+
+  // Incremented on every push, so that workers going to sleep notice jobs
+  // pushed since they last looked.
+  std::atomic<uint64_t> epoch_{0};
+  std::atomic<size_t> sleeping_{0};
+  std::atomic<bool> stopping_{false};
+  std::mutex mu_;
+  std::condition_variable wake_;
+  std::vector<std::thread> workers_;
+};
+
+// Jobs and the order between them, for job_system::run.  A frame's graph is
+// typically built once and run every frame:
+//
+//   spk::job_graph frame;
+//   auto simulate = frame.add_parallel_for(
+//       "simulate", particles.size(), 4096,
+//       [&](size_t begin, size_t end) { update(particles, begin, end); });
+//   auto write = frame.add("write_vertices", [&] { write(mapped); });
+//   auto render = frame.add("render", [&] { presenter.render(prepare); });
+//   frame.precede(simulate, write);
+//   frame.precede(write, render);
+//   while (running) jobs.run(frame);
+//
+// Jobs are traced as zones named by name, which must outlive the graph.
+class job_graph : nomove {
+ public:
+  using job_id = size_t;
+
+  job_graph();
+  ~job_graph();
+
+  job_id add(const char* name, std::function<void()> function);
+  // As job_system::parallel_for.  The job finishes when every range has.
+  job_id add_parallel_for(const char* name, size_t count, size_t grain,
+                          job_system::range_function function);
+  // after starts only once before has finished.
+  void precede(job_id before, job_id after);
+
+  size_t size() const { return nodes_.size(); }
+
+ private:
+  friend class job_system;
+  struct node;
+  struct range;
+
+  std::vector<std::unique_ptr<node>> nodes_;
+  // Jobs of the current run yet to finish.
+  std::atomic<size_t> unfinished_{0};
+};
+
+}  // namespace spk
@@ -1,13 +1,54 @@
 #include "loader.h"
 
-#include <SDL2/SDL_vulkan.h>
 #include <dlfcn.h>
 
+#include <filesystem>
+#include <fstream>
 #include <memory>
+#include <regex>
+#include <sstream>
 
 #include "dvc/log.h"
 
 namespace spk {
+namespace {
+
+using startup_clock = std::chrono::steady_clock;
+
+// The loader-ICD interface, from vk_icd.h, which is not in vulkan/.
+using PFN_vk_icdNegotiateLoaderICDInterfaceVersion =
+    VkResult(VKAPI_PTR*)(uint32_t* pSupportedVersion);
+constexpr uint32_t icd_interface_version = 5;
+
+// The library_path of an ICD manifest.  Relative paths containing a slash
+// are relative to the manifest; bare names are left to dlopen's search.
+std::string icd_library_path(const std::filesystem::path& manifest) {
+  std::ifstream in(manifest);
+  DVC_ASSERT(in, "cannot read ICD manifest ", manifest);
+  std::stringstream contents;
+  contents << in.rdbuf();
+  std::string text = contents.str();
+  static const std::regex library_path(
+      R"re("library_path"\s*:\s*"([^"]*)")re");
+  std::smatch match;
+  bool found = std::regex_search(text, match, library_path);
+  DVC_ASSERT(found, "no library_path in ICD manifest ", manifest);
+  std::filesystem::path library = match[1].str();
+  if (library.is_relative() && library.has_parent_path())
+    library = manifest.parent_path() / library;
+  return library;
+}
+
+}  // namespace
+
+std::ostream& operator<<(std::ostream& o, const loader_startup& s) {
+  auto us = [](std::chrono::nanoseconds t) { return t.count() / 1000; };
+  return o << (s.library.empty() ? "linked-in driver" : s.library)
+           << (s.icd ? " (ICD)" : "") << ": open " << us(s.open)
+           << " us, resolve " << us(s.resolve) << " us, dispatch table "
+           << us(s.dispatch_table) << " us, create instance "
+           << us(s.create_instance) << " us";
+}
 
 instance::instance(spk::instance_ref handle, const spk::loader& loader,
                    spk::allocation_callbacks const* allocation_callbacks)
@@ -17,32 +58,85 @@ instance::instance(spk::instance_ref handle, const spk::loader& loader,
       allocation_callbacks_(allocation_callbacks) {}
 
 std::unique_ptr<device_dispatch_table> load_device_dispatch_table(
-    spk::physical_device& physical_device, spk::device_ref device) {
+    spk::physical_device& physical_device, spk::device_ref device,
+    const spk::device_layer& layer) {
   auto pvkGetDeviceProcAddr =
       (PFN_vkGetDeviceProcAddr)physical_device.dispatch_table()
           .get_instance_proc_addr(physical_device.dispatch_table().instance,
                                   "vkGetDeviceProcAddr");
-  return load_device_dispatch_table(pvkGetDeviceProcAddr, device);
+  auto dispatch_table =
+      load_device_dispatch_table(pvkGetDeviceProcAddr, device);
+  if (layer) layer(*dispatch_table);
+  return dispatch_table;
 }
 
 device::device(spk::device_ref handle, spk::physical_device& physical_device,
-               spk::allocation_callbacks const* allocation_callbacks)
+               spk::allocation_callbacks const* allocation_callbacks,
+               const spk::device_layer& layer)
     : handle_(handle),
-      dispatch_table_(load_device_dispatch_table(physical_device, handle_)),
+      dispatch_table_(
+          load_device_dispatch_table(physical_device, handle_, layer)),
       allocation_callbacks_(allocation_callbacks) {}
 
 loader::loader(const char* path) {
-  if (SDL_Vulkan_LoadLibrary(path) != 0) DVC_FATAL(SDL_GetError());
-
-  pvkGetInstanceProcAddr =
-      (PFN_vkGetInstanceProcAddr)SDL_Vulkan_GetVkGetInstanceProcAddr();
+  auto start = startup_clock::now();
+  open(path);
+  auto opened = startup_clock::now();
+  resolve();
+  auto resolved = startup_clock::now();
+  global_dispatch_table = load_global_dispatch_table(pvkGetInstanceProcAddr);
+  startup_.open = opened - start;
+  startup_.resolve = resolved - opened;
+  startup_.dispatch_table = startup_clock::now() - resolved;
+}
 
+loader::loader(PFN_vkGetInstanceProcAddr get_instance_proc_addr)
+    : pvkGetInstanceProcAddr(get_instance_proc_addr) {
   DVC_ASSERT(pvkGetInstanceProcAddr);
-
+  auto start = startup_clock::now();
   global_dispatch_table = load_global_dispatch_table(pvkGetInstanceProcAddr);
+  startup_.dispatch_table = startup_clock::now() - start;
+}
+
+loader::~loader() {
+  if (library_) dlclose(library_);
+}
+
+void loader::open(const char* path) {
+  std::string library = path ? path : "libvulkan.so.1";
+  if (std::filesystem::path(library).extension() == ".json")
+    library = icd_library_path(library);
+  library_ = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!library_ && !path) {
+    // Development packages install only the unversioned name.
+    library = "libvulkan.so";
+    library_ = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+  }
+  if (!library_) DVC_FATAL("cannot load ", library, ": ", dlerror());
+  startup_.library = library;
 }
 
-loader::~loader() { SDL_Vulkan_UnloadLibrary(); }
+void loader::resolve() {
+  pvkGetInstanceProcAddr =
+      (PFN_vkGetInstanceProcAddr)dlsym(library_, "vkGetInstanceProcAddr");
+  if (pvkGetInstanceProcAddr) return;
+
+  // Not a loader, so an ICD.  ICDs of interface version 2 and later must be
+  // told the version the caller supports before any other call.
+  pvkGetInstanceProcAddr =
+      (PFN_vkGetInstanceProcAddr)dlsym(library_, "vk_icdGetInstanceProcAddr");
+  if (!pvkGetInstanceProcAddr)
+    DVC_FATAL(startup_.library, " is neither a Vulkan loader nor an ICD");
+  startup_.icd = true;
+  auto negotiate = (PFN_vk_icdNegotiateLoaderICDInterfaceVersion)dlsym(
+      library_, "vk_icdNegotiateLoaderICDInterfaceVersion");
+  if (negotiate) {
+    uint32_t version = icd_interface_version;
+    VkResult result = negotiate(&version);
+    DVC_ASSERT(result == VK_SUCCESS, "ICD interface negotiation failed for ",
+               startup_.library);
+  }
+}
 
 spk::version loader::instance_version() const {
   uint32_t v;
@@ -88,9 +182,11 @@ std::vector<spk::extension_properties> loader::instance_extension_properties_(
 spk::instance loader::create_instance(
     spk::instance_create_info const& create_info,
     spk::allocation_callbacks const* allocation_callbacks) const {
+  auto start = startup_clock::now();
   spk::instance_ref instance_ref;
   dispatch_table().create_instance(&create_info, allocation_callbacks,
                                    &instance_ref);
+  startup_.create_instance = startup_clock::now() - start;
 
   return {instance_ref, *this, allocation_callbacks};
 }
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
+#include <ostream>
+#include <string>
 #define VULKAN_NO_PROTOTYPES
 #include <vulkan/vulkan.h>
 
@@ -76,9 +79,34 @@ spk::allocation_callbacks create_allocation_callbacks(Allocator* allocator) {
       allocator);
 }
 
+// What a loader loaded and how long each step of its startup took.
+struct loader_startup {
+  // The library opened, or empty for a driver linked into the program.
+  std::string library;
+  // Whether library is an ICD used directly, bypassing libvulkan.
+  bool icd = false;
+  // dlopen, including reading an ICD manifest.
+  std::chrono::nanoseconds open{0};
+  // Finding vkGetInstanceProcAddr and negotiating with an ICD.
+  std::chrono::nanoseconds resolve{0};
+  std::chrono::nanoseconds dispatch_table{0};
+  // The most recent create_instance.
+  std::chrono::nanoseconds create_instance{0};
+};
+
+std::ostream& operator<<(std::ostream& o, const loader_startup& s);
+
 class loader {
  public:
+  // Loads path with dlopen, without SDL: libvulkan.so.1 if path is null,
+  // otherwise a Vulkan loader library, an ICD library such as
+  // libvulkan_lvp.so, or an ICD manifest such as lvp_icd.x86_64.json.  ICDs
+  // are used directly, skipping the Vulkan loader and its layers, which
+  // pins a benchmark to one driver and avoids scanning for the others.
   loader(const char* path = nullptr);
+  // Uses a driver linked into the program, such as
+  // spk::null_driver_get_instance_proc_addr.
+  explicit loader(PFN_vkGetInstanceProcAddr get_instance_proc_addr);
   loader(const loader&) = delete;
   loader(loader&&) = delete;
   ~loader();
@@ -100,11 +128,17 @@ class loader {
     return *global_dispatch_table;
   }
 
+  const loader_startup& startup() const { return startup_; }
+
  private:
+  void open(const char* path);
+  void resolve();
   std::vector<spk::extension_properties> instance_extension_properties_(
       const char* layer_name) const;
 
   std::unique_ptr<spk::global_dispatch_table> global_dispatch_table;
+  void* library_ = nullptr;
+  mutable loader_startup startup_;
 };
 
 }  // namespace spk
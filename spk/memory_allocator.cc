@@ -0,0 +1,414 @@
+#include "memory_allocator.h"
+
+#include <algorithm>
+
+#include "dvc/log.h"
+
+namespace spk {
+namespace {
+
+int popcount(VkFlags flags) { return __builtin_popcount(flags); }
+
+}  // namespace
+
+std::optional<uint32_t> find_memory_type(
+    const spk::physical_device_memory_properties& memory_properties,
+    uint32_t memory_type_bits, spk::memory_property_flags required,
+    spk::memory_property_flags preferred) {
+  std::optional<uint32_t> best;
+  int best_score = -1;
+  for (uint32_t i = 0; i < memory_properties.memory_type_count(); ++i) {
+    if (!(memory_type_bits & (1 << i))) continue;
+    spk::memory_property_flags flags =
+        memory_properties.memory_types()[i].property_flags();
+    if ((flags & required) != VkFlags(required)) continue;
+    int score = popcount(flags & preferred);
+    if (score > best_score) {
+      best = i;
+      best_score = score;
+    }
+  }
+  return best;
+}
+
+uint64_t align_offset(uint64_t offset, uint64_t alignment) {
+  DVC_ASSERT((alignment & (alignment - 1)) == 0, "alignment ", alignment,
+             " is not a power of two");
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+memory_range sub_range(const memory_range& range, uint64_t offset,
+                       uint64_t size) {
+  memory_range result;
+  result.memory = range.memory;
+  result.offset = range.offset + offset;
+  result.size = size;
+  if (range.mapped) result.mapped = static_cast<char*>(range.mapped) + offset;
+  return result;
+}
+
+struct memory_allocator::block {
+  block(spk::device_memory memory, uint32_t memory_type, uint64_t size,
+        bool linear, bool dedicated)
+      : memory(std::move(memory)),
+        memory_type(memory_type),
+        linear(linear),
+        dedicated(dedicated),
+        placement(size) {}
+
+  spk::device_memory memory;
+  uint32_t memory_type;
+  bool linear;
+  bool dedicated;
+  void* mapped = nullptr;
+  spk::tlsf placement;
+  // Allocations placed in this block, for defragmentation.
+  memory_allocation::record* records = nullptr;
+};
+
+struct memory_allocation::record {
+  memory_allocator::block* block;
+  uint32_t node;
+  memory_range range;
+  uint64_t alignment;
+  bool movable;
+  bool moving = false;
+  void* user_data;
+  record* prev = nullptr;
+  record* next = nullptr;
+
+  void link(memory_allocator::block* b) {
+    block = b;
+    prev = nullptr;
+    next = b->records;
+    if (next) next->prev = this;
+    b->records = this;
+  }
+  void unlink() {
+    if (prev)
+      prev->next = next;
+    else
+      block->records = next;
+    if (next) next->prev = prev;
+  }
+};
+
+// memory_allocation
+
+memory_allocation::memory_allocation(memory_allocation&& that)
+    : allocator_(that.allocator_), record_(that.record_) {
+  that.record_ = nullptr;
+}
+
+memory_allocation& memory_allocation::operator=(memory_allocation&& that) {
+  if (this != &that) {
+    reset();
+    allocator_ = that.allocator_;
+    record_ = that.record_;
+    that.record_ = nullptr;
+  }
+  return *this;
+}
+
+memory_allocation::~memory_allocation() { reset(); }
+
+void memory_allocation::reset() {
+  if (!record_) return;
+  allocator_->free(record_);
+  record_ = nullptr;
+}
+
+const memory_range& memory_allocation::range() const {
+  DVC_ASSERT(record_, "empty memory_allocation");
+  return record_->range;
+}
+
+uint32_t memory_allocation::memory_type() const {
+  DVC_ASSERT(record_, "empty memory_allocation");
+  return record_->block->memory_type;
+}
+
+// memory_allocator
+
+memory_allocator::memory_allocator(spk::physical_device& physical_device,
+                                   spk::device& device, uint64_t block_size)
+    : device_(device),
+      memory_properties_(physical_device.memory_properties()),
+      block_size_(block_size) {}
+
+memory_allocator::~memory_allocator() {
+  for (const auto& b : blocks_) {
+    DVC_ASSERT(b->placement.empty(), "memory_allocator destroyed with ",
+               b->placement.allocations(), " live allocations");
+    if (b->mapped) b->memory.unmap_memory();
+    device_.free_memory(b->memory);
+  }
+}
+
+memory_allocator::block* memory_allocator::new_block(uint32_t memory_type,
+                                                     uint64_t size,
+                                                     bool linear,
+                                                     bool dedicated) {
+  spk::memory_allocate_info allocate_info;
+  allocate_info.set_allocation_size(size);
+  allocate_info.set_memory_type_index(memory_type);
+  std::optional<spk::device_memory> memory;
+  try {
+    memory.emplace(device_.allocate_memory(allocate_info));
+  } catch (const spk::error_out_of_device_memory&) {
+    return nullptr;
+  } catch (const spk::error_out_of_host_memory&) {
+    return nullptr;
+  }
+  auto b = std::make_unique<block>(std::move(*memory), memory_type, size,
+                                   linear, dedicated);
+  if (memory_properties_.memory_types()[memory_type].property_flags() &
+      spk::memory_property_flags::host_visible)
+    b->memory.map_memory(0, size, b->mapped);
+  blocks_.push_back(std::move(b));
+  return blocks_.back().get();
+}
+
+void memory_allocator::free_block(block* b) {
+  if (b->mapped) b->memory.unmap_memory();
+  device_.free_memory(b->memory);
+  blocks_.erase(std::find_if(
+      blocks_.begin(), blocks_.end(),
+      [b](const std::unique_ptr<block>& p) { return p.get() == b; }));
+}
+
+memory_allocation memory_allocator::allocate(const memory_request& request) {
+  DVC_ASSERT_GT(request.size, 0);
+  std::optional<uint32_t> memory_type =
+      find_memory_type(memory_properties_, request.memory_type_bits,
+                       request.required, request.preferred);
+  if (!memory_type) return {};
+
+  std::lock_guard lock(mu_);
+  block* b = nullptr;
+  std::optional<tlsf::allocation> placement;
+  if (request.dedicated || request.size > block_size_ / 2) {
+    b = new_block(*memory_type, request.size, request.linear, true);
+    if (b) placement = b->placement.allocate(request.size);
+  } else {
+    for (const auto& candidate : blocks_) {
+      if (candidate->memory_type != *memory_type ||
+          candidate->linear != request.linear || candidate->dedicated)
+        continue;
+      placement =
+          candidate->placement.allocate(request.size, request.alignment);
+      if (placement) {
+        b = candidate.get();
+        break;
+      }
+    }
+    if (!b) {
+      b = new_block(*memory_type, block_size_, request.linear, false);
+      if (b)
+        placement = b->placement.allocate(request.size, request.alignment);
+    }
+  }
+  if (!b) return {};
+  DVC_ASSERT(placement);
+
+  memory_range range;
+  range.memory = b->memory;
+  range.offset = placement->offset;
+  range.size = request.size;
+  if (b->mapped) range.mapped = static_cast<char*>(b->mapped) + range.offset;
+  auto r = new memory_allocation::record{b, placement->node, range,
+                                         request.alignment, request.movable};
+  r->user_data = request.user_data;
+  r->link(b);
+  return {this, r};
+}
+
+memory_allocation memory_allocator::allocate_for(
+    spk::buffer& buffer, spk::memory_property_flags required,
+    spk::memory_property_flags preferred) {
+  const spk::memory_requirements requirements = buffer.memory_requirements();
+  memory_request request;
+  request.size = requirements.size();
+  request.alignment = requirements.alignment();
+  request.memory_type_bits = requirements.memory_type_bits();
+  request.required = required;
+  request.preferred = preferred;
+  memory_allocation allocation = allocate(request);
+  if (allocation) buffer.bind_memory(allocation.memory(), allocation.offset());
+  return allocation;
+}
+
+memory_allocation memory_allocator::allocate_for(
+    spk::image& image, spk::memory_property_flags required,
+    spk::memory_property_flags preferred, bool linear) {
+  const spk::memory_requirements requirements = image.memory_requirements();
+  memory_request request;
+  request.size = requirements.size();
+  request.alignment = requirements.alignment();
+  request.memory_type_bits = requirements.memory_type_bits();
+  request.required = required;
+  request.preferred = preferred;
+  request.linear = linear;
+  memory_allocation allocation = allocate(request);
+  if (allocation) image.bind_memory(allocation.memory(), allocation.offset());
+  return allocation;
+}
+
+void memory_allocator::free(memory_allocation::record* r) {
+  std::lock_guard lock(mu_);
+  DVC_ASSERT(!r->moving, "allocation freed during defragmentation");
+  block* b = r->block;
+  b->placement.free(r->node);
+  r->unlink();
+  delete r;
+  release_if_unneeded(b);
+}
+
+// Dedicated blocks go as soon as they are empty; shared blocks are kept
+// while no other empty block of the same kind exists, to avoid churn.
+void memory_allocator::release_if_unneeded(block* b) {
+  if (!b->placement.empty()) return;
+  bool spare = b->dedicated;
+  for (const auto& other : blocks_)
+    if (other.get() != b && !other->dedicated &&
+        other->memory_type == b->memory_type && other->linear == b->linear &&
+        other->placement.empty())
+      spare = true;
+  if (spare) free_block(b);
+}
+
+std::vector<memory_allocator::block_statistics> memory_allocator::statistics()
+    const {
+  std::lock_guard lock(mu_);
+  std::vector<block_statistics> result;
+  for (const auto& b : blocks_)
+    result.push_back({b->memory_type, b->linear, b->dedicated,
+                      b->placement.size(), b->placement.used(),
+                      b->placement.largest_free(),
+                      b->placement.allocations()});
+  return result;
+}
+
+uint32_t memory_allocator::device_memory_allocations() const {
+  std::lock_guard lock(mu_);
+  return blocks_.size();
+}
+
+std::vector<memory_allocator::defragment_move>
+memory_allocator::begin_defragment(uint64_t max_bytes) {
+  std::lock_guard lock(mu_);
+  std::vector<block*> order;
+  for (const auto& b : blocks_)
+    if (!b->dedicated) order.push_back(b.get());
+  std::stable_sort(order.begin(), order.end(), [](block* a, block* b) {
+    return a->placement.used() < b->placement.used();
+  });
+
+  std::vector<defragment_move> moves;
+  uint64_t bytes = 0;
+  // Empty the emptiest blocks into the fullest ones that have room.
+  for (size_t source = 0; source < order.size() && bytes < max_bytes;
+       ++source) {
+    block* from = order[source];
+    for (memory_allocation::record* r = from->records;
+         r && bytes < max_bytes; r = r->next) {
+      if (!r->movable || r->moving) continue;
+      for (size_t target = order.size() - 1; target > source; --target) {
+        block* to = order[target];
+        if (to->memory_type != from->memory_type || to->linear != from->linear)
+          continue;
+        std::optional<tlsf::allocation> placement =
+            to->placement.allocate(r->range.size, r->alignment);
+        if (!placement) continue;
+        defragment_move move;
+        move.from = r->range;
+        move.to.memory = to->memory;
+        move.to.offset = placement->offset;
+        move.to.size = r->range.size;
+        if (to->mapped)
+          move.to.mapped = static_cast<char*>(to->mapped) + placement->offset;
+        move.user_data = r->user_data;
+        move.record = r;
+        move.to_block = to;
+        move.to_node = placement->node;
+        r->moving = true;
+        bytes += r->range.size;
+        moves.push_back(move);
+        break;
+      }
+    }
+  }
+  return moves;
+}
+
+void memory_allocator::end_defragment(
+    const std::vector<defragment_move>& moves) {
+  std::lock_guard lock(mu_);
+  std::vector<block*> sources;
+  for (const defragment_move& move : moves) {
+    memory_allocation::record* r = move.record;
+    DVC_ASSERT(r->moving);
+    r->block->placement.free(r->node);
+    r->unlink();
+    if (std::find(sources.begin(), sources.end(), r->block) == sources.end())
+      sources.push_back(r->block);
+    r->link(move.to_block);
+    r->node = move.to_node;
+    r->range = move.to;
+    r->moving = false;
+  }
+  for (block* b : sources) release_if_unneeded(b);
+}
+
+// linear_pool
+
+linear_pool::linear_pool(memory_allocation backing, uint64_t capacity)
+    : backing_(std::move(backing)), capacity_(capacity) {
+  DVC_ASSERT_LE(capacity_, backing_.size());
+}
+
+std::optional<memory_range> linear_pool::allocate(uint64_t size,
+                                                  uint64_t alignment) {
+  const memory_range& range = backing_.range();
+  uint64_t offset =
+      align_offset(range.offset + offset_, alignment) - range.offset;
+  if (offset + size > capacity_) return std::nullopt;
+  offset_ = offset + size;
+  return sub_range(range, offset, size);
+}
+
+// ring_pool
+
+ring_pool::ring_pool(memory_allocation backing, uint64_t capacity)
+    : backing_(std::move(backing)), capacity_(capacity) {
+  DVC_ASSERT_GT(capacity_, 0u);
+  DVC_ASSERT_LE(capacity_, backing_.size());
+}
+
+std::optional<memory_range> ring_pool::allocate(uint64_t size,
+                                                uint64_t alignment) {
+  const memory_range& range = backing_.range();
+  const uint64_t capacity = capacity_;
+  // head_ and tail_ increase monotonically; their difference is the number
+  // of bytes in use, including padding skipped at the end of the ring.
+  uint64_t position = head_ % capacity;
+  uint64_t offset =
+      align_offset(range.offset + position, alignment) - range.offset;
+  uint64_t start = head_ + (offset - position);
+  if (offset + size > capacity) {
+    // Does not fit before the end; start again at the beginning.
+    offset = align_offset(range.offset, alignment) - range.offset;
+    start = head_ + (capacity - position) + offset;
+    if (offset + size > capacity) return std::nullopt;
+  }
+  if (start + size - tail_ > capacity) return std::nullopt;
+  head_ = start + size;
+  return sub_range(range, offset, size);
+}
+
+void ring_pool::release(uint64_t marker) {
+  DVC_ASSERT_LE(marker, head_);
+  tail_ = std::max(tail_, marker);
+}
+
+}  // namespace spk
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "spk/spock.h"
+#include "spk/tlsf.h"
+
+namespace spk {
+
+// Index of the first memory type allowed by memory_type_bits that has all of
+// the required properties, preferring types that also have the most of the
+// preferred ones.
+std::optional<uint32_t> find_memory_type(
+    const spk::physical_device_memory_properties& memory_properties,
+    uint32_t memory_type_bits, spk::memory_property_flags required,
+    spk::memory_property_flags preferred = spk::memory_property_flags(0));
+
+// A range of a VkDeviceMemory, with its host address if it is mapped.
+struct memory_range {
+  spk::device_memory_ref memory = VK_NULL_HANDLE;
+  uint64_t offset = 0;
+  uint64_t size = 0;
+  void* mapped = nullptr;
+};
+
+// offset rounded up to a power of two alignment.
+uint64_t align_offset(uint64_t offset, uint64_t alignment);
+
+// The size bytes at offset within range.
+memory_range sub_range(const memory_range& range, uint64_t offset,
+                       uint64_t size);
+
+class memory_allocator;
+
+// Owns a sub-allocation from a memory_allocator and returns it on
+// destruction.  The range can change only through defragmentation.
+class memory_allocation {
+ public:
+  memory_allocation() = default;
+  memory_allocation(const memory_allocation&) = delete;
+  memory_allocation& operator=(const memory_allocation&) = delete;
+  memory_allocation(memory_allocation&& that);
+  memory_allocation& operator=(memory_allocation&& that);
+  ~memory_allocation();
+
+  explicit operator bool() const { return record_; }
+
+  const memory_range& range() const;
+  spk::device_memory_ref memory() const { return range().memory; }
+  uint64_t offset() const { return range().offset; }
+  uint64_t size() const { return range().size; }
+  void* mapped() const { return range().mapped; }
+  uint32_t memory_type() const;
+
+  void reset();
+
+  struct record;
+
+ private:
+  friend class memory_allocator;
+
+  memory_allocation(memory_allocator* allocator, record* record)
+      : allocator_(allocator), record_(record) {}
+
+  memory_allocator* allocator_ = nullptr;
+  record* record_ = nullptr;
+};
+
+struct memory_request {
+  uint64_t size = 0;
+  uint64_t alignment = 1;
+  uint32_t memory_type_bits = ~uint32_t(0);
+  spk::memory_property_flags required = spk::memory_property_flags(0);
+  spk::memory_property_flags preferred = spk::memory_property_flags(0);
+  // Buffers and linear images must not share a page of
+  // bufferImageGranularity with optimal images, so they use separate blocks.
+  bool linear = true;
+  // Gives the allocation its own VkDeviceMemory.
+  bool dedicated = false;
+  // May be relocated by begin_defragment.
+  bool movable = false;
+  // Returned with defragment moves so the caller can find the resource.
+  void* user_data = nullptr;
+};
+
+// Sub-allocates buffers and images out of large VkDeviceMemory blocks, one
+// TLSF per block, instead of one vkAllocateMemory per resource.  Host visible
+// blocks are mapped once for their lifetime.  Requests larger than half a
+// block get a dedicated allocation.  Thread-safe.
+class memory_allocator : nomove {
+  struct block;
+
+ public:
+  static constexpr uint64_t default_block_size = 64 * 1024 * 1024;
+
+  memory_allocator(spk::physical_device& physical_device,
+                   spk::device& device,
+                   uint64_t block_size = default_block_size);
+  ~memory_allocator();
+
+  // Returns an empty allocation if no memory type matches or the device is
+  // out of memory.
+  memory_allocation allocate(const memory_request& request);
+
+  // Allocates memory satisfying the resource's requirements and binds it.
+  memory_allocation allocate_for(
+      spk::buffer& buffer, spk::memory_property_flags required,
+      spk::memory_property_flags preferred = spk::memory_property_flags(0));
+  memory_allocation allocate_for(
+      spk::image& image, spk::memory_property_flags required,
+      spk::memory_property_flags preferred = spk::memory_property_flags(0),
+      bool linear = false);
+
+  struct block_statistics {
+    uint32_t memory_type;
+    bool linear;
+    bool dedicated;
+    uint64_t size;
+    uint64_t used;
+    uint64_t largest_free;
+    size_t allocations;
+  };
+  std::vector<block_statistics> statistics() const;
+  uint32_t device_memory_allocations() const;
+
+  // Defragmentation is two-phase.  begin_defragment picks movable
+  // allocations from the least used blocks, up to max_bytes, and reserves a
+  // destination for each in a fuller block.  The caller then recreates each
+  // resource at move.to, records the copies from move.from and waits for
+  // them.  end_defragment repoints the allocations at their destinations
+  // and releases the sources and any blocks left empty.  Moved allocations
+  // must not be destroyed between the two calls.
+  struct defragment_move {
+    memory_range from;
+    memory_range to;
+    void* user_data;
+
+   private:
+    friend class memory_allocator;
+    memory_allocation::record* record;
+    block* to_block;
+    uint32_t to_node;
+  };
+  std::vector<defragment_move> begin_defragment(uint64_t max_bytes);
+  void end_defragment(const std::vector<defragment_move>& moves);
+
+ private:
+  friend class memory_allocation;
+
+  block* new_block(uint32_t memory_type, uint64_t size, bool linear,
+                   bool dedicated);
+  void free_block(block* b);
+  void release_if_unneeded(block* b);
+  void free(memory_allocation::record* r);
+
+  spk::device& device_;
+  spk::physical_device_memory_properties memory_properties_;
+  const uint64_t block_size_;
+
+  mutable std::mutex mu_;
+  std::vector<std::unique_ptr<block>> blocks_;
+};
+
+// Bump allocation inside the first capacity bytes of one memory_allocation,
+// released all at once by reset().  For per-frame or per-pass transient data.
+// When backing is bound to a buffer, capacity is the size the buffer was
+// created with: the memory requirements may be larger.  Not thread-safe.
+class linear_pool {
+ public:
+  linear_pool(memory_allocation backing, uint64_t capacity);
+
+  std::optional<memory_range> allocate(uint64_t size, uint64_t alignment = 1);
+  void reset() { offset_ = 0; }
+
+  uint64_t used() const { return offset_; }
+  uint64_t capacity() const { return capacity_; }
+  const memory_allocation& backing() const { return backing_; }
+
+ private:
+  memory_allocation backing_;
+  uint64_t capacity_;
+  uint64_t offset_ = 0;
+};
+
+// FIFO allocation inside the first capacity bytes of one memory_allocation
+// treated as a ring, with capacity as for linear_pool.  marker() names
+// everything allocated so far; once the GPU has finished with those
+// allocations (eg the frame's fence has signaled), release(marker) makes
+// their space available again.  Not thread-safe.
+class ring_pool {
+ public:
+  ring_pool(memory_allocation backing, uint64_t capacity);
+
+  // Returns nullopt if the ring is full.
+  std::optional<memory_range> allocate(uint64_t size, uint64_t alignment = 1);
+  uint64_t marker() const { return head_; }
+  void release(uint64_t marker);
+
+  uint64_t used() const { return head_ - tail_; }
+  uint64_t capacity() const { return capacity_; }
+  const memory_allocation& backing() const { return backing_; }
+
+ private:
+  memory_allocation backing_;
+  uint64_t capacity_;
+  uint64_t head_ = 0;
+  uint64_t tail_ = 0;
+};
+
+}  // namespace spk
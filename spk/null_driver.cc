@@ -0,0 +1,348 @@
+#include "null_driver.h"
+
+#include <atomic>
+#include <memory>
+#include <new>
+
+#include "dvc/log.h"
+#include "spk/spock.h"
+#include "spk/spock_null_driver.h"
+
+namespace spk {
+namespace {
+
+std::atomic<uint64_t> null_handle_counter{1};
+
+constexpr VkDeviceSize gibibyte = VkDeviceSize(1) << 30;
+constexpr VkDeviceSize null_alignment = 256;
+constexpr uint32_t null_memory_type_bits = 0xf;
+
+VkDeviceSize align_up(VkDeviceSize size, VkDeviceSize alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+// The state behind the handles the driver must describe later.
+struct null_buffer {
+  VkDeviceSize size;
+};
+struct null_image {
+  VkDeviceSize size;
+};
+struct null_memory {
+  VkDeviceSize size;
+  uint8_t* data;
+};
+
+// Non-dispatchable handles are integers on 32-bit platforms.
+template <typename Handle, typename State>
+Handle to_handle(State* state) {
+  if constexpr (std::is_pointer_v<Handle>)
+    return reinterpret_cast<Handle>(state);
+  else
+    return Handle(reinterpret_cast<uintptr_t>(state));
+}
+template <typename State, typename Handle>
+State* from_handle(Handle handle) {
+  if constexpr (std::is_pointer_v<Handle>)
+    return reinterpret_cast<State*>(handle);
+  else
+    return reinterpret_cast<State*>(uintptr_t(handle));
+}
+
+void fill_properties(VkPhysicalDeviceProperties& p) {
+  p = {};
+  p.apiVersion = VK_API_VERSION_1_2;
+  p.driverVersion = 1;
+  p.deviceType = VK_PHYSICAL_DEVICE_TYPE_CPU;
+  std::strncpy(p.deviceName, "spk null device", sizeof(p.deviceName));
+
+  VkPhysicalDeviceLimits& l = p.limits;
+  l.maxImageDimension1D = 16384;
+  l.maxImageDimension2D = 16384;
+  l.maxImageDimension3D = 2048;
+  l.maxImageDimensionCube = 16384;
+  l.maxImageArrayLayers = 2048;
+  l.maxTexelBufferElements = 1 << 27;
+  l.maxUniformBufferRange = 1 << 16;
+  l.maxStorageBufferRange = 1u << 30;
+  l.maxPushConstantsSize = 256;
+  l.maxMemoryAllocationCount = 4096;
+  l.maxSamplerAllocationCount = 4000;
+  l.bufferImageGranularity = 1;
+  l.maxBoundDescriptorSets = 8;
+  l.maxPerStageDescriptorSamplers = 1 << 20;
+  l.maxPerStageDescriptorUniformBuffers = 1 << 20;
+  l.maxPerStageDescriptorStorageBuffers = 1 << 20;
+  l.maxPerStageDescriptorSampledImages = 1 << 20;
+  l.maxPerStageDescriptorStorageImages = 1 << 20;
+  l.maxPerStageDescriptorInputAttachments = 1 << 20;
+  l.maxPerStageResources = 1 << 20;
+  l.maxDescriptorSetSamplers = 1 << 20;
+  l.maxDescriptorSetUniformBuffers = 1 << 20;
+  l.maxDescriptorSetUniformBuffersDynamic = 16;
+  l.maxDescriptorSetStorageBuffers = 1 << 20;
+  l.maxDescriptorSetStorageBuffersDynamic = 16;
+  l.maxDescriptorSetSampledImages = 1 << 20;
+  l.maxDescriptorSetStorageImages = 1 << 20;
+  l.maxDescriptorSetInputAttachments = 1 << 20;
+  l.maxVertexInputAttributes = 32;
+  l.maxVertexInputBindings = 32;
+  l.maxVertexInputAttributeOffset = 2047;
+  l.maxVertexInputBindingStride = 2048;
+  l.maxVertexOutputComponents = 128;
+  l.maxFragmentInputComponents = 128;
+  l.maxFragmentOutputAttachments = 8;
+  l.maxComputeSharedMemorySize = 1 << 15;
+  for (uint32_t& count : l.maxComputeWorkGroupCount) count = 65535;
+  l.maxComputeWorkGroupInvocations = 1024;
+  l.maxComputeWorkGroupSize[0] = 1024;
+  l.maxComputeWorkGroupSize[1] = 1024;
+  l.maxComputeWorkGroupSize[2] = 64;
+  l.maxDrawIndexedIndexValue = ~0u;
+  l.maxDrawIndirectCount = ~0u;
+  l.maxSamplerLodBias = 16;
+  l.maxSamplerAnisotropy = 16;
+  l.maxViewports = 16;
+  l.maxViewportDimensions[0] = 16384;
+  l.maxViewportDimensions[1] = 16384;
+  l.viewportBoundsRange[0] = -32768;
+  l.viewportBoundsRange[1] = 32767;
+  l.minMemoryMapAlignment = 64;
+  l.minTexelBufferOffsetAlignment = null_alignment;
+  l.minUniformBufferOffsetAlignment = null_alignment;
+  l.minStorageBufferOffsetAlignment = null_alignment;
+  l.maxFramebufferWidth = 16384;
+  l.maxFramebufferHeight = 16384;
+  l.maxFramebufferLayers = 2048;
+  constexpr VkSampleCountFlags samples =
+      VK_SAMPLE_COUNT_1_BIT | VK_SAMPLE_COUNT_4_BIT;
+  l.framebufferColorSampleCounts = samples;
+  l.framebufferDepthSampleCounts = samples;
+  l.framebufferStencilSampleCounts = samples;
+  l.framebufferNoAttachmentsSampleCounts = samples;
+  l.maxColorAttachments = 8;
+  l.sampledImageColorSampleCounts = samples;
+  l.sampledImageIntegerSampleCounts = samples;
+  l.sampledImageDepthSampleCounts = samples;
+  l.sampledImageStencilSampleCounts = samples;
+  l.storageImageSampleCounts = VK_SAMPLE_COUNT_1_BIT;
+  l.maxSampleMaskWords = 1;
+  l.timestampComputeAndGraphics = VK_TRUE;
+  l.timestampPeriod = 1;
+  l.maxClipDistances = 8;
+  l.maxCullDistances = 8;
+  l.maxCombinedClipAndCullDistances = 8;
+  l.pointSizeRange[0] = 1;
+  l.pointSizeRange[1] = 64;
+  l.lineWidthRange[0] = 1;
+  l.lineWidthRange[1] = 1;
+  l.optimalBufferCopyOffsetAlignment = 1;
+  l.optimalBufferCopyRowPitchAlignment = 1;
+  l.nonCoherentAtomSize = null_alignment;
+}
+
+void fill_memory_properties(VkPhysicalDeviceMemoryProperties& p) {
+  p = {};
+  p.memoryHeapCount = 2;
+  p.memoryHeaps[0] = {4 * gibibyte, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT};
+  p.memoryHeaps[1] = {4 * gibibyte, 0};
+  constexpr VkMemoryPropertyFlags host = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  p.memoryTypeCount = 4;
+  p.memoryTypes[0] = {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0};
+  p.memoryTypes[1] = {host, 1};
+  p.memoryTypes[2] = {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | host, 0};
+  p.memoryTypes[3] = {host | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, 1};
+}
+
+void fill_queue_family_properties(VkQueueFamilyProperties& p) {
+  p = {};
+  p.queueFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT |
+                 VK_QUEUE_TRANSFER_BIT | VK_QUEUE_SPARSE_BINDING_BIT;
+  p.queueCount = 4;
+  p.timestampValidBits = 64;
+  p.minImageTransferGranularity = {1, 1, 1};
+}
+
+void fill_memory_requirements(VkDeviceSize size, VkMemoryRequirements& r) {
+  r.size = align_up(size, null_alignment);
+  r.alignment = null_alignment;
+  r.memoryTypeBits = null_memory_type_bits;
+}
+
+}  // namespace
+
+VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL
+null_driver_get_instance_proc_addr(VkInstance, const char* name) {
+  return null_proc_addr(name);
+}
+
+uint64_t next_null_handle() { return null_handle_counter++; }
+
+void null_fill_chain(void* next) {
+  while (next) {
+    auto header = static_cast<VkBaseOutStructure*>(next);
+    next = header->pNext;
+    bool known = spk::visit_structure_type(header->sType, [&](auto* tag) {
+      using S = typename std::remove_pointer_t<decltype(tag)>::underlying_type;
+      std::memset(reinterpret_cast<uint8_t*>(header) + sizeof(*header), 0,
+                  sizeof(S) - sizeof(*header));
+    });
+    DVC_ASSERT(known, "unknown structure type ", header->sType);
+  }
+}
+
+VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL
+null_commands::vkGetInstanceProcAddr(VkInstance, const char* pName) {
+  return null_proc_addr(pName);
+}
+
+VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL
+null_commands::vkGetDeviceProcAddr(VkDevice, const char* pName) {
+  return null_proc_addr(pName);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+null_commands::vkEnumerateInstanceVersion(uint32_t* pApiVersion) {
+  *pApiVersion = VK_API_VERSION_1_2;
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL null_commands::vkGetPhysicalDeviceProperties(
+    VkPhysicalDevice, VkPhysicalDeviceProperties* pProperties) {
+  fill_properties(*pProperties);
+}
+
+VKAPI_ATTR void VKAPI_CALL null_commands::vkGetPhysicalDeviceProperties2(
+    VkPhysicalDevice, VkPhysicalDeviceProperties2* pProperties) {
+  spk::null_fill(pProperties, 1);
+  fill_properties(pProperties->properties);
+}
+
+VKAPI_ATTR void VKAPI_CALL null_commands::vkGetPhysicalDeviceMemoryProperties(
+    VkPhysicalDevice, VkPhysicalDeviceMemoryProperties* pMemoryProperties) {
+  fill_memory_properties(*pMemoryProperties);
+}
+
+VKAPI_ATTR void VKAPI_CALL
+null_commands::vkGetPhysicalDeviceMemoryProperties2(
+    VkPhysicalDevice, VkPhysicalDeviceMemoryProperties2* pMemoryProperties) {
+  spk::null_fill(pMemoryProperties, 1);
+  fill_memory_properties(pMemoryProperties->memoryProperties);
+}
+
+VKAPI_ATTR void VKAPI_CALL
+null_commands::vkGetPhysicalDeviceQueueFamilyProperties(
+    VkPhysicalDevice, uint32_t* pQueueFamilyPropertyCount,
+    VkQueueFamilyProperties* pQueueFamilyProperties) {
+  spk::null_enumerate(pQueueFamilyPropertyCount, 1,
+                      pQueueFamilyProperties == nullptr);
+  if (pQueueFamilyProperties && *pQueueFamilyPropertyCount)
+    fill_queue_family_properties(pQueueFamilyProperties[0]);
+}
+
+VKAPI_ATTR void VKAPI_CALL
+null_commands::vkGetPhysicalDeviceQueueFamilyProperties2(
+    VkPhysicalDevice, uint32_t* pQueueFamilyPropertyCount,
+    VkQueueFamilyProperties2* pQueueFamilyProperties) {
+  spk::null_enumerate(pQueueFamilyPropertyCount, 1,
+                      pQueueFamilyProperties == nullptr);
+  if (pQueueFamilyProperties && *pQueueFamilyPropertyCount) {
+    spk::null_fill(pQueueFamilyProperties, 1);
+    fill_queue_family_properties(
+        pQueueFamilyProperties[0].queueFamilyProperties);
+  }
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL null_commands::vkCreateBuffer(
+    VkDevice, const VkBufferCreateInfo* pCreateInfo,
+    const VkAllocationCallbacks*, VkBuffer* pBuffer) {
+  *pBuffer = to_handle<VkBuffer>(new null_buffer{pCreateInfo->size});
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL null_commands::vkDestroyBuffer(
+    VkDevice, VkBuffer buffer, const VkAllocationCallbacks*) {
+  delete from_handle<null_buffer>(buffer);
+}
+
+// Images are sized for 16 bytes a texel, the largest common format, with a
+// full mip chain at most doubling that.
+VKAPI_ATTR VkResult VKAPI_CALL null_commands::vkCreateImage(
+    VkDevice, const VkImageCreateInfo* pCreateInfo,
+    const VkAllocationCallbacks*, VkImage* pImage) {
+  const VkExtent3D& e = pCreateInfo->extent;
+  VkDeviceSize size = VkDeviceSize(e.width) * e.height * e.depth *
+                      pCreateInfo->arrayLayers * pCreateInfo->samples * 16;
+  if (pCreateInfo->mipLevels > 1) size *= 2;
+  *pImage = to_handle<VkImage>(new null_image{size});
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL null_commands::vkDestroyImage(
+    VkDevice, VkImage image, const VkAllocationCallbacks*) {
+  delete from_handle<null_image>(image);
+}
+
+VKAPI_ATTR void VKAPI_CALL null_commands::vkGetBufferMemoryRequirements(
+    VkDevice, VkBuffer buffer, VkMemoryRequirements* pMemoryRequirements) {
+  fill_memory_requirements(from_handle<null_buffer>(buffer)->size,
+                           *pMemoryRequirements);
+}
+
+VKAPI_ATTR void VKAPI_CALL null_commands::vkGetBufferMemoryRequirements2(
+    VkDevice, const VkBufferMemoryRequirementsInfo2* pInfo,
+    VkMemoryRequirements2* pMemoryRequirements) {
+  spk::null_fill(pMemoryRequirements, 1);
+  fill_memory_requirements(from_handle<null_buffer>(pInfo->buffer)->size,
+                           pMemoryRequirements->memoryRequirements);
+}
+
+VKAPI_ATTR void VKAPI_CALL null_commands::vkGetImageMemoryRequirements(
+    VkDevice, VkImage image, VkMemoryRequirements* pMemoryRequirements) {
+  fill_memory_requirements(from_handle<null_image>(image)->size,
+                           *pMemoryRequirements);
+}
+
+VKAPI_ATTR void VKAPI_CALL null_commands::vkGetImageMemoryRequirements2(
+    VkDevice, const VkImageMemoryRequirementsInfo2* pInfo,
+    VkMemoryRequirements2* pMemoryRequirements) {
+  spk::null_fill(pMemoryRequirements, 1);
+  fill_memory_requirements(from_handle<null_image>(pInfo->image)->size,
+                           pMemoryRequirements->memoryRequirements);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL null_commands::vkAllocateMemory(
+    VkDevice, const VkMemoryAllocateInfo* pAllocateInfo,
+    const VkAllocationCallbacks*, VkDeviceMemory* pMemory) {
+  VkDeviceSize size = pAllocateInfo->allocationSize;
+  auto data = static_cast<uint8_t*>(::operator new(
+      size, std::align_val_t(null_alignment), std::nothrow));
+  if (!data) return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+  *pMemory = to_handle<VkDeviceMemory>(new null_memory{size, data});
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL null_commands::vkFreeMemory(
+    VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*) {
+  if (memory == VK_NULL_HANDLE) return;
+  std::unique_ptr<null_memory> m(from_handle<null_memory>(memory));
+  ::operator delete(m->data, std::align_val_t(null_alignment));
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL null_commands::vkMapMemory(
+    VkDevice, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize,
+    VkMemoryMapFlags, void** ppData) {
+  *ppData = from_handle<null_memory>(memory)->data + offset;
+  return VK_SUCCESS;
+}
+
+// Work completes as it is submitted, so timelines have always reached any
+// value that will be signaled.
+VKAPI_ATTR VkResult VKAPI_CALL null_commands::vkGetSemaphoreCounterValue(
+    VkDevice, VkSemaphore, uint64_t* pValue) {
+  *pValue = UINT64_MAX;
+  return VK_SUCCESS;
+}
+
+}  // namespace spk
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+namespace spk {
+
+// A Vulkan driver that does nothing, for measuring the CPU cost of spk and
+// everything above it without a GPU or a window:
+//
+//   spk::loader loader(spk::null_driver_get_instance_proc_addr);
+//
+// It implements every command of vk.xml.  Commands succeed, handles they
+// create are fresh, and outputs are zeroed apart from sType and pNext.
+// Enumerations report one element when they enumerate handles, such as
+// physical devices, and none otherwise.  Beyond that:
+//
+// - The physical device reports Vulkan 1.2, generous limits, one queue
+//   family that supports everything, and host visible and device local
+//   memory types on two heaps.
+// - Memory is allocated from the host, so it can be mapped and written.
+// - Buffers and images report memory requirements from their create infos.
+// - Submitted work completes immediately: timeline semaphores read as
+//   UINT64_MAX.
+//
+// The driver keeps no other state: nothing is validated and nothing is
+// executed.
+VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL
+null_driver_get_instance_proc_addr(VkInstance instance, const char* name);
+
+// Used by the generated commands.
+
+uint64_t next_null_handle();
+
+template <typename T>
+void null_handles(T* handles, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    if constexpr (std::is_pointer_v<T>)
+      handles[i] = reinterpret_cast<T>(uintptr_t(next_null_handle()));
+    else
+      handles[i] = T(next_null_handle());
+  }
+}
+
+// Zeroes the structures on an output pNext chain, keeping their headers.
+void null_fill_chain(void* next);
+
+template <typename T, typename = void>
+struct has_structure_type : std::false_type {};
+template <typename T>
+struct has_structure_type<T, std::void_t<decltype(std::declval<T&>().sType)>>
+    : std::true_type {};
+
+template <typename T>
+void null_fill(T* p, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    if constexpr (has_structure_type<T>::value) {
+      VkStructureType type = p[i].sType;
+      void* next = p[i].pNext;
+      p[i] = T{};
+      p[i].sType = type;
+      p[i].pNext = next;
+      null_fill_chain(next);
+    } else {
+      p[i] = T{};
+    }
+  }
+}
+
+inline void null_fill_bytes(void* p, size_t size) { std::memset(p, 0, size); }
+
+// The two-call protocol: with query set, reports how many elements are
+// available; otherwise caps count to that and returns whether it was
+// enough.
+template <typename Count>
+bool null_enumerate(Count* count, size_t available, bool query) {
+  if (query) {
+    *count = Count(available);
+    return true;
+  }
+  bool complete = (*count >= available);
+  *count = Count(std::min<size_t>(*count, available));
+  return complete;
+}
+
+}  // namespace spk
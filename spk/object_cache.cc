@@ -0,0 +1,252 @@
+#include "object_cache.h"
+
+#include <chrono>
+#include <type_traits>
+
+#include "dvc/log.h"
+
+namespace spk {
+namespace {
+
+// Collects the handles in a spk struct, following the members
+// canonical_encoder encodes.  Handles are the object pointers visit_members
+// passes to value(), as they are on 64-bit platforms.
+class handle_collector {
+ public:
+  explicit handle_collector(std::vector<uint64_t>& handles)
+      : handles_(handles) {}
+
+  template <typename T>
+  void value(const T& x) {
+    if constexpr (is_visitable<T>::value) {
+      T::visit_members(x, *this);
+    } else if constexpr (is_std_array<T>::value) {
+      for (const auto& element : x) value(element);
+    } else if constexpr (std::is_pointer_v<T> &&
+                         std::is_class_v<std::remove_pointer_t<T>>) {
+      if (x) handles_.push_back((uint64_t)x);
+    }
+  }
+
+  void next(const void* p) {
+    if (!p) return;
+    VkStructureType type = static_cast<const VkBaseInStructure*>(p)->sType;
+    bool known = spk::visit_structure_type(type, [&](auto* tag) {
+      using S = std::remove_pointer_t<decltype(tag)>;
+      S::visit_members(*static_cast<const S*>(p), *this);
+    });
+    if (!known) unknown_structure_type(type);
+  }
+
+  template <typename T>
+  void array(const T* p, size_t count) {
+    if constexpr (!std::is_arithmetic_v<T>)
+      if (p)
+        for (size_t i = 0; i < count; ++i) value(p[i]);
+  }
+
+  template <typename T>
+  void pointer(const T* p) {
+    if (p) value(*p);
+  }
+
+  template <typename T>
+  void pointers(const T* const* p, size_t count) {
+    if (p)
+      for (size_t i = 0; i < count; ++i) pointer(p[i]);
+  }
+
+  void string(const char*) {}
+  void strings(const char* const*, size_t) {}
+  void bytes(const void*, size_t) {}
+  template <typename T>
+  void opaque(const T&) {}
+  template <typename T>
+  void raw(const T&) {}
+
+ private:
+  std::vector<uint64_t>& handles_;
+};
+
+}  // namespace
+
+object_cache::object_cache(spk::device& device,
+                           spk::pipeline_cache_ref pipeline_cache)
+    : device_(device), pipeline_cache_(pipeline_cache) {}
+
+template <typename Object, typename CreateInfo, typename Create>
+std::shared_ptr<const Object> object_cache::find_or_create(
+    kind k, const CreateInfo& create_info, Create create) {
+  std::vector<uint8_t> key = canonical_encoding(create_info);
+  key.push_back(uint8_t(k));
+  hash_sink sink;
+  sink.write(key.data(), key.size());
+  const uint64_t hash = sink.hash();
+
+  std::vector<uint64_t> handles;
+  handle_collector collector(handles);
+  collector.value(create_info);
+
+  std::promise<std::shared_ptr<const void>> promise;
+  std::shared_future<std::shared_ptr<const void>> found;
+  {
+    std::lock_guard lock(mu_);
+    auto [begin, end] = entries_.equal_range(hash);
+    for (auto it = begin; it != end; ++it) {
+      if (it->second.key == key) {
+        found = it->second.object;
+        break;
+      }
+    }
+    if (found.valid()) {
+      ++hits_;
+    } else {
+      ++misses_;
+      entry e{key, promise.get_future().share()};
+      for (uint64_t handle : handles) {
+        auto it = objects_.find(handle);
+        if (it != objects_.end())
+          if (auto dependency = it->second.lock())
+            e.dependencies.push_back(std::move(dependency));
+      }
+      entries_.emplace(hash, std::move(e));
+    }
+  }
+  // Another thread may still be creating it.
+  if (found.valid())
+    return std::static_pointer_cast<const Object>(found.get());
+
+  try {
+    auto object = std::make_shared<const Object>(create(create_info));
+    {
+      typename Object::ref_type ref = *object;
+      const uint64_t handle = (uint64_t)ref;
+      std::lock_guard lock(mu_);
+      objects_[handle] = object;
+      auto [begin, end] = entries_.equal_range(hash);
+      for (auto it = begin; it != end; ++it) {
+        if (it->second.key == key) {
+          it->second.handle = handle;
+          break;
+        }
+      }
+    }
+    promise.set_value(object);
+    return object;
+  } catch (...) {
+    // Later requests try again; current waiters see the failure.
+    {
+      std::lock_guard lock(mu_);
+      auto [begin, end] = entries_.equal_range(hash);
+      for (auto it = begin; it != end; ++it) {
+        if (it->second.key == key) {
+          entries_.erase(it);
+          break;
+        }
+      }
+    }
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+}
+
+std::shared_ptr<const spk::pipeline> object_cache::graphics_pipeline(
+    const spk::graphics_pipeline_create_info& create_info) {
+  return find_or_create<spk::pipeline>(
+      kind::graphics_pipeline, create_info, [&](const auto& info) {
+        std::vector<spk::pipeline> pipelines =
+            device_.create_graphics_pipelines(
+                pipeline_cache_,
+                spk::array_view<const spk::graphics_pipeline_create_info>(
+                    &info, 1));
+        DVC_ASSERT_EQ(pipelines.size(), 1u);
+        return std::move(pipelines.front());
+      });
+}
+
+std::shared_ptr<const spk::pipeline> object_cache::compute_pipeline(
+    const spk::compute_pipeline_create_info& create_info) {
+  return find_or_create<spk::pipeline>(
+      kind::compute_pipeline, create_info, [&](const auto& info) {
+        std::vector<spk::pipeline> pipelines =
+            device_.create_compute_pipelines(
+                pipeline_cache_,
+                spk::array_view<const spk::compute_pipeline_create_info>(
+                    &info, 1));
+        DVC_ASSERT_EQ(pipelines.size(), 1u);
+        return std::move(pipelines.front());
+      });
+}
+
+std::shared_ptr<const spk::sampler> object_cache::sampler(
+    const spk::sampler_create_info& create_info) {
+  return find_or_create<spk::sampler>(
+      kind::sampler, create_info,
+      [&](const auto& info) { return device_.create_sampler(info); });
+}
+
+std::shared_ptr<const spk::descriptor_set_layout>
+object_cache::descriptor_set_layout(
+    const spk::descriptor_set_layout_create_info& create_info) {
+  return find_or_create<spk::descriptor_set_layout>(
+      kind::descriptor_set_layout, create_info, [&](const auto& info) {
+        return device_.create_descriptor_set_layout(info);
+      });
+}
+
+std::shared_ptr<const spk::pipeline_layout> object_cache::pipeline_layout(
+    const spk::pipeline_layout_create_info& create_info) {
+  return find_or_create<spk::pipeline_layout>(
+      kind::pipeline_layout, create_info,
+      [&](const auto& info) { return device_.create_pipeline_layout(info); });
+}
+
+std::shared_ptr<const spk::shader_module> object_cache::shader_module(
+    const spk::shader_module_create_info& create_info) {
+  return find_or_create<spk::shader_module>(
+      kind::shader_module, create_info,
+      [&](const auto& info) { return device_.create_shader_module(info); });
+}
+
+size_t object_cache::trim() {
+  size_t trimmed = 0;
+  // Each pass releases the dependencies of what it destroys, which the next
+  // pass may then destroy.
+  for (;;) {
+    std::vector<std::shared_ptr<const void>> garbage;
+    size_t destroyed = 0;
+    {
+      std::lock_guard lock(mu_);
+      for (auto it = entries_.begin(); it != entries_.end();) {
+        const auto& object = it->second.object;
+        if (object.wait_for(std::chrono::seconds(0)) ==
+                std::future_status::ready &&
+            object.get().use_count() == 1) {
+          objects_.erase(it->second.handle);
+          garbage.push_back(object.get());
+          for (auto& dependency : it->second.dependencies)
+            garbage.push_back(std::move(dependency));
+          ++destroyed;
+          it = entries_.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+    if (destroyed == 0) return trimmed;
+    trimmed += destroyed;
+    // Destroy outside the lock.
+    garbage.clear();
+  }
+}
+
+object_cache::statistics object_cache::stats() const {
+  std::lock_guard lock(mu_);
+  statistics s;
+  s.hits = hits_;
+  s.misses = misses_;
+  s.size = entries_.size();
+  return s;
+}
+
+}  // namespace spk
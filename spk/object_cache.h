@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "spk/deep_hash.h"
+#include "spk/spock.h"
+
+namespace spk {
+
+// Shares pipelines, samplers and layouts between everything that asks for the
+// same state.  Objects are keyed by the canonical_encoding of their create
+// info, so two subsystems that fill in equal create infos through different
+// pointers get the same handle and the driver compiles once.  Concurrent
+// requests for one key wait on the first instead of compiling again.
+//
+// Handles inside a create info (layouts, render passes, shader modules) are
+// part of its key by value, so they must outlive the cached objects created
+// from it, or a new object reusing a handle would match a stale key.  Each
+// cached object keeps the cached objects its create info references alive,
+// so handles from the same cache satisfy this; others, such as render
+// passes, are the caller's to keep.  trim() destroys objects that only the
+// cache still references, and then those that only they referenced, and like
+// any destruction must not race GPU work that uses them.
+class object_cache : nomove {
+ public:
+  explicit object_cache(
+      spk::device& device,
+      spk::pipeline_cache_ref pipeline_cache = VK_NULL_HANDLE);
+
+  std::shared_ptr<const spk::pipeline> graphics_pipeline(
+      const spk::graphics_pipeline_create_info& create_info);
+  std::shared_ptr<const spk::pipeline> compute_pipeline(
+      const spk::compute_pipeline_create_info& create_info);
+  std::shared_ptr<const spk::sampler> sampler(
+      const spk::sampler_create_info& create_info);
+  std::shared_ptr<const spk::descriptor_set_layout> descriptor_set_layout(
+      const spk::descriptor_set_layout_create_info& create_info);
+  std::shared_ptr<const spk::pipeline_layout> pipeline_layout(
+      const spk::pipeline_layout_create_info& create_info);
+  std::shared_ptr<const spk::shader_module> shader_module(
+      const spk::shader_module_create_info& create_info);
+
+  // Destroys every object no longer referenced outside the cache or by
+  // another cached object, and returns how many there were.
+  size_t trim();
+
+  struct statistics {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    size_t size = 0;
+  };
+  statistics stats() const;
+
+ private:
+  enum class kind : uint8_t {
+    graphics_pipeline,
+    compute_pipeline,
+    sampler,
+    descriptor_set_layout,
+    pipeline_layout,
+    shader_module,
+  };
+
+  struct entry {
+    std::vector<uint8_t> key;
+    std::shared_future<std::shared_ptr<const void>> object;
+    // The handle of object, once created.
+    uint64_t handle = 0;
+    // The cached objects whose handles are in key.
+    std::vector<std::shared_ptr<const void>> dependencies;
+  };
+
+  template <typename Object, typename CreateInfo, typename Create>
+  std::shared_ptr<const Object> find_or_create(kind k,
+                                               const CreateInfo& create_info,
+                                               Create create);
+
+  spk::device& device_;
+  const spk::pipeline_cache_ref pipeline_cache_;
+
+  mutable std::mutex mu_;
+  std::unordered_multimap<uint64_t, entry> entries_;
+  // The created objects of entries_ by handle, to find dependencies.
+  std::unordered_map<uint64_t, std::weak_ptr<const void>> objects_;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
+}  // namespace spk
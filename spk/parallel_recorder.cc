@@ -0,0 +1,90 @@
+#include "parallel_recorder.h"
+
+#include <algorithm>
+
+#include "dvc/log.h"
+
+namespace spk {
+namespace {
+
+// Secondary command buffers are allocated in arrays of at least this many.
+constexpr size_t min_allocation = 16;
+
+spk::command_pool create_command_pool(spk::device& device,
+                                      uint32_t queue_family) {
+  spk::command_pool_create_info create_info;
+  create_info.set_flags(spk::command_pool_create_flags::transient);
+  create_info.set_queue_family_index(queue_family);
+  return device.create_command_pool(create_info);
+}
+
+}  // namespace
+
+parallel_recorder::parallel_recorder(spk::job_system& jobs,
+                                     spk::device& device,
+                                     uint32_t queue_family,
+                                     size_t frame_slots)
+    : jobs_(jobs), device_(device), num_threads_(jobs.num_threads()) {
+  DVC_ASSERT_GT(frame_slots, 0u);
+  pools_.reserve(frame_slots * num_threads_);
+  for (size_t i = 0; i < frame_slots * num_threads_; ++i)
+    pools_.push_back({create_command_pool(device, queue_family)});
+}
+
+void parallel_recorder::record(spk::command_buffer& primary, size_t slot,
+                               const spk::render_pass_begin_info& begin_info,
+                               size_t num_tasks, const record_task& task) {
+  DVC_ASSERT(slot * num_threads_ < pools_.size(), "no frame slot ", slot);
+  for (size_t thread = 0; thread < num_threads_; ++thread) {
+    pool& p = pools_[slot * num_threads_ + thread];
+    if (p.used == 0) continue;
+    DVC_ASSERT_EQ(device_.context().dispatch_table().vkResetCommandPool(
+                      device_.context().device(), p.command_pool, 0),
+                  VK_SUCCESS);
+    p.used = 0;
+  }
+
+  spk::command_buffer_inheritance_info inheritance_info;
+  inheritance_info.set_render_pass(begin_info.render_pass());
+  inheritance_info.set_subpass(0);
+  inheritance_info.set_framebuffer(begin_info.framebuffer());
+  spk::command_buffer_begin_info secondary_begin_info;
+  secondary_begin_info.set_flags(
+      spk::command_buffer_usage_flags::one_time_submit |
+      spk::command_buffer_usage_flags::render_pass_continue);
+  secondary_begin_info.set_p_inheritance_info(&inheritance_info);
+
+  recorded_.assign(num_tasks, VK_NULL_HANDLE);
+  jobs_.parallel_for(num_tasks, 1, [&](size_t begin, size_t end) {
+    pool& p = pools_[slot * num_threads_ + jobs_.thread_index()];
+    for (size_t i = begin; i < end; ++i) {
+      spk::command_buffer& command_buffer = next_command_buffer(p);
+      command_buffer.begin(secondary_begin_info);
+      task(command_buffer, i);
+      command_buffer.end();
+      recorded_[i] = command_buffer;
+    }
+  });
+
+  primary.begin_render_pass(begin_info,
+                            spk::subpass_contents::secondary_command_buffers);
+  if (num_tasks) primary.execute_commands({recorded_.data(), num_tasks});
+  primary.end_render_pass();
+}
+
+spk::command_buffer& parallel_recorder::next_command_buffer(pool& p) {
+  if (p.used == p.command_buffers.size()) {
+    uint32_t count =
+        uint32_t(std::max(min_allocation, p.command_buffers.size()));
+    spk::command_buffer_allocate_info allocate_info;
+    allocate_info.set_command_pool(p.command_pool);
+    allocate_info.set_level(spk::command_buffer_level::secondary);
+    allocate_info.set_command_buffer_count(count);
+    p.arrays.push_back(device_.allocate_command_buffers(allocate_info));
+    for (uint32_t i = 0; i < count; ++i)
+      p.command_buffers.push_back(p.arrays.back().handle(i));
+  }
+  return p.command_buffers[p.used++];
+}
+
+}  // namespace spk
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "spk/job_system.h"
+#include "spk/spock.h"
+
+namespace spk {
+
+// Records a render pass's commands on the threads of a job_system, for
+// frames with more draws than one thread can record in time:
+//
+//   spk::parallel_recorder recorder(jobs, device, queue_family,
+//                                   presenter.num_renderings());
+//   presenter.render([&](spk::command_buffer& command_buffer, size_t slot,
+//                        spk::render_pass_begin_info& begin_info) {
+//     recorder.record(command_buffer, slot, begin_info, batches.size(),
+//                     [&](spk::command_buffer& secondary, size_t i) {
+//                       draw(secondary, batches[i]);
+//                     });
+//   });
+//
+// Each task records into its own secondary command buffer, which continues
+// the first subpass and so must bind its own pipeline and dynamic state.
+// Tasks run as a job_system::parallel_for, so idle threads steal them and
+// faster threads take more.  The primary command buffer then runs the
+// render pass, executing the secondary command buffers in task order.
+//
+// Every thread has a command pool per frame slot, so recording never
+// synchronizes on a pool.  A slot's pools are reset when the slot is next
+// recorded, by when the frame that last used it must have completed, as with
+// frame_scheduler.  record() is called from one thread at a time, and the
+// recorder is destroyed only once its command buffers have completed.
+class parallel_recorder : nomove {
+ public:
+  using record_task =
+      std::function<void(spk::command_buffer& command_buffer, size_t task)>;
+
+  parallel_recorder(spk::job_system& jobs, spk::device& device,
+                    uint32_t queue_family, size_t frame_slots);
+
+  // Records tasks [0, num_tasks) and the render pass of begin_info into
+  // primary.  Returns once every task has been recorded.
+  void record(spk::command_buffer& primary, size_t slot,
+              const spk::render_pass_begin_info& begin_info, size_t num_tasks,
+              const record_task& task);
+
+ private:
+  // The secondary command buffers of one thread for one slot.
+  struct pool {
+    spk::command_pool command_pool;
+    std::vector<spk::command_buffer_array> arrays;
+    std::vector<spk::command_buffer> command_buffers;
+    size_t used = 0;
+  };
+
+  spk::command_buffer& next_command_buffer(pool& p);
+
+  spk::job_system& jobs_;
+  spk::device& device_;
+  const size_t num_threads_;
+  // Indexed by slot * num_threads_ + thread.
+  std::vector<pool> pools_;
+  // The secondary command buffers of the current record(), in task order.
+  std::vector<spk::command_buffer_ref> recorded_;
+};
+
+}  // namespace spk
@@ -0,0 +1,151 @@
+#include "particles.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "dvc/log.h"
+
+// x86-64 compiles the kernels for AVX2 and for the SSE2 baseline, and picks
+// one when the program loads.  AArch64 always has NEON.
+#if defined(__x86_64__)
+#define SPK_PARTICLE_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define SPK_PARTICLE_KERNEL
+#endif
+
+namespace spk {
+namespace {
+
+constexpr size_t cache_line = 64;
+constexpr size_t floats_per_line = cache_line / sizeof(float);
+constexpr size_t lanes = 8;
+
+typedef float float8 __attribute__((vector_size(lanes * sizeof(float))));
+typedef int32_t int32x8 __attribute__((vector_size(lanes * sizeof(float))));
+
+// The same operations in the same order for vectors and for the scalar tail,
+// so that every particle gets the same result whichever path it takes.  The
+// turn back negates velocity by flipping its sign bit.
+SPK_PARTICLE_KERNEL void step_axis(float* position, float* velocity,
+                                   size_t begin, size_t end, float alpha,
+                                   float beta, float gamma, float target) {
+  const float damping = 1 - gamma;
+  const int32x8 sign_bit = int32x8{} + INT32_MIN;
+  size_t i = begin;
+  for (; i + lanes <= end; i += lanes) {
+    float8 p, v;
+    std::memcpy(&p, position + i, sizeof(p));
+    std::memcpy(&v, velocity + i, sizeof(v));
+    v += beta * (target - p);
+    v *= damping;
+    p += alpha * v;
+    int32x8 turn = ((p > 1.0f) & (v > 0.0f)) | ((p < -1.0f) & (v < 0.0f));
+    v = (float8)((int32x8)v ^ (turn & sign_bit));
+    std::memcpy(position + i, &p, sizeof(p));
+    std::memcpy(velocity + i, &v, sizeof(v));
+  }
+  for (; i < end; ++i) {
+    float p = position[i];
+    float v = velocity[i];
+    v += beta * (target - p);
+    v *= damping;
+    p += alpha * v;
+    bool turn = ((p > 1) & (v > 0)) | ((p < -1) & (v < 0));
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    bits ^= uint32_t(turn) << 31;
+    std::memcpy(&v, &bits, sizeof(v));
+    position[i] = p;
+    velocity[i] = v;
+  }
+}
+
+// Copies size bytes, a multiple of 16, bypassing the cache if to is 16-byte
+// aligned.  Returns whether it did.
+bool stream(void* to, const void* from, size_t size) {
+#if defined(__SSE2__)
+  if (reinterpret_cast<uintptr_t>(to) % 16 == 0) {
+    auto* out = static_cast<__m128i*>(to);
+    auto* in = static_cast<const __m128i*>(from);
+    for (size_t i = 0; i < size / 16; ++i)
+      _mm_stream_si128(out + i, _mm_load_si128(in + i));
+    return true;
+  }
+#endif
+  std::memcpy(to, from, size);
+  return false;
+}
+
+// Assembles vertices in groups of lanes, whose size is a multiple of 16
+// bytes for either format, in a cache-line aligned block, and streams each
+// block out whole.  sources are the arrays of the vertex's floats in order.
+template <size_t floats>
+void interleave(const float* const* sources, char* out, size_t begin,
+                    size_t end) {
+  alignas(cache_line) float block[lanes * floats];
+  bool streamed = false;
+  size_t i = begin;
+  for (; i + lanes <= end; i += lanes) {
+    for (size_t k = 0; k < floats; ++k) {
+      const float* source = sources[k] + i;
+      for (size_t j = 0; j < lanes; ++j) block[j * floats + k] = source[j];
+    }
+    streamed |= stream(out, block, sizeof(block));
+    out += sizeof(block);
+  }
+  for (; i < end; ++i)
+    for (size_t k = 0; k < floats; ++k) {
+      std::memcpy(out, sources[k] + i, sizeof(float));
+      out += sizeof(float);
+    }
+#if defined(__SSE2__)
+  // Orders the streaming stores before whatever publishes the vertices.
+  if (streamed) _mm_sfence();
+#else
+  (void)streamed;
+#endif
+}
+
+}  // namespace
+
+particles::particles(size_t count)
+    : count_(count),
+      stride_(std::max<size_t>(count + floats_per_line - 1, floats_per_line) /
+              floats_per_line * floats_per_line),
+      storage_(static_cast<float*>(std::aligned_alloc(
+          cache_line, num_arrays * stride_ * sizeof(float)))) {
+  DVC_ASSERT(storage_, "cannot allocate ", count, " particles");
+  std::fill_n(storage_.get(), num_arrays * stride_, 0.0f);
+}
+
+void particles::step_range(const particle_step& step, size_t begin,
+                           size_t end) {
+  DVC_ASSERT(begin <= end && end <= count_, "bad particle range ", begin,
+             " to ", end);
+  for (size_t axis = 0; axis < 3; ++axis)
+    step_axis(position(axis), velocity(axis), begin, end, step.alpha,
+              step.beta, step.gamma, step.target[axis]);
+}
+
+void particles::write_vertices_range(particle_vertex_format format,
+                                     void* vertices, size_t begin,
+                                     size_t end) const {
+  DVC_ASSERT(begin <= end && end <= count_, "bad particle range ", begin,
+             " to ", end);
+  char* out = static_cast<char*>(vertices) + begin * vertex_size(format);
+  if (format == particle_vertex_format::xyz_rgb) {
+    const float* sources[] = {position(0), position(1), position(2),
+                              color(0),    color(1),    color(2)};
+    interleave<6>(sources, out, begin, end);
+  } else {
+    const float* sources[] = {position(0), position(1), color(0), color(1),
+                              color(2)};
+    interleave<5>(sources, out, begin, end);
+  }
+}
+
+}  // namespace spk
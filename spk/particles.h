@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+
+#include "spk/spock_fwd.h"
+
+namespace spk {
+
+// One step of point mass motion: velocity is pulled towards target by beta
+// and damped by gamma, position moves by alpha times velocity, and a point
+// outside [-1, 1] on an axis turns back on that axis.
+struct particle_step {
+  float alpha = 0;
+  float beta = 0;
+  float gamma = 0;
+  float target[3] = {0, 0, 0};
+};
+
+// The layouts particles write vertices in: a position of two or three
+// floats followed by an rgb color of three floats.
+enum class particle_vertex_format { xy_rgb, xyz_rgb };
+
+constexpr size_t vertex_size(particle_vertex_format format) {
+  return (format == particle_vertex_format::xyz_rgb ? 6 : 5) * sizeof(float);
+}
+
+// Point masses stored as structure of arrays, one 64-byte aligned array per
+// component, so that step() updates eight particles per instruction with
+// AVX2 (chosen at run time) or two NEON registers, and no branches:
+//
+//   spk::particles particles(1 << 20);
+//   ...initialize particles.position(0)[i] and so on...
+//   particles.step(step);
+//   particles.write_vertices(particle_vertex_format::xyz_rgb, mapped);
+//
+// Ranges let a job_system::parallel_for split both across threads.  For 2D
+// points leave the z components 0, which step() then leaves alone.
+class particles : nomove {
+ public:
+  explicit particles(size_t count);
+
+  size_t size() const { return count_; }
+
+  // Component axis (0 to 2) of every particle.
+  float* position(size_t axis) { return array(axis); }
+  float* velocity(size_t axis) { return array(3 + axis); }
+  // Channel 0 to 2 of every particle's rgb color.
+  float* color(size_t channel) { return array(6 + channel); }
+  const float* position(size_t axis) const { return array(axis); }
+  const float* velocity(size_t axis) const { return array(3 + axis); }
+  const float* color(size_t channel) const { return array(6 + channel); }
+
+  void step(const particle_step& step) { step_range(step, 0, count_); }
+  void step_range(const particle_step& step, size_t begin, size_t end);
+
+  // Writes vertex i of [begin, end) at vertices + i * vertex_size(format).
+  // Whole cache lines are written with non-temporal stores where the target
+  // allows, so that writing to mapped, write-combined memory neither reads
+  // it nor evicts the particles from the cache.
+  void write_vertices(particle_vertex_format format, void* vertices) const {
+    write_vertices_range(format, vertices, 0, count_);
+  }
+  void write_vertices_range(particle_vertex_format format, void* vertices,
+                            size_t begin, size_t end) const;
+
+ private:
+  static constexpr size_t num_arrays = 9;
+
+  float* array(size_t i) const { return storage_.get() + i * stride_; }
+
+  struct free_storage {
+    void operator()(float* p) const { std::free(p); }
+  };
+
+  const size_t count_;
+  // Floats per array: count_ rounded up to a whole cache line.
+  const size_t stride_;
+  std::unique_ptr<float, free_storage> storage_;
+};
+
+}  // namespace spk
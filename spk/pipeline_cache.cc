@@ -0,0 +1,161 @@
+#include "pipeline_cache.h"
+
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "dvc/log.h"
+
+namespace spk {
+namespace {
+
+std::atomic<uint64_t> next_cache_id{1};
+
+// The layout of VkPipelineCacheHeaderVersionOne, which vk.xml does not
+// describe as a struct at this version.
+struct cache_header {
+  uint32_t header_size;
+  uint32_t header_version;
+  uint32_t vendor_id;
+  uint32_t device_id;
+  uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+};
+static_assert(sizeof(cache_header) == 32);
+
+std::filesystem::path cache_path(
+    const std::filesystem::path& directory,
+    const spk::physical_device_properties& properties) {
+  std::ostringstream name;
+  name << "pipeline_cache_" << std::hex << std::setfill('0') << std::setw(4)
+       << properties.vendor_id() << "_" << std::setw(4)
+       << properties.device_id() << ".bin";
+  return directory / name.str();
+}
+
+bool header_matches(const std::vector<char>& data,
+                    const spk::physical_device_properties& properties) {
+  cache_header header;
+  if (data.size() < sizeof(header)) return false;
+  std::memcpy(&header, data.data(), sizeof(header));
+  return header.header_size >= sizeof(header) &&
+         header.header_size <= data.size() &&
+         header.header_version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header.vendor_id == properties.vendor_id() &&
+         header.device_id == properties.device_id() &&
+         std::memcmp(header.pipeline_cache_uuid,
+                     properties.pipeline_cache_uuid().data(),
+                     VK_UUID_SIZE) == 0;
+}
+
+std::vector<char> load(const std::filesystem::path& path,
+                       const spk::physical_device_properties& properties) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return {};
+  std::vector<char> data((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  if (!header_matches(data, properties)) {
+    DVC_ERROR("ignoring pipeline cache ", path,
+              " written for another device or driver");
+    return {};
+  }
+  return data;
+}
+
+}  // namespace
+
+persistent_pipeline_cache::persistent_pipeline_cache(
+    spk::physical_device& physical_device, spk::device& device,
+    std::filesystem::path directory)
+    : device_(device),
+      path_(cache_path(directory, physical_device.properties())),
+      initial_data_(load(path_, physical_device.properties())),
+      loaded_size_(initial_data_.size()),
+      main_(create_cache()),
+      id_(next_cache_id++) {}
+
+persistent_pipeline_cache::~persistent_pipeline_cache() { save(); }
+
+spk::pipeline_cache persistent_pipeline_cache::create_cache() {
+  spk::pipeline_cache_create_info create_info;
+  create_info.set_initial_data({initial_data_.data(), initial_data_.size()});
+  return device_.create_pipeline_cache(create_info);
+}
+
+spk::pipeline_cache_ref persistent_pipeline_cache::thread_cache() {
+  // Caches are identified by id rather than address, so a stale entry left
+  // by a destroyed cache can never match a new one.
+  thread_local std::vector<std::pair<uint64_t, spk::pipeline_cache_ref>>
+      cache;
+  for (const auto& [id, ref] : cache)
+    if (id == id_) return ref;
+
+  spk::pipeline_cache_ref ref;
+  {
+    std::lock_guard lock(mu_);
+    thread_caches_.push_back(
+        std::make_unique<spk::pipeline_cache>(create_cache()));
+    ref = *thread_caches_.back();
+  }
+  cache.emplace_back(id_, ref);
+  return ref;
+}
+
+std::vector<char> persistent_pipeline_cache::data() const {
+  const spk::device_dispatch_table& dispatch_table =
+      device_.context().dispatch_table();
+  VkDevice device = device_.context().device();
+  while (true) {
+    size_t size = 0;
+    DVC_ASSERT_EQ(
+        dispatch_table.vkGetPipelineCacheData(device, main_, &size, nullptr),
+        VK_SUCCESS);
+    std::vector<char> data(size);
+    VkResult res = dispatch_table.vkGetPipelineCacheData(device, main_, &size,
+                                                         data.data());
+    // VK_INCOMPLETE if another thread grew the cache in between; try again.
+    if (res == VK_INCOMPLETE) continue;
+    DVC_ASSERT_EQ(res, VK_SUCCESS);
+    data.resize(size);
+    return data;
+  }
+}
+
+void persistent_pipeline_cache::save() {
+  std::lock_guard lock(mu_);
+  if (!thread_caches_.empty()) {
+    std::vector<spk::pipeline_cache_ref> sources;
+    for (const auto& thread_cache : thread_caches_)
+      sources.push_back(*thread_cache);
+    DVC_ASSERT_EQ(device_.context().dispatch_table().vkMergePipelineCaches(
+                      device_.context().device(), main_,
+                      uint32_t(sources.size()), sources.data()),
+                  VK_SUCCESS);
+  }
+
+  std::vector<char> contents = data();
+  if (contents == initial_data_) return;
+
+  std::error_code error;
+  std::filesystem::create_directories(path_.parent_path(), error);
+  std::filesystem::path temporary = path_;
+  temporary += ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(contents.data(), contents.size());
+    if (!out.flush()) {
+      DVC_ERROR("failed to write pipeline cache ", temporary);
+      return;
+    }
+  }
+  std::filesystem::rename(temporary, path_, error);
+  if (error) {
+    DVC_ERROR("failed to replace pipeline cache ", path_, ": ",
+              error.message());
+    return;
+  }
+  initial_data_ = std::move(contents);
+}
+
+}  // namespace spk
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "spk/spock.h"
+
+namespace spk {
+
+// A VkPipelineCache that persists across runs.  The constructor loads
+// <directory>/pipeline_cache_<vendor>_<device>.bin, keeping its contents only
+// if the pipeline_cache_header_version_one header matches this physical
+// device's vendor, device and pipeline cache UUID; a stale or corrupt file is
+// ignored and replaced on save.
+//
+// Threads compiling pipelines concurrently should use thread_cache(), which
+// gives each thread its own cache seeded from the file, so the driver need
+// not serialize them on one cache.  save() merges the per-thread caches into
+// the main one and writes it to a temporary file renamed over the old one,
+// so a crash never leaves a truncated cache behind.  The destructor saves.
+// Like any VkPipelineCache, main_cache() must not be in use during save().
+class persistent_pipeline_cache : nomove {
+ public:
+  persistent_pipeline_cache(spk::physical_device& physical_device,
+                            spk::device& device,
+                            std::filesystem::path directory);
+  ~persistent_pipeline_cache();
+
+  spk::pipeline_cache_ref main_cache() const { return main_; }
+  spk::pipeline_cache_ref thread_cache();
+
+  void save();
+
+  // Bytes of valid data loaded from disk; zero on the first run.
+  size_t loaded_size() const { return loaded_size_; }
+  const std::filesystem::path& path() const { return path_; }
+
+ private:
+  spk::pipeline_cache create_cache();
+  std::vector<char> data() const;
+
+  spk::device& device_;
+  std::filesystem::path path_;
+  // The file contents as last loaded or saved.
+  std::vector<char> initial_data_;
+  const size_t loaded_size_;
+  spk::pipeline_cache main_;
+  const uint64_t id_;
+
+  std::mutex mu_;
+  std::vector<std::unique_ptr<spk::pipeline_cache>> thread_caches_;
+};
+
+}  // namespace spk
@@ -0,0 +1,154 @@
+#include "pipeline_compiler.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "dvc/log.h"
+
+namespace spk {
+namespace {
+
+// Several chunks per worker so that a few slow pipelines do not leave the
+// other workers idle at the end of a batch.
+constexpr size_t chunks_per_worker = 4;
+
+std::vector<spk::pipeline> create_pipelines(
+    spk::device& device, spk::pipeline_cache_ref cache,
+    const std::vector<spk::graphics_pipeline_create_info>& create_infos) {
+  return device.create_graphics_pipelines(
+      cache, spk::array_view<const spk::graphics_pipeline_create_info>(
+                 create_infos.data(), create_infos.size()));
+}
+
+std::vector<spk::pipeline> create_pipelines(
+    spk::device& device, spk::pipeline_cache_ref cache,
+    const std::vector<spk::compute_pipeline_create_info>& create_infos) {
+  return device.create_compute_pipelines(
+      cache, spk::array_view<const spk::compute_pipeline_create_info>(
+                 create_infos.data(), create_infos.size()));
+}
+
+spk::pipeline_cache create_pipeline_cache(spk::device& device) {
+  spk::pipeline_cache_create_info create_info;
+  return device.create_pipeline_cache(create_info);
+}
+
+}  // namespace
+
+pipeline_compiler::pipeline_compiler(spk::device& device,
+                                     spk::persistent_pipeline_cache* cache,
+                                     size_t num_threads)
+    : device_(device), cache_(cache) {
+  num_threads = std::max<size_t>(num_threads, 1);
+  if (!cache_) {
+    worker_caches_.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i)
+      worker_caches_.push_back(create_pipeline_cache(device_));
+    merged_cache_ =
+        std::make_unique<spk::pipeline_cache>(create_pipeline_cache(device_));
+  }
+  for (size_t i = 0; i < num_threads; ++i)
+    workers_.emplace_back([this, i] { run(i); });
+}
+
+pipeline_compiler::~pipeline_compiler() {
+  {
+    std::lock_guard lock(mu_);
+    stopping_ = true;
+  }
+  work_available_.notify_all();
+  for (std::thread& worker : workers_) worker.join();
+}
+
+// Workers drain the queue before exiting, so no future is left unsatisfied.
+void pipeline_compiler::run(size_t worker) {
+  spk::pipeline_cache_ref cache =
+      cache_ ? cache_->thread_cache()
+             : spk::pipeline_cache_ref(worker_caches_[worker]);
+  std::unique_lock lock(mu_);
+  while (true) {
+    work_available_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+    if (queue_.empty()) return;
+    std::function<void(spk::pipeline_cache_ref)> task =
+        std::move(queue_.front());
+    queue_.pop_front();
+    ++running_;
+    lock.unlock();
+    task(cache);
+    lock.lock();
+    --running_;
+    if (queue_.empty() && running_ == 0) idle_.notify_all();
+  }
+}
+
+// The lock is held while merging, so no worker uses its cache meanwhile.
+void pipeline_compiler::wait_idle() {
+  std::unique_lock lock(mu_);
+  idle_.wait(lock, [&] { return queue_.empty() && running_ == 0; });
+  if (!merged_cache_) return;
+  std::vector<spk::pipeline_cache_ref> sources(worker_caches_.begin(),
+                                               worker_caches_.end());
+  DVC_ASSERT_EQ(device_.context().dispatch_table().vkMergePipelineCaches(
+                    device_.context().device(), *merged_cache_,
+                    uint32_t(sources.size()), sources.data()),
+                VK_SUCCESS);
+}
+
+spk::pipeline_cache_ref pipeline_compiler::pipeline_cache() const {
+  if (!merged_cache_) return VK_NULL_HANDLE;
+  return *merged_cache_;
+}
+
+template <typename CreateInfo>
+std::vector<std::future<spk::pipeline>> pipeline_compiler::enqueue(
+    const CreateInfo* create_infos, size_t n) {
+  struct chunk {
+    std::vector<CreateInfo> create_infos;
+    std::vector<std::promise<spk::pipeline>> promises;
+  };
+
+  std::vector<std::future<spk::pipeline>> futures;
+  futures.reserve(n);
+  if (n == 0) return futures;
+
+  const size_t max_chunks = workers_.size() * chunks_per_worker;
+  const size_t chunk_size = (n + max_chunks - 1) / max_chunks;
+  {
+    std::lock_guard lock(mu_);
+    for (size_t begin = 0; begin < n; begin += chunk_size) {
+      auto c = std::make_shared<chunk>();
+      size_t end = std::min(n, begin + chunk_size);
+      c->create_infos.assign(create_infos + begin, create_infos + end);
+      c->promises.resize(end - begin);
+      for (auto& promise : c->promises)
+        futures.push_back(promise.get_future());
+
+      queue_.emplace_back([this, c](spk::pipeline_cache_ref cache) {
+        try {
+          std::vector<spk::pipeline> pipelines =
+              create_pipelines(device_, cache, c->create_infos);
+          DVC_ASSERT_EQ(pipelines.size(), c->promises.size());
+          for (size_t i = 0; i < pipelines.size(); ++i)
+            c->promises[i].set_value(std::move(pipelines[i]));
+        } catch (...) {
+          for (auto& promise : c->promises)
+            promise.set_exception(std::current_exception());
+        }
+      });
+    }
+  }
+  work_available_.notify_all();
+  return futures;
+}
+
+std::vector<std::future<spk::pipeline>> pipeline_compiler::compile(
+    spk::array_view<const spk::graphics_pipeline_create_info> create_infos) {
+  return enqueue(create_infos.data(), create_infos.size());
+}
+
+std::vector<std::future<spk::pipeline>> pipeline_compiler::compile(
+    spk::array_view<const spk::compute_pipeline_create_info> create_infos) {
+  return enqueue(create_infos.data(), create_infos.size());
+}
+
+}  // namespace spk
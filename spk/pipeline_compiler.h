@@ -0,0 +1,72 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "spk/pipeline_cache.h"
+#include "spk/spock.h"
+
+namespace spk {
+
+// Compiles batches of pipelines on a pool of worker threads.  A batch is cut
+// into chunks that each become one create_graphics_pipelines or
+// create_compute_pipelines call on some worker, so drivers still see arrays.
+// Each worker compiles into a VkPipelineCache of its own, so the driver need
+// not serialize the workers on one cache: the thread_cache() of the optional
+// persistent_pipeline_cache, which merges them when it saves, or else one
+// created by the compiler, which wait_idle() merges into pipeline_cache().
+//
+// The create infos are copied, but everything they point to (shader stages,
+// fixed function state, layouts, render passes) must stay alive until the
+// futures are ready.  A failed chunk sets its exception on each of its
+// futures.
+class pipeline_compiler : nomove {
+ public:
+  explicit pipeline_compiler(
+      spk::device& device, spk::persistent_pipeline_cache* cache = nullptr,
+      size_t num_threads = std::thread::hardware_concurrency());
+  ~pipeline_compiler();
+
+  std::vector<std::future<spk::pipeline>> compile(
+      spk::array_view<const spk::graphics_pipeline_create_info> create_infos);
+  std::vector<std::future<spk::pipeline>> compile(
+      spk::array_view<const spk::compute_pipeline_create_info> create_infos);
+
+  // Blocks until every batch submitted so far has finished, then merges the
+  // workers' caches into pipeline_cache() if the compiler owns them.
+  void wait_idle();
+
+  // Without a persistent_pipeline_cache, the cache holding everything the
+  // workers had compiled at the last wait_idle(); otherwise null.
+  spk::pipeline_cache_ref pipeline_cache() const;
+
+  size_t num_threads() const { return workers_.size(); }
+
+ private:
+  template <typename CreateInfo>
+  std::vector<std::future<spk::pipeline>> enqueue(
+      const CreateInfo* create_infos, size_t n);
+  void run(size_t worker);
+
+  spk::device& device_;
+  spk::persistent_pipeline_cache* const cache_;
+  // Without cache_, each worker's cache and the one they are merged into.
+  std::vector<spk::pipeline_cache> worker_caches_;
+  std::unique_ptr<spk::pipeline_cache> merged_cache_;
+
+  std::mutex mu_;
+  std::condition_variable work_available_;
+  std::condition_variable idle_;
+  std::deque<std::function<void(spk::pipeline_cache_ref)>> queue_;
+  size_t running_ = 0;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace spk
@@ -0,0 +1,60 @@
+#include "serialization.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "dvc/log.h"
+
+namespace spk {
+
+void* decode_arena::allocate(size_t size, size_t alignment) {
+  DVC_ASSERT(alignment <= alignof(std::max_align_t),
+             "unsupported alignment ", alignment);
+  size_t padding = (alignment - uintptr_t(head_) % alignment) % alignment;
+  while (padding + size > left_) {
+    if (current_ == blocks_.size()) {
+      size_t n = std::max(size, block_size);
+      blocks_.push_back({std::make_unique<uint8_t[]>(n), n});
+    }
+    head_ = blocks_[current_].data.get();
+    left_ = blocks_[current_].size;
+    ++current_;
+    padding = 0;
+  }
+  void* result = head_ + padding;
+  head_ += padding + size;
+  left_ -= padding + size;
+  size_ += size;
+  return result;
+}
+
+void decode_arena::reset() {
+  current_ = 0;
+  head_ = nullptr;
+  left_ = 0;
+  size_ = 0;
+}
+
+void byte_reader::read(void* out, size_t size) {
+  DVC_ASSERT(size <= left_, "truncated spk serialization: ", size,
+             " bytes wanted, ", left_, " left");
+  if (size == 0) return;
+  std::memcpy(out, data_, size);
+  data_ += size;
+  left_ -= size;
+}
+
+void byte_reader::finish() const {
+  DVC_ASSERT(left_ == 0, left_, " unexpected bytes after spk serialization");
+}
+
+const char* canonical_decoder::read_string() {
+  size_t size;
+  value(size);
+  auto string = static_cast<char*>(arena_.allocate(size + 1, 1));
+  in_.read(string, size);
+  string[size] = '\0';
+  return string;
+}
+
+}  // namespace spk
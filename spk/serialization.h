@@ -0,0 +1,259 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "spk/deep_hash.h"
+#include "spk/spock.h"
+
+namespace spk {
+
+// Owns the memory that deserialized structs point into.  Everything it hands
+// out lives until the arena is reset or destroyed.
+class decode_arena : nomove {
+ public:
+  void* allocate(size_t size, size_t alignment);
+  // Frees everything at once but keeps the blocks for reuse.
+  void reset();
+
+  // Value initialized, so decoded spk structs start with their sType set.
+  template <typename T>
+  T* allocate_array(size_t count) {
+    static_assert(std::is_trivially_destructible_v<T>);
+    T* array = static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    for (size_t i = 0; i < count; ++i) new (array + i) T();
+    return array;
+  }
+
+  // Bytes handed out so far.
+  size_t size() const { return size_; }
+
+ private:
+  static constexpr size_t block_size = 64 * 1024;
+
+  struct block {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size;
+  };
+  std::vector<block> blocks_;
+  // blocks_[current_ - 1] is being allocated from.
+  size_t current_ = 0;
+  uint8_t* head_ = nullptr;
+  size_t left_ = 0;
+  size_t size_ = 0;
+};
+
+// Translates handles recorded in one process to the handles that stand for
+// them in another, for replaying captured commands.  Handles it has not seen
+// translate to VK_NULL_HANDLE.
+class handle_map {
+ public:
+  template <typename T>
+  void add(T recorded, T replayed) {
+    map_[to_bits(recorded)] = to_bits(replayed);
+  }
+  template <typename T>
+  T translate(T recorded) {
+    if (to_bits(recorded) == 0) return recorded;
+    auto it = map_.find(to_bits(recorded));
+    if (it == map_.end()) {
+      ++unknown_;
+      return T();
+    }
+    return reinterpret_cast<T>(it->second);
+  }
+  template <typename T>
+  void remove(T recorded) {
+    map_.erase(to_bits(recorded));
+  }
+
+  // How many translations found no handle.
+  uint64_t unknown() const { return unknown_; }
+
+ private:
+  template <typename T>
+  static uintptr_t to_bits(T handle) {
+    return reinterpret_cast<uintptr_t>(handle);
+  }
+
+  std::unordered_map<uintptr_t, uintptr_t> map_;
+  uint64_t unknown_ = 0;
+};
+
+class byte_reader {
+ public:
+  byte_reader(const uint8_t* data, size_t size) : data_(data), left_(size) {}
+
+  // Both fail fatally on malformed input: read() if too little is left,
+  // finish() if anything is.
+  void read(void* out, size_t size);
+  void finish() const;
+
+ private:
+  const uint8_t* data_;
+  size_t left_;
+};
+
+// The inverse of canonical_encoder: reads a canonical encoding into a spk
+// struct, allocating the arrays, strings and pNext structures it points to
+// from an arena.  With a handle_map, every handle read is translated by it.
+class canonical_decoder {
+ public:
+  canonical_decoder(byte_reader& in, decode_arena& arena,
+                    handle_map* handles = nullptr)
+      : in_(in), arena_(arena), handles_(handles) {}
+
+  handle_map* handles() const { return handles_; }
+  void set_handles(handle_map* handles) { handles_ = handles; }
+
+  template <typename T>
+  void value(T& x) {
+    if constexpr (is_visitable<T>::value) {
+      T::visit_members(x, *this);
+    } else if constexpr (is_std_array<T>::value) {
+      for (auto& element : x) value(element);
+    } else if constexpr (std::is_pointer_v<T> &&
+                         !std::is_function_v<std::remove_pointer_t<T>>) {
+      // Pointers reach value() only as handles.
+      in_.read(&x, sizeof(x));
+      if (handles_) x = handles_->translate(x);
+    } else {
+      static_assert(std::is_trivially_copyable_v<T>);
+      in_.read(&x, sizeof(x));
+    }
+  }
+
+  template <typename P>
+  void next(P*& p) {
+    p = nullptr;
+    if (!present()) return;
+    VkStructureType type;
+    value(type);
+    bool known = spk::visit_structure_type(type, [&](auto* tag) {
+      using S = std::remove_pointer_t<decltype(tag)>;
+      S* s = arena_.allocate_array<S>(1);
+      S::visit_members(*s, *this);
+      p = reinterpret_cast<P*>(s);
+    });
+    if (!known) unknown_structure_type(type);
+  }
+
+  template <typename P>
+  void string(P& p) {
+    p = nullptr;
+    if (!present()) return;
+    p = read_string();
+  }
+
+  template <typename P>
+  void strings(P& p, size_t) {
+    p = nullptr;
+    if (!present()) return;
+    size_t count;
+    value(count);
+    auto array = arena_.allocate_array<const char*>(count);
+    for (size_t i = 0; i < count; ++i) string(array[i]);
+    p = array;
+  }
+
+  template <typename P>
+  void bytes(P& p, size_t) {
+    p = nullptr;
+    if (!present()) return;
+    size_t size;
+    value(size);
+    void* data = arena_.allocate(size, alignof(std::max_align_t));
+    in_.read(data, size);
+    p = data;
+  }
+
+  template <typename T>
+  void array(T*& p, size_t) {
+    using U = std::remove_const_t<T>;
+    p = nullptr;
+    if (!present()) return;
+    size_t count;
+    value(count);
+    U* array = arena_.allocate_array<U>(count);
+    if constexpr (std::is_arithmetic_v<U>) {
+      in_.read(array, count * sizeof(U));
+    } else {
+      for (size_t i = 0; i < count; ++i) value(array[i]);
+    }
+    p = array;
+  }
+
+  template <typename T>
+  void pointer(T*& p) {
+    p = nullptr;
+    if (!present()) return;
+    auto pointee = arena_.allocate_array<std::remove_const_t<T>>(1);
+    value(*pointee);
+    p = pointee;
+  }
+
+  template <typename P>
+  void pointers(P& p, size_t) {
+    using E = std::remove_const_t<std::remove_pointer_t<P>>;
+    p = nullptr;
+    if (!present()) return;
+    size_t count;
+    value(count);
+    E* array = arena_.allocate_array<E>(count);
+    for (size_t i = 0; i < count; ++i) pointer(array[i]);
+    p = array;
+  }
+
+  template <typename T>
+  void opaque(T& x) {
+    in_.read(&x, sizeof(x));
+  }
+
+  template <typename T>
+  void raw(T& x) {
+    in_.read(&x, sizeof(x));
+  }
+
+ private:
+  bool present() {
+    uint8_t flag;
+    in_.read(&flag, 1);
+    return flag;
+  }
+  const char* read_string();
+
+  byte_reader& in_;
+  decode_arena& arena_;
+  handle_map* handles_;
+};
+
+// A compact binary form of a spk struct and everything it points to, for
+// caching create infos or capturing workloads.  The form is that of the host:
+// it is not portable between byte orders or pointer sizes, and opaque
+// pointers such as pUserData round-trip by address only.
+template <typename T>
+std::vector<uint8_t> serialize(const T& x) {
+  return spk::canonical_encoding(x);
+}
+
+template <typename T>
+T deserialize(const uint8_t* data, size_t size, spk::decode_arena& arena) {
+  byte_reader in(data, size);
+  canonical_decoder decoder(in, arena);
+  T x;
+  decoder.value(x);
+  in.finish();
+  return x;
+}
+
+template <typename T>
+T deserialize(const std::vector<uint8_t>& data, spk::decode_arena& arena) {
+  return deserialize<T>(data.data(), data.size(), arena);
+}
+
+}  // namespace spk
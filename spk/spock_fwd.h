@@ -2,6 +2,7 @@
 
 #include <vulkan/vulkan.h>
 
+#include <functional>
 #include <memory>
 #include <ostream>
 #include <sstream>
@@ -237,4 +238,71 @@ struct nomove {
   nomove& operator=(nomove&&) = delete;
 };
 
+struct device_dispatch_table;
+class allocation_callbacks;
+
+// Called with a device's dispatch table once it is loaded and before the
+// device uses it, to point its entries at a layer such as
+// spk::command_instrumentation.  Without one the entries are the driver's.
+using device_layer = std::function<void(device_dispatch_table&)>;
+
+// Per-device state shared by every child of a spk::device.  The device owns
+// it on the heap, so its address is stable across moves of the device.  With
+// vkxmlc --thin_handles, device children hold a pointer to this instead of
+// their own parent handle, dispatch table and allocator.
+class device_context : nomove {
+ public:
+  device_context(VkDevice device, const device_dispatch_table* dispatch_table,
+                 const spk::allocation_callbacks* allocation_callbacks)
+      : device_(device),
+        dispatch_table_(dispatch_table),
+        allocation_callbacks_(allocation_callbacks) {}
+
+  VkDevice device() const { return device_; }
+  const device_dispatch_table& dispatch_table() const {
+    return *dispatch_table_;
+  }
+  const spk::allocation_callbacks* allocation_callbacks() const {
+    return allocation_callbacks_;
+  }
+
+ private:
+  VkDevice device_;
+  const device_dispatch_table* dispatch_table_;
+  const spk::allocation_callbacks* allocation_callbacks_;
+};
+
+// A batch of device child handles stored as contiguous raw handles plus one
+// pointer to their device_context.  It does not own the handles: it can be
+// passed directly to array commands (free_command_buffers,
+// queue submit_info::set_command_buffers, ...) as an array_view.  The
+// generated <handle>_array types derive from it to own a batch.
+template <typename Handle>
+class handle_vector {
+ public:
+  using ref_type = typename Handle::ref_type;
+
+  handle_vector() = default;
+  handle_vector(std::vector<ref_type> refs, const device_context& context)
+      : refs_(std::move(refs)), context_(&context) {}
+
+  size_t size() const { return refs_.size(); }
+  bool empty() const { return refs_.empty(); }
+  const ref_type* data() const { return refs_.data(); }
+  ref_type operator[](size_t i) const { return refs_[i]; }
+  ref_type at(size_t i) const { return refs_.at(i); }
+  auto begin() const { return refs_.begin(); }
+  auto end() const { return refs_.end(); }
+
+  operator array_view<const ref_type>() const {
+    return {refs_.data(), refs_.size()};
+  }
+
+  const device_context& context() const { return *context_; }
+
+ protected:
+  std::vector<ref_type> refs_;
+  const device_context* context_ = nullptr;
+};
+
 }  // namespace spk
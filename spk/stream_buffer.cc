@@ -0,0 +1,72 @@
+#include "stream_buffer.h"
+
+#include "dvc/log.h"
+
+namespace spk {
+namespace {
+
+spk::buffer create_buffer(spk::device& device, uint64_t size,
+                          spk::buffer_usage_flags usage) {
+  spk::buffer_create_info create_info;
+  create_info.set_size(size);
+  create_info.set_usage(usage);
+  create_info.set_sharing_mode(spk::sharing_mode::exclusive);
+  return device.create_buffer(create_info);
+}
+
+spk::memory_allocation allocate_mapped(spk::memory_allocator& allocator,
+                                       spk::buffer& buffer) {
+  spk::memory_allocation memory = allocator.allocate_for(
+      buffer, spk::memory_property_flags::host_visible |
+                  spk::memory_property_flags::host_coherent);
+  DVC_ASSERT(memory, "no host visible memory for stream buffer");
+  DVC_ASSERT(memory.mapped());
+  return memory;
+}
+
+}  // namespace
+
+stream_buffer::stream_buffer(spk::physical_device& physical_device,
+                             spk::device& device,
+                             spk::memory_allocator& memory_allocator,
+                             uint64_t size, spk::buffer_usage_flags usage,
+                             size_t num_frames)
+    : buffer_(create_buffer(device, size, usage)),
+      ring_(allocate_mapped(memory_allocator, buffer_), size),
+      uniform_alignment_(std::max<uint64_t>(
+          1, physical_device.properties()
+                 .limits()
+                 .min_uniform_buffer_offset_alignment())),
+      frame_end_(num_frames, no_marker) {
+  DVC_ASSERT_GT(num_frames, 0);
+}
+
+void stream_buffer::begin_frame(size_t frame_index) {
+  DVC_ASSERT(frame_ == no_frame, "begin_frame without end_frame");
+  DVC_ASSERT_LT(frame_index, frame_end_.size());
+  // Frames retire in submission order, so everything allocated up to the end
+  // of this index's last use is finished with.
+  if (frame_end_[frame_index] != no_marker)
+    ring_.release(frame_end_[frame_index]);
+  frame_ = frame_index;
+}
+
+void stream_buffer::end_frame() {
+  DVC_ASSERT(frame_ != no_frame, "end_frame without begin_frame");
+  frame_end_[frame_] = ring_.marker();
+  frame_ = no_frame;
+}
+
+// The ring aligns memory offsets.  The buffer is bound at an offset aligned
+// to its memory requirements, which for uniform buffers is a multiple of
+// minUniformBufferOffsetAlignment, so buffer offsets are aligned too.
+std::optional<stream_range> stream_buffer::allocate(uint64_t size,
+                                                    uint64_t alignment) {
+  DVC_ASSERT(frame_ != no_frame, "allocate outside a frame");
+  std::optional<memory_range> range = ring_.allocate(size, alignment);
+  if (!range) return std::nullopt;
+  return stream_range{buffer_, range->offset - ring_.backing().offset(),
+                      range->size, range->mapped};
+}
+
+}  // namespace spk
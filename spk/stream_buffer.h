@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+#include "spk/memory_allocator.h"
+#include "spk/spock.h"
+
+namespace spk {
+
+// A sub-range of a stream_buffer handed out for one frame.  offset is
+// relative to the start of buffer, as bind_vertex_buffers and dynamic
+// uniform buffer offsets expect.
+struct stream_range {
+  spk::buffer_ref buffer = VK_NULL_HANDLE;
+  uint64_t offset = 0;
+  uint64_t size = 0;
+  void* mapped = nullptr;
+
+  template <typename T>
+  T* data() const {
+    return static_cast<T*>(mapped);
+  }
+};
+
+// One persistently mapped, host coherent buffer used as a ring for data
+// rewritten every frame (vertices, uniforms).  Each frame allocates aligned
+// sub-ranges between begin_frame and end_frame; when a frame index comes
+// round again the space it used last time is reclaimed, so the caller must
+// have waited for that frame's fence first.  Uniforms are bound through one
+// descriptor set of type uniform_buffer_dynamic with the range's offset.
+// Not thread-safe.
+class stream_buffer {
+ public:
+  stream_buffer(spk::physical_device& physical_device, spk::device& device,
+                spk::memory_allocator& memory_allocator, uint64_t size,
+                spk::buffer_usage_flags usage, size_t num_frames);
+
+  void begin_frame(size_t frame_index);
+  void end_frame();
+
+  // Returns nullopt if the ring is full.
+  std::optional<stream_range> allocate(uint64_t size, uint64_t alignment = 1);
+
+  // Aligned to minUniformBufferOffsetAlignment.
+  std::optional<stream_range> allocate_uniform(uint64_t size) {
+    return allocate(size, uniform_alignment_);
+  }
+
+  template <typename T>
+  std::optional<stream_range> write_uniform(const T& value) {
+    std::optional<stream_range> range = allocate_uniform(sizeof(T));
+    if (range) std::memcpy(range->mapped, &value, sizeof(T));
+    return range;
+  }
+
+  spk::buffer& buffer() { return buffer_; }
+  uint64_t size() const { return ring_.capacity(); }
+  uint64_t used() const { return ring_.used(); }
+
+ private:
+  static constexpr uint64_t no_marker = UINT64_MAX;
+  static constexpr size_t no_frame = SIZE_MAX;
+
+  spk::buffer buffer_;
+  spk::ring_pool ring_;
+  uint64_t uniform_alignment_;
+  // The ring marker at the end of each frame index's last use.
+  std::vector<uint64_t> frame_end_;
+  size_t frame_ = no_frame;
+};
+
+}  // namespace spk
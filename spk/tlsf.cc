@@ -0,0 +1,185 @@
+#include "tlsf.h"
+
+#include "dvc/log.h"
+
+namespace spk {
+namespace {
+
+uint32_t log2_floor(uint64_t x) { return 63 - __builtin_clzll(x); }
+
+}  // namespace
+
+tlsf::tlsf(uint64_t size) : size_(size) {
+  DVC_ASSERT_GT(size, 0);
+  for (auto& heads : heads_)
+    for (uint32_t& head : heads) head = null;
+  insert_free(new_node(0, size));
+}
+
+// Sizes below sl_count map linearly into first level 0.  Above that, first
+// level f >= 1 covers [2^(f+sl_log2-1), 2^(f+sl_log2)) in sl_count classes.
+void tlsf::mapping(uint64_t size, uint32_t& fl, uint32_t& sl) {
+  if (size < sl_count) {
+    fl = 0;
+    sl = uint32_t(size);
+  } else {
+    uint32_t l = log2_floor(size);
+    fl = l - sl_log2 + 1;
+    sl = uint32_t(size >> (l - sl_log2)) - sl_count;
+  }
+}
+
+// Finds a non-empty class whose every block is at least size bytes.
+bool tlsf::find_free(uint64_t size, uint32_t& fl, uint32_t& sl) const {
+  if (size >= sl_count) {
+    uint64_t round = (uint64_t(1) << (log2_floor(size) - sl_log2)) - 1;
+    if (size + round < size) return false;
+    size += round;
+  }
+  mapping(size, fl, sl);
+  uint32_t sl_map = sl_bitmap_[fl] & (~uint32_t(0) << sl);
+  if (!sl_map) {
+    uint64_t fl_map = fl + 1 < 64 ? fl_bitmap_ & (~uint64_t(0) << (fl + 1)) : 0;
+    if (!fl_map) return false;
+    fl = __builtin_ctzll(fl_map);
+    sl_map = sl_bitmap_[fl];
+  }
+  sl = __builtin_ctz(sl_map);
+  return true;
+}
+
+uint32_t tlsf::find_in_class(uint64_t size) const {
+  uint32_t fl, sl;
+  mapping(size, fl, sl);
+  for (uint32_t n = heads_[fl][sl]; n != null; n = nodes_[n].next_free)
+    if (nodes_[n].size >= size) return n;
+  return null;
+}
+
+uint32_t tlsf::new_node(uint64_t offset, uint64_t size) {
+  uint32_t n;
+  if (!unused_nodes_.empty()) {
+    n = unused_nodes_.back();
+    unused_nodes_.pop_back();
+    nodes_[n] = node{offset, size};
+  } else {
+    n = uint32_t(nodes_.size());
+    nodes_.push_back(node{offset, size});
+  }
+  return n;
+}
+
+void tlsf::insert_free(uint32_t n) {
+  uint32_t fl, sl;
+  mapping(nodes_[n].size, fl, sl);
+  nodes_[n].free = true;
+  nodes_[n].prev_free = null;
+  nodes_[n].next_free = heads_[fl][sl];
+  if (heads_[fl][sl] != null) nodes_[heads_[fl][sl]].prev_free = n;
+  heads_[fl][sl] = n;
+  fl_bitmap_ |= uint64_t(1) << fl;
+  sl_bitmap_[fl] |= uint32_t(1) << sl;
+}
+
+void tlsf::remove_free(uint32_t n) {
+  uint32_t fl, sl;
+  mapping(nodes_[n].size, fl, sl);
+  node& x = nodes_[n];
+  if (x.prev_free != null)
+    nodes_[x.prev_free].next_free = x.next_free;
+  else
+    heads_[fl][sl] = x.next_free;
+  if (x.next_free != null) nodes_[x.next_free].prev_free = x.prev_free;
+  if (heads_[fl][sl] == null) {
+    sl_bitmap_[fl] &= ~(uint32_t(1) << sl);
+    if (!sl_bitmap_[fl]) fl_bitmap_ &= ~(uint64_t(1) << fl);
+  }
+  x.free = false;
+}
+
+void tlsf::split(uint32_t n, uint64_t size) {
+  uint64_t rest = nodes_[n].size - size;
+  if (rest == 0) return;
+  uint32_t m = new_node(nodes_[n].offset + size, rest);
+  nodes_[n].size = size;
+  nodes_[m].prev_phys = n;
+  nodes_[m].next_phys = nodes_[n].next_phys;
+  if (nodes_[m].next_phys != null) nodes_[nodes_[m].next_phys].prev_phys = m;
+  nodes_[n].next_phys = m;
+  insert_free(m);
+}
+
+// Absorbs n into its physical predecessor and recycles n.
+void tlsf::merge_into_prev(uint32_t n) {
+  uint32_t p = nodes_[n].prev_phys;
+  nodes_[p].size += nodes_[n].size;
+  nodes_[p].next_phys = nodes_[n].next_phys;
+  if (nodes_[n].next_phys != null) nodes_[nodes_[n].next_phys].prev_phys = p;
+  unused_nodes_.push_back(n);
+}
+
+std::optional<tlsf::allocation> tlsf::allocate(uint64_t size,
+                                               uint64_t alignment) {
+  DVC_ASSERT_GT(size, 0);
+  DVC_ASSERT((alignment & (alignment - 1)) == 0, "alignment ", alignment,
+             " is not a power of two");
+  // Worst case padding is alignment - 1 bytes before the aligned offset.
+  uint64_t search = size + alignment - 1;
+  if (search < size) return std::nullopt;
+  uint32_t fl, sl;
+  uint32_t n = find_free(search, fl, sl) ? heads_[fl][sl]
+                                         : find_in_class(search);
+  if (n == null) return std::nullopt;
+  remove_free(n);
+  uint64_t offset = nodes_[n].offset;
+  uint64_t aligned = (offset + alignment - 1) & ~(alignment - 1);
+  if (aligned != offset) {
+    // The padding stays free as its own node; n's predecessor is in use
+    // (free neighbours are always merged), so no merge is possible.
+    uint64_t padding = aligned - offset;
+    uint32_t m = new_node(offset, padding);
+    nodes_[m].prev_phys = nodes_[n].prev_phys;
+    nodes_[m].next_phys = n;
+    if (nodes_[m].prev_phys != null) nodes_[nodes_[m].prev_phys].next_phys = m;
+    nodes_[n].prev_phys = m;
+    nodes_[n].offset = aligned;
+    nodes_[n].size -= padding;
+    insert_free(m);
+  }
+  split(n, size);
+  used_ += size;
+  ++allocations_;
+  return allocation{aligned, n};
+}
+
+void tlsf::free(uint32_t n) {
+  DVC_ASSERT_LT(n, nodes_.size());
+  DVC_ASSERT(!nodes_[n].free, "double free of tlsf node ", n);
+  used_ -= nodes_[n].size;
+  --allocations_;
+
+  uint32_t next = nodes_[n].next_phys;
+  if (next != null && nodes_[next].free) {
+    remove_free(next);
+    merge_into_prev(next);
+  }
+  uint32_t prev = nodes_[n].prev_phys;
+  if (prev != null && nodes_[prev].free) {
+    remove_free(prev);
+    merge_into_prev(n);
+    n = prev;
+  }
+  insert_free(n);
+}
+
+uint64_t tlsf::largest_free() const {
+  if (!fl_bitmap_) return 0;
+  uint32_t fl = log2_floor(fl_bitmap_);
+  uint32_t sl = log2_floor(sl_bitmap_[fl]);
+  uint64_t largest = 0;
+  for (uint32_t n = heads_[fl][sl]; n != null; n = nodes_[n].next_free)
+    largest = std::max(largest, nodes_[n].size);
+  return largest;
+}
+
+}  // namespace spk
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace spk {
+
+// Two-level segregated fit allocator over an abstract range [0, size).  It
+// manages offsets only and never touches the memory, so it can place
+// sub-allocations inside a VkDeviceMemory.  allocate and free are O(1): a
+// first level indexed by the log2 of the size and a second level splitting
+// each power of two into 32 linear classes, both found with bit scans.  Only
+// a request that no class above its own can satisfy, such as one for the
+// whole range, scans the blocks of its own class instead.  Freed ranges are
+// merged with free neighbours immediately.
+class tlsf {
+ public:
+  struct allocation {
+    uint64_t offset;
+    uint32_t node;  // pass back to free()
+  };
+
+  explicit tlsf(uint64_t size);
+
+  std::optional<allocation> allocate(uint64_t size, uint64_t alignment = 1);
+  void free(uint32_t node);
+
+  uint64_t size() const { return size_; }
+  uint64_t used() const { return used_; }
+  uint64_t largest_free() const;
+  size_t allocations() const { return allocations_; }
+  bool empty() const { return allocations_ == 0; }
+
+ private:
+  static constexpr uint32_t sl_log2 = 5;
+  static constexpr uint32_t sl_count = 1 << sl_log2;
+  static constexpr uint32_t fl_count = 64 - sl_log2 + 1;
+  static constexpr uint32_t null = UINT32_MAX;
+
+  struct node {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t prev_phys = null;
+    uint32_t next_phys = null;
+    uint32_t prev_free = null;
+    uint32_t next_free = null;
+    bool free = false;
+  };
+
+  static void mapping(uint64_t size, uint32_t& fl, uint32_t& sl);
+  bool find_free(uint64_t size, uint32_t& fl, uint32_t& sl) const;
+  // A free block of at least size bytes in size's own class, or null.
+  uint32_t find_in_class(uint64_t size) const;
+
+  uint32_t new_node(uint64_t offset, uint64_t size);
+  void insert_free(uint32_t n);
+  void remove_free(uint32_t n);
+  // Splits size bytes off the front of free node n; the rest (if any)
+  // becomes a new free node.
+  void split(uint32_t n, uint64_t size);
+  void merge_into_prev(uint32_t n);
+
+  uint64_t size_;
+  uint64_t used_ = 0;
+  size_t allocations_ = 0;
+  uint64_t fl_bitmap_ = 0;
+  uint32_t sl_bitmap_[fl_count] = {};
+  uint32_t heads_[fl_count][sl_count];
+  std::vector<node> nodes_;
+  std::vector<uint32_t> unused_nodes_;
+};
+
+}  // namespace spk
@@ -0,0 +1,133 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <iomanip>
+
+#include "dvc/log.h"
+
+namespace spk {
+namespace {
+
+std::atomic<uint64_t> next_tracer_id{1};
+
+// Chrome trace microseconds from steady_clock nanoseconds.
+double trace_us(uint64_t ns) { return ns / 1000.0; }
+
+}  // namespace
+
+void write_json_string(std::ostream& o, const char* s) {
+  static const char hex[] = "0123456789abcdef";
+  o << '"';
+  for (; *s; ++s) {
+    unsigned char c = *s;
+    if (c < 0x20) {
+      o << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+      continue;
+    }
+    if (c == '"' || c == '\\') o << '\\';
+    o << *s;
+  }
+  o << '"';
+}
+
+tracer::tracer(size_t events_per_thread)
+    : id_(next_tracer_id++), events_per_thread_(events_per_thread) {
+  DVC_ASSERT_GT(events_per_thread, 0u);
+}
+
+tracer::~tracer() { uninstall(); }
+
+void tracer::install() {
+  tracer* expected = nullptr;
+  DVC_ASSERT(active_.compare_exchange_strong(expected, this),
+             "a tracer is already installed");
+}
+
+void tracer::uninstall() {
+  tracer* expected = this;
+  active_.compare_exchange_strong(expected, nullptr);
+}
+
+void tracer::set_thread_name(const char* name) {
+  if (ring* r = thread_ring())
+    r->thread_name.store(name, std::memory_order_relaxed);
+}
+
+// Thread ids start at 1: 0 is the GPU thread of gpu_profiler's events.
+tracer::ring* tracer::register_thread() {
+  std::lock_guard lock(mu_);
+  rings_.push_back(
+      std::make_unique<ring>(events_per_thread_, uint32_t(rings_.size() + 1)));
+  return rings_.back().get();
+}
+
+void tracer::write_chrome_trace_events(std::ostream& o, uint32_t pid) const {
+  struct copied {
+    const char* name;
+    uint32_t kind;
+    uint64_t time;
+    uint64_t data;
+  };
+
+  std::lock_guard lock(mu_);
+  // Nanosecond resolution.
+  o << std::fixed << std::setprecision(3);
+  bool first = true;
+  auto separate = [&] {
+    if (!first) o << ",\n";
+    first = false;
+  };
+  for (const std::unique_ptr<ring>& r : rings_) {
+    if (const char* name = r->thread_name.load(std::memory_order_relaxed)) {
+      separate();
+      o << R"({"name":"thread_name","ph":"M","pid":)" << pid << R"(,"tid":)"
+        << r->tid << R"(,"args":{"name":)";
+      write_json_string(o, name);
+      o << "}}";
+    }
+
+    // Copies the ring, then drops whatever its thread may have overwritten
+    // during the copy.  The thread publishes head n before it starts
+    // writing event n over event n - capacity, and the acquire fence pairs
+    // with its release fence, so if the copy read any part of event n, after
+    // is at least n.
+    uint64_t head = r->head.load(std::memory_order_acquire);
+    uint64_t begin = head > r->capacity ? head - r->capacity : 0;
+    std::vector<copied> events;
+    events.reserve(head - begin);
+    for (uint64_t n = begin; n < head; ++n) {
+      const event& e = r->events[n % r->capacity];
+      events.push_back({e.name.load(std::memory_order_relaxed),
+                        e.kind.load(std::memory_order_relaxed),
+                        e.time.load(std::memory_order_relaxed),
+                        e.data.load(std::memory_order_relaxed)});
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = r->head.load(std::memory_order_relaxed);
+    uint64_t valid = after + 1 > r->capacity ? after + 1 - r->capacity : 0;
+    size_t skip =
+        valid > begin ? std::min<uint64_t>(valid - begin, events.size()) : 0;
+
+    for (size_t i = skip; i < events.size(); ++i) {
+      const copied& e = events[i];
+      // A zone that ends before it begins was torn; never write a negative
+      // duration.
+      if (e.kind == zone && e.data < e.time) continue;
+      separate();
+      o << R"({"name":)";
+      write_json_string(o, e.name);
+      if (e.kind == zone) {
+        o << R"(,"cat":"cpu","ph":"X","ts":)" << trace_us(e.time)
+          << R"(,"dur":)" << trace_us(e.data - e.time);
+      } else {
+        double value;
+        std::memcpy(&value, &e.data, sizeof(value));
+        o << R"(,"ph":"C","ts":)" << trace_us(e.time) << R"(,"args":{"value":)"
+          << value << "}";
+      }
+      o << R"(,"pid":)" << pid << R"(,"tid":)" << r->tid << "}";
+    }
+  }
+}
+
+}  // namespace spk
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "spk/spock_fwd.h"
+
+namespace spk {
+
+// Records zones (named intervals) and counters from any thread into
+// per-thread rings, for frame pacing and hitch analysis without an external
+// profiler:
+//
+//   spk::tracer tracer;
+//   tracer.install();
+//   ...
+//   {
+//     spk::trace_zone zone("update");
+//     world.update(dt);
+//   }
+//   spk::trace_counter("particles", n);
+//   ...
+//   tracer.write_chrome_trace_events(out);
+//
+// Recording is lock-free: each thread appends to its own ring with relaxed
+// stores between a release fence and a release store, and a thread takes a
+// lock only the first time it records.  Rings keep the most recent
+// events_per_thread events.  With no tracer installed, recording costs a
+// relaxed load.  Only one tracer may be installed in a process, and it must
+// outlive every recording thread's last event.  Names must outlive the
+// tracer, eg string literals.
+class tracer : nomove {
+ public:
+  static constexpr size_t default_events_per_thread = 1 << 16;
+
+  explicit tracer(size_t events_per_thread = default_events_per_thread);
+  ~tracer();
+
+  void install();
+  void uninstall();
+
+  // Names the calling thread in exported traces.
+  static void set_thread_name(const char* name);
+
+  // Writes the events as Chrome trace events (chrome://tracing, Perfetto),
+  // for the traceEvents array of a trace: comma separated, with no
+  // brackets.  Times are steady_clock microseconds.  Events being
+  // overwritten while this runs are skipped.
+  void write_chrome_trace_events(std::ostream& o, uint32_t pid = 1) const;
+
+  // For trace_zone and trace_counter.
+  static void record_zone(const char* name, uint64_t begin_ns,
+                          uint64_t end_ns) {
+    if (ring* r = thread_ring()) r->append(name, zone, begin_ns, end_ns);
+  }
+  static void record_counter(const char* name, double value) {
+    if (ring* r = thread_ring()) {
+      uint64_t bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      r->append(name, counter, now_ns(), bits);
+    }
+  }
+  static bool enabled() {
+    return active_.load(std::memory_order_relaxed) != nullptr;
+  }
+  static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+ private:
+  enum event_kind : uint32_t { zone, counter };
+
+  // Every field is atomic so that export can read while the owner writes.
+  struct event {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<uint32_t> kind{zone};
+    std::atomic<uint64_t> time{0};
+    // The end of a zone, or the bits of a counter's value.
+    std::atomic<uint64_t> data{0};
+  };
+
+  // Written only by its thread.
+  struct ring {
+    explicit ring(size_t capacity, uint32_t tid)
+        : events(new event[capacity]), capacity(capacity), tid(tid) {}
+
+    // The fence orders the publication of head n before the stores that
+    // overwrite event n - capacity, so an export that reads any of them
+    // and then head sees at least n.
+    void append(const char* name, uint32_t kind, uint64_t time,
+                uint64_t data) {
+      uint64_t n = head.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      event& e = events[n % capacity];
+      e.name.store(name, std::memory_order_relaxed);
+      e.kind.store(kind, std::memory_order_relaxed);
+      e.time.store(time, std::memory_order_relaxed);
+      e.data.store(data, std::memory_order_relaxed);
+      head.store(n + 1, std::memory_order_release);
+    }
+
+    std::unique_ptr<event[]> events;
+    const size_t capacity;
+    const uint32_t tid;
+    std::atomic<const char*> thread_name{nullptr};
+    // Events appended so far.
+    std::atomic<uint64_t> head{0};
+  };
+
+  static ring* thread_ring() {
+    thread_local uint64_t id = 0;
+    thread_local ring* local = nullptr;
+    tracer* active = active_.load(std::memory_order_acquire);
+    if (!active) return nullptr;
+    if (id != active->id_) {
+      local = active->register_thread();
+      id = active->id_;
+    }
+    return local;
+  }
+
+  ring* register_thread();
+
+  inline static std::atomic<tracer*> active_{nullptr};
+
+  const uint64_t id_;
+  const size_t events_per_thread_;
+
+  mutable std::mutex mu_;
+  std::vector<std::unique_ptr<ring>> rings_;
+};
+
+// Records the time from its construction to its destruction as a zone.
+class trace_zone : nomove {
+ public:
+  explicit trace_zone(const char* name)
+      : name_(name), begin_ns_(tracer::enabled() ? tracer::now_ns() : 0) {}
+  ~trace_zone() {
+    if (begin_ns_) tracer::record_zone(name_, begin_ns_, tracer::now_ns());
+  }
+
+ private:
+  const char* const name_;
+  const uint64_t begin_ns_;
+};
+
+// Records a counter's value at this time.
+inline void trace_counter(const char* name, double value) {
+  tracer::record_counter(name, value);
+}
+
+// Writes s as a quoted JSON string, escaping quotes, backslashes and
+// control characters.
+void write_json_string(std::ostream& o, const char* s);
+
+}  // namespace spk
@@ -0,0 +1,428 @@
+#include "upload_scheduler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#include "dvc/log.h"
+
+namespace spk {
+namespace {
+
+// bufferOffset of a buffer-to-image copy must be a multiple of 4 and of the
+// texel block size; 16 covers every format whose block size is a power of
+// two.
+constexpr uint64_t image_alignment = 16;
+constexpr uint64_t buffer_alignment = 4;
+
+spk::buffer create_staging_buffer(spk::device& device, uint64_t size) {
+  spk::buffer_create_info create_info;
+  create_info.set_size(size);
+  create_info.set_usage(spk::buffer_usage_flags::transfer_src);
+  create_info.set_sharing_mode(spk::sharing_mode::exclusive);
+  return device.create_buffer(create_info);
+}
+
+spk::memory_allocation allocate_staging(spk::memory_allocator& allocator,
+                                        spk::buffer& buffer) {
+  spk::memory_allocation memory = allocator.allocate_for(
+      buffer,
+      spk::memory_property_flags::host_visible |
+          spk::memory_property_flags::host_coherent,
+      spk::memory_property_flags::host_cached);
+  DVC_ASSERT(memory, "no host visible memory for staging");
+  DVC_ASSERT(memory.mapped());
+  return memory;
+}
+
+spk::semaphore create_timeline(spk::device& device) {
+  spk::semaphore_type_create_info type_info;
+  type_info.set_semaphore_type(spk::semaphore_type::timeline);
+  type_info.set_initial_value(0);
+  spk::semaphore_create_info create_info;
+  create_info.set_next(&type_info);
+  return device.create_semaphore(create_info);
+}
+
+spk::command_pool create_command_pool(spk::device& device,
+                                      uint32_t queue_family) {
+  spk::command_pool_create_info create_info;
+  create_info.set_flags(spk::command_pool_create_flags::transient |
+                        spk::command_pool_create_flags::reset_command_buffer);
+  create_info.set_queue_family_index(queue_family);
+  return device.create_command_pool(create_info);
+}
+
+spk::command_buffer_array allocate_command_buffers(
+    spk::device& device, spk::command_pool& command_pool, uint32_t count) {
+  spk::command_buffer_allocate_info allocate_info;
+  allocate_info.set_command_pool(command_pool);
+  allocate_info.set_level(spk::command_buffer_level::primary);
+  allocate_info.set_command_buffer_count(count);
+  return device.allocate_command_buffers(allocate_info);
+}
+
+spk::image_subresource_range range_of(
+    const spk::image_subresource_layers& layers) {
+  spk::image_subresource_range range;
+  range.set_aspect_mask(layers.aspect_mask());
+  range.set_base_mip_level(layers.mip_level());
+  range.set_level_count(1);
+  range.set_base_array_layer(layers.base_array_layer());
+  range.set_layer_count(layers.layer_count());
+  return range;
+}
+
+// The bytes of one destination buffer written by a flush, and where in
+// staging each comes from.  A later write replaces the bytes of earlier ones
+// it overlaps, so the last upload wins and no two copies of the flush
+// overlap, as vkCmdCopyBuffer requires.
+class dst_bytes {
+ public:
+  void write(uint64_t dst_offset, uint64_t src_offset, uint64_t size);
+  // In dst order, merging spans contiguous in both staging and dst.
+  void append_copies(std::vector<spk::buffer_copy>& copies) const;
+
+  uint64_t low() const { return spans_.begin()->first; }
+  uint64_t high() const { return spans_.rbegin()->second.end; }
+
+ private:
+  struct span {
+    uint64_t end;
+    uint64_t src_offset;
+  };
+  // Disjoint spans by dst offset.
+  std::map<uint64_t, span> spans_;
+};
+
+void dst_bytes::write(uint64_t dst_offset, uint64_t src_offset,
+                      uint64_t size) {
+  const uint64_t end = dst_offset + size;
+  // Keeps the part of s at offset beyond end, if any.
+  auto keep_tail = [&](uint64_t offset, const span& s) {
+    if (s.end > end) spans_[end] = {s.end, s.src_offset + (end - offset)};
+  };
+  auto it = spans_.lower_bound(dst_offset);
+  if (it != spans_.begin()) {
+    auto prev = std::prev(it);
+    if (prev->second.end > dst_offset) {
+      keep_tail(prev->first, prev->second);
+      prev->second.end = dst_offset;
+    }
+  }
+  while (it != spans_.end() && it->first < end) {
+    keep_tail(it->first, it->second);
+    it = spans_.erase(it);
+  }
+  spans_[dst_offset] = {end, src_offset};
+}
+
+void dst_bytes::append_copies(std::vector<spk::buffer_copy>& copies) const {
+  const size_t begin = copies.size();
+  for (const auto& [dst_offset, s] : spans_) {
+    const uint64_t size = s.end - dst_offset;
+    if (copies.size() > begin) {
+      spk::buffer_copy& last = copies.back();
+      if (last.src_offset() + last.size() == s.src_offset &&
+          last.dst_offset() + last.size() == dst_offset) {
+        last.set_size(last.size() + size);
+        continue;
+      }
+    }
+    spk::buffer_copy copy;
+    copy.set_src_offset(s.src_offset);
+    copy.set_dst_offset(dst_offset);
+    copy.set_size(size);
+    copies.push_back(copy);
+  }
+}
+
+}  // namespace
+
+std::optional<uint32_t> find_transfer_queue_family(
+    spk::physical_device& physical_device) {
+  std::vector<spk::queue_family_properties> properties =
+      physical_device.queue_family_properties();
+  for (uint32_t i = 0; i < properties.size(); ++i) {
+    spk::queue_flags flags = properties[i].queue_flags();
+    if ((flags & spk::queue_flags::transfer) &&
+        !(flags & spk::queue_flags::graphics) &&
+        !(flags & spk::queue_flags::compute))
+      return i;
+  }
+  return std::nullopt;
+}
+
+upload_scheduler::upload_scheduler(spk::device& device,
+                                   spk::memory_allocator& memory_allocator,
+                                   spk::queue& queue, uint32_t queue_family,
+                                   uint32_t graphics_queue_family,
+                                   uint64_t staging_size)
+    : device_(device),
+      queue_(queue),
+      queue_family_(queue_family),
+      graphics_family_(graphics_queue_family),
+      staging_buffer_(create_staging_buffer(device, staging_size)),
+      staging_(allocate_staging(memory_allocator, staging_buffer_),
+               staging_size),
+      timeline_(create_timeline(device)),
+      command_pool_(create_command_pool(device, queue_family)),
+      command_buffers_(
+          allocate_command_buffers(device, command_pool_, num_batches)),
+      batches_(num_batches) {
+  DVC_ASSERT(device_.context().dispatch_table().vkWaitSemaphores &&
+                 device_.context().dispatch_table().vkGetSemaphoreCounterValue,
+             "timeline semaphores need an instance created for Vulkan 1.2");
+}
+
+// Pending uploads are submitted, and everything submitted must finish before
+// the staging buffer and command buffers are freed.
+upload_scheduler::~upload_scheduler() { wait(flush()); }
+
+uint64_t upload_scheduler::completed() const {
+  uint64_t value = 0;
+  DVC_ASSERT_EQ(device_.context().dispatch_table().vkGetSemaphoreCounterValue(
+                    device_.context().device(), timeline_, &value),
+                VK_SUCCESS);
+  return value;
+}
+
+void upload_scheduler::wait(uint64_t value) const {
+  if (value == 0) return;
+  VkSemaphore semaphore = timeline_;
+  VkSemaphoreWaitInfo wait_info = {};
+  wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  wait_info.semaphoreCount = 1;
+  wait_info.pSemaphores = &semaphore;
+  wait_info.pValues = &value;
+  DVC_ASSERT_EQ(device_.context().dispatch_table().vkWaitSemaphores(
+                    device_.context().device(), &wait_info, UINT64_MAX),
+                VK_SUCCESS);
+}
+
+// Space is reclaimed a batch at a time.  Batches signal increasing timeline
+// values on one queue, so once a value has been reached every earlier batch
+// is finished too.
+std::optional<memory_range> upload_scheduler::stage(uint64_t size,
+                                                    uint64_t alignment) {
+  uint64_t done = completed();
+  while (true) {
+    for (const batch& b : batches_)
+      if (b.value && b.value <= done) staging_.release(b.ring_marker);
+    if (std::optional<memory_range> range = staging_.allocate(size, alignment))
+      return range;
+
+    // Full: submit what is queued, then wait for the oldest batch in flight.
+    flush_locked();
+    uint64_t oldest = 0;
+    for (const batch& b : batches_)
+      if (b.value > done && (!oldest || b.value < oldest)) oldest = b.value;
+    if (!oldest) return std::nullopt;
+    wait(oldest);
+    done = oldest;
+  }
+}
+
+void upload_scheduler::upload(spk::buffer_ref dst, uint64_t dst_offset,
+                              const void* data, uint64_t size) {
+  std::lock_guard lock(mu_);
+  const uint64_t max_chunk = staging_.capacity() / 2;
+  const char* bytes = static_cast<const char*>(data);
+  while (size) {
+    uint64_t chunk = std::min(size, max_chunk);
+    std::optional<memory_range> range = stage(chunk, buffer_alignment);
+    DVC_ASSERT(range, "staging ring of ", staging_.capacity(),
+               " bytes cannot hold ", chunk);
+    std::memcpy(range->mapped, bytes, chunk);
+    buffer_regions_.push_back(
+        {dst, range->offset - staging_.backing().offset(), dst_offset, chunk});
+    bytes += chunk;
+    dst_offset += chunk;
+    size -= chunk;
+  }
+}
+
+void upload_scheduler::upload(const image_upload& dst, const void* data,
+                              uint64_t size) {
+  std::lock_guard lock(mu_);
+  std::optional<memory_range> range = stage(size, image_alignment);
+  DVC_ASSERT(range, "image upload of ", size,
+             " bytes does not fit in the staging ring of ",
+             staging_.capacity());
+  std::memcpy(range->mapped, data, size);
+  image_regions_.push_back(
+      {dst, range->offset - staging_.backing().offset()});
+}
+
+uint64_t upload_scheduler::flush() {
+  std::lock_guard lock(mu_);
+  return flush_locked();
+}
+
+uint64_t upload_scheduler::flush_locked() {
+  if (buffer_regions_.empty() && image_regions_.empty()) return submitted_;
+
+  batch& b = batches_[next_batch_];
+  wait(b.value);
+  spk::command_buffer command_buffer = command_buffers_.handle(next_batch_);
+  spk::command_buffer_begin_info begin_info;
+  begin_info.set_flags(spk::command_buffer_usage_flags::one_time_submit);
+  command_buffer.begin(begin_info);
+  record(command_buffer);
+  command_buffer.end();
+
+  uint64_t value = submitted_ + 1;
+  spk::timeline_semaphore_submit_info timeline_info;
+  timeline_info.set_signal_semaphore_values({&value, 1});
+  spk::submit_info submit_info;
+  submit_info.set_next(&timeline_info);
+  spk::command_buffer_ref command_buffer_ref = command_buffer;
+  submit_info.set_command_buffers({&command_buffer_ref, 1});
+  spk::semaphore_ref signal = timeline_;
+  submit_info.set_signal_semaphores({&signal, 1});
+  queue_.submit({&submit_info, 1}, VK_NULL_HANDLE);
+
+  submitted_ = value;
+  b.value = value;
+  b.ring_marker = staging_.marker();
+  next_batch_ = (next_batch_ + 1) % num_batches;
+  return value;
+}
+
+void upload_scheduler::record(spk::command_buffer& command_buffer) {
+  const bool transfer_ownership = dedicated_queue();
+  std::vector<spk::buffer_memory_barrier> buffer_releases;
+  std::vector<spk::image_memory_barrier> image_releases;
+
+  // Buffers: group by destination, keeping upload order within each, drop
+  // bytes a later upload overwrites, merge regions contiguous in both staging
+  // and destination, and issue one copy per destination buffer.
+  std::stable_sort(buffer_regions_.begin(), buffer_regions_.end(),
+                   [](const buffer_region& a, const buffer_region& b) {
+                     return a.dst < b.dst;
+                   });
+  std::vector<spk::buffer_copy> copies;
+  for (size_t i = 0; i < buffer_regions_.size();) {
+    spk::buffer_ref dst = buffer_regions_[i].dst;
+    dst_bytes bytes;
+    for (; i < buffer_regions_.size() && buffer_regions_[i].dst == dst; ++i) {
+      const buffer_region& r = buffer_regions_[i];
+      bytes.write(r.dst_offset, r.src_offset, r.size);
+    }
+    copies.clear();
+    bytes.append_copies(copies);
+    command_buffer.copy_buffer(staging_buffer_, dst,
+                               {copies.data(), copies.size()});
+
+    if (transfer_ownership) {
+      spk::buffer_memory_barrier barrier;
+      barrier.set_src_queue_family_index(queue_family_);
+      barrier.set_dst_queue_family_index(graphics_family_);
+      barrier.set_buffer(dst);
+      barrier.set_offset(bytes.low());
+      barrier.set_size(bytes.high() - bytes.low());
+      barrier.set_src_access_mask(spk::access_flags::transfer_write);
+      buffer_releases.push_back(barrier);
+      barrier.set_src_access_mask(spk::access_flags(0));
+      barrier.set_dst_access_mask(spk::access_flags::memory_read);
+      buffer_acquires_.push_back(barrier);
+    }
+  }
+  buffer_regions_.clear();
+
+  // Images: one barrier into transfer_dst_optimal for all of them, the
+  // copies, then one barrier into each image's final layout.
+  if (!image_regions_.empty()) {
+    std::stable_sort(image_regions_.begin(), image_regions_.end(),
+                     [](const image_region& a, const image_region& b) {
+                       return a.dst.image < b.dst.image;
+                     });
+    std::vector<spk::image_memory_barrier> to_transfer;
+    for (const image_region& r : image_regions_) {
+      spk::image_memory_barrier barrier;
+      barrier.set_src_queue_family_index(VK_QUEUE_FAMILY_IGNORED);
+      barrier.set_dst_queue_family_index(VK_QUEUE_FAMILY_IGNORED);
+      barrier.set_image(r.dst.image);
+      barrier.set_subresource_range(range_of(r.dst.subresource));
+      barrier.set_old_layout(spk::image_layout::undefined);
+      barrier.set_new_layout(spk::image_layout::transfer_dst_optimal);
+      barrier.set_dst_access_mask(spk::access_flags::transfer_write);
+      to_transfer.push_back(barrier);
+    }
+    command_buffer.pipeline_barrier(
+        spk::pipeline_stage_flags::top_of_pipe,
+        spk::pipeline_stage_flags::transfer, spk::dependency_flags(0),
+        {nullptr, 0}, {nullptr, 0}, {to_transfer.data(), to_transfer.size()});
+
+    std::vector<spk::buffer_image_copy> image_copies;
+    for (size_t i = 0; i < image_regions_.size();) {
+      spk::image_ref image = image_regions_[i].dst.image;
+      image_copies.clear();
+      for (; i < image_regions_.size() && image_regions_[i].dst.image == image;
+           ++i) {
+        const image_region& r = image_regions_[i];
+        spk::buffer_image_copy copy;
+        copy.set_buffer_offset(r.src_offset);
+        copy.set_buffer_row_length(0);
+        copy.set_buffer_image_height(0);
+        copy.set_image_subresource(r.dst.subresource);
+        copy.set_image_offset(r.dst.offset);
+        copy.set_image_extent(r.dst.extent);
+        image_copies.push_back(copy);
+      }
+      command_buffer.copy_buffer_to_image(
+          staging_buffer_, image, spk::image_layout::transfer_dst_optimal,
+          {image_copies.data(), image_copies.size()});
+    }
+
+    std::vector<spk::image_memory_barrier> to_final;
+    for (const image_region& r : image_regions_) {
+      spk::image_memory_barrier barrier;
+      barrier.set_image(r.dst.image);
+      barrier.set_subresource_range(range_of(r.dst.subresource));
+      barrier.set_old_layout(spk::image_layout::transfer_dst_optimal);
+      barrier.set_new_layout(r.dst.final_layout);
+      barrier.set_src_access_mask(spk::access_flags::transfer_write);
+      if (transfer_ownership) {
+        barrier.set_src_queue_family_index(queue_family_);
+        barrier.set_dst_queue_family_index(graphics_family_);
+        image_releases.push_back(barrier);
+        barrier.set_src_access_mask(spk::access_flags(0));
+        barrier.set_dst_access_mask(spk::access_flags::memory_read);
+        image_acquires_.push_back(barrier);
+      } else {
+        barrier.set_src_queue_family_index(VK_QUEUE_FAMILY_IGNORED);
+        barrier.set_dst_queue_family_index(VK_QUEUE_FAMILY_IGNORED);
+        barrier.set_dst_access_mask(spk::access_flags::memory_read);
+        to_final.push_back(barrier);
+      }
+    }
+    if (!to_final.empty())
+      command_buffer.pipeline_barrier(
+          spk::pipeline_stage_flags::transfer,
+          spk::pipeline_stage_flags::all_commands, spk::dependency_flags(0),
+          {nullptr, 0}, {nullptr, 0}, {to_final.data(), to_final.size()});
+    image_regions_.clear();
+  }
+
+  if (!buffer_releases.empty() || !image_releases.empty())
+    command_buffer.pipeline_barrier(
+        spk::pipeline_stage_flags::transfer,
+        spk::pipeline_stage_flags::bottom_of_pipe, spk::dependency_flags(0),
+        {nullptr, 0}, {buffer_releases.data(), buffer_releases.size()},
+        {image_releases.data(), image_releases.size()});
+}
+
+void upload_scheduler::record_acquires(spk::command_buffer& command_buffer) {
+  std::lock_guard lock(mu_);
+  if (buffer_acquires_.empty() && image_acquires_.empty()) return;
+  command_buffer.pipeline_barrier(
+      spk::pipeline_stage_flags::top_of_pipe,
+      spk::pipeline_stage_flags::all_commands, spk::dependency_flags(0),
+      {nullptr, 0}, {buffer_acquires_.data(), buffer_acquires_.size()},
+      {image_acquires_.data(), image_acquires_.size()});
+  buffer_acquires_.clear();
+  image_acquires_.clear();
+}
+
+}  // namespace spk
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "spk/memory_allocator.h"
+#include "spk/spock.h"
+
+namespace spk {
+
+// A queue family with transfer support but neither graphics nor compute, if
+// the physical device has one.  Such families are usually backed by DMA
+// engines that copy concurrently with rendering.
+std::optional<uint32_t> find_transfer_queue_family(
+    spk::physical_device& physical_device);
+
+// Where and how an upload lands in an image.  The image is transitioned from
+// undefined, so the upload must cover every texel that will be read.
+struct image_upload {
+  spk::image_ref image = VK_NULL_HANDLE;
+  spk::image_subresource_layers subresource;
+  spk::offset_3d offset;
+  spk::extent_3d extent;
+  spk::image_layout final_layout = spk::image_layout::shader_read_only_optimal;
+};
+
+// Uploads to device local buffers and images through a host visible staging
+// ring.  upload() copies the data into staging immediately and queues a copy
+// region; flush() records every queued region in one command buffer, merging
+// adjacent buffer regions and issuing one copy per destination, and submits
+// it signaling the next value of a timeline semaphore.  Where buffer uploads
+// overlap, the last one wins.  Submissions that
+// read the uploaded resources wait for that value on the timeline.
+//
+// When the queue belongs to a different family than the graphics queue
+// (see find_transfer_queue_family), exclusive resources are released by the
+// transfer queue and record_acquires() records the matching acquire barriers
+// on the graphics side.
+//
+// Requires an instance created for Vulkan 1.2 and the timelineSemaphore device
+// feature.  Thread-safe.
+class upload_scheduler : nomove {
+ public:
+  static constexpr uint64_t default_staging_size = 16 * 1024 * 1024;
+  static constexpr size_t num_batches = 3;
+
+  upload_scheduler(spk::device& device,
+                   spk::memory_allocator& memory_allocator, spk::queue& queue,
+                   uint32_t queue_family, uint32_t graphics_queue_family,
+                   uint64_t staging_size = default_staging_size);
+  ~upload_scheduler();
+
+  // Buffer uploads larger than the staging ring are split into several
+  // copies, flushing as needed.
+  void upload(spk::buffer_ref dst, uint64_t dst_offset, const void* data,
+              uint64_t size);
+  // Image uploads must fit in the staging ring.  data is tightly packed.
+  void upload(const image_upload& dst, const void* data, uint64_t size);
+
+  // Submits everything queued since the last flush.  Returns the timeline
+  // value that will be signaled when it completes, or the last submitted
+  // value if nothing was queued.
+  uint64_t flush();
+
+  // Records the queue family acquire barriers for every submitted upload not
+  // yet acquired.  The submission containing command_buffer must wait for
+  // the value returned by the flush() that submitted them.  Does nothing if
+  // the upload queue is in the graphics family.
+  void record_acquires(spk::command_buffer& command_buffer);
+
+  spk::semaphore_ref timeline() const { return timeline_; }
+  uint64_t completed() const;
+  void wait(uint64_t value) const;
+
+  bool dedicated_queue() const { return queue_family_ != graphics_family_; }
+
+ private:
+  struct buffer_region {
+    spk::buffer_ref dst;
+    uint64_t src_offset;
+    uint64_t dst_offset;
+    uint64_t size;
+  };
+  struct image_region {
+    image_upload dst;
+    uint64_t src_offset;
+  };
+  // Batch i records into command_buffers_.handle(i).
+  struct batch {
+    uint64_t value = 0;
+    uint64_t ring_marker = 0;
+  };
+
+  std::optional<memory_range> stage(uint64_t size, uint64_t alignment);
+  uint64_t flush_locked();
+  void record(spk::command_buffer& command_buffer);
+
+  spk::device& device_;
+  spk::queue& queue_;
+  const uint32_t queue_family_;
+  const uint32_t graphics_family_;
+
+  spk::buffer staging_buffer_;
+  spk::ring_pool staging_;
+  spk::semaphore timeline_;
+  spk::command_pool command_pool_;
+  spk::command_buffer_array command_buffers_;
+
+  mutable std::mutex mu_;
+  std::vector<buffer_region> buffer_regions_;
+  std::vector<image_region> image_regions_;
+  std::vector<batch> batches_;
+  size_t next_batch_ = 0;
+  uint64_t submitted_ = 0;
+  std::vector<spk::buffer_memory_barrier> buffer_acquires_;
+  std::vector<spk::image_memory_barrier> image_acquires_;
+};
+
+}  // namespace spk
@@ -72,6 +72,9 @@ struct Handle : Entity {
   const Command* destructor = nullptr;
   bool destructor_parent;
   const Handle* parent = nullptr;
+  // free_* command that releases an array of these from a pool in one call.
+  const Command* batch_destructor = nullptr;
+  const Handle* pool = nullptr;
 };
 
 struct Name : vks::Type {
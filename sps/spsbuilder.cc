@@ -430,14 +430,16 @@ std::vector<sps::ManualTranslation> Registry::manual_translations = {
 
      R"(
     inline spk::device create_device(
-        spk::device_create_info const& pCreateInfo);
+        spk::device_create_info const& pCreateInfo,
+        const spk::device_layer& layer = {});
 )",
      R"(inline spk::device physical_device::create_device(
-    spk::device_create_info const& create_info) {
+    spk::device_create_info const& create_info,
+    const spk::device_layer& layer) {
   spk::device_ref device_ref;
   dispatch_table().create_device(handle_, &create_info, allocation_callbacks_,
                                  &device_ref);
-  return device(device_ref, *this, allocation_callbacks_);
+  return device(device_ref, *this, allocation_callbacks_, layer);
 }
 )"},
     {"physical_device", "get_physical_device_generated_commands_properties_nvx",
@@ -467,7 +469,7 @@ device::create_graphics_pipeline(spk::pipeline_cache_ref pipeline_cache,
                           const spk::graphics_pipeline_create_info& create_info) {
   spk::pipeline_ref ref;
   dispatch_table().create_graphics_pipelines(handle_,pipeline_cache, 1, &create_info, allocation_callbacks_, &ref);
-  return {ref,*this,dispatch_table(),allocation_callbacks_};
+  return adopt<spk::pipeline>(ref);
 }
 
 inline std::vector<spk::pipeline>
@@ -478,7 +480,7 @@ device::create_graphics_pipelines(spk::pipeline_cache_ref pipeline_cache,
   std::vector<spk::pipeline> pipelines;
   pipelines.reserve(create_infos.size());
   for (auto pipeline_ref : pipeline_refs)
-    pipelines.emplace_back(pipeline_ref,*this,dispatch_table(),allocation_callbacks_);
+    pipelines.push_back(adopt<spk::pipeline>(pipeline_ref));
   return pipelines;
 }
 )"},
@@ -486,19 +488,15 @@ device::create_graphics_pipelines(spk::pipeline_cache_ref pipeline_cache,
         "device",
         "allocate_command_buffers",
         R"(
-inline std::vector<spk::command_buffer>
+inline spk::command_buffer_array
 allocate_command_buffers(spk::command_buffer_allocate_info& allocate_info);
 )",
         R"(
-inline std::vector<spk::command_buffer>
+inline spk::command_buffer_array
 device::allocate_command_buffers(spk::command_buffer_allocate_info& allocate_info) {
   std::vector<spk::command_buffer_ref> command_buffer_refs(allocate_info.command_buffer_count());
   dispatch_table().allocate_command_buffers(handle_, &allocate_info, command_buffer_refs.data());
-  std::vector<spk::command_buffer> command_buffers;
-  command_buffers.reserve(allocate_info.command_buffer_count());
-  for (auto command_buffer_ref : command_buffer_refs)
-    command_buffers.emplace_back(command_buffer_ref,*this,dispatch_table(),allocation_callbacks_);
-  return command_buffers;
+  return {allocate_info.command_pool(), std::move(command_buffer_refs), context()};
 }
 )",
     },
@@ -506,19 +504,18 @@ device::allocate_command_buffers(spk::command_buffer_allocate_info& allocate_inf
         "device",
         "allocate_descriptor_sets",
         R"(
-inline std::vector<spk::descriptor_set>
+// The sets are freed when the array is destroyed, so the pool must have been
+// created with descriptor_pool_create_flags::free_descriptor_set.  Otherwise
+// release() the array and reset the pool instead.
+inline spk::descriptor_set_array
 allocate_descriptor_sets(spk::descriptor_set_allocate_info& allocate_info);
 )",
         R"(
-inline std::vector<spk::descriptor_set>
+inline spk::descriptor_set_array
 device::allocate_descriptor_sets(spk::descriptor_set_allocate_info& allocate_info) {
   std::vector<spk::descriptor_set_ref> descriptor_set_refs(allocate_info.set_layouts().size());
   dispatch_table().allocate_descriptor_sets(handle_, &allocate_info, descriptor_set_refs.data());
-  std::vector<spk::descriptor_set> descriptor_sets;
-  descriptor_sets.reserve(allocate_info.set_layouts().size());
-  for (auto descriptor_set_ref : descriptor_set_refs)
-    descriptor_sets.emplace_back(descriptor_set_ref,*this,dispatch_table(),allocation_callbacks_);
-  return descriptor_sets;
+  return {allocate_info.descriptor_pool(), std::move(descriptor_set_refs), context()};
 }
 )",
     },
@@ -537,7 +534,7 @@ device::create_compute_pipeline(spk::pipeline_cache_ref pipeline_cache,
                          const spk::compute_pipeline_create_info& create_info) {
  spk::pipeline_ref pipeline_ref;
  dispatch_table().create_compute_pipelines(handle_,pipeline_cache, 1, &create_info, allocation_callbacks_, &pipeline_ref);
- return {pipeline_ref,*this,dispatch_table(),allocation_callbacks_};
+ return adopt<spk::pipeline>(pipeline_ref);
 }
 
 inline std::vector<spk::pipeline>
@@ -548,7 +545,7 @@ device::create_compute_pipelines(spk::pipeline_cache_ref pipeline_cache,
  std::vector<spk::pipeline> pipelines;
  pipelines.reserve(create_infos.size());
  for (auto pipeline_ref : pipeline_refs)
-   pipelines.emplace_back(pipeline_ref,*this,dispatch_table(),allocation_callbacks_);
+   pipelines.push_back(adopt<spk::pipeline>(pipeline_ref));
  return pipelines;
 }
 )"},
@@ -565,7 +562,7 @@ device::create_shared_swapchains_khr(spk::array_view<const spk::swapchain_create
   std::vector<spk::swapchain_khr> swapchains;
   swapchains.reserve(create_infos.size());
   for (auto swapchain_ref : swapchain_refs)
-    swapchains.emplace_back(swapchain_ref,*this,dispatch_table(),allocation_callbacks_);
+    swapchains.push_back(adopt<spk::swapchain_khr>(swapchain_ref));
   return swapchains;
 }
 )"},
@@ -585,7 +582,7 @@ device::create_ray_tracing_pipeline_nv(spk::pipeline_cache_ref pipeline_cache,
                      const spk::ray_tracing_pipeline_create_info_nv& create_info) {
   spk::pipeline_ref pipeline_ref;
   dispatch_table().create_ray_tracing_pipelines_nv(handle_,pipeline_cache, 1, &create_info, allocation_callbacks_, &pipeline_ref);
-  return {pipeline_ref,*this,dispatch_table(),allocation_callbacks_};
+  return adopt<spk::pipeline>(pipeline_ref);
 }
 
 inline std::vector<spk::pipeline>
@@ -596,7 +593,7 @@ device::create_ray_tracing_pipelines_nv(spk::pipeline_cache_ref pipeline_cache,
   std::vector<spk::pipeline> pipelines;
   pipelines.reserve(create_infos.size());
   for (auto pipeline_ref : pipeline_refs)
-    pipelines.emplace_back(pipeline_ref,*this,dispatch_table(),allocation_callbacks_);
+    pipelines.push_back(adopt<spk::pipeline>(pipeline_ref));
   return pipelines;
 }
 )"},
@@ -609,21 +606,20 @@ device::create_ray_tracing_pipelines_nv(spk::pipeline_cache_ref pipeline_cache,
      {
       uint32_t size_;
       spk::result success1_ = dispatch_table().get_swapchain_images_khr(
-          parent_, handle_, &size_, nullptr);
+          dispatch_table().device, handle_, &size_, nullptr);
       if (success1_ != spk::result::success)
         throw spk::unexpected_command_result(success1_,
         "vkGetSwapchainImagesKHR");
       std::vector<spk::image_ref> result_(size_);
       spk::result success2_ = dispatch_table().get_swapchain_images_khr(
-          parent_, handle_, &size_, result_.data());
+          dispatch_table().device, handle_, &size_, result_.data());
       if (success2_ != spk::result::success)
         throw spk::unexpected_command_result(success2_,
         "vkGetSwapchainImagesKHR");
       std::vector<spk::image> result2_;
       result2_.reserve(size_);
       for (auto ref : result_)
-        result2_.emplace_back(ref, parent_, dispatch_table(),
-                              allocation_callbacks_);
+        result2_.push_back(adopt<spk::image>(ref));
       return result2_;
     }
     )"},
@@ -879,8 +875,26 @@ void build_command(sps::Registry& sreg, const vks::Registry& vreg) {
     if (handle_parents.count(handle->fullname))
       handle->parent = handle_names.at(handle_parents.at(handle->fullname));
 
+  for (const sps::Command* command : sreg.commands) {
+    if (!dvc::startswith(command->name, "free_")) continue;
+    if (command->params.size() != 4) continue;
+    const sps::Param& count = command->params.at(2);
+    const sps::Param& array = command->params.at(3);
+    if (!array.param->len || array.param->len.value() != count.name) continue;
+    const vks::Type* element = sps::get_pointee(array.stype);
+    if (auto const_ = dynamic_cast<const vks::Const*>(element))
+      element = const_->T;
+    const sps::Handle* pool = get_handle(command->params.at(1).stype);
+    const sps::Handle* batched = get_handle(element);
+    if (!pool || !batched) continue;
+    sps::Handle* handle = sreg.handle_map.at(batched->handle);
+    DVC_ASSERT(handle->batch_destructor == nullptr, command->name);
+    handle->batch_destructor = command;
+    handle->pool = pool;
+  }
+
   for (const sps::Handle* handle : sreg.handles) {
-    if (handle->destructor == nullptr)
+    if (handle->destructor == nullptr && handle->batch_destructor == nullptr)
       DVC_ERROR("no destructor: ", handle->fullname);
   }
 
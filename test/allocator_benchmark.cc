@@ -0,0 +1,233 @@
+// Measures driver-heavy object churn (compute pipeline creation, descriptor
+// set and command buffer allocation) with the driver's own host allocator,
+// with spk::scoped_allocator, and with spk::scoped_allocator putting each
+// iteration's objects in a linear_arena that is reset after the iteration.
+// Intended to be run against a software ICD so that host allocation
+// dominates, eg:
+//
+//   allocator_benchmark --iterations 1000 \
+//     --vulkan_library /usr/share/vulkan/icd.d/lvp_icd.x86_64.json
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+
+#include "dvc/file.h"
+#include "dvc/log.h"
+#include "dvc/opts.h"
+#include "dvc/terminate.h"
+#include "spk/allocation_statistics.h"
+#include "spk/allocators.h"
+#include "spk/loader.h"
+#include "spk/spock.h"
+
+namespace {
+
+uint64_t DVC_OPTION(iterations, -, 1000, "iterations per workload");
+uint64_t DVC_OPTION(batch, -, 64, "descriptor sets / command buffers per pool");
+std::string DVC_OPTION(vulkan_library, -, "",
+                       "Vulkan loader, ICD library or ICD manifest to load "
+                       "instead of libvulkan.so.1");
+bool DVC_OPTION(statistics, -, false,
+                "also run with spk::statistics_allocator and print its totals");
+
+uint32_t select_compute_queue_family(spk::physical_device& physical_device) {
+  std::vector<spk::queue_family_properties> properties =
+      physical_device.queue_family_properties();
+  for (uint32_t i = 0; i < properties.size(); ++i)
+    if (properties[i].queue_flags() & spk::queue_flags::compute) return i;
+  DVC_FATAL("no compute queue family");
+}
+
+spk::device create_device(spk::physical_device& physical_device,
+                          uint32_t queue_family_index) {
+  spk::device_queue_create_info queue_create_info;
+  queue_create_info.set_queue_family_index(queue_family_index);
+  float queue_priority = 1.0;
+  queue_create_info.set_queue_priorities({&queue_priority, 1});
+  spk::device_create_info create_info;
+  create_info.set_queue_create_infos({&queue_create_info, 1});
+  return physical_device.create_device(create_info);
+}
+
+spk::shader_module create_shader(spk::device& device,
+                                 const std::filesystem::path& path) {
+  DVC_ASSERT(exists(path), "file not found: ", path);
+  std::string code = dvc::load_file(path);
+  spk::shader_module_create_info create_info;
+  create_info.set_code_size(code.size());
+  create_info.set_p_code((uint32_t*)code.data());
+  return device.create_shader_module(create_info);
+}
+
+spk::descriptor_set_layout create_descriptor_set_layout(spk::device& device) {
+  spk::descriptor_set_layout_binding binding;
+  binding.set_binding(0);
+  binding.set_descriptor_type(spk::descriptor_type::storage_buffer);
+  binding.set_descriptor_count(1);
+  binding.set_stage_flags(spk::shader_stage_flags::compute);
+  spk::descriptor_set_layout_create_info create_info;
+  create_info.set_bindings({&binding, 1});
+  return device.create_descriptor_set_layout(create_info);
+}
+
+// Host allocation callbacks for one run().  The instance and device live for
+// the whole run and use device_callbacks.  Each iteration's transient objects
+// are created with object_callbacks, and reset is called after every
+// iteration, once they have all been destroyed.
+struct run_allocators {
+  const spk::allocation_callbacks* device_callbacks = nullptr;
+  const spk::allocation_callbacks* object_callbacks = nullptr;
+  std::function<void()> reset = [] {};
+};
+
+template <typename F>
+void measure(const char* allocator, const char* workload,
+             const run_allocators& allocators, F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    f();
+    allocators.reset();
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << allocator << " " << workload << ": "
+            << std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                       .count() /
+                   iterations
+            << " ns/iteration" << std::endl;
+}
+
+// The transient objects are created and destroyed through the dispatch table,
+// as spk's wrappers always use their device's allocation callbacks.
+void run(spk::loader& loader, const char* name,
+         const run_allocators& allocators) {
+  spk::instance_create_info instance_create_info;
+  spk::instance instance = loader.create_instance(
+      instance_create_info, allocators.device_callbacks);
+  std::vector<spk::physical_device> physical_devices =
+      instance.enumerate_physical_devices();
+  DVC_ASSERT(!physical_devices.empty(), "no physical devices");
+  spk::physical_device& physical_device = physical_devices.at(0);
+  uint32_t queue_family_index = select_compute_queue_family(physical_device);
+  spk::device device = create_device(physical_device, queue_family_index);
+  const spk::device_dispatch_table& table = device.dispatch_table();
+  const spk::allocation_callbacks* object_callbacks =
+      allocators.object_callbacks;
+
+  spk::shader_module shader =
+      create_shader(device, "test/allocator_benchmark.comp.spv");
+  spk::descriptor_set_layout descriptor_set_layout =
+      create_descriptor_set_layout(device);
+  spk::descriptor_set_layout_ref descriptor_set_layout_ref =
+      descriptor_set_layout;
+  spk::pipeline_layout_create_info pipeline_layout_create_info;
+  pipeline_layout_create_info.set_set_layouts({&descriptor_set_layout_ref, 1});
+  spk::pipeline_layout pipeline_layout =
+      device.create_pipeline_layout(pipeline_layout_create_info);
+
+  measure(name, "create_compute_pipeline", allocators, [&] {
+    spk::pipeline_shader_stage_create_info stage;
+    stage.set_module(shader);
+    stage.set_name("main");
+    stage.set_stage(spk::shader_stage_flags::compute);
+    spk::compute_pipeline_create_info create_info;
+    create_info.set_stage(stage);
+    create_info.set_layout(pipeline_layout);
+    spk::pipeline_ref pipeline;
+    spk::result result = table.create_compute_pipelines(
+        device, VK_NULL_HANDLE, 1, &create_info, object_callbacks, &pipeline);
+    DVC_ASSERT(result == spk::result::success);
+    table.destroy_pipeline(device, pipeline, object_callbacks);
+  });
+
+  measure(name, "allocate_descriptor_sets", allocators, [&] {
+    spk::descriptor_pool_size size;
+    size.set_type(spk::descriptor_type::storage_buffer);
+    size.set_descriptor_count(batch);
+    spk::descriptor_pool_create_info pool_create_info;
+    pool_create_info.set_flags(
+        spk::descriptor_pool_create_flags::free_descriptor_set);
+    pool_create_info.set_max_sets(batch);
+    pool_create_info.set_pool_sizes({&size, 1});
+    spk::descriptor_pool_ref pool;
+    table.create_descriptor_pool(device, &pool_create_info, object_callbacks,
+                                 &pool);
+    std::vector<spk::descriptor_set_layout_ref> layouts(
+        batch, descriptor_set_layout_ref);
+    spk::descriptor_set_allocate_info allocate_info;
+    allocate_info.set_descriptor_pool(pool);
+    allocate_info.set_set_layouts({layouts.data(), layouts.size()});
+    std::vector<spk::descriptor_set_ref> sets(batch);
+    table.allocate_descriptor_sets(device, &allocate_info, sets.data());
+    table.free_descriptor_sets(device, pool, sets.size(), sets.data());
+    table.destroy_descriptor_pool(device, pool, object_callbacks);
+  });
+
+  measure(name, "allocate_command_buffers", allocators, [&] {
+    spk::command_pool_create_info pool_create_info;
+    pool_create_info.set_queue_family_index(queue_family_index);
+    spk::command_pool_ref pool;
+    table.create_command_pool(device, &pool_create_info, object_callbacks,
+                              &pool);
+    spk::command_buffer_allocate_info allocate_info;
+    allocate_info.set_command_pool(pool);
+    allocate_info.set_level(spk::command_buffer_level::primary);
+    allocate_info.set_command_buffer_count(batch);
+    std::vector<spk::command_buffer_ref> command_buffers(batch);
+    table.allocate_command_buffers(device, &allocate_info,
+                                   command_buffers.data());
+    spk::command_buffer_begin_info begin_info;
+    for (spk::command_buffer_ref command_buffer : command_buffers) {
+      table.begin_command_buffer(command_buffer, &begin_info);
+      table.end_command_buffer(command_buffer);
+    }
+    table.free_command_buffers(device, pool, command_buffers.size(),
+                               command_buffers.data());
+    table.destroy_command_pool(device, pool, object_callbacks);
+  });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  dvc::init_options(argc, argv);
+  dvc::install_terminate_handler();
+
+  spk::loader loader(vulkan_library.empty() ? nullptr
+                                            : vulkan_library.c_str());
+
+  run(loader, "driver", {});
+
+  spk::scoped_allocator allocator;
+  spk::allocation_callbacks callbacks =
+      spk::create_allocation_callbacks(&allocator);
+  run(loader, "spk::scoped_allocator", {&callbacks, &callbacks});
+
+  // Only the transient objects go through the arena, which is reset after
+  // every iteration.
+  spk::linear_arena arena;
+  spk::scoped_allocator arena_allocator(&arena);
+  spk::allocation_callbacks arena_callbacks =
+      spk::create_allocation_callbacks(&arena_allocator);
+  size_t arena_peak = 0;
+  run(loader, "spk::scoped_allocator+linear_arena",
+      {&callbacks, &arena_callbacks, [&] {
+         arena_peak = std::max(arena_peak, arena.bytes_used());
+         arena.reset();
+       }});
+  std::cout << "linear_arena peak per iteration: " << arena_peak << " bytes"
+            << std::endl;
+
+  if (statistics) {
+    spk::statistics_allocator<spk::scoped_allocator> statistics_allocator;
+    spk::allocation_callbacks statistics_callbacks =
+        spk::create_allocation_callbacks(&statistics_allocator);
+    run(loader, "spk::statistics_allocator",
+        {&statistics_callbacks, &statistics_callbacks});
+    std::cout << statistics_allocator.snapshot();
+  }
+}
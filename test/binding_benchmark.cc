@@ -0,0 +1,345 @@
+// Measures what each binding adds on top of the driver by issuing the same
+// workloads through the raw function pointers of spk's dispatch tables and
+// through spk's wrappers.  Each workload reports ns, user-space instructions
+// (where perf events are available) and operator new calls per Vulkan call.
+//
+// By default the program runs against spk's null driver, so the driver
+// costs next to nothing and the numbers are those of the bindings.
+// --null_driver=false loads the system driver instead, or with
+// --vulkan_library a specific one, eg:
+//
+//   binding_benchmark --null_driver=false \
+//     --vulkan_library /usr/share/vulkan/icd.d/lvp_icd.x86_64.json
+//
+// Command buffers are recorded but never submitted.  The recorded commands
+// are descriptor set binds, which are valid outside a render pass and
+// without a bound pipeline, so that recording is valid on a real driver.
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "dvc/log.h"
+#include "dvc/opts.h"
+#include "dvc/terminate.h"
+#include "spk/loader.h"
+#include "spk/null_driver.h"
+#include "spk/spock.h"
+
+namespace {
+
+uint64_t DVC_OPTION(iterations, -, 1000, "iterations per workload");
+uint64_t DVC_OPTION(binds, -, 1000,
+                    "descriptor set binds per recorded command buffer");
+bool DVC_OPTION(null_driver, -, true,
+                "use spk's null driver instead of the system ICD");
+std::string DVC_OPTION(vulkan_library, -, "",
+                       "with --null_driver=false, the Vulkan loader, ICD "
+                       "library or ICD manifest to load");
+
+std::atomic<uint64_t> allocations{0};
+
+}  // namespace
+
+void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+// Counts user-space instructions retired by this thread.
+class instruction_counter {
+ public:
+  instruction_counter() {
+    perf_event_attr attr = {};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+  ~instruction_counter() {
+    if (fd_ >= 0) close(fd_);
+  }
+
+  bool available() const { return fd_ >= 0; }
+  void start() {
+    ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  uint64_t stop() {
+    ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t count = 0;
+    if (read(fd_, &count, sizeof(count)) != sizeof(count)) return 0;
+    return count;
+  }
+
+ private:
+  int fd_;
+};
+
+instruction_counter instructions;
+
+// Runs f iterations times; each run makes calls Vulkan calls.
+template <typename F>
+void measure(const char* workload, const char* binding, uint64_t calls,
+             F&& f) {
+  f();  // Warm up.
+  uint64_t allocations_before = allocations.load();
+  if (instructions.available()) instructions.start();
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < iterations; ++i) f();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  uint64_t instructions_used =
+      instructions.available() ? instructions.stop() : 0;
+  uint64_t allocations_made = allocations.load() - allocations_before;
+
+  double n = double(iterations) * calls;
+  std::cout << std::left << std::setw(20) << workload << std::setw(12)
+            << binding << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10)
+            << std::chrono::duration<double, std::nano>(elapsed).count() / n
+            << " ns/call";
+  if (instructions.available())
+    std::cout << std::setw(10) << instructions_used / n << " instructions/call";
+  std::cout << std::setprecision(2) << std::setw(8) << allocations_made / n
+            << " allocations/call" << std::endl;
+}
+
+spk::device create_device(spk::physical_device& physical_device) {
+  spk::device_queue_create_info queue_create_info;
+  queue_create_info.set_queue_family_index(0);
+  float queue_priority = 1.0;
+  queue_create_info.set_queue_priorities({&queue_priority, 1});
+  spk::device_create_info create_info;
+  create_info.set_queue_create_infos({&queue_create_info, 1});
+  return physical_device.create_device(create_info);
+}
+
+spk::descriptor_set_layout create_descriptor_set_layout(spk::device& device) {
+  spk::descriptor_set_layout_binding binding;
+  binding.set_binding(0);
+  binding.set_descriptor_type(spk::descriptor_type::storage_buffer);
+  binding.set_descriptor_count(1);
+  binding.set_stage_flags(spk::shader_stage_flags::compute);
+  spk::descriptor_set_layout_create_info create_info;
+  create_info.set_bindings({&binding, 1});
+  return device.create_descriptor_set_layout(create_info);
+}
+
+spk::pipeline_layout create_pipeline_layout(
+    spk::device& device, spk::descriptor_set_layout_ref set_layout) {
+  spk::pipeline_layout_create_info create_info;
+  create_info.set_set_layouts({&set_layout, 1});
+  return device.create_pipeline_layout(create_info);
+}
+
+spk::descriptor_pool create_descriptor_pool(spk::device& device) {
+  spk::descriptor_pool_size size;
+  size.set_type(spk::descriptor_type::storage_buffer);
+  size.set_descriptor_count(1);
+  spk::descriptor_pool_create_info create_info;
+  // descriptor_set_array frees its sets.
+  create_info.set_flags(spk::descriptor_pool_create_flags::free_descriptor_set);
+  create_info.set_max_sets(1);
+  create_info.set_pool_sizes({&size, 1});
+  return device.create_descriptor_pool(create_info);
+}
+
+spk::buffer_create_info storage_buffer_create_info() {
+  spk::buffer_create_info create_info;
+  create_info.set_size(4096);
+  create_info.set_usage(spk::buffer_usage_flags::storage_buffer);
+  create_info.set_sharing_mode(spk::sharing_mode::exclusive);
+  return create_info;
+}
+
+// Binds memory to buffer, through the raw table as it is only setup.
+VkDeviceMemory bind_memory(spk::device& device, VkBuffer buffer) {
+  const spk::device_dispatch_table& t = device.context().dispatch_table();
+  VkMemoryRequirements requirements;
+  t.vkGetBufferMemoryRequirements(device, buffer, &requirements);
+  uint32_t type = 0;
+  while (!(requirements.memoryTypeBits & (1u << type))) ++type;
+  VkMemoryAllocateInfo allocate_info = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+  allocate_info.allocationSize = requirements.size;
+  allocate_info.memoryTypeIndex = type;
+  VkDeviceMemory memory;
+  DVC_ASSERT(t.vkAllocateMemory(device, &allocate_info, nullptr, &memory) ==
+                 VK_SUCCESS,
+             "vkAllocateMemory failed");
+  t.vkBindBufferMemory(device, buffer, memory, 0);
+  return memory;
+}
+
+void run(spk::loader& loader) {
+  spk::instance instance = loader.create_instance(spk::instance_create_info());
+  std::cout << loader.startup() << std::endl;
+  std::vector<spk::physical_device> physical_devices =
+      instance.enumerate_physical_devices();
+  DVC_ASSERT(!physical_devices.empty(), "no physical devices");
+  spk::physical_device& physical_device = physical_devices.at(0);
+  spk::device device = create_device(physical_device);
+  std::cout << physical_device.properties().device_name().data() << std::endl;
+
+  spk::command_pool_create_info pool_create_info;
+  pool_create_info.set_flags(
+      spk::command_pool_create_flags::reset_command_buffer);
+  pool_create_info.set_queue_family_index(0);
+  spk::command_pool pool = device.create_command_pool(pool_create_info);
+  spk::command_buffer_allocate_info allocate_info;
+  allocate_info.set_command_pool(pool);
+  allocate_info.set_level(spk::command_buffer_level::primary);
+  allocate_info.set_command_buffer_count(1);
+  spk::command_buffer_array command_buffers =
+      device.allocate_command_buffers(allocate_info);
+  spk::command_buffer command_buffer = command_buffers.handle(0);
+
+  spk::descriptor_set_layout descriptor_set_layout =
+      create_descriptor_set_layout(device);
+  spk::descriptor_set_layout_ref descriptor_set_layout_ref =
+      descriptor_set_layout;
+  spk::pipeline_layout pipeline_layout =
+      create_pipeline_layout(device, descriptor_set_layout);
+  spk::descriptor_pool descriptor_pool = create_descriptor_pool(device);
+  spk::descriptor_set_allocate_info set_allocate_info;
+  set_allocate_info.set_descriptor_pool(descriptor_pool);
+  set_allocate_info.set_set_layouts({&descriptor_set_layout_ref, 1});
+  spk::descriptor_set_array descriptor_sets =
+      device.allocate_descriptor_sets(set_allocate_info);
+  spk::buffer buffer = device.create_buffer(storage_buffer_create_info());
+  VkDeviceMemory memory = bind_memory(device, buffer);
+
+  const spk::instance_dispatch_table& it = instance.dispatch_table();
+  const spk::device_dispatch_table& dt = device.context().dispatch_table();
+  VkInstance vk_instance = instance;
+  VkPhysicalDevice vk_physical_device = physical_device;
+  VkDevice vk_device = device;
+  VkCommandBuffer vk_command_buffer = command_buffer;
+  VkPipelineLayout vk_pipeline_layout = pipeline_layout;
+  VkDescriptorSet vk_descriptor_set = descriptor_sets[0];
+  VkBuffer vk_buffer = buffer;
+
+  // Recording descriptor set binds.
+
+  measure("record_binds", "c", binds + 2, [&] {
+    VkCommandBufferBeginInfo begin_info = {
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    dt.vkBeginCommandBuffer(vk_command_buffer, &begin_info);
+    for (uint64_t i = 0; i < binds; ++i)
+      dt.vkCmdBindDescriptorSets(vk_command_buffer,
+                                 VK_PIPELINE_BIND_POINT_COMPUTE,
+                                 vk_pipeline_layout, 0, 1, &vk_descriptor_set,
+                                 0, nullptr);
+    dt.vkEndCommandBuffer(vk_command_buffer);
+  });
+  measure("record_binds", "spk", binds + 2, [&] {
+    command_buffer.begin(spk::command_buffer_begin_info());
+    spk::descriptor_set_ref descriptor_set_ref = descriptor_sets[0];
+    for (uint64_t i = 0; i < binds; ++i)
+      command_buffer.bind_descriptor_sets(spk::pipeline_bind_point::compute,
+                                          pipeline_layout, 0,
+                                          {&descriptor_set_ref, 1},
+                                          {nullptr, 0});
+    command_buffer.end();
+  });
+
+  // Updating one storage buffer descriptor.
+
+  measure("update_descriptors", "c", 1, [&] {
+    VkDescriptorBufferInfo buffer_info = {vk_buffer, 0, VK_WHOLE_SIZE};
+    VkWriteDescriptorSet write = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    write.dstSet = vk_descriptor_set;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &buffer_info;
+    dt.vkUpdateDescriptorSets(vk_device, 1, &write, 0, nullptr);
+  });
+  measure("update_descriptors", "spk", 1, [&] {
+    spk::descriptor_buffer_info buffer_info;
+    buffer_info.set_buffer(buffer);
+    buffer_info.set_range(VK_WHOLE_SIZE);
+    spk::write_descriptor_set write;
+    write.set_dst_set(descriptor_sets[0]);
+    write.set_descriptor_type(spk::descriptor_type::storage_buffer);
+    write.set_buffer_info({&buffer_info, 1});
+    device.update_descriptor_sets({&write, 1}, {nullptr, 0});
+  });
+
+  // Two-call enumerations.
+
+  measure("enumerate", "c", 6, [&] {
+    uint32_t count;
+    it.vkEnumeratePhysicalDevices(vk_instance, &count, nullptr);
+    std::vector<VkPhysicalDevice> devices(count);
+    it.vkEnumeratePhysicalDevices(vk_instance, &count, devices.data());
+    it.vkGetPhysicalDeviceQueueFamilyProperties(vk_physical_device, &count,
+                                                nullptr);
+    std::vector<VkQueueFamilyProperties> families(count);
+    it.vkGetPhysicalDeviceQueueFamilyProperties(vk_physical_device, &count,
+                                                families.data());
+    it.vkEnumerateDeviceExtensionProperties(vk_physical_device, nullptr,
+                                            &count, nullptr);
+    std::vector<VkExtensionProperties> extensions(count);
+    it.vkEnumerateDeviceExtensionProperties(vk_physical_device, nullptr,
+                                            &count, extensions.data());
+  });
+  measure("enumerate", "spk", 6, [&] {
+    instance.enumerate_physical_devices();
+    physical_device.queue_family_properties();
+    physical_device.enumerate_device_extension_properties(nullptr);
+  });
+
+  // Creating and destroying a buffer.
+
+  measure("buffer_churn", "c", 2, [&] {
+    VkBufferCreateInfo create_info = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    create_info.size = 4096;
+    create_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    VkBuffer churned;
+    dt.vkCreateBuffer(vk_device, &create_info, nullptr, &churned);
+    dt.vkDestroyBuffer(vk_device, churned, nullptr);
+  });
+  measure("buffer_churn", "spk", 2, [&] {
+    spk::buffer churned = device.create_buffer(storage_buffer_create_info());
+  });
+
+  dt.vkDestroyBuffer(vk_device, vk_buffer, nullptr);
+  buffer.release();
+  dt.vkFreeMemory(vk_device, memory, nullptr);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  dvc::init_options(argc, argv);
+  dvc::install_terminate_handler();
+
+  if (!instructions.available())
+    std::cout << "perf events unavailable: not counting instructions"
+              << std::endl;
+
+  if (null_driver) {
+    spk::loader loader(spk::null_driver_get_instance_proc_addr);
+    run(loader);
+  } else {
+    spk::loader loader(vulkan_library.empty() ? nullptr
+                                              : vulkan_library.c_str());
+    run(loader);
+  }
+}
@@ -0,0 +1,130 @@
+// Captures a few commands on spk's null driver, replays the capture against
+// a second device, and checks that every record was accounted for and every
+// recorded handle was created by the replay.  The commands cover created
+// handles, counted arrays of handles whose count is a member of a create
+// info (vkAllocateCommandBuffers and vkAllocateDescriptorSets), and writes to
+// mapped memory.
+
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include "dvc/log.h"
+#include "spk/capture.h"
+#include "spk/loader.h"
+#include "spk/memory_allocator.h"
+#include "spk/null_driver.h"
+#include "spk/spock.h"
+
+namespace {
+
+spk::device create_device(spk::physical_device& physical_device,
+                          const spk::device_layer& layer = {}) {
+  spk::device_queue_create_info queue_create_info;
+  queue_create_info.set_queue_family_index(0);
+  float queue_priority = 1.0;
+  queue_create_info.set_queue_priorities({&queue_priority, 1});
+  spk::device_create_info create_info;
+  create_info.set_queue_create_infos({&queue_create_info, 1});
+  return physical_device.create_device(create_info, layer);
+}
+
+void record_commands(spk::physical_device& physical_device,
+                     spk::device& device) {
+  spk::memory_allocator memory_allocator(physical_device, device);
+  spk::buffer_create_info buffer_create_info;
+  buffer_create_info.set_size(4096);
+  buffer_create_info.set_usage(spk::buffer_usage_flags::vertex_buffer);
+  buffer_create_info.set_sharing_mode(spk::sharing_mode::exclusive);
+  spk::buffer buffer = device.create_buffer(buffer_create_info);
+  spk::memory_allocation memory = memory_allocator.allocate_for(
+      buffer, spk::memory_property_flags::host_visible |
+                  spk::memory_property_flags::host_coherent);
+  DVC_ASSERT(memory.mapped());
+  std::memset(memory.mapped(), 0xab, 4096);
+
+  spk::command_pool_create_info pool_create_info;
+  pool_create_info.set_queue_family_index(0);
+  spk::command_pool command_pool =
+      device.create_command_pool(pool_create_info);
+  spk::command_buffer_allocate_info allocate_info;
+  allocate_info.set_command_pool(command_pool);
+  allocate_info.set_level(spk::command_buffer_level::primary);
+  allocate_info.set_command_buffer_count(3);
+  spk::command_buffer_array command_buffers =
+      device.allocate_command_buffers(allocate_info);
+  spk::command_buffer_begin_info begin_info;
+  for (size_t i = 0; i < command_buffers.size(); ++i) {
+    spk::command_buffer command_buffer = command_buffers.handle(i);
+    command_buffer.begin(begin_info);
+    command_buffer.end();
+  }
+
+  spk::descriptor_set_layout_binding binding;
+  binding.set_binding(0);
+  binding.set_descriptor_type(spk::descriptor_type::storage_buffer);
+  binding.set_descriptor_count(1);
+  binding.set_stage_flags(spk::shader_stage_flags::compute);
+  spk::descriptor_set_layout_create_info layout_create_info;
+  layout_create_info.set_bindings({&binding, 1});
+  spk::descriptor_set_layout layout =
+      device.create_descriptor_set_layout(layout_create_info);
+  spk::descriptor_pool_size size;
+  size.set_type(spk::descriptor_type::storage_buffer);
+  size.set_descriptor_count(2);
+  spk::descriptor_pool_create_info descriptor_pool_create_info;
+  descriptor_pool_create_info.set_flags(
+      spk::descriptor_pool_create_flags::free_descriptor_set);
+  descriptor_pool_create_info.set_max_sets(2);
+  descriptor_pool_create_info.set_pool_sizes({&size, 1});
+  spk::descriptor_pool descriptor_pool =
+      device.create_descriptor_pool(descriptor_pool_create_info);
+  spk::descriptor_set_layout_ref layouts[2] = {layout, layout};
+  spk::descriptor_set_allocate_info descriptor_set_allocate_info;
+  descriptor_set_allocate_info.set_descriptor_pool(descriptor_pool);
+  descriptor_set_allocate_info.set_set_layouts({layouts, 2});
+  spk::descriptor_set_array descriptor_sets =
+      device.allocate_descriptor_sets(descriptor_set_allocate_info);
+}
+
+}  // namespace
+
+int main() {
+  spk::loader loader(spk::null_driver_get_instance_proc_addr);
+  spk::instance instance = loader.create_instance(spk::instance_create_info());
+  std::vector<spk::physical_device> physical_devices =
+      instance.enumerate_physical_devices();
+  DVC_ASSERT(!physical_devices.empty(), "no physical devices");
+  spk::physical_device& physical_device = physical_devices.at(0);
+  const std::filesystem::path path =
+      std::filesystem::temp_directory_path() / "capture_test.spkcap";
+
+  uint64_t records;
+  {
+    spk::capture_writer writer(path);
+    {
+      spk::device device = create_device(
+          physical_device, [&](spk::device_dispatch_table& table) {
+            spk::install_capture(table, writer);
+          });
+      record_commands(physical_device, device);
+    }
+    records = writer.records();
+  }
+
+  spk::device device = create_device(physical_device);
+  spk::replayer replayer(device);
+  spk::replay_statistics stats = replayer.replay(path);
+  std::filesystem::remove(path);
+  std::cout << records << " records: " << stats.commands << " commands, "
+            << stats.skipped << " skipped, " << stats.memory_updates
+            << " memory updates, " << stats.unknown_handles
+            << " unknown handles" << std::endl;
+
+  // The device record, then one of the others for every other record.
+  DVC_ASSERT_EQ(records,
+                1 + stats.commands + stats.skipped + stats.memory_updates);
+  DVC_ASSERT_GT(stats.commands, 10u);
+  DVC_ASSERT_GT(stats.memory_updates, 0u);
+  DVC_ASSERT_EQ(stats.unknown_handles, 0u);
+}
@@ -0,0 +1,293 @@
+// Simulates pointtest's particles on the GPU with spk::gpu_particles and
+// draws them as points with spk::headless_presenter: each frame records a
+// compute step and a draw reading the stepped state as vertices, and the
+// host writes nothing.  Reports frame times, and on a real device checks the
+// particles after the last frame against the same steps of spk::particles
+// on the CPU.  Runs against spk's null driver by default, to measure the CPU
+// side of a frame; to validate, eg on lavapipe:
+//
+//   gpu_particle_benchmark --null_driver=false --frames 100 \
+//     --vulkan_library /usr/share/vulkan/icd.d/lvp_icd.x86_64.json
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dvc/file.h"
+#include "dvc/log.h"
+#include "dvc/opts.h"
+#include "dvc/terminate.h"
+#include "spk/gpu_particles.h"
+#include "spk/headless_presenter.h"
+#include "spk/loader.h"
+#include "spk/memory_allocator.h"
+#include "spk/null_driver.h"
+#include "spk/particles.h"
+#include "spk/spock.h"
+#include "spk/upload_scheduler.h"
+
+namespace {
+
+uint64_t DVC_OPTION(num_points, -, 1 << 20, "particles to simulate");
+uint64_t DVC_OPTION(frames, -, 1000, "frames to render, one step each");
+uint64_t DVC_OPTION(width, -, 1024, "width of the rendered images");
+uint64_t DVC_OPTION(height, -, 1024, "height of the rendered images");
+double DVC_OPTION(tolerance, -, 1e-4,
+                  "largest difference from the CPU allowed in any component "
+                  "of any particle");
+bool DVC_OPTION(null_driver, -, true,
+                "use spk's null driver instead of the system ICD");
+std::string DVC_OPTION(vulkan_library, -, "",
+                       "with --null_driver=false, the Vulkan loader, ICD "
+                       "library or ICD manifest to load");
+
+// pointtest's vertex shader takes a two dimensional position.
+constexpr spk::particle_vertex_format format =
+    spk::particle_vertex_format::xy_rgb;
+
+uint32_t select_graphics_queue_family(spk::physical_device& physical_device) {
+  std::vector<spk::queue_family_properties> properties =
+      physical_device.queue_family_properties();
+  for (uint32_t i = 0; i < properties.size(); ++i)
+    if (properties[i].queue_flags() & spk::queue_flags::graphics) return i;
+  DVC_FATAL("no graphics queue family");
+}
+
+// vkWaitSemaphores and vkGetSemaphoreCounterValue, which the frame_scheduler
+// and upload_scheduler call, are core in Vulkan 1.2 and only loaded for
+// instances that ask for it.
+spk::instance create_instance(spk::loader& loader) {
+  spk::application_info application_info;
+  application_info.set_api_version(VK_API_VERSION_1_2);
+  spk::instance_create_info create_info;
+  create_info.set_p_application_info(&application_info);
+  return loader.create_instance(create_info);
+}
+
+spk::device create_device(spk::physical_device& physical_device,
+                          uint32_t queue_family_index) {
+  spk::device_queue_create_info queue_create_info;
+  queue_create_info.set_queue_family_index(queue_family_index);
+  float queue_priority = 1.0;
+  queue_create_info.set_queue_priorities({&queue_priority, 1});
+  // For the presenter's frame_scheduler and the upload_scheduler.
+  spk::physical_device_timeline_semaphore_features timeline_features;
+  timeline_features.set_timeline_semaphore(true);
+  spk::device_create_info create_info;
+  create_info.set_next(&timeline_features);
+  create_info.set_queue_create_infos({&queue_create_info, 1});
+  return physical_device.create_device(create_info);
+}
+
+spk::shader_module create_shader(spk::device& device,
+                                 const std::filesystem::path& path) {
+  DVC_ASSERT(exists(path), "file not found: ", path);
+  std::string code = dvc::load_file(path);
+  spk::shader_module_create_info create_info;
+  create_info.set_code_size(code.size());
+  create_info.set_p_code((uint32_t*)code.data());
+  return device.create_shader_module(create_info);
+}
+
+struct Pipeline {
+  spk::pipeline_layout pipeline_layout;
+  spk::pipeline pipeline;
+};
+
+Pipeline create_pipeline(spk::device& device,
+                         spk::headless_presenter& presenter) {
+  spk::shader_module vertex_shader =
+      create_shader(device, "test/pointtest.vert.spv");
+  spk::shader_module fragment_shader =
+      create_shader(device, "test/pointtest.frag.spv");
+
+  spk::pipeline_shader_stage_create_info stages[2];
+  stages[0].set_module(vertex_shader);
+  stages[0].set_name("main");
+  stages[0].set_stage(spk::shader_stage_flags::vertex);
+  stages[1].set_module(fragment_shader);
+  stages[1].set_name("main");
+  stages[1].set_stage(spk::shader_stage_flags::fragment);
+
+  spk::vertex_input_binding_description binding =
+      spk::gpu_particles::vertex_binding();
+  std::vector<spk::vertex_input_attribute_description> attributes =
+      spk::gpu_particles::vertex_attributes(format);
+  spk::pipeline_vertex_input_state_create_info vertex_input_info;
+  vertex_input_info.set_vertex_binding_descriptions({&binding, 1});
+  vertex_input_info.set_vertex_attribute_descriptions(
+      {attributes.data(), attributes.size()});
+
+  spk::pipeline_input_assembly_state_create_info input_assembly;
+  input_assembly.set_topology(spk::primitive_topology::point_list);
+
+  spk::viewport viewport;
+  viewport.set_width(presenter.extent().width());
+  viewport.set_height(presenter.extent().height());
+  viewport.set_max_depth(1);
+  spk::rect_2d scissor;
+  scissor.set_extent(presenter.extent());
+  spk::pipeline_viewport_state_create_info viewport_state;
+  viewport_state.set_viewports({&viewport, 1});
+  viewport_state.set_scissors({&scissor, 1});
+
+  spk::pipeline_rasterization_state_create_info rasterizer;
+  rasterizer.set_polygon_mode(spk::polygon_mode::fill);
+  rasterizer.set_line_width(1);
+  rasterizer.set_cull_mode(spk::cull_mode_flags::none);
+  rasterizer.set_front_face(spk::front_face::clockwise);
+
+  spk::pipeline_multisample_state_create_info multisampling;
+  multisampling.set_rasterization_samples(spk::sample_count_flags::n1);
+  multisampling.set_min_sample_shading(1);
+
+  spk::pipeline_color_blend_attachment_state color_blend_attachment;
+  color_blend_attachment.set_color_write_mask(
+      spk::color_component_flags::r | spk::color_component_flags::g |
+      spk::color_component_flags::b | spk::color_component_flags::a);
+  spk::pipeline_color_blend_state_create_info color_blend;
+  color_blend.set_attachments({&color_blend_attachment, 1});
+
+  spk::pipeline_layout pipeline_layout =
+      device.create_pipeline_layout(spk::pipeline_layout_create_info());
+
+  spk::graphics_pipeline_create_info pipeline_info;
+  pipeline_info.set_stages({stages, 2});
+  pipeline_info.set_p_vertex_input_state(&vertex_input_info);
+  pipeline_info.set_p_input_assembly_state(&input_assembly);
+  pipeline_info.set_p_viewport_state(&viewport_state);
+  pipeline_info.set_p_rasterization_state(&rasterizer);
+  pipeline_info.set_p_multisample_state(&multisampling);
+  pipeline_info.set_p_color_blend_state(&color_blend);
+  pipeline_info.set_layout(pipeline_layout);
+  pipeline_info.set_render_pass(presenter.render_pass());
+  pipeline_info.set_subpass(0);
+
+  spk::pipeline pipeline = std::move(
+      device.create_graphics_pipelines(VK_NULL_HANDLE, {&pipeline_info, 1})
+          .at(0));
+  return {std::move(pipeline_layout), std::move(pipeline)};
+}
+
+// Compares every component of the GPU's particles with the CPU's.
+void validate(const spk::particles& cpu, const spk::particles& gpu) {
+  size_t differing = 0;
+  double max_difference = 0;
+  auto compare = [&](const float* a, const float* b) {
+    for (size_t i = 0; i < cpu.size(); ++i) {
+      if (a[i] == b[i]) continue;
+      ++differing;
+      max_difference =
+          std::max(max_difference, std::fabs(double(a[i]) - b[i]));
+    }
+  };
+  for (size_t k = 0; k < 3; ++k) {
+    compare(cpu.position(k), gpu.position(k));
+    compare(cpu.velocity(k), gpu.velocity(k));
+    compare(cpu.color(k), gpu.color(k));
+  }
+  std::cout << differing << " of " << 9 * cpu.size()
+            << " components differ from the CPU, by at most " << max_difference
+            << std::endl;
+  DVC_ASSERT(max_difference <= tolerance,
+             "GPU particles differ from the CPU by ", max_difference);
+}
+
+void run(spk::loader& loader) {
+  spk::instance instance = create_instance(loader);
+  std::vector<spk::physical_device> physical_devices =
+      instance.enumerate_physical_devices();
+  DVC_ASSERT(!physical_devices.empty(), "no physical devices");
+  spk::physical_device& physical_device = physical_devices.at(0);
+  std::cout << physical_device.properties().device_name().data() << std::endl;
+  DVC_ASSERT(physical_device.properties().api_version() >= VK_API_VERSION_1_2,
+             "the device does not support Vulkan 1.2");
+  uint32_t queue_family = select_graphics_queue_family(physical_device);
+  spk::device device = create_device(physical_device, queue_family);
+  spk::queue queue = device.queue(queue_family, 0);
+  spk::memory_allocator memory_allocator(physical_device, device);
+
+  spk::extent_2d extent;
+  extent.set_width(width);
+  extent.set_height(height);
+  spk::headless_presenter presenter(device, memory_allocator, queue,
+                                    queue_family, extent);
+  Pipeline pipeline = create_pipeline(device, presenter);
+
+  std::mt19937 rng(1);
+  std::normal_distribution<float> normal;
+  std::uniform_real_distribution<float> uniform;
+  spk::particles cpu(num_points);
+  for (size_t i = 0; i < num_points; ++i) {
+    for (size_t k = 0; k < 2; ++k) cpu.position(k)[i] = normal(rng);
+    for (size_t k = 0; k < 2; ++k) cpu.velocity(k)[i] = 0.1f * normal(rng);
+    for (size_t k = 0; k < 3; ++k) cpu.color(k)[i] = uniform(rng);
+  }
+
+  spk::shader_module compute_shader =
+      create_shader(device, "spk/particles.comp.spv");
+  spk::gpu_particles gpu(device, memory_allocator, compute_shader,
+                         num_points);
+  {
+    spk::upload_scheduler uploads(device, memory_allocator, queue,
+                                  queue_family, queue_family);
+    gpu.upload(uploads, cpu);
+    uploads.wait(uploads.flush());
+  }
+
+  // pointtest's constants, pulled towards a point off the origin.
+  spk::particle_step step;
+  step.alpha = 0.01;
+  step.beta = 0.1;
+  step.gamma = 0.01;
+  step.target[0] = 0.5;
+  step.target[1] = -0.25;
+
+  for (uint64_t i = 0; i < frames; ++i) {
+    presenter.render([&](spk::command_buffer& command_buffer, size_t,
+                         spk::render_pass_begin_info& render_pass_begin_info) {
+      gpu.record_step(command_buffer, step);
+      spk::clear_color_value clear_color_value;
+      clear_color_value.set_float_32({0, 0, 0, 1});
+      spk::clear_value clear_color;
+      clear_color.set_color(clear_color_value);
+      render_pass_begin_info.set_clear_values({&clear_color, 1});
+      command_buffer.begin_render_pass(render_pass_begin_info,
+                                       spk::subpass_contents::inline_);
+      command_buffer.bind_pipeline(spk::pipeline_bind_point::graphics,
+                                   pipeline.pipeline);
+      gpu.bind_vertex_buffer(command_buffer);
+      command_buffer.draw(gpu.size(), 1, 0, 0);
+      command_buffer.end_render_pass();
+      if (i + 1 == frames) gpu.record_read(command_buffer);
+    });
+  }
+  presenter.wait_idle();
+  std::cout << presenter.statistics() << std::endl;
+
+  if (null_driver || frames == 0) return;
+  for (uint64_t i = 0; i < frames; ++i) cpu.step(step);
+  spk::particles result(num_points);
+  gpu.read(result);
+  validate(cpu, result);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  dvc::init_options(argc, argv);
+  dvc::install_terminate_handler();
+
+  if (null_driver) {
+    spk::loader loader(spk::null_driver_get_instance_proc_addr);
+    run(loader);
+  } else {
+    spk::loader loader(vulkan_library.empty() ? nullptr
+                                              : vulkan_library.c_str());
+    run(loader);
+  }
+}
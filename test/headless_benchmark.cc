@@ -0,0 +1,284 @@
+// Renders triangletest1's triangle with spk::headless_presenter, with no
+// window or swapchain, as fast as the device allows, and reports frame times
+// and the GPU time of the last frame.  --draws draws it many times, and
+// --recording_threads records the draws in parallel with
+// spk::parallel_recorder on an spk::job_system.  --trace writes the CPU
+// phases of each frame and the GPU scopes as one Chrome trace, for
+// chrome://tracing or ui.perfetto.dev.  Runs against spk's null driver by
+// default, to measure the CPU side of a frame; --null_driver=false loads the
+// system driver, or with --vulkan_library a specific one.  Needs no display,
+// eg on lavapipe:
+//
+//   headless_benchmark --null_driver=false --frames 100 \
+//     --vulkan_library /usr/share/vulkan/icd.d/lvp_icd.x86_64.json \
+//     --trace /tmp/trace.json
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+
+#include "dvc/file.h"
+#include "dvc/log.h"
+#include "dvc/opts.h"
+#include "dvc/terminate.h"
+#include "spk/gpu_profiler.h"
+#include "spk/headless_presenter.h"
+#include "spk/job_system.h"
+#include "spk/loader.h"
+#include "spk/memory_allocator.h"
+#include "spk/null_driver.h"
+#include "spk/parallel_recorder.h"
+#include "spk/spock.h"
+#include "spk/trace.h"
+
+namespace {
+
+uint64_t DVC_OPTION(frames, -, 1000, "frames to render");
+uint64_t DVC_OPTION(warmup, -, 10, "frames to render before measuring");
+uint64_t DVC_OPTION(width, -, 1920, "width of the rendered images");
+uint64_t DVC_OPTION(height, -, 1080, "height of the rendered images");
+uint64_t DVC_OPTION(draws, -, 1, "draws per frame");
+uint64_t DVC_OPTION(recording_threads, -, 0,
+                    "threads to record draws on in secondary command "
+                    "buffers, or 0 to record them inline");
+uint64_t DVC_OPTION(draws_per_task, -, 256,
+                    "draws per secondary command buffer");
+bool DVC_OPTION(null_driver, -, true,
+                "use spk's null driver instead of the system ICD");
+std::string DVC_OPTION(vulkan_library, -, "",
+                       "with --null_driver=false, the Vulkan loader, ICD "
+                       "library or ICD manifest to load");
+std::string DVC_OPTION(trace, -, "",
+                       "file to write CPU and GPU timings to, as a Chrome "
+                       "trace");
+
+uint32_t select_graphics_queue_family(spk::physical_device& physical_device) {
+  std::vector<spk::queue_family_properties> properties =
+      physical_device.queue_family_properties();
+  for (uint32_t i = 0; i < properties.size(); ++i)
+    if (properties[i].queue_flags() & spk::queue_flags::graphics) return i;
+  DVC_FATAL("no graphics queue family");
+}
+
+// vkWaitSemaphores and vkGetSemaphoreCounterValue, which the frame_scheduler
+// calls, are core in Vulkan 1.2 and only loaded for instances that ask for it.
+spk::instance create_instance(spk::loader& loader) {
+  spk::application_info application_info;
+  application_info.set_api_version(VK_API_VERSION_1_2);
+  spk::instance_create_info create_info;
+  create_info.set_p_application_info(&application_info);
+  return loader.create_instance(create_info);
+}
+
+spk::device create_device(spk::physical_device& physical_device,
+                          uint32_t queue_family_index) {
+  spk::device_queue_create_info queue_create_info;
+  queue_create_info.set_queue_family_index(queue_family_index);
+  float queue_priority = 1.0;
+  queue_create_info.set_queue_priorities({&queue_priority, 1});
+  // For the presenter's frame_scheduler.
+  spk::physical_device_timeline_semaphore_features timeline_features;
+  timeline_features.set_timeline_semaphore(true);
+  spk::device_create_info create_info;
+  create_info.set_next(&timeline_features);
+  create_info.set_queue_create_infos({&queue_create_info, 1});
+  return physical_device.create_device(create_info);
+}
+
+spk::shader_module create_shader(spk::device& device,
+                                 const std::filesystem::path& path) {
+  DVC_ASSERT(exists(path), "file not found: ", path);
+  std::string code = dvc::load_file(path);
+  spk::shader_module_create_info create_info;
+  create_info.set_code_size(code.size());
+  create_info.set_p_code((uint32_t*)code.data());
+  return device.create_shader_module(create_info);
+}
+
+struct Pipeline {
+  spk::pipeline_layout pipeline_layout;
+  spk::pipeline pipeline;
+};
+
+Pipeline create_pipeline(spk::device& device,
+                         spk::headless_presenter& presenter) {
+  spk::shader_module vertex_shader =
+      create_shader(device, "test/triangletest1.vert.spv");
+  spk::shader_module fragment_shader =
+      create_shader(device, "test/triangletest1.frag.spv");
+
+  spk::pipeline_shader_stage_create_info stages[2];
+  stages[0].set_module(vertex_shader);
+  stages[0].set_name("main");
+  stages[0].set_stage(spk::shader_stage_flags::vertex);
+  stages[1].set_module(fragment_shader);
+  stages[1].set_name("main");
+  stages[1].set_stage(spk::shader_stage_flags::fragment);
+
+  spk::pipeline_vertex_input_state_create_info vertex_input_info;
+
+  spk::pipeline_input_assembly_state_create_info input_assembly;
+  input_assembly.set_topology(spk::primitive_topology::triangle_list);
+
+  spk::viewport viewport;
+  viewport.set_width(presenter.extent().width());
+  viewport.set_height(presenter.extent().height());
+  viewport.set_max_depth(1);
+  spk::rect_2d scissor;
+  scissor.set_extent(presenter.extent());
+  spk::pipeline_viewport_state_create_info viewport_state;
+  viewport_state.set_viewports({&viewport, 1});
+  viewport_state.set_scissors({&scissor, 1});
+
+  spk::pipeline_rasterization_state_create_info rasterizer;
+  rasterizer.set_polygon_mode(spk::polygon_mode::fill);
+  rasterizer.set_line_width(1);
+  rasterizer.set_cull_mode(spk::cull_mode_flags::back);
+  rasterizer.set_front_face(spk::front_face::clockwise);
+
+  spk::pipeline_multisample_state_create_info multisampling;
+  multisampling.set_rasterization_samples(spk::sample_count_flags::n1);
+  multisampling.set_min_sample_shading(1);
+
+  spk::pipeline_color_blend_attachment_state color_blend_attachment;
+  color_blend_attachment.set_color_write_mask(
+      spk::color_component_flags::r | spk::color_component_flags::g |
+      spk::color_component_flags::b | spk::color_component_flags::a);
+  spk::pipeline_color_blend_state_create_info color_blend;
+  color_blend.set_attachments({&color_blend_attachment, 1});
+
+  spk::pipeline_layout pipeline_layout =
+      device.create_pipeline_layout(spk::pipeline_layout_create_info());
+
+  spk::graphics_pipeline_create_info pipeline_info;
+  pipeline_info.set_stages({stages, 2});
+  pipeline_info.set_p_vertex_input_state(&vertex_input_info);
+  pipeline_info.set_p_input_assembly_state(&input_assembly);
+  pipeline_info.set_p_viewport_state(&viewport_state);
+  pipeline_info.set_p_rasterization_state(&rasterizer);
+  pipeline_info.set_p_multisample_state(&multisampling);
+  pipeline_info.set_p_color_blend_state(&color_blend);
+  pipeline_info.set_layout(pipeline_layout);
+  pipeline_info.set_render_pass(presenter.render_pass());
+  pipeline_info.set_subpass(0);
+
+  spk::pipeline pipeline = std::move(
+      device.create_graphics_pipelines(VK_NULL_HANDLE, {&pipeline_info, 1})
+          .at(0));
+  return {std::move(pipeline_layout), std::move(pipeline)};
+}
+
+void run(spk::loader& loader) {
+  spk::instance instance = create_instance(loader);
+  std::cout << loader.startup() << std::endl;
+  std::vector<spk::physical_device> physical_devices =
+      instance.enumerate_physical_devices();
+  DVC_ASSERT(!physical_devices.empty(), "no physical devices");
+  spk::physical_device& physical_device = physical_devices.at(0);
+  std::cout << physical_device.properties().device_name().data() << std::endl;
+  DVC_ASSERT(physical_device.properties().api_version() >= VK_API_VERSION_1_2,
+             "the device does not support Vulkan 1.2");
+  uint32_t queue_family = select_graphics_queue_family(physical_device);
+  spk::device device = create_device(physical_device, queue_family);
+  spk::queue queue = device.queue(queue_family, 0);
+  spk::memory_allocator memory_allocator(physical_device, device);
+
+  spk::extent_2d extent;
+  extent.set_width(width);
+  extent.set_height(height);
+  spk::headless_presenter presenter(device, memory_allocator, queue,
+                                    queue_family, extent);
+  Pipeline pipeline = create_pipeline(device, presenter);
+  spk::gpu_profiler profiler(physical_device, device, queue_family,
+                             presenter.num_renderings());
+
+  std::optional<spk::job_system> jobs;
+  std::optional<spk::parallel_recorder> recorder;
+  if (recording_threads) {
+    jobs.emplace(recording_threads);
+    recorder.emplace(*jobs, device, queue_family, presenter.num_renderings());
+  }
+  DVC_ASSERT_GT(draws_per_task, 0u);
+  const size_t num_tasks = (draws + draws_per_task - 1) / draws_per_task;
+  auto record_draws = [&](spk::command_buffer& command_buffer, size_t task) {
+    command_buffer.bind_pipeline(spk::pipeline_bind_point::graphics,
+                                 pipeline.pipeline);
+    uint64_t end = std::min(draws, (task + 1) * draws_per_task);
+    for (uint64_t i = task * draws_per_task; i < end; ++i)
+      command_buffer.draw(3, 1, 0, 0);
+  };
+
+  auto prepare_rendering =
+      [&](spk::command_buffer& command_buffer, size_t rendering_index,
+          spk::render_pass_begin_info& render_pass_begin_info) {
+        profiler.begin_frame(command_buffer,
+                             presenter.scheduler().submitted() + 1,
+                             rendering_index);
+        {
+          spk::gpu_scope scope(profiler, command_buffer, "triangle");
+          spk::clear_color_value clear_color_value;
+          clear_color_value.set_float_32({0, 0, 0, 1});
+          spk::clear_value clear_color;
+          clear_color.set_color(clear_color_value);
+          render_pass_begin_info.set_clear_values({&clear_color, 1});
+          if (recorder) {
+            recorder->record(command_buffer, rendering_index,
+                             render_pass_begin_info, num_tasks, record_draws);
+          } else {
+            command_buffer.begin_render_pass(render_pass_begin_info,
+                                             spk::subpass_contents::inline_);
+            for (size_t task = 0; task < num_tasks; ++task)
+              record_draws(command_buffer, task);
+            command_buffer.end_render_pass();
+          }
+        }
+        profiler.end_frame(command_buffer);
+      };
+
+  for (uint64_t i = 0; i < warmup; ++i) presenter.render(prepare_rendering);
+  presenter.wait_idle();
+  profiler.collect();
+  presenter.reset_statistics();
+  // Installed after warmup, so that the trace covers only measured frames.
+  spk::tracer tracer;
+  if (!trace.empty()) {
+    tracer.install();
+    spk::tracer::set_thread_name("main");
+  }
+  for (uint64_t i = 0; i < frames; ++i) presenter.render(prepare_rendering);
+  presenter.wait_idle();
+  tracer.uninstall();
+  std::cout << presenter.statistics() << std::endl;
+  std::cout << presenter.scheduler().statistics() << std::endl;
+
+  std::vector<spk::gpu_frame_timing> gpu_timings = profiler.collect();
+  if (!gpu_timings.empty()) std::cout << gpu_timings.back();
+  if (!trace.empty()) {
+    std::ofstream out(trace);
+    out << "{\"traceEvents\":[\n";
+    spk::write_chrome_trace_events(out, gpu_timings);
+    out << ",\n";
+    tracer.write_chrome_trace_events(out);
+    out << "\n]}\n";
+    DVC_ASSERT(out, "cannot write ", trace);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  dvc::init_options(argc, argv);
+  dvc::install_terminate_handler();
+
+  if (null_driver) {
+    spk::loader loader(spk::null_driver_get_instance_proc_addr);
+    run(loader);
+  } else {
+    spk::loader loader(vulkan_library.empty() ? nullptr
+                                              : vulkan_library.c_str());
+    run(loader);
+  }
+}
@@ -0,0 +1,156 @@
+// Exercises spk::job_system: parallel_for coverage, parallel_for nested in
+// jobs, precede() ordering over repeated runs of one graph, deque overflow,
+// and shutdown with sleeping workers.
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "dvc/log.h"
+#include "spk/job_system.h"
+
+namespace {
+
+// Every index in [0, count) is visited once, by a thread of jobs.
+void check_parallel_for(spk::job_system& jobs, size_t count, size_t grain) {
+  std::unique_ptr<std::atomic<uint32_t>[]> visits(
+      new std::atomic<uint32_t>[count]());
+  std::atomic<uint64_t> sum{0};
+  jobs.parallel_for(count, grain, [&](size_t begin, size_t end) {
+    DVC_ASSERT_LT(begin, end);
+    DVC_ASSERT_LE(end - begin, grain);
+    DVC_ASSERT_LT(jobs.thread_index(), jobs.num_threads());
+    uint64_t partial = 0;
+    for (size_t i = begin; i < end; ++i) {
+      visits[i].fetch_add(1, std::memory_order_relaxed);
+      partial += i;
+    }
+    sum.fetch_add(partial, std::memory_order_relaxed);
+  });
+  for (size_t i = 0; i < count; ++i)
+    DVC_ASSERT_EQ(visits[i].load(), 1u, "index ", i);
+  DVC_ASSERT_EQ(sum.load(), uint64_t(count) * (count - 1) / 2);
+}
+
+void test_parallel_for(spk::job_system& jobs) {
+  check_parallel_for(jobs, 100003, 97);
+  check_parallel_for(jobs, 1000, 1);
+  check_parallel_for(jobs, 5, 64);
+  bool called = false;
+  jobs.parallel_for(0, 8, [&](size_t, size_t) { called = true; });
+  DVC_ASSERT(!called, "parallel_for called for no indices");
+}
+
+// Jobs of a graph and ranges of a parallel_for both call parallel_for.
+void test_nested_parallel_for(spk::job_system& jobs) {
+  constexpr size_t outer = 64;
+  constexpr size_t inner = 1000;
+  std::atomic<uint64_t> sum{0};
+  auto inner_sum = [&] {
+    jobs.parallel_for(inner, 16, [&](size_t begin, size_t end) {
+      uint64_t partial = 0;
+      for (size_t i = begin; i < end; ++i) partial += i;
+      sum.fetch_add(partial, std::memory_order_relaxed);
+    });
+  };
+  const uint64_t inner_total = uint64_t(inner) * (inner - 1) / 2;
+
+  jobs.parallel_for(outer, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) inner_sum();
+  });
+  DVC_ASSERT_EQ(sum.load(), outer * inner_total);
+
+  sum = 0;
+  spk::job_graph graph;
+  spk::job_graph::job_id first = graph.add("first", inner_sum);
+  spk::job_graph::job_id second = graph.add("second", inner_sum);
+  graph.precede(first, second);
+  graph.add_parallel_for("outer", outer, 4, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) inner_sum();
+  });
+  jobs.run(graph);
+  DVC_ASSERT_EQ(sum.load(), (outer + 2) * inner_total);
+}
+
+// A diamond with a parallel_for in one arm, run many times: every job runs
+// after its predecessors of the same run and sees what they wrote.
+void test_precede(spk::job_system& jobs) {
+  constexpr size_t count = 4096;
+  std::atomic<uint64_t> sequence{0};
+  uint64_t source_seq = 0, left_seq = 0, right_seq = 0, sink_seq = 0;
+  std::vector<uint32_t> values(count);
+  uint32_t run = 0;
+  uint64_t sink_sum = 0;
+
+  spk::job_graph graph;
+  auto source = graph.add("source", [&] { source_seq = ++sequence; });
+  auto left = graph.add_parallel_for(
+      "left", count, 64, [&](size_t begin, size_t end) {
+        DVC_ASSERT_GT(++sequence, source_seq);
+        for (size_t i = begin; i < end; ++i) values[i] = run;
+      });
+  auto left_done = graph.add("left_done", [&] {
+    left_seq = ++sequence;
+    for (uint32_t v : values) DVC_ASSERT_EQ(v, run, "a range ran late");
+  });
+  auto right = graph.add("right", [&] { right_seq = ++sequence; });
+  auto sink = graph.add("sink", [&] {
+    sink_seq = ++sequence;
+    sink_sum = 0;
+    for (uint32_t v : values) sink_sum += v;
+  });
+  graph.precede(source, left);
+  graph.precede(left, left_done);
+  graph.precede(source, right);
+  graph.precede(left_done, sink);
+  graph.precede(right, sink);
+  DVC_ASSERT_EQ(graph.size(), 5u);
+
+  for (run = 1; run <= 200; ++run) {
+    jobs.run(graph);
+    DVC_ASSERT_LT(source_seq, right_seq);
+    DVC_ASSERT_LT(source_seq, left_seq);
+    DVC_ASSERT_LT(left_seq, sink_seq);
+    DVC_ASSERT_LT(right_seq, sink_seq);
+    DVC_ASSERT_EQ(sink_seq, sequence.load(), "a job ran after the sink");
+    DVC_ASSERT_EQ(sink_sum, uint64_t(count) * run);
+  }
+}
+
+// More ranges than a deque holds: pushes past the capacity run inline.
+void test_deque_overflow() {
+  constexpr size_t count = spk::job_system::deque_capacity * 3 + 17;
+  for (size_t num_threads : {1, 3}) {
+    spk::job_system jobs(num_threads);
+    check_parallel_for(jobs, count, 1);
+  }
+}
+
+// Workers asleep with nothing to do, and asleep after work, are woken and
+// joined.
+void test_shutdown() {
+  for (int i = 0; i < 10; ++i) {
+    spk::job_system jobs(4);
+    if (i % 2) check_parallel_for(jobs, 1000, 10);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
+}  // namespace
+
+int main() {
+  {
+    spk::job_system jobs(4);
+    DVC_ASSERT_EQ(jobs.num_threads(), 4u);
+    DVC_ASSERT_EQ(jobs.thread_index(), 0u);
+    test_parallel_for(jobs);
+    test_nested_parallel_for(jobs);
+    test_precede(jobs);
+  }
+  test_deque_overflow();
+  test_shutdown();
+  std::cout << "job_system_test passed" << std::endl;
+}
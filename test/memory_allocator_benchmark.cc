@@ -0,0 +1,154 @@
+// Compares one vkAllocateMemory per buffer against spk::memory_allocator
+// sub-allocation, and measures raw spk::tlsf placement throughput.  Needs no
+// GPU; run it against a software ICD, eg:
+//
+//   memory_allocator_benchmark --buffers 4096 \
+//     --vulkan_library /usr/share/vulkan/icd.d/lvp_icd.x86_64.json
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "dvc/log.h"
+#include "dvc/opts.h"
+#include "dvc/terminate.h"
+#include "spk/loader.h"
+#include "spk/memory_allocator.h"
+#include "spk/spock.h"
+#include "spk/tlsf.h"
+
+namespace {
+
+uint64_t DVC_OPTION(buffers, -, 4096, "buffers to create per run");
+uint64_t DVC_OPTION(buffer_size, -, 4096, "size of each buffer");
+uint64_t DVC_OPTION(tlsf_operations, -, 10000000, "tlsf operations to time");
+std::string DVC_OPTION(vulkan_library, -, "",
+                       "Vulkan loader, ICD library or ICD manifest to load "
+                       "instead of libvulkan.so.1");
+
+using clock = std::chrono::steady_clock;
+
+double seconds_since(clock::time_point start) {
+  return std::chrono::duration<double>(clock::now() - start).count();
+}
+
+void tlsf_benchmark() {
+  spk::tlsf placement(uint64_t(1) << 30);
+  std::mt19937_64 rng(1);
+  std::vector<uint32_t> live;
+  auto start = clock::now();
+  for (uint64_t i = 0; i < tlsf_operations; ++i) {
+    if (live.empty() || rng() % 2) {
+      auto allocation = placement.allocate(rng() % 65536 + 1, 256);
+      if (allocation) live.push_back(allocation->node);
+    } else {
+      size_t k = rng() % live.size();
+      placement.free(live[k]);
+      live[k] = live.back();
+      live.pop_back();
+    }
+  }
+  double elapsed = seconds_since(start);
+  std::cout << "tlsf: " << elapsed * 1e9 / tlsf_operations << " ns/operation, "
+            << live.size() << " live, " << placement.used() << " bytes used"
+            << std::endl;
+}
+
+spk::device create_device(spk::physical_device& physical_device) {
+  spk::device_queue_create_info queue_create_info;
+  queue_create_info.set_queue_family_index(0);
+  float queue_priority = 1.0;
+  queue_create_info.set_queue_priorities({&queue_priority, 1});
+  spk::device_create_info create_info;
+  create_info.set_queue_create_infos({&queue_create_info, 1});
+  return physical_device.create_device(create_info);
+}
+
+spk::buffer create_buffer(spk::device& device) {
+  spk::buffer_create_info create_info;
+  create_info.set_size(buffer_size);
+  create_info.set_usage(spk::buffer_usage_flags::vertex_buffer |
+                        spk::buffer_usage_flags::uniform_buffer);
+  create_info.set_sharing_mode(spk::sharing_mode::exclusive);
+  return device.create_buffer(create_info);
+}
+
+const spk::memory_property_flags host_memory =
+    spk::memory_property_flags::host_visible |
+    spk::memory_property_flags::host_coherent;
+
+void allocate_memory_per_buffer(spk::physical_device& physical_device,
+                                spk::device& device) {
+  spk::physical_device_memory_properties memory_properties =
+      physical_device.memory_properties();
+  auto start = clock::now();
+  std::vector<spk::buffer> created;
+  std::vector<spk::device_memory> memories;
+  for (uint64_t i = 0; i < buffers; ++i) {
+    spk::buffer buffer = create_buffer(device);
+    const spk::memory_requirements requirements = buffer.memory_requirements();
+    spk::memory_allocate_info allocate_info;
+    allocate_info.set_allocation_size(requirements.size());
+    allocate_info.set_memory_type_index(
+        spk::find_memory_type(memory_properties,
+                              requirements.memory_type_bits(), host_memory)
+            .value());
+    memories.push_back(device.allocate_memory(allocate_info));
+    buffer.bind_memory(memories.back(), 0);
+    created.push_back(std::move(buffer));
+  }
+  double create = seconds_since(start);
+  start = clock::now();
+  created.clear();
+  for (spk::device_memory& memory : memories) device.free_memory(memory);
+  double destroy = seconds_since(start);
+  std::cout << "allocate_memory per buffer: create " << create * 1e6 / buffers
+            << " us/buffer, destroy " << destroy * 1e6 / buffers
+            << " us/buffer, " << memories.size() << " VkDeviceMemory"
+            << std::endl;
+}
+
+void sub_allocate(spk::physical_device& physical_device, spk::device& device) {
+  spk::memory_allocator memory_allocator(physical_device, device);
+  auto start = clock::now();
+  std::vector<spk::buffer> created;
+  std::vector<spk::memory_allocation> allocations;
+  for (uint64_t i = 0; i < buffers; ++i) {
+    spk::buffer buffer = create_buffer(device);
+    allocations.push_back(memory_allocator.allocate_for(buffer, host_memory));
+    DVC_ASSERT(allocations.back());
+    created.push_back(std::move(buffer));
+  }
+  double create = seconds_since(start);
+  uint32_t device_memories = memory_allocator.device_memory_allocations();
+  start = clock::now();
+  created.clear();
+  allocations.clear();
+  double destroy = seconds_since(start);
+  std::cout << "spk::memory_allocator: create " << create * 1e6 / buffers
+            << " us/buffer, destroy " << destroy * 1e6 / buffers
+            << " us/buffer, " << device_memories << " VkDeviceMemory"
+            << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  dvc::init_options(argc, argv);
+  dvc::install_terminate_handler();
+
+  tlsf_benchmark();
+
+  spk::loader loader(vulkan_library.empty() ? nullptr
+                                            : vulkan_library.c_str());
+  spk::instance instance = loader.create_instance(spk::instance_create_info());
+  std::vector<spk::physical_device> physical_devices =
+      instance.enumerate_physical_devices();
+  DVC_ASSERT(!physical_devices.empty(), "no physical devices");
+  spk::physical_device& physical_device = physical_devices.at(0);
+  spk::device device = create_device(physical_device);
+
+  allocate_memory_per_buffer(physical_device, device);
+  sub_allocate(physical_device, device);
+}
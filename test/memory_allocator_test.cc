@@ -0,0 +1,206 @@
+// Randomized allocate/free checks of spk::tlsf and of spk::memory_allocator
+// on spk's null driver, against a shadow map of the live ranges: no two live
+// ranges overlap, offsets are aligned, freed neighbours are merged, linear
+// and optimal resources never share a VkDeviceMemory (so never a page of
+// bufferImageGranularity), and dedicated allocations own their memory.
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "dvc/log.h"
+#include "spk/loader.h"
+#include "spk/memory_allocator.h"
+#include "spk/null_driver.h"
+#include "spk/spock.h"
+#include "spk/tlsf.h"
+
+namespace {
+
+// Live ranges of one address space, by offset.
+struct shadow_range {
+  uint64_t size;
+  uint32_t node;
+};
+using shadow_map = std::map<uint64_t, shadow_range>;
+
+// Checks that [offset, offset + size) overlaps nothing in live.
+void check_disjoint(const shadow_map& live, uint64_t offset, uint64_t size) {
+  auto next = live.lower_bound(offset);
+  if (next != live.end())
+    DVC_ASSERT(offset + size <= next->first, "[", offset, ", ",
+               offset + size, ") overlaps the range at ", next->first);
+  if (next != live.begin()) {
+    auto prev = std::prev(next);
+    DVC_ASSERT(prev->first + prev->second.size <= offset, "[", offset, ", ",
+               offset + size, ") overlaps the range at ", prev->first);
+  }
+}
+
+// The largest gap between live ranges in [0, size).  With every free range
+// merged with its free neighbours, it is tlsf::largest_free().
+uint64_t largest_gap(const shadow_map& live, uint64_t size) {
+  uint64_t largest = 0;
+  uint64_t end = 0;
+  for (const auto& [offset, range] : live) {
+    largest = std::max(largest, offset - end);
+    end = offset + range.size;
+  }
+  return std::max(largest, size - end);
+}
+
+void test_tlsf(uint64_t size, uint64_t max_allocation) {
+  spk::tlsf placement(size);
+  std::mt19937_64 rng(size);
+  shadow_map live;
+  uint64_t used = 0;
+  for (int i = 0; i < 20000; ++i) {
+    if (live.empty() || rng() % 2) {
+      uint64_t n = rng() % max_allocation + 1;
+      uint64_t alignment = uint64_t(1) << (rng() % 9);
+      std::optional<spk::tlsf::allocation> a =
+          placement.allocate(n, alignment);
+      if (!a) continue;
+      DVC_ASSERT_EQ(a->offset % alignment, 0u);
+      DVC_ASSERT_LE(a->offset + n, size);
+      check_disjoint(live, a->offset, n);
+      live[a->offset] = {n, a->node};
+      used += n;
+    } else {
+      auto it = std::next(live.begin(), rng() % live.size());
+      placement.free(it->second.node);
+      used -= it->second.size;
+      live.erase(it);
+    }
+    DVC_ASSERT_EQ(placement.used(), used);
+    DVC_ASSERT_EQ(placement.allocations(), live.size());
+    DVC_ASSERT_EQ(placement.largest_free(), largest_gap(live, size));
+  }
+
+  for (const auto& [offset, range] : live) placement.free(range.node);
+  DVC_ASSERT(placement.empty());
+  DVC_ASSERT_EQ(placement.largest_free(), size);
+  std::optional<spk::tlsf::allocation> all = placement.allocate(size);
+  DVC_ASSERT(all);
+  DVC_ASSERT_EQ(all->offset, 0u);
+  DVC_ASSERT(!placement.allocate(1));
+}
+
+spk::device create_device(spk::physical_device& physical_device) {
+  spk::device_queue_create_info queue_create_info;
+  queue_create_info.set_queue_family_index(0);
+  float queue_priority = 1.0;
+  queue_create_info.set_queue_priorities({&queue_priority, 1});
+  spk::device_create_info create_info;
+  create_info.set_queue_create_infos({&queue_create_info, 1});
+  return physical_device.create_device(create_info);
+}
+
+// Live allocations of one VkDeviceMemory.
+struct shadow_memory {
+  bool linear;
+  bool dedicated;
+  shadow_map live;
+};
+
+void test_memory_allocator(spk::physical_device& physical_device,
+                           spk::device& device) {
+  constexpr uint64_t block_size = 1 << 20;
+  const spk::physical_device_memory_properties memory_properties =
+      physical_device.memory_properties();
+  spk::memory_allocator allocator(physical_device, device, block_size);
+  std::mt19937_64 rng(1);
+  std::vector<spk::memory_allocation> allocations;
+  std::map<spk::device_memory_ref, shadow_memory> memories;
+
+  auto release = [&](size_t i) {
+    spk::memory_allocation& a = allocations[i];
+    shadow_memory& memory = memories.at(a.memory());
+    memory.live.erase(a.offset());
+    if (memory.live.empty()) memories.erase(a.memory());
+    std::swap(a, allocations.back());
+    allocations.pop_back();
+  };
+
+  for (int i = 0; i < 5000; ++i) {
+    if (!allocations.empty() && rng() % 2) {
+      release(rng() % allocations.size());
+      continue;
+    }
+    spk::memory_request request;
+    request.size = rng() % (block_size / 16) + 1;
+    if (rng() % 50 == 0) request.size = block_size / 2 + rng() % block_size;
+    request.alignment = uint64_t(1) << (rng() % 13);
+    request.required = rng() % 2 ? spk::memory_property_flags::device_local
+                                 : spk::memory_property_flags::host_visible;
+    request.linear = rng() % 2;
+    request.dedicated = rng() % 50 == 0;
+    const bool dedicated =
+        request.dedicated || request.size > block_size / 2;
+
+    spk::memory_allocation a = allocator.allocate(request);
+    DVC_ASSERT(a, "allocation of ", request.size, " bytes failed");
+    DVC_ASSERT_EQ(a.size(), request.size);
+    spk::memory_property_flags flags =
+        memory_properties.memory_types()[a.memory_type()].property_flags();
+    DVC_ASSERT((flags & request.required) == VkFlags(request.required));
+    DVC_ASSERT(bool(a.mapped()) ==
+               bool(flags & spk::memory_property_flags::host_visible));
+    DVC_ASSERT_EQ(a.offset() % request.alignment, 0u);
+
+    auto [it, inserted] = memories.try_emplace(
+        a.memory(), shadow_memory{request.linear, dedicated, {}});
+    shadow_memory& memory = it->second;
+    if (dedicated) {
+      DVC_ASSERT(inserted, "dedicated allocation shares its memory");
+      DVC_ASSERT_EQ(a.offset(), 0u);
+    } else {
+      DVC_ASSERT(!memory.dedicated, "allocation placed in dedicated memory");
+      DVC_ASSERT(memory.linear == request.linear,
+                 "linear and optimal resources share a memory");
+      DVC_ASSERT_LE(a.offset() + a.size(), block_size);
+      check_disjoint(memory.live, a.offset(), a.size());
+    }
+    memory.live[a.offset()] = {a.size(), 0};
+    allocations.push_back(std::move(a));
+  }
+
+  // Once everything is freed, all that is left is at most one spare empty
+  // block per kind, merged back into a single free range.
+  while (!allocations.empty()) release(allocations.size() - 1);
+  DVC_ASSERT(memories.empty());
+  std::vector<spk::memory_allocator::block_statistics> blocks =
+      allocator.statistics();
+  for (const auto& block : blocks) {
+    DVC_ASSERT(!block.dedicated, "empty dedicated memory kept");
+    DVC_ASSERT_EQ(block.used, 0u);
+    DVC_ASSERT_EQ(block.allocations, 0u);
+    DVC_ASSERT_EQ(block.largest_free, block.size);
+  }
+  for (size_t i = 0; i < blocks.size(); ++i)
+    for (size_t j = 0; j < i; ++j)
+      DVC_ASSERT(blocks[i].memory_type != blocks[j].memory_type ||
+                     blocks[i].linear != blocks[j].linear,
+                 "two empty blocks of one kind kept");
+  DVC_ASSERT_EQ(allocator.device_memory_allocations(), blocks.size());
+}
+
+}  // namespace
+
+int main() {
+  test_tlsf(1 << 20, 5000);
+  test_tlsf(12345, 500);
+  test_tlsf(uint64_t(1) << 40, uint64_t(1) << 30);
+
+  spk::loader loader(spk::null_driver_get_instance_proc_addr);
+  spk::instance instance = loader.create_instance(spk::instance_create_info());
+  std::vector<spk::physical_device> physical_devices =
+      instance.enumerate_physical_devices();
+  DVC_ASSERT(!physical_devices.empty(), "no physical devices");
+  spk::physical_device& physical_device = physical_devices.at(0);
+  spk::device device = create_device(physical_device);
+  test_memory_allocator(physical_device, device);
+  std::cout << "memory_allocator_test passed" << std::endl;
+}
@@ -0,0 +1,53 @@
+// Compiles the generated spk/spock_null_driver.h on its own, so that a
+// generator change that emits invalid C++ fails here, and checks the
+// generated commands whose output counts vk.xml gives as a member of a
+// create info, such as pAllocateInfo->commandBufferCount.
+
+#include <set>
+
+#include "dvc/log.h"
+#include "spk/null_driver.h"
+#include "spk/spock_null_driver.h"
+
+namespace {
+
+// Each of count handles is fresh.
+template <typename T>
+void check_handles(const T* handles, size_t count) {
+  std::set<T> seen;
+  for (size_t i = 0; i < count; ++i) {
+    DVC_ASSERT(handles[i] != VK_NULL_HANDLE, "null handle ", i);
+    DVC_ASSERT(seen.insert(handles[i]).second, "handle ", i, " repeated");
+  }
+}
+
+}  // namespace
+
+int main() {
+  VkDevice device = VK_NULL_HANDLE;
+
+  VkCommandBufferAllocateInfo command_buffer_info = {};
+  command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  command_buffer_info.commandBufferCount = 3;
+  VkCommandBuffer command_buffers[4] = {};
+  DVC_ASSERT_EQ(spk::null_commands::vkAllocateCommandBuffers(
+                    device, &command_buffer_info, command_buffers),
+                VK_SUCCESS);
+  check_handles(command_buffers, 3);
+  DVC_ASSERT(command_buffers[3] == VK_NULL_HANDLE, "wrote past the count");
+
+  VkDescriptorSetLayout layouts[2] = {};
+  VkDescriptorSetAllocateInfo descriptor_set_info = {};
+  descriptor_set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  descriptor_set_info.descriptorSetCount = 2;
+  descriptor_set_info.pSetLayouts = layouts;
+  VkDescriptorSet descriptor_sets[3] = {};
+  DVC_ASSERT_EQ(spk::null_commands::vkAllocateDescriptorSets(
+                    device, &descriptor_set_info, descriptor_sets),
+                VK_SUCCESS);
+  check_handles(descriptor_sets, 2);
+  DVC_ASSERT(descriptor_sets[2] == VK_NULL_HANDLE, "wrote past the count");
+
+  DVC_ASSERT(spk::null_proc_addr("vkAllocateCommandBuffers"),
+             "vkAllocateCommandBuffers missing");
+}
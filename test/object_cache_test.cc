@@ -0,0 +1,135 @@
+// Checks deep_hash and deep_equal on structs holding the same state through
+// different pointers, and spk::object_cache on spk's null driver: that equal
+// create infos share an object, and that trim() keeps an object alive while
+// a cached object created from its handle is.
+
+#include <iostream>
+
+#include "dvc/log.h"
+#include "spk/deep_hash.h"
+#include "spk/loader.h"
+#include "spk/null_driver.h"
+#include "spk/object_cache.h"
+#include "spk/spock.h"
+
+namespace {
+
+spk::device create_device(spk::physical_device& physical_device) {
+  spk::device_queue_create_info queue_create_info;
+  queue_create_info.set_queue_family_index(0);
+  float queue_priority = 1.0;
+  queue_create_info.set_queue_priorities({&queue_priority, 1});
+  spk::device_create_info create_info;
+  create_info.set_queue_create_infos({&queue_create_info, 1});
+  return physical_device.create_device(create_info);
+}
+
+spk::descriptor_set_layout_binding storage_binding(uint32_t binding) {
+  spk::descriptor_set_layout_binding b;
+  b.set_binding(binding);
+  b.set_descriptor_type(spk::descriptor_type::storage_buffer);
+  b.set_descriptor_count(1);
+  b.set_stage_flags(spk::shader_stage_flags::compute);
+  return b;
+}
+
+void test_deep_equal() {
+  spk::descriptor_set_layout_binding a_bindings[2] = {storage_binding(0),
+                                                      storage_binding(1)};
+  spk::descriptor_set_layout_binding b_bindings[2] = {storage_binding(0),
+                                                      storage_binding(1)};
+  spk::descriptor_set_layout_create_info a;
+  a.set_bindings({a_bindings, 2});
+  spk::descriptor_set_layout_create_info b;
+  b.set_bindings({b_bindings, 2});
+  DVC_ASSERT(spk::deep_equal(a, b));
+  DVC_ASSERT(a == b);
+  DVC_ASSERT_EQ(spk::deep_hash(a), spk::deep_hash(b));
+
+  // A difference inside the array.
+  b_bindings[1].set_descriptor_count(2);
+  DVC_ASSERT(!spk::deep_equal(a, b));
+  DVC_ASSERT(a != b);
+  DVC_ASSERT(spk::deep_hash(a) != spk::deep_hash(b));
+  b_bindings[1].set_descriptor_count(1);
+
+  // A shorter array.
+  b.set_bindings({b_bindings, 1});
+  DVC_ASSERT(!spk::deep_equal(a, b));
+  b.set_bindings({b_bindings, 2});
+
+  // A difference on the pNext chain.
+  spk::descriptor_binding_flags a_flags[2] = {
+      spk::descriptor_binding_flags::partially_bound,
+      spk::descriptor_binding_flags(0)};
+  spk::descriptor_binding_flags b_flags[2] = {
+      spk::descriptor_binding_flags::partially_bound,
+      spk::descriptor_binding_flags(0)};
+  spk::descriptor_set_layout_binding_flags_create_info a_flags_info;
+  a_flags_info.set_binding_flags({a_flags, 2});
+  spk::descriptor_set_layout_binding_flags_create_info b_flags_info;
+  b_flags_info.set_binding_flags({b_flags, 2});
+  a.set_next(&a_flags_info);
+  DVC_ASSERT(!spk::deep_equal(a, b));
+  b.set_next(&b_flags_info);
+  DVC_ASSERT(spk::deep_equal(a, b));
+  DVC_ASSERT_EQ(spk::deep_hash(a), spk::deep_hash(b));
+  b_flags[1] = spk::descriptor_binding_flags::partially_bound;
+  DVC_ASSERT(!spk::deep_equal(a, b));
+}
+
+void test_object_cache(spk::device& device) {
+  spk::object_cache cache(device);
+
+  spk::descriptor_set_layout_binding binding = storage_binding(0);
+  spk::descriptor_set_layout_create_info set_layout_info;
+  set_layout_info.set_bindings({&binding, 1});
+  spk::descriptor_set_layout_binding other_binding = storage_binding(0);
+  spk::descriptor_set_layout_create_info other_set_layout_info;
+  other_set_layout_info.set_bindings({&other_binding, 1});
+
+  std::shared_ptr<const spk::descriptor_set_layout> set_layout =
+      cache.descriptor_set_layout(set_layout_info);
+  DVC_ASSERT(cache.descriptor_set_layout(other_set_layout_info) ==
+             set_layout);
+  DVC_ASSERT_EQ(cache.stats().hits, 1u);
+  DVC_ASSERT_EQ(cache.stats().misses, 1u);
+
+  spk::descriptor_set_layout_ref set_layout_ref = *set_layout;
+  spk::pipeline_layout_create_info pipeline_layout_info;
+  pipeline_layout_info.set_set_layouts({&set_layout_ref, 1});
+  std::shared_ptr<const spk::pipeline_layout> pipeline_layout =
+      cache.pipeline_layout(pipeline_layout_info);
+  DVC_ASSERT_EQ(cache.stats().size, 2u);
+  DVC_ASSERT_EQ(cache.trim(), 0u);
+
+  // The pipeline layout's entry keeps the set layout, whose handle is in its
+  // key, from being destroyed and its handle reused.
+  set_layout.reset();
+  DVC_ASSERT_EQ(cache.trim(), 0u);
+  set_layout = cache.descriptor_set_layout(set_layout_info);
+  DVC_ASSERT(spk::descriptor_set_layout_ref(*set_layout) == set_layout_ref);
+  DVC_ASSERT_EQ(cache.stats().misses, 2u);
+  set_layout.reset();
+
+  // Both go once nothing else references the pipeline layout.
+  pipeline_layout.reset();
+  DVC_ASSERT_EQ(cache.trim(), 2u);
+  DVC_ASSERT_EQ(cache.stats().size, 0u);
+  DVC_ASSERT_EQ(cache.trim(), 0u);
+}
+
+}  // namespace
+
+int main() {
+  test_deep_equal();
+
+  spk::loader loader(spk::null_driver_get_instance_proc_addr);
+  spk::instance instance = loader.create_instance(spk::instance_create_info());
+  std::vector<spk::physical_device> physical_devices =
+      instance.enumerate_physical_devices();
+  DVC_ASSERT(!physical_devices.empty(), "no physical devices");
+  spk::device device = create_device(physical_devices.at(0));
+  test_object_cache(device);
+  std::cout << "object_cache_test passed" << std::endl;
+}
@@ -0,0 +1,152 @@
+// Compares pointtest's and skyfly's particle update, one array-of-structs
+// PointMass at a time, with spk::particles' vectorized structure-of-arrays
+// kernels, on one thread and across an spk::job_system.  Each variant steps
+// the same particles and writes them as skyfly's vertices into a buffer
+// standing in for mapped memory, and the results are checked to be equal.
+//
+//   particle_benchmark --num_points 4000000 --steps 50
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "dvc/log.h"
+#include "dvc/opts.h"
+#include "dvc/terminate.h"
+#include "spk/job_system.h"
+#include "spk/particles.h"
+
+namespace {
+
+uint64_t DVC_OPTION(num_points, -, 1 << 20, "particles to simulate");
+uint64_t DVC_OPTION(steps, -, 100, "steps to time");
+uint64_t DVC_OPTION(threads, -, std::thread::hardware_concurrency(),
+                    "threads of the job system");
+uint64_t DVC_OPTION(grain, -, 1 << 14, "particles per parallel job");
+
+constexpr spk::particle_vertex_format format =
+    spk::particle_vertex_format::xyz_rgb;
+
+// skyfly's and pointtest's PointMass::update, in three dimensions.
+struct PointMass {
+  float pos[3];
+  float color[3];
+  float velocity[3];
+
+  void update(const spk::particle_step& step) {
+    for (size_t k = 0; k < 3; ++k) {
+      velocity[k] += step.beta * (step.target[k] - pos[k]);
+      velocity[k] *= 1 - step.gamma;
+      pos[k] += step.alpha * velocity[k];
+      if (pos[k] > 1 && velocity[k] > 0) velocity[k] = -velocity[k];
+      if (pos[k] < -1 && velocity[k] < 0) velocity[k] = -velocity[k];
+    }
+  }
+};
+
+struct Vertex {
+  float pos[3];
+  float color[3];
+};
+static_assert(sizeof(Vertex) == spk::vertex_size(format));
+
+struct free_vertices {
+  void operator()(Vertex* p) const { std::free(p); }
+};
+
+// Cache-line aligned, as a stream_buffer allocation for particles would be.
+std::unique_ptr<Vertex, free_vertices> allocate_vertices(size_t count) {
+  size_t size = (count * sizeof(Vertex) + 63) / 64 * 64;
+  auto* vertices = static_cast<Vertex*>(std::aligned_alloc(64, size));
+  DVC_ASSERT(vertices, "cannot allocate ", count, " vertices");
+  return std::unique_ptr<Vertex, free_vertices>(vertices);
+}
+
+template <typename F>
+void measure(const char* name, F step_and_write) {
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < steps; ++i) step_and_write();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  double ms = elapsed.count() * 1e3 / steps;
+  std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+            << std::setprecision(3) << std::setw(10) << ms << " ms/step "
+            << std::setw(8) << num_points / ms / 1e3 << " M points/s"
+            << std::endl;
+}
+
+void run() {
+  std::mt19937 rng(1);
+  std::normal_distribution<float> normal;
+  std::vector<PointMass> points(num_points);
+  spk::particles single(num_points);
+  spk::particles parallel(num_points);
+  for (size_t i = 0; i < num_points; ++i) {
+    for (size_t k = 0; k < 3; ++k) points[i].pos[k] = normal(rng);
+    for (size_t k = 0; k < 3; ++k) points[i].color[k] = normal(rng);
+    for (size_t k = 0; k < 3; ++k) points[i].velocity[k] = normal(rng);
+    for (spk::particles* p : {&single, &parallel}) {
+      for (size_t k = 0; k < 3; ++k) {
+        p->position(k)[i] = points[i].pos[k];
+        p->color(k)[i] = points[i].color[k];
+        p->velocity(k)[i] = points[i].velocity[k];
+      }
+    }
+  }
+
+  // pointtest's constants, pulled towards a point off the origin.
+  spk::particle_step step;
+  step.alpha = 0.01;
+  step.beta = 0.1;
+  step.gamma = 0.01;
+  step.target[0] = 0.5;
+  step.target[1] = -0.25;
+
+  auto aos_vertices = allocate_vertices(num_points);
+  measure("aos", [&] {
+    for (PointMass& point : points) point.update(step);
+    Vertex* v = aos_vertices.get();
+    for (size_t i = 0; i < num_points; ++i) {
+      std::memcpy(v[i].pos, points[i].pos, sizeof(v[i].pos));
+      std::memcpy(v[i].color, points[i].color, sizeof(v[i].color));
+    }
+  });
+
+  auto single_vertices = allocate_vertices(num_points);
+  measure("soa", [&] {
+    single.step(step);
+    single.write_vertices(format, single_vertices.get());
+  });
+
+  spk::job_system jobs(threads);
+  auto parallel_vertices = allocate_vertices(num_points);
+  measure("soa parallel", [&] {
+    jobs.parallel_for(num_points, grain, [&](size_t begin, size_t end) {
+      parallel.step_range(step, begin, end);
+      parallel.write_vertices_range(format, parallel_vertices.get(), begin,
+                                    end);
+    });
+  });
+  std::cout << jobs.num_threads() << " threads" << std::endl;
+
+  size_t size = num_points * sizeof(Vertex);
+  DVC_ASSERT(!std::memcmp(aos_vertices.get(), single_vertices.get(), size),
+             "soa vertices differ from aos");
+  DVC_ASSERT(!std::memcmp(aos_vertices.get(), parallel_vertices.get(), size),
+             "parallel soa vertices differ from aos");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  dvc::init_options(argc, argv);
+  dvc::install_terminate_handler();
+  run();
+}
@@ -0,0 +1,175 @@
+// Compiles batches of compute and graphics pipelines with
+// spk::pipeline_compiler on spk's null driver and checks that every future
+// resolves to a fresh pipeline, that every create call went through a
+// worker's own VkPipelineCache, and that wait_idle() merges those caches into
+// pipeline_cache().
+
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "dvc/log.h"
+#include "spk/loader.h"
+#include "spk/null_driver.h"
+#include "spk/pipeline_compiler.h"
+#include "spk/spock.h"
+
+namespace {
+
+// Records the caches that pipelines are created with and merged into.
+struct cache_use {
+  spk::device_dispatch_table next;
+  std::mutex mu;
+  std::set<VkPipelineCache> compiled_with;
+  uint64_t uncached_calls = 0;
+  VkPipelineCache merged_into = VK_NULL_HANDLE;
+  std::set<VkPipelineCache> merged;
+} layer;
+
+void record_cache(VkPipelineCache cache) {
+  std::lock_guard lock(layer.mu);
+  if (cache == VK_NULL_HANDLE)
+    ++layer.uncached_calls;
+  else
+    layer.compiled_with.insert(cache);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL create_compute_pipelines(
+    VkDevice device, VkPipelineCache cache, uint32_t count,
+    const VkComputePipelineCreateInfo* create_infos,
+    const VkAllocationCallbacks* allocator, VkPipeline* pipelines) {
+  record_cache(cache);
+  return layer.next.vkCreateComputePipelines(device, cache, count,
+                                             create_infos, allocator,
+                                             pipelines);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL create_graphics_pipelines(
+    VkDevice device, VkPipelineCache cache, uint32_t count,
+    const VkGraphicsPipelineCreateInfo* create_infos,
+    const VkAllocationCallbacks* allocator, VkPipeline* pipelines) {
+  record_cache(cache);
+  return layer.next.vkCreateGraphicsPipelines(device, cache, count,
+                                              create_infos, allocator,
+                                              pipelines);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL merge_pipeline_caches(
+    VkDevice device, VkPipelineCache dst, uint32_t count,
+    const VkPipelineCache* sources) {
+  {
+    std::lock_guard lock(layer.mu);
+    layer.merged_into = dst;
+    layer.merged.insert(sources, sources + count);
+  }
+  return layer.next.vkMergePipelineCaches(device, dst, count, sources);
+}
+
+spk::device create_device(spk::physical_device& physical_device) {
+  spk::device_queue_create_info queue_create_info;
+  queue_create_info.set_queue_family_index(0);
+  float queue_priority = 1.0;
+  queue_create_info.set_queue_priorities({&queue_priority, 1});
+  spk::device_create_info create_info;
+  create_info.set_queue_create_infos({&queue_create_info, 1});
+  return physical_device.create_device(
+      create_info, [](spk::device_dispatch_table& table) {
+        layer.next = table;
+        table.vkCreateComputePipelines = create_compute_pipelines;
+        table.vkCreateGraphicsPipelines = create_graphics_pipelines;
+        table.vkMergePipelineCaches = merge_pipeline_caches;
+      });
+}
+
+// The null driver accepts any code.
+spk::shader_module create_shader(spk::device& device) {
+  uint32_t code = 0x07230203;
+  spk::shader_module_create_info create_info;
+  create_info.set_code_size(sizeof(code));
+  create_info.set_p_code(&code);
+  return device.create_shader_module(create_info);
+}
+
+// Each future holds a pipeline that no other future holds.
+void check_pipelines(std::vector<std::future<spk::pipeline>>& futures,
+                     std::vector<spk::pipeline>& pipelines) {
+  for (std::future<spk::pipeline>& future : futures) {
+    spk::pipeline pipeline = future.get();
+    DVC_ASSERT(spk::pipeline_ref(pipeline) != VK_NULL_HANDLE);
+    for (const spk::pipeline& other : pipelines)
+      DVC_ASSERT(spk::pipeline_ref(other) != spk::pipeline_ref(pipeline),
+                 "pipeline returned twice");
+    pipelines.push_back(std::move(pipeline));
+  }
+}
+
+void test_pipeline_compiler(spk::device& device) {
+  constexpr size_t num_threads = 4;
+  spk::shader_module shader = create_shader(device);
+  spk::pipeline_layout_create_info layout_create_info;
+  spk::pipeline_layout layout =
+      device.create_pipeline_layout(layout_create_info);
+
+  std::vector<spk::compute_pipeline_create_info> compute_infos(100);
+  for (spk::compute_pipeline_create_info& create_info : compute_infos) {
+    spk::pipeline_shader_stage_create_info stage;
+    stage.set_module(shader);
+    stage.set_name("main");
+    stage.set_stage(spk::shader_stage_flags::compute);
+    create_info.set_stage(stage);
+    create_info.set_layout(layout);
+  }
+  spk::pipeline_shader_stage_create_info stages[2];
+  stages[0].set_module(shader);
+  stages[0].set_name("main");
+  stages[0].set_stage(spk::shader_stage_flags::vertex);
+  stages[1].set_module(shader);
+  stages[1].set_name("main");
+  stages[1].set_stage(spk::shader_stage_flags::fragment);
+  std::vector<spk::graphics_pipeline_create_info> graphics_infos(30);
+  for (spk::graphics_pipeline_create_info& create_info : graphics_infos) {
+    create_info.set_stages({stages, 2});
+    create_info.set_layout(layout);
+  }
+
+  std::vector<spk::pipeline> pipelines;
+  {
+    spk::pipeline_compiler compiler(device, nullptr, num_threads);
+    DVC_ASSERT(compiler.pipeline_cache() != VK_NULL_HANDLE);
+    std::vector<std::future<spk::pipeline>> compute_futures =
+        compiler.compile({compute_infos.data(), compute_infos.size()});
+    std::vector<std::future<spk::pipeline>> graphics_futures =
+        compiler.compile({graphics_infos.data(), graphics_infos.size()});
+    DVC_ASSERT_EQ(compute_futures.size(), compute_infos.size());
+    DVC_ASSERT_EQ(graphics_futures.size(), graphics_infos.size());
+    check_pipelines(compute_futures, pipelines);
+    check_pipelines(graphics_futures, pipelines);
+
+    compiler.wait_idle();
+    std::lock_guard lock(layer.mu);
+    DVC_ASSERT_EQ(layer.uncached_calls, 0u);
+    DVC_ASSERT(!layer.compiled_with.empty());
+    DVC_ASSERT_LE(layer.compiled_with.size(), num_threads);
+    DVC_ASSERT(!layer.compiled_with.count(compiler.pipeline_cache()),
+               "a worker compiled into the merged cache");
+    DVC_ASSERT(layer.merged_into == compiler.pipeline_cache());
+    DVC_ASSERT_EQ(layer.merged.size(), num_threads);
+    for (VkPipelineCache cache : layer.compiled_with)
+      DVC_ASSERT(layer.merged.count(cache), "a worker's cache was not merged");
+  }
+}
+
+}  // namespace
+
+int main() {
+  spk::loader loader(spk::null_driver_get_instance_proc_addr);
+  spk::instance instance = loader.create_instance(spk::instance_create_info());
+  std::vector<spk::physical_device> physical_devices =
+      instance.enumerate_physical_devices();
+  DVC_ASSERT(!physical_devices.empty(), "no physical devices");
+  spk::device device = create_device(physical_devices.at(0));
+  test_pipeline_compiler(device);
+  std::cout << "pipeline_compiler_test passed" << std::endl;
+}
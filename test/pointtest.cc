@@ -13,7 +13,10 @@
 #include "dvc/file.h"
 #include "dvc/terminate.h"
 #include "spk/loader.h"
+#include "spk/memory_allocator.h"
+#include "spk/particles.h"
 #include "spk/spock.h"
+#include "spk/stream_buffer.h"
 #include "spkx/helpers.h"
 // #include "spk/presenter.h"
 #include "spkx/game.h"
@@ -43,28 +46,11 @@ struct Vertex {
   glm::vec2 pos;
   glm::vec3 color;
 };
+static_assert(sizeof(Vertex) ==
+              spk::vertex_size(spk::particle_vertex_format::xy_rgb));
 
-struct PointMass {
-  glm::vec2 pos;
-  glm::vec3 color;
-  glm::vec2 velocity;
-  void update(float alpha, float beta, float gamma, glm::vec2 mouse_pos) {
-    glm::vec2 dmouse = mouse_pos - pos;
-
-    velocity += beta * dmouse;
-
-    velocity *= 1 - gamma;
-
-    pos += alpha * velocity;
-
-    auto adjust = [](float& pos, float& vel) {
-      if (pos > 1 && vel > 0) vel = -vel;
-      if (pos < -1 && vel < 0) vel = -vel;
-    };
-    adjust(pos.x, velocity.x);
-    adjust(pos.y, velocity.y);
-  }
-};
+// Lets spk::particles stream whole cache lines of vertices.
+constexpr uint64_t vertex_alignment = 64;
 
 spk::vertex_input_binding_description get_vertex_input_binding_description() {
   spk::vertex_input_binding_description vertex_input_binding_description;
@@ -89,57 +75,29 @@ get_vertex_input_attribute_descriptions() {
   return result;
 }
 
-spk::buffer create_buffer(spk::device& device) {
-  spk::buffer_create_info buffer_create_info;
-  buffer_create_info.set_size(sizeof(Vertex) * num_points);
-  buffer_create_info.set_usage(spk::buffer_usage_flags::vertex_buffer);
-  buffer_create_info.set_sharing_mode(spk::sharing_mode::exclusive);
-  return device.create_buffer(buffer_create_info);
-}
-
-uint32_t find_compatible_memory_type(spk::physical_device& physical_device,
-                                     spk::buffer& buffer) {
-  const spk::memory_requirements memory_requirements =
-      buffer.memory_requirements();
-
-  static constexpr spk::memory_property_flags flags =
-      spk::memory_property_flags::host_visible |
-      spk::memory_property_flags::host_coherent;
-
-  spk::physical_device_memory_properties memory_properties =
-      physical_device.memory_properties();
-  for (uint32_t i = 0; i < memory_properties.memory_type_count(); ++i) {
-    if (!(memory_requirements.memory_type_bits() & (1 << i))) continue;
-    if (memory_properties.memory_types()[i].property_flags() & flags) return i;
-  }
-  DVC_FATAL("no compatible memory type found");
-}
-
-spk::device_memory create_memory(spk::physical_device& physical_device,
-                                 spk::device& device, spk::buffer& buffer) {
-  const spk::memory_requirements memory_requirements =
-      buffer.memory_requirements();
-  spk::memory_allocate_info memory_allocate_info;
-  memory_allocate_info.set_allocation_size(memory_requirements.size());
-  memory_allocate_info.set_memory_type_index(
-      find_compatible_memory_type(physical_device, buffer));
-  return device.allocate_memory(memory_allocate_info);
-}
-
 struct World {
   World(size_t num_points) : num_points(num_points), points(num_points) {
     rng.seed(std::random_device()());
 
     for (size_t i = 0; i < num_points; ++i) {
-      points[i].pos = glm::vec2{normal(), normal()};
-      points[i].color = glm::vec3{normal(), normal(), normal()};
-      points[i].velocity = glm::vec2{normal(), normal()};
-      points[i].update(0, 0, 0, glm::vec2{0, 0});
+      for (size_t axis = 0; axis < 2; ++axis)
+        points.position(axis)[i] = normal();
+      for (size_t channel = 0; channel < 3; ++channel)
+        points.color(channel)[i] = normal();
+      for (size_t axis = 0; axis < 2; ++axis)
+        points.velocity(axis)[i] = normal();
     }
+    points.step(spk::particle_step());
   }
 
   void update(float alpha, float beta, float gamma) {
-    for (auto& point : points) point.update(alpha, beta, gamma, mouse_pos);
+    spk::particle_step step;
+    step.alpha = alpha;
+    step.beta = beta;
+    step.gamma = gamma;
+    step.target[0] = mouse_pos.x;
+    step.target[1] = mouse_pos.y;
+    points.step(step);
   }
 
   float normal() { return normal_(rng); }
@@ -150,37 +108,11 @@ struct World {
   std::normal_distribution<float> normal_;
   std::mt19937 rng;
   size_t num_points;
-  std::vector<PointMass> points;
-};
-
-struct VertexBuffer {
-  spk::buffer buffer;
-  spk::device_memory device_memory;
-  uint64_t size;
-  void* data;
-
-  void map() { device_memory.map_memory(0, size, data); }
-  void unmap() { device_memory.unmap_memory(); }
-  void update(const World& world) {
-    Vertex* v = (Vertex*)data;
-    for (size_t i = 0; i < world.num_points; ++i) {
-      v[i].color = world.points[i].color;
-      v[i].pos = world.points[i].pos;
-    }
-  }
+  spk::particles points;
 };
 
-VertexBuffer create_vertex_buffer(spk::physical_device& physical_device,
-                                  spk::device& device) {
-  spk::buffer buffer = create_buffer(device);
-  const spk::memory_requirements memory_requirements =
-      buffer.memory_requirements();
-  spk::device_memory device_memory =
-      create_memory(physical_device, device, buffer);
-  buffer.bind_memory(device_memory, 0);
-
-  return {std::move(buffer), std::move(device_memory),
-          memory_requirements.size()};
+void write_vertices(const World& world, Vertex* v) {
+  world.points.write_vertices(spk::particle_vertex_format::xy_rgb, v);
 }
 
 spk::pipeline create_pipeline(spk::device& device, spkx::presenter& presenter) {
@@ -239,37 +171,35 @@ spk::pipeline create_pipeline(spk::device& device, spkx::presenter& presenter) {
 //  return {std::move(command_pool), std::move(command_buffers)};
 //}
 
-std::vector<VertexBuffer> create_vertex_buffers(
-    size_t num_renderings, spk::physical_device& physical_device,
-    spk::device& device) {
-  std::vector<VertexBuffer> buffers;
-  for (size_t i = 0; i < num_renderings; ++i)
-    buffers.emplace_back(create_vertex_buffer(physical_device, device));
-  for (VertexBuffer& buffer : buffers) buffer.map();
-  return buffers;
-}
-
 struct PointTest : spkx::game {
   World world;
   spk::pipeline pipeline;
-  std::vector<VertexBuffer> buffers;
+  spk::memory_allocator memory_allocator;
+  spk::stream_buffer stream;
 
   PointTest(int argc, char** argv)
       : spkx::game(argc, argv),
         world(num_points),
         pipeline(create_pipeline(device(), presenter())),
-        buffers(create_vertex_buffers(num_renderings(), physical_device(),
-                                      device())) {}
+        memory_allocator(physical_device(), device()),
+        stream(physical_device(), device(), memory_allocator,
+               (num_renderings() + 1) *
+                   (sizeof(Vertex) * num_points + vertex_alignment),
+               spk::buffer_usage_flags::vertex_buffer, num_renderings()) {}
 
   void tick() override {}
 
   void prepare_rendering(
       spk::command_buffer& command_buffer, size_t rendering_index,
       spk::render_pass_begin_info& render_pass_begin_info) override {
-    VertexBuffer& current_buffer = buffers[rendering_index];
-
     world.update(0.01, 0.1, 0.01);
-    current_buffer.update(world);
+
+    stream.begin_frame(rendering_index);
+    std::optional<spk::stream_range> vertices =
+        stream.allocate(sizeof(Vertex) * num_points, vertex_alignment);
+    DVC_ASSERT(vertices, "stream buffer full");
+    write_vertices(world, vertices->data<Vertex>());
+    stream.end_frame();
 
     spk::clear_color_value clear_color_value;
     clear_color_value.set_float_32({0, 0, 0, 1});
@@ -282,9 +212,8 @@ struct PointTest : spkx::game {
                                      spk::subpass_contents::inline_);
 
     command_buffer.bind_pipeline(spk::pipeline_bind_point::graphics, pipeline);
-    spk::buffer_ref buffer_ref = current_buffer.buffer;
-    uint64_t offset = 0;
-    command_buffer.bind_vertex_buffers(0, 1, &buffer_ref, &offset);
+    command_buffer.bind_vertex_buffers(0, 1, &vertices->buffer,
+                                       &vertices->offset);
     command_buffer.draw(num_points, 1, 0, 0);
     command_buffer.end_render_pass();
   }
@@ -295,13 +224,6 @@ struct PointTest : spkx::game {
     world.set_mouse_pos(glm::vec2{2 * mouse_x / window_size().x - 1,
                                   2 * mouse_y / window_size().y - 1});
   };
-
-  ~PointTest() {
-    for (VertexBuffer& buffer : buffers) {
-      buffer.unmap();
-      device().free_memory(buffer.device_memory);
-    }
-  }
 };
 
 }  // namespace
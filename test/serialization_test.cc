@@ -0,0 +1,161 @@
+// Round-trips nested create infos through spk::serialize and
+// spk::deserialize and checks that the result describes the same state from
+// memory of its own: a graphics pipeline create info with its state structs,
+// arrays, strings and a pNext chain, and an acceleration structure build
+// info whose geometries are an array of pointers.
+
+#include <iostream>
+
+#include "dvc/log.h"
+#include "spk/serialization.h"
+#include "spk/spock.h"
+
+namespace {
+
+// Checks that x survives a round trip and returns the copy.
+template <typename T>
+T round_trip(const T& x, spk::decode_arena& arena) {
+  std::vector<uint8_t> data = spk::serialize(x);
+  T y = spk::deserialize<T>(data, arena);
+  DVC_ASSERT(spk::deep_equal(x, y));
+  DVC_ASSERT_EQ(spk::deep_hash(x), spk::deep_hash(y));
+  DVC_ASSERT(spk::serialize(y) == data);
+  return y;
+}
+
+void test_graphics_pipeline_create_info() {
+  // Handles are encoded by their bits; these are never used.
+  spk::shader_module_ref vertex_shader =
+      reinterpret_cast<spk::shader_module_ref>(uintptr_t(0x1000));
+  spk::shader_module_ref fragment_shader =
+      reinterpret_cast<spk::shader_module_ref>(uintptr_t(0x2000));
+  spk::pipeline_layout_ref layout =
+      reinterpret_cast<spk::pipeline_layout_ref>(uintptr_t(0x3000));
+
+  spk::pipeline_shader_stage_create_info stages[2];
+  stages[0].set_module(vertex_shader);
+  stages[0].set_name("main");
+  stages[0].set_stage(spk::shader_stage_flags::vertex);
+  stages[1].set_module(fragment_shader);
+  stages[1].set_name("fragment_main");
+  stages[1].set_stage(spk::shader_stage_flags::fragment);
+
+  spk::vertex_input_binding_description binding;
+  binding.set_binding(0);
+  binding.set_stride(24);
+  binding.set_input_rate(spk::vertex_input_rate::vertex);
+  spk::vertex_input_attribute_description attributes[2];
+  attributes[0].set_location(0);
+  attributes[0].set_format(spk::format::r32g32b32_sfloat);
+  attributes[1].set_location(1);
+  attributes[1].set_format(spk::format::r32g32b32_sfloat);
+  attributes[1].set_offset(12);
+  spk::pipeline_vertex_input_state_create_info vertex_input;
+  vertex_input.set_vertex_binding_descriptions({&binding, 1});
+  vertex_input.set_vertex_attribute_descriptions({attributes, 2});
+
+  spk::pipeline_input_assembly_state_create_info input_assembly;
+  input_assembly.set_topology(spk::primitive_topology::triangle_list);
+
+  spk::pipeline_viewport_state_create_info viewport_state;
+
+  spk::pipeline_rasterization_state_create_info rasterizer;
+  rasterizer.set_polygon_mode(spk::polygon_mode::fill);
+  rasterizer.set_line_width(1);
+  rasterizer.set_cull_mode(spk::cull_mode_flags::back);
+  rasterizer.set_front_face(spk::front_face::clockwise);
+
+  spk::pipeline_multisample_state_create_info multisampling;
+  multisampling.set_rasterization_samples(spk::sample_count_flags::n1);
+
+  spk::pipeline_color_blend_attachment_state color_blend_attachment;
+  color_blend_attachment.set_color_write_mask(
+      spk::color_component_flags::r | spk::color_component_flags::g |
+      spk::color_component_flags::b | spk::color_component_flags::a);
+  spk::pipeline_color_blend_state_create_info color_blend;
+  color_blend.set_attachments({&color_blend_attachment, 1});
+  color_blend.set_blend_constants({0.25, 0.5, 0.75, 1});
+
+  spk::dynamic_state dynamic_states[2] = {spk::dynamic_state::viewport,
+                                          spk::dynamic_state::scissor};
+  spk::pipeline_dynamic_state_create_info dynamic_state;
+  dynamic_state.set_dynamic_states({dynamic_states, 2});
+
+  spk::format color_format = spk::format::b8g8r8a8_unorm;
+  spk::pipeline_rendering_create_info rendering;
+  rendering.set_color_attachment_formats({&color_format, 1});
+
+  spk::graphics_pipeline_create_info create_info;
+  create_info.set_next(&rendering);
+  create_info.set_stages({stages, 2});
+  create_info.set_p_vertex_input_state(&vertex_input);
+  create_info.set_p_input_assembly_state(&input_assembly);
+  create_info.set_p_viewport_state(&viewport_state);
+  create_info.set_p_rasterization_state(&rasterizer);
+  create_info.set_p_multisample_state(&multisampling);
+  create_info.set_p_color_blend_state(&color_blend);
+  create_info.set_p_dynamic_state(&dynamic_state);
+  create_info.set_layout(layout);
+
+  spk::decode_arena arena;
+  spk::graphics_pipeline_create_info copy = round_trip(create_info, arena);
+  DVC_ASSERT(copy.stages().data() != create_info.stages().data());
+  DVC_ASSERT(copy.p_vertex_input_state() != &vertex_input);
+  DVC_ASSERT(copy.layout() == layout);
+
+  // A change anywhere below the top level is a different state.
+  stages[1].set_name("main");
+  DVC_ASSERT(!spk::deep_equal(create_info, copy));
+  stages[1].set_name("fragment_main");
+  color_format = spk::format::r8g8b8a8_unorm;
+  DVC_ASSERT(!spk::deep_equal(create_info, copy));
+  color_format = spk::format::b8g8r8a8_unorm;
+  DVC_ASSERT(spk::deep_equal(create_info, copy));
+}
+
+// ppGeometries has no setter of its own, so the struct is filled in as the C
+// struct spk's struct wraps.
+void test_array_of_pointers() {
+  using build_geometry_info =
+      spk::acceleration_structure_build_geometry_info_khr;
+  VkAccelerationStructureGeometryKHR geometries[2] = {};
+  for (size_t i = 0; i < 2; ++i) {
+    geometries[i].sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+    geometries[i].geometryType = VK_GEOMETRY_TYPE_AABBS_KHR;
+    geometries[i].geometry.aabbs.sType =
+        VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_AABBS_DATA_KHR;
+    geometries[i].geometry.aabbs.stride = 24 * (i + 1);
+    geometries[i].flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+  }
+  const VkAccelerationStructureGeometryKHR* pointers[2] = {&geometries[0],
+                                                           &geometries[1]};
+  VkAccelerationStructureBuildGeometryInfoKHR vk_build_info = {
+      VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
+  vk_build_info.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+  vk_build_info.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+  vk_build_info.geometryCount = 2;
+  vk_build_info.ppGeometries = pointers;
+  const auto& build_info =
+      reinterpret_cast<const build_geometry_info&>(vk_build_info);
+
+  spk::decode_arena arena;
+  build_geometry_info copy = round_trip(build_info, arena);
+  const auto& vk_copy =
+      reinterpret_cast<const VkAccelerationStructureBuildGeometryInfoKHR&>(
+          copy);
+  DVC_ASSERT(vk_copy.ppGeometries != pointers);
+  DVC_ASSERT(vk_copy.ppGeometries[1] != &geometries[1]);
+  DVC_ASSERT_EQ(vk_copy.ppGeometries[1]->geometry.aabbs.stride, 48u);
+
+  // The geometries are encoded by value, not by address.
+  geometries[1].flags = 0;
+  DVC_ASSERT(!spk::deep_equal(build_info, copy));
+}
+
+}  // namespace
+
+int main() {
+  test_graphics_pipeline_create_info();
+  test_array_of_pointers();
+  std::cout << "serialization_test passed" << std::endl;
+}
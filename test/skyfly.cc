@@ -19,8 +19,12 @@
 #include "dvc/log.h"
 #include "dvc/opts.h"
 #include "dvc/terminate.h"
+#include "spk/deferred_destruction.h"
 #include "spk/loader.h"
+#include "spk/memory_allocator.h"
+#include "spk/particles.h"
 #include "spk/spock.h"
+#include "spk/stream_buffer.h"
 #include "spkx/game.h"
 #include "spkx/helpers.h"
 #include "spkx/memory.h"
@@ -46,7 +50,7 @@ struct UniformBufferObject {
 spk::descriptor_set_layout create_descriptor_set_layout(spk::device& device) {
   spk::descriptor_set_layout_binding binding;
   binding.set_binding(0);
-  binding.set_descriptor_type(spk::descriptor_type::uniform_buffer);
+  binding.set_descriptor_type(spk::descriptor_type::uniform_buffer_dynamic);
   binding.set_immutable_samplers({nullptr, 1});
   binding.set_stage_flags(spk::shader_stage_flags::vertex);
   spk::descriptor_set_layout_create_info create_info;
@@ -58,23 +62,11 @@ struct Vertex {
   glm::vec3 pos;
   glm::vec3 color;
 };
+static_assert(sizeof(Vertex) ==
+              spk::vertex_size(spk::particle_vertex_format::xyz_rgb));
 
-struct PointMass {
-  glm::vec3 pos;
-  glm::vec3 color;
-  glm::vec3 velocity;
-  void update(float alpha) {
-    pos += alpha * velocity;
-
-    auto adjust = [](float& pos, float& vel) {
-      if (pos > 1 && vel > 0) vel = -vel;
-      if (pos < -1 && vel < 0) vel = -vel;
-    };
-    adjust(pos.x, velocity.x);
-    adjust(pos.y, velocity.y);
-    adjust(pos.z, velocity.z);
-  }
-};
+// Lets spk::particles stream whole cache lines of vertices.
+constexpr uint64_t vertex_alignment = 64;
 
 spk::vertex_input_binding_description get_vertex_input_binding_description() {
   spk::vertex_input_binding_description vertex_input_binding_description;
@@ -132,11 +124,14 @@ struct World {
     rng.seed(std::random_device()());
 
     for (size_t i = 0; i < num_points; ++i) {
-      points[i].pos = glm::vec3{normal(), normal(), normal()};
-      points[i].color = glm::vec3{normal(), normal(), normal()};
-      points[i].velocity = glm::vec3{normal(), normal(), normal()};
-      points[i].update(0);
+      for (size_t axis = 0; axis < 3; ++axis)
+        points.position(axis)[i] = normal();
+      for (size_t channel = 0; channel < 3; ++channel)
+        points.color(channel)[i] = normal();
+      for (size_t axis = 0; axis < 3; ++axis)
+        points.velocity(axis)[i] = normal();
     }
+    points.step(spk::particle_step());
 
     player.pos = {-20, -20, -20};
     player.fac = {20, 20, 20};
@@ -146,7 +141,9 @@ struct World {
   }
 
   void update(float alpha) {
-    for (auto& point : points) point.update(alpha);
+    spk::particle_step step;
+    step.alpha = alpha;
+    points.step(step);
 
     player.vel += player.dir * player.fac * 0.001f;
     player.pos += player.vel;
@@ -174,74 +171,20 @@ struct World {
   std::normal_distribution<float> normal_;
   std::mt19937 rng;
   size_t num_points;
-  std::vector<PointMass> points;
-};
-
-struct VertexBuffer {
-  spk::buffer buffer;
-  spk::device_memory device_memory;
-  uint64_t size;
-  void* data;
-
-  void map() { device_memory.map_memory(0, size, data); }
-  void unmap() { device_memory.unmap_memory(); }
-  void update(const World& world) {
-    Vertex* v = (Vertex*)data;
-    for (size_t i = 0; i < world.num_points; ++i) {
-      v[i].color = world.points[i].color;
-      v[i].pos = world.points[i].pos;
-    }
-  }
+  spk::particles points;
 };
 
-VertexBuffer create_vertex_buffer(spk::physical_device& physical_device,
-                                  spk::device& device) {
-  spk::buffer buffer =
-      spkx::create_buffer(device, sizeof(Vertex) * num_points,
-                          spk::buffer_usage_flags::vertex_buffer);
-  const spk::memory_requirements memory_requirements =
-      buffer.memory_requirements();
-  spk::device_memory device_memory = spkx::create_memory(
-      device, memory_requirements.size(),
-      spkx::find_compatible_memory_type(
-          physical_device, memory_requirements.memory_type_bits(),
-          spk::memory_property_flags::host_visible |
-              spk::memory_property_flags::host_coherent));
-
-  buffer.bind_memory(device_memory, 0);
-
-  return {std::move(buffer), std::move(device_memory),
-          memory_requirements.size()};
+void write_vertices(const World& world, Vertex* v) {
+  world.points.write_vertices(spk::particle_vertex_format::xyz_rgb, v);
 }
 
-struct UniformBuffer {
-  spk::buffer buffer;
-  spk::device_memory device_memory;
-  uint64_t size;
-  void* data;
-
-  void map() { device_memory.map_memory(0, size, data); }
-  void unmap() { device_memory.unmap_memory(); }
-  void update(const UniformBufferObject& ubo) { std::memcpy(data, &ubo, size); }
-};
-
-UniformBuffer create_uniform_buffer(spk::physical_device& physical_device,
-                                    spk::device& device) {
-  spk::buffer buffer =
-      spkx::create_buffer(device, sizeof(UniformBufferObject),
-                          spk::buffer_usage_flags::uniform_buffer);
-  const spk::memory_requirements memory_requirements =
-      buffer.memory_requirements();
-  spkx::memory_type_index memory_type_index = spkx::find_compatible_memory_type(
-      physical_device, memory_requirements.memory_type_bits(),
-      spk::memory_property_flags::host_visible |
-          spk::memory_property_flags::host_coherent);
-  spk::device_memory device_memory = spkx::create_memory(
-      device, memory_requirements.size(), memory_type_index);
-  buffer.bind_memory(device_memory, 0);
-
-  return {std::move(buffer), std::move(device_memory),
-          memory_requirements.size()};
+// Room for num_renderings frames of vertices and uniforms plus one more, as
+// a frame that does not fit before the end of the ring skips the rest of it.
+uint64_t stream_size(size_t num_renderings) {
+  constexpr uint64_t max_uniform_alignment = 256;
+  uint64_t frame_size = sizeof(Vertex) * num_points + vertex_alignment +
+                        sizeof(UniformBufferObject) + max_uniform_alignment;
+  return (num_renderings + 1) * frame_size;
 }
 
 spk::pipeline_layout create_pipeline_layout(
@@ -268,38 +211,19 @@ spk::pipeline create_pipeline(spk::device& device, spkx::presenter& presenter,
   return spkx::create_pipeline(device, presenter, config);
 }
 
-std::vector<VertexBuffer> create_vertex_buffers(
-    size_t num_renderings, spk::physical_device& physical_device,
-    spk::device& device) {
-  std::vector<VertexBuffer> buffers;
-  for (size_t i = 0; i < num_renderings; ++i)
-    buffers.emplace_back(create_vertex_buffer(physical_device, device));
-  for (VertexBuffer& buffer : buffers) buffer.map();
-  return buffers;
-}
-
-std::vector<UniformBuffer> create_uniform_buffers(
-    size_t num_renderings, spk::physical_device& physical_device,
-    spk::device& device) {
-  std::vector<UniformBuffer> buffers;
-  for (size_t i = 0; i < num_renderings; ++i)
-    buffers.emplace_back(create_uniform_buffer(physical_device, device));
-  for (UniformBuffer& buffer : buffers) buffer.map();
-  return buffers;
-}
-
 spk::descriptor_pool create_descriptor_pool(spk::device& device,
                                             uint32_t pool_size) {
   spk::descriptor_pool_create_info create_info;
+  create_info.set_flags(spk::descriptor_pool_create_flags::free_descriptor_set);
   create_info.set_max_sets(pool_size);
   spk::descriptor_pool_size size;
   size.set_descriptor_count(pool_size);
-  size.set_type(spk::descriptor_type::uniform_buffer);
+  size.set_type(spk::descriptor_type::uniform_buffer_dynamic);
   create_info.set_pool_sizes({&size, 1});
   return device.create_descriptor_pool(create_info);
 }
 
-std::vector<spk::descriptor_set> create_descriptor_sets(
+spk::descriptor_set_array create_descriptor_sets(
     spk::device& device, spk::descriptor_pool& descriptor_pool,
     spk::descriptor_set_layout& layout, uint32_t num_descriptors) {
   spk::descriptor_set_allocate_info allocate_info;
@@ -344,10 +268,11 @@ struct SkyFly : spkx::game {
   spk::descriptor_set_layout descriptor_set_layout;
   spk::pipeline_layout pipeline_layout;
   spk::pipeline pipeline;
-  std::vector<VertexBuffer> vertex_buffers;
-  std::vector<UniformBuffer> uniform_buffers;
+  spk::memory_allocator memory_allocator;
+  spk::stream_buffer stream;
   spk::descriptor_pool descriptor_pool;
-  std::vector<spk::descriptor_set> descriptor_sets;
+  spk::descriptor_set_array descriptor_sets;
+  spk::deferred_destruction retired;
 
   SkyFly(int argc, char** argv)
       : spkx::game(argc, argv),
@@ -356,31 +281,31 @@ struct SkyFly : spkx::game {
         pipeline_layout(
             create_pipeline_layout(device(), descriptor_set_layout)),
         pipeline(create_pipeline(device(), presenter(), pipeline_layout)),
-        vertex_buffers(create_vertex_buffers(num_renderings(),
-                                             physical_device(), device())),
-        uniform_buffers(create_uniform_buffers(num_renderings(),
-                                               physical_device(), device())),
-        descriptor_pool(create_descriptor_pool(device(), num_renderings())),
+        memory_allocator(physical_device(), device()),
+        stream(physical_device(), device(), memory_allocator,
+               stream_size(num_renderings()),
+               spk::buffer_usage_flags::vertex_buffer |
+                   spk::buffer_usage_flags::uniform_buffer,
+               num_renderings()),
+        descriptor_pool(create_descriptor_pool(device(), 1)),
         descriptor_sets(create_descriptor_sets(device(), descriptor_pool,
-                                               descriptor_set_layout,
-                                               num_renderings())) {
-    DVC_ASSERT_EQ(uniform_buffers.size(), descriptor_sets.size());
-    DVC_ASSERT_EQ(uniform_buffers.size(), num_renderings());
-    for (size_t i = 0; i < num_renderings(); i++) {
-      spk::descriptor_buffer_info buffer_info;
-      buffer_info.set_buffer(uniform_buffers[i].buffer);
-      buffer_info.set_offset(0);
-      buffer_info.set_range(sizeof(UniformBufferObject));
-      spk::write_descriptor_set write;
-      write.set_buffer_info({&buffer_info, 1});
-      write.set_descriptor_type(spk::descriptor_type::uniform_buffer);
-      write.set_dst_array_element(0);
-      write.set_dst_binding(0);
-      write.set_dst_set(descriptor_sets[i]);
-      write.set_image_info({nullptr, 1});
-      write.set_texel_buffer_view({nullptr, 1});
-      device().update_descriptor_sets({&write, 1}, {nullptr, 0});
-    }
+                                               descriptor_set_layout, 1)),
+        retired(device().context()) {
+    // One descriptor for every frame; each frame's uniforms are selected by
+    // the dynamic offset passed to bind_descriptor_sets.
+    spk::descriptor_buffer_info buffer_info;
+    buffer_info.set_buffer(stream.buffer());
+    buffer_info.set_offset(0);
+    buffer_info.set_range(sizeof(UniformBufferObject));
+    spk::write_descriptor_set write;
+    write.set_buffer_info({&buffer_info, 1});
+    write.set_descriptor_type(spk::descriptor_type::uniform_buffer_dynamic);
+    write.set_dst_array_element(0);
+    write.set_dst_binding(0);
+    write.set_dst_set(descriptor_sets[0]);
+    write.set_image_info({nullptr, 1});
+    write.set_texel_buffer_view({nullptr, 1});
+    device().update_descriptor_sets({&write, 1}, {nullptr, 0});
   }
 
   void tick() override {}
@@ -389,17 +314,22 @@ struct SkyFly : spkx::game {
       spk::command_buffer& command_buffer, size_t rendering_index,
       spk::render_pass_begin_info& render_pass_begin_info) override {
     // std::terminate();
-    VertexBuffer& current_buffer = vertex_buffers[rendering_index];
-    UniformBuffer& uniform_buffer = uniform_buffers[rendering_index];
+    stream.begin_frame(rendering_index);
 
     world.update(0.01);
-    current_buffer.update(world);
+    std::optional<spk::stream_range> vertices =
+        stream.allocate(sizeof(Vertex) * num_points, vertex_alignment);
+    DVC_ASSERT(vertices, "stream buffer full");
+    write_vertices(world, vertices->data<Vertex>());
 
     UniformBufferObject ubo;
     ubo.view = glm::lookAt(
         world.player.pos, world.player.pos + world.player.fac, world.player.up);
     ubo.proj = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
-    uniform_buffer.update(ubo);
+    std::optional<spk::stream_range> uniforms = stream.write_uniform(ubo);
+    DVC_ASSERT(uniforms, "stream buffer full");
+
+    stream.end_frame();
     spk::clear_color_value clear_color_value;
     clear_color_value.set_float_32({0, 0, 0, 1});
 
@@ -411,14 +341,14 @@ struct SkyFly : spkx::game {
                                      spk::subpass_contents::inline_);
 
     command_buffer.bind_pipeline(spk::pipeline_bind_point::graphics, pipeline);
-    spk::buffer_ref buffer_ref = current_buffer.buffer;
-    uint64_t offset = 0;
-    command_buffer.bind_vertex_buffers(0, 1, &buffer_ref, &offset);
-    spk::descriptor_set_ref descriptor_set_ref =
-        descriptor_sets.at(rendering_index);
+    command_buffer.bind_vertex_buffers(0, 1, &vertices->buffer,
+                                       &vertices->offset);
+    spk::descriptor_set_ref descriptor_set_ref = descriptor_sets.at(0);
+    uint32_t dynamic_offset = uint32_t(uniforms->offset);
     command_buffer.bind_descriptor_sets(spk::pipeline_bind_point::graphics,
                                         pipeline_layout, 0,
-                                        {&descriptor_set_ref, 1}, {nullptr, 0});
+                                        {&descriptor_set_ref, 1},
+                                        {&dynamic_offset, 1});
     command_buffer.draw(num_points, 1, 0, 0);
     command_buffer.end_render_pass();
   }
@@ -465,16 +395,9 @@ struct SkyFly : spkx::game {
     }
   }
 
-  ~SkyFly() {
-    for (VertexBuffer& buffer : vertex_buffers) {
-      buffer.unmap();
-      device().free_memory(buffer.device_memory);
-    }
-    for (UniformBuffer& buffer : uniform_buffers) {
-      buffer.unmap();
-      device().free_memory(buffer.device_memory);
-    }
-  }
+  // The last frames may still be in flight, so the stream buffer is
+  // released by retired, after the device is idle.
+  ~SkyFly() { retired.retire_at_idle(std::move(stream)); }
 };
 
 }  // namespace
@@ -12,6 +12,7 @@
 #include "dvc/opts.h"
 #include "dvc/terminate.h"
 #include "spk/loader.h"
+#include "spk/pipeline_cache.h"
 #include "spk/spock.h"
 
 namespace spk {
@@ -368,7 +369,11 @@ struct Pipeline {
   spk::pipeline pipeline;
 };
 
-Pipeline create_pipeline(spk::device& device, Swapchain& swapchain) {
+std::string DVC_OPTION(pipeline_cache_dir, -, "/tmp/spockgen",
+                       "directory of the persistent pipeline cache");
+
+Pipeline create_pipeline(spk::device& device, Swapchain& swapchain,
+                         spk::pipeline_cache_ref pipeline_cache) {
   spk::shader_module vertex_shader =
       create_shader(device, "test/triangletest1.vert.spv");
   spk::shader_module fragment_shader =
@@ -467,7 +472,7 @@ Pipeline create_pipeline(spk::device& device, Swapchain& swapchain) {
   pipeline_info.set_p_multisample_state(&multisampling);
 
   spk::pipeline pipeline = std::move(
-      device.create_graphics_pipelines(VK_NULL_HANDLE, {&pipeline_info, 1})
+      device.create_graphics_pipelines(pipeline_cache, {&pipeline_info, 1})
           .at(0));
   return {std::move(vertex_shader), std::move(fragment_shader),
           std::move(pipeline_layout), std::move(render_pass),
@@ -535,19 +540,9 @@ spk::command_pool create_command_pool(spk::device& device,
   return device.create_command_pool(pool_info);
 }
 
-spk::command_buffer create_command_buffer(spk::device& device,
-                                          spk::command_pool& command_pool,
-                                          Pipeline& pipeline,
-                                          Framebuffer& framebuffer,
-                                          Swapchain& swapchain) {
-  spk::command_buffer_allocate_info command_buffer_allocate_info;
-  command_buffer_allocate_info.set_command_pool(command_pool);
-  command_buffer_allocate_info.set_level(spk::command_buffer_level::primary);
-  command_buffer_allocate_info.set_command_buffer_count(1);
-
-  spk::command_buffer command_buffer = std::move(
-      device.allocate_command_buffers(command_buffer_allocate_info).at(0));
-
+void record_command_buffer(spk::command_buffer command_buffer,
+                           Pipeline& pipeline, Framebuffer& framebuffer,
+                           Swapchain& swapchain) {
   spk::command_buffer_begin_info command_buffer_begin_info;
   command_buffer_begin_info.set_flags(
       spk::command_buffer_usage_flags::simultaneous_use);
@@ -571,12 +566,11 @@ spk::command_buffer create_command_buffer(spk::device& device,
   command_buffer.draw(3, 1, 0, 0);
   command_buffer.end_render_pass();
   command_buffer.end();
-  return command_buffer;
 }
 
 struct Commands {
   spk::command_pool command_pool;
-  std::vector<spk::command_buffer> command_buffers;
+  spk::command_buffer_array command_buffers;
 };
 
 Commands create_commands(spk::device& device, uint32_t queue_family_index,
@@ -586,16 +580,22 @@ Commands create_commands(spk::device& device, uint32_t queue_family_index,
   spk::command_pool command_pool =
       create_command_pool(device, queue_family_index);
 
-  std::vector<spk::command_buffer> command_buffers;
-  for (Framebuffer& framebuffer : framebuffers)
-    command_buffers.push_back(create_command_buffer(
-        device, command_pool, pipeline, framebuffer, swapchain));
+  spk::command_buffer_allocate_info command_buffer_allocate_info;
+  command_buffer_allocate_info.set_command_pool(command_pool);
+  command_buffer_allocate_info.set_level(spk::command_buffer_level::primary);
+  command_buffer_allocate_info.set_command_buffer_count(framebuffers.size());
+
+  spk::command_buffer_array command_buffers =
+      device.allocate_command_buffers(command_buffer_allocate_info);
+  for (size_t i = 0; i < framebuffers.size(); ++i)
+    record_command_buffer(command_buffers.handle(i), pipeline,
+                          framebuffers[i], swapchain);
 
   return {std::move(command_pool), std::move(command_buffers)};
 }
 
 void main_loop(spk::device& device, Swapchain& swapchain, spk::queue& queue,
-               std::vector<spk::command_buffer>& command_buffers) {
+               spk::command_buffer_array& command_buffers) {
   std::vector<spk::semaphore> image_available_semaphores;
   std::vector<spk::semaphore> render_finished_semaphores;
   std::vector<spk::fence> fences;
@@ -735,7 +735,11 @@ void triangle_test() {
   Swapchain swapchain =
       create_swapchain(physical_device, window.get(), surface, device);
 
-  Pipeline pipeline = create_pipeline(device, swapchain);
+  spk::persistent_pipeline_cache pipeline_cache(physical_device, device,
+                                                pipeline_cache_dir);
+
+  Pipeline pipeline =
+      create_pipeline(device, swapchain, pipeline_cache.main_cache());
 
   std::vector<Framebuffer> framebuffers =
       create_framebuffers(device, swapchain, pipeline);
@@ -0,0 +1,167 @@
+// Uploads overlapping ranges of one buffer through spk::upload_scheduler on
+// spk's null driver and checks that the bytes of the last upload win.  The
+// null driver executes nothing, so a layer below the scheduler carries out
+// each vkCmdCopyBuffer on the host as it is recorded, which is after
+// upload() has written staging, and checks that no two of its regions
+// overlap in the destination.
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "dvc/log.h"
+#include "spk/loader.h"
+#include "spk/memory_allocator.h"
+#include "spk/null_driver.h"
+#include "spk/spock.h"
+#include "spk/upload_scheduler.h"
+
+namespace {
+
+// The null driver's memory is host memory, so a buffer's bytes are at the
+// address its memory is mapped at plus its bind offset.
+struct host_copies {
+  spk::device_dispatch_table next;
+  std::map<VkDeviceMemory, uint8_t*> memory_data;
+  std::map<VkBuffer, uint8_t*> buffer_data;
+  uint64_t regions = 0;
+} layer;
+
+VKAPI_ATTR VkResult VKAPI_CALL map_memory(VkDevice device,
+                                          VkDeviceMemory memory,
+                                          VkDeviceSize offset,
+                                          VkDeviceSize size,
+                                          VkMemoryMapFlags flags,
+                                          void** data) {
+  VkResult result =
+      layer.next.vkMapMemory(device, memory, offset, size, flags, data);
+  layer.memory_data[memory] = static_cast<uint8_t*>(*data) - offset;
+  return result;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL bind_buffer_memory(VkDevice device,
+                                                  VkBuffer buffer,
+                                                  VkDeviceMemory memory,
+                                                  VkDeviceSize offset) {
+  auto it = layer.memory_data.find(memory);
+  DVC_ASSERT(it != layer.memory_data.end(), "buffer bound to unmapped memory");
+  layer.buffer_data[buffer] = it->second + offset;
+  return layer.next.vkBindBufferMemory(device, buffer, memory, offset);
+}
+
+VKAPI_ATTR void VKAPI_CALL cmd_copy_buffer(VkCommandBuffer command_buffer,
+                                           VkBuffer src, VkBuffer dst,
+                                           uint32_t count,
+                                           const VkBufferCopy* regions) {
+  for (uint32_t i = 0; i < count; ++i)
+    for (uint32_t j = 0; j < i; ++j)
+      DVC_ASSERT(regions[i].dstOffset + regions[i].size <=
+                         regions[j].dstOffset ||
+                     regions[j].dstOffset + regions[j].size <=
+                         regions[i].dstOffset,
+                 "regions ", j, " and ", i, " overlap in the destination");
+  for (uint32_t i = 0; i < count; ++i)
+    std::memcpy(layer.buffer_data.at(dst) + regions[i].dstOffset,
+                layer.buffer_data.at(src) + regions[i].srcOffset,
+                regions[i].size);
+  layer.regions += count;
+  layer.next.vkCmdCopyBuffer(command_buffer, src, dst, count, regions);
+}
+
+spk::device create_device(spk::physical_device& physical_device) {
+  spk::device_queue_create_info queue_create_info;
+  queue_create_info.set_queue_family_index(0);
+  float queue_priority = 1.0;
+  queue_create_info.set_queue_priorities({&queue_priority, 1});
+  spk::physical_device_timeline_semaphore_features timeline_features;
+  timeline_features.set_timeline_semaphore(true);
+  spk::device_create_info create_info;
+  create_info.set_next(&timeline_features);
+  create_info.set_queue_create_infos({&queue_create_info, 1});
+  return physical_device.create_device(
+      create_info, [](spk::device_dispatch_table& table) {
+        layer.next = table;
+        table.vkMapMemory = map_memory;
+        table.vkBindBufferMemory = bind_buffer_memory;
+        table.vkCmdCopyBuffer = cmd_copy_buffer;
+      });
+}
+
+spk::buffer create_buffer(spk::device& device, uint64_t size) {
+  spk::buffer_create_info create_info;
+  create_info.set_size(size);
+  create_info.set_usage(spk::buffer_usage_flags::transfer_dst);
+  create_info.set_sharing_mode(spk::sharing_mode::exclusive);
+  return device.create_buffer(create_info);
+}
+
+// Uploads size bytes of value at offset and applies them to expected.
+void upload(spk::upload_scheduler& uploads, spk::buffer_ref dst,
+            std::vector<uint8_t>& expected, uint64_t offset, uint64_t size,
+            uint8_t value) {
+  std::vector<uint8_t> data(size, value);
+  uploads.upload(dst, offset, data.data(), size);
+  std::memset(expected.data() + offset, value, size);
+}
+
+void test_overlapping_uploads(spk::device& device,
+                              spk::memory_allocator& memory_allocator,
+                              spk::queue& queue) {
+  constexpr uint64_t size = 4096;
+  spk::buffer dst = create_buffer(device, size);
+  spk::memory_allocation memory = memory_allocator.allocate_for(
+      dst, spk::memory_property_flags::host_visible |
+               spk::memory_property_flags::host_coherent);
+  DVC_ASSERT(memory.mapped());
+  std::memset(memory.mapped(), 0, size);
+  std::vector<uint8_t> expected(size, 0);
+  auto check = [&] {
+    DVC_ASSERT(std::memcmp(memory.mapped(), expected.data(), size) == 0,
+               "a later upload was overwritten");
+  };
+
+  spk::upload_scheduler uploads(device, memory_allocator, queue, 0, 0,
+                                64 * 1024);
+
+  // A later upload inside, across the end of, and around earlier ones.
+  upload(uploads, dst, expected, 0, 64, 1);
+  upload(uploads, dst, expected, 16, 16, 2);
+  upload(uploads, dst, expected, 48, 32, 3);
+  upload(uploads, dst, expected, 8, 100, 4);
+  upload(uploads, dst, expected, 100, 8, 5);
+  uploads.wait(uploads.flush());
+  check();
+
+  std::mt19937_64 rng(1);
+  for (int round = 0; round < 200; ++round) {
+    int n = rng() % 16 + 1;
+    for (int i = 0; i < n; ++i) {
+      uint64_t offset = rng() % size / 4 * 4;
+      uint64_t length = (rng() % 256 + 1) * 4;
+      length = std::min(length, size - offset);
+      upload(uploads, dst, expected, offset, length, uint8_t(rng()));
+    }
+    uploads.wait(uploads.flush());
+    check();
+  }
+  DVC_ASSERT_GT(layer.regions, 0u);
+}
+
+}  // namespace
+
+int main() {
+  spk::loader loader(spk::null_driver_get_instance_proc_addr);
+  spk::instance instance = loader.create_instance(spk::instance_create_info());
+  std::vector<spk::physical_device> physical_devices =
+      instance.enumerate_physical_devices();
+  DVC_ASSERT(!physical_devices.empty(), "no physical devices");
+  spk::physical_device& physical_device = physical_devices.at(0);
+  spk::device device = create_device(physical_device);
+  spk::memory_allocator memory_allocator(physical_device, device);
+  spk::queue queue = device.queue(0, 0);
+  test_overlapping_uploads(device, memory_allocator, queue);
+  std::cout << "upload_scheduler_test passed" << std::endl;
+}
@@ -1,5 +1,9 @@
+#include <algorithm>
+#include <cctype>
 #include <iostream>
+#include <map>
 #include <set>
+#include <sstream>
 #include <unordered_set>
 
 #include "dvc/container.h"
@@ -17,6 +21,15 @@ std::string DVC_OPTION(outjson, -, "", "Output AST to json");
 std::string DVC_OPTION(outtest, -, "", "Output test of API");
 std::string DVC_OPTION(outh, -, "", "Output C++ header");
 std::string DVC_OPTION(outcc, -, "", "Output C++ source");
+std::string DVC_OPTION(outspk, -, "", "Output Spock C++ header");
+std::string DVC_OPTION(outcapture, -, "",
+                       "Output capture and replay C++ header");
+std::string DVC_OPTION(outinstrumentation, -, "",
+                       "Output per-command instrumentation C++ header");
+std::string DVC_OPTION(outnulldriver, -, "", "Output null driver C++ header");
+bool DVC_OPTION(thin_handles, -, false,
+                "Emit device child handles as a raw handle plus a pointer to "
+                "the shared spk::device_context");
 
 void write_test(const vks::Registry& registry) {
   dvc::file_writer test(outtest, dvc::truncate);
@@ -181,740 +194,1547 @@ void write_source(const vks::Registry& registry) {
   h.println("}  // namespace vulkan");
 }
 
-//  h.println("#pragma once");
-//  h.println();
-//  h.println("#include <array>");
-//  h.println("#include <cstring>");
-//  h.println("#include <type_traits>");
-//  h.println("#include <vulkan/vulkan.h>");
-//  h.println();
-//  h.println("#include \"spk/spock_fwd.h\"");
-//  h.println();
-//  h.println("namespace vulkan {");
-
-//  for (const auto& [name, command] : registry.commands) {
-//    (void)command;
-//    if (command->platform) test.println("#ifdef ",
-//    command->platform->protect); test.println("extern
-//    PFN_VKXMLTEST_CHECK_COMMAND(", name, ", ",
-//                 command->to_type_string(), ");");
-//    if (command->platform) test.println("#endif");
-//  }
-
-//  h.println("#pragma once");
-//  h.println();
-//  h.println("#include <array>");
-//  h.println("#include <cstring>");
-//  h.println("#include <type_traits>");
-//  h.println("#include <vulkan/vulkan.h>");
-//  h.println();
-//  h.println("#include \"spk/spock_fwd.h\"");
-//  h.println();
-//  h.println("namespace spk {");
-//  h.println();
-//
-//  for (const sps::Bitmask* bitmask : registry.bitmasks) {
-//    if (bitmask->enumerators.empty()) continue;
-//    std::string name = bitmask->name;
-//    h.println("// bitmask ", bitmask->bitmask->name);
-//    h.print("enum class ", name, " {");
-//    h.println();
-//    for (const auto& enumerator : bitmask->enumerators)
-//      h.println("  ", enumerator.name, " = ", enumerator.constant->name, ",");
-//    h.println("};");
-//    h.println("SPK_DEFINE_BITMASK_BITWISE_OPS(", name, ");");
-//    h.println();
-//    for (const auto& alias : bitmask->aliases) {
-//      h.println("using ", alias, " = ", bitmask->name, ";");
-//      h.println();
-//    }
-//    h.println("inline std::ostream& operator<<(std::ostream& o, ", name,
-//              " e){");
-//    h.println("  SPK_BEGIN_BITMASK_OUTPUT(", name, ")");
-//    for (const auto& enumerator : bitmask->enumerators) {
-//      h.println("  SPK_BITMASK_OUTPUT_ENUMERATOR(", name, ", ",
-//      enumerator.name,
-//                ")");
-//    }
-//    h.println("  SPK_END_BITMASK_OUTPUT(", name, ")");
-//    h.println("}");
-//  }
-//
-//  for (const sps::Enumeration* enumeration : registry.enumerations) {
-//    if (enumeration->enumerators.empty()) continue;
-//    std::string name = enumeration->name;
-//    h.println("// enumeration ", enumeration->enumeration->name);
-//    h.println("enum class ", name, " {");
-//    for (const auto& enumerator : enumeration->enumerators)
-//      h.println("  ", enumerator.name, " = ", enumerator.constant->name, ",");
-//    h.println("};");
-//    h.println();
-//    for (const auto& alias : enumeration->aliases) {
-//      h.println("using ", alias, " = ", enumeration->name, ";");
-//      h.println();
-//    }
-//    h.println("inline std::ostream& operator<<(std::ostream& o, ", name,
-//              " e){");
-//    h.println("  SPK_BEGIN_ENUMERATION_OUTPUT(", name, ")");
-//    for (const auto& enumerator : enumeration->enumerators) {
-//      h.println("  SPK_ENUMERATION_OUTPUT_ENUMERATOR(", name, ", ",
-//                enumerator.name, ")");
-//    }
-//    h.println("  SPK_END_ENUMERATION_OUTPUT(", name, ")");
-//    h.println("}");
-//    if (enumeration->name == "result") {
-//      h.println("SPK_BEGIN_RESULT_ERRORS");
-//      for (const auto& enumerator : enumeration->enumerators)
-//        if (dvc::startswith(enumerator.name, "error"))
-//          h.println("SPK_DEFINE_RESULT_ERROR(", enumerator.name, ")");
-//      h.println("SPK_END_RESULT_ERRORS");
-//    }
-//  }
-//
-//  for (const auto& constant : registry.constants) {
-//    if (constant->constant->platform)
-//      h.println("#ifdef ", constant->constant->platform->protect);
-//    h.println("constexpr auto ", constant->name, " = ",
-//              constant->constant->name, ";");
-//    if (constant->constant->platform) h.println("#endif");
-//  }
-//
-//  h.println();
-//
-//  h.println("// handle refs");
-//  for (const auto& handle : registry.handles) {
-//    h.println("using ", handle->name, " = ", handle->handle->name, ";");
-//  }
-//
-//  h.println("// struct fwd decls");
-//  for (const auto& struct_ : registry.structs) {
-//    if (struct_->struct_->platform)
-//      h.println("#ifdef ", struct_->struct_->platform->protect);
-//    std::string keyword = (struct_->struct_->is_union ? "union" : "class");
-//    h.println(keyword, " ", struct_->name, ";");
-//    if (struct_->struct_->platform) h.println("#endif");
-//  }
-//  h.println();
-//  for (const auto& struct_ : registry.structs) {
-//    if (struct_->struct_->platform)
-//      h.println("#ifdef ", struct_->struct_->platform->protect);
-//    std::string keyword = (struct_->struct_->is_union ? "union" : "class");
-//    h.println(keyword, " ", struct_->name, " {");
-//    h.println(" public:");
-//    h.println("  using underlying_type = ", struct_->struct_->name, ";");
-//    h.println();
-//    if (struct_->struct_->is_union) {
-//      h.println("  ", struct_->name, "() { std::memset(this, 0, sizeof(",
-//                struct_->name, ")); }");
-//      h.println();
-//    }
-//    //    auto member_name = [&](size_t member_idx) {
-//    //      return struct_->struct_->members.at(member_idx).name + "_";
-//    //    };
-//
-//    for (bool mutator : {true, false}) {
-//      if (mutator) {
-//        h.println("  // mutators");
-//      } else {
-//        h.println("  // accessors");
-//      }
-//
-//      for (const auto& accessor : struct_->accessors) {
-//        if (auto value_accessor =
-//                dynamic_cast<const sps::ValueAccessor*>(accessor)) {
-//          DVC_ASSERT(dvc::endswith(value_accessor->member->name, "_"));
-//          std::string mname = value_accessor->member->name;
-//          std::string bname = mname.substr(0, mname.size() - 1);
-//          bool large = value_accessor->large;
-//
-//          if (mutator) {
-//            h.println("  void set_", bname, "(", (large ? "const " : ""),
-//                      value_accessor->member->stype->make_declaration(
-//                          (large ? "& value" : "value"), false),
-//                      ") { ", mname, " = value; }");
-//          } else {
-//            h.println("  ", (large ? "const " : ""),
-//                      value_accessor->member->stype->make_declaration(
-//                          (large ? "& " : "") + bname, false),
-//                      "() const { return ", mname, "; }");
-//          }
-//        } else if (auto string_accessor =
-//                       dynamic_cast<const sps::StringAccessor*>(accessor)) {
-//          std::string mname = string_accessor->member->name;
-//          std::string aname = string_accessor->name;
-//
-//          if (mutator) {
-//            h.println("  void set_", aname, "(spk::string_ptr str) { ", mname,
-//                      " = str.get(); }");
-//          } else {
-//            h.println("  std::string_view ", aname, "() const { return ",
-//            mname,
-//                      "; }");
-//          }
-//        } else if (auto bool_accessor =
-//                       dynamic_cast<const sps::BoolAccessor*>(accessor)) {
-//          std::string mname = bool_accessor->member->name;
-//          std::string aname = bool_accessor->name;
-//
-//          if (mutator) {
-//            h.println("  void set_", aname, "(bool val) { ", mname,
-//                      " = val; }");
-//          } else {
-//            h.println("  bool ", aname, "() const { return ", mname, "; }");
-//          }
-//        } else if (auto span_accessor =
-//                       dynamic_cast<const sps::SpanAccessor*>(accessor)) {
-//          std::string mcount = span_accessor->count->name;
-//          std::string msubject = span_accessor->subject->name;
-//          const vks::Pointer* ptr_type =
-//              dynamic_cast<const
-//              vks::Pointer*>(span_accessor->subject->stype);
-//          DVC_ASSERT(ptr_type);
-//          const vks::Type* element_type = ptr_type->T;
-//          std::string aname = span_accessor->name;
-//
-//          if (mutator) {
-//            h.println("  void set_", aname, "(spk::array_ptr<",
-//                      element_type->to_string(), "> value) { ", msubject,
-//                      " = value.data(); ", mcount, " = value.size(); }");
-//          } else {
-//            h.println("  spk::array_view<", element_type->to_string(), "> ",
-//                      aname, "() const { return {", msubject, ", ", mcount,
-//                      "};}");
-//          }
-//        } else {
-//          DVC_FATAL("Unknown Accessor subclass ", typeid(accessor).name());
-//        }
-//      }
-//      h.println();
-//    }
-//    if (struct_->struct_->structured_type) {
-//      h.println("  void set_next(void* next) { p_next_ = next; }");
-//    }
-//    h.println(" private:");
-//    if (struct_->struct_->structured_type) {
-//      h.println("  VkStructureType s_type_ = ",
-//                struct_->struct_->structured_type->name, ";");
-//      h.println("  void* p_next_ = nullptr;");
-//      h.println();
-//    }
-//    for (const auto& member : struct_->members)
-//      if (member.empty_enum())
-//        h.println("  VkFlags ", member.name, " = {}; // reserved");
-//      else
-//        h.println("  ",
-//                  member.stype->make_declaration(
-//                      member.name, /*zero*/ !struct_->struct_->is_union),
-//                  ";", (member.optional(0) ? "// optional" : ""));
-//    h.println("};");
-//    h.println("static_assert(sizeof(", struct_->name, ") == sizeof(",
-//              struct_->name, "::underlying_type));");
-//    for (const auto& alias : struct_->aliases) {
-//      h.println("using ", alias, " = ", struct_->name, ";");
-//      h.println();
-//    }
-//    if (struct_->struct_->platform) h.println("#endif");
-//    h.println();
-//  }
-//
-//  for (vks::DispatchTableKind kind :
-//       {vks::DispatchTableKind::GLOBAL, vks::DispatchTableKind::INSTANCE,
-//        vks::DispatchTableKind::DEVICE}) {
-//    std::string name = std::string(vks::to_string(kind)) + "_dispatch_table";
-//    const sps::DispatchTable* dispatch_table = registry.dispatch_table(kind);
-//    h.println("struct ", name, " {");
-//    if (kind == vks::DispatchTableKind::INSTANCE)
-//      h.println("  spk::instance_ref instance;");
-//    else if (kind == vks::DispatchTableKind::DEVICE)
-//      h.println("  spk::device_ref device;");
-//
-//    h.println("  // spock commands");
-//    for (const sps::Command* command : dispatch_table->commands) {
-//      bool isresult = (command->vreturn_type->to_string() == "VkResult");
-//      bool ismultisuccess =
-//          (isresult && command->command->successcodes.size() > 1);
-//      bool isonesuccess = (isresult && !ismultisuccess);
-//      bool isvoid = command->vreturn_type->to_string() == "void";
-//      bool isother = (!isvoid && !isresult);
-//
-//      if (command->command->platform)
-//        h.println("#ifdef ", command->command->platform->protect);
-//
-//      if (ismultisuccess) {
-//        h.println("  [[nodiscard]] spk::result ", command->name, "(");
-//      } else {
-//        h.println("  ", command->sreturn_type->to_string(), " ",
-//        command->name,
-//                  "(");
-//      }
-//      bool first = true;
-//      for (const sps::Param& param : command->params) {
-//        if (param.stype->is_empty_enum()) continue;
-//        if (first) {
-//          first = false;
-//        } else {
-//          h.println(",");
-//        }
-//        h.print("    ", param.stype->make_declaration(param.name, 0));
-//      }
-//      h.println();
-//      h.println("  ) const {");
-//
-//      if (isresult) h.println("    const VkResult res = ");
-//      if (isother)
-//        h.println("    return (", command->sreturn_type->to_string(), ")(");
-//      h.println("    ", command->command->name, "(");
-//      first = true;
-//      for (const sps::Param& param : command->params) {
-//        if (first) {
-//          first = false;
-//        } else {
-//          h.println(",");
-//        }
-//        if (param.stype->is_empty_enum())
-//          h.print("      (", param.vtype->to_string(), ") 0 /*", param.name,
-//                  "*/");
-//        else if (dynamic_cast<const vks::Array*>(param.vtype))
-//          h.print("      ", param.name, ".data()");
-//        else
-//          h.print("      (", param.vtype->to_string(), ") ", param.name);
-//      }
-//      h.println();
-//      h.print("    )");
-//      if (isother) h.print(")");
-//      h.println(";");
-//      if (isresult) {
-//        h.println("    switch (res) {");
-//        if (isonesuccess) {
-//          DVC_ASSERT(command->command->successcodes.at(0)->name ==
-//                     "VK_SUCCESS");
-//          h.println("      case VK_SUCCESS: return;");
-//        } else {
-//          for (const sps::Enumerator* successcode : command->successcodes) {
-//            h.println("      case ", successcode->constant->name,
-//                      ": return spk::result::", successcode->name, ";");
-//          }
-//        }
-//
-//        for (const sps::Enumerator* errorcode : command->errorcodes) {
-//          h.println("      case ", errorcode->constant->name,
-//                    ": throw spk::", errorcode->name, "();");
-//        }
-//        h.println(
-//            "      default: throw spk::unexpected_command_result((spk::result)
-//            " "res, \"", command->command->name, "\");");
-//        h.println("    }");
-//      }
-//      h.println("  }");
-//
-//      if (command->command->platform) h.println("#endif");
-//      h.println();
-//    }
-//
-//    h.println("  // vulkan commands");
-//    for (const vks::Command* command :
-//         dispatch_table->dispatch_table->commands) {
-//      if (command->platform) h.println("#ifdef ", command->platform->protect);
-//      h.println("  PFN_", command->name, " ", command->name, " = nullptr;");
-//      if (command->platform) h.println("#endif");
-//    }
-//    h.println("};");
-//    h.println();
-//    h.println("template<class Visitor> void visit_dispatch_table(", name,
-//              "& dispatch_table, const Visitor& V) {");
-//    for (const vks::Command* command :
-//         dispatch_table->dispatch_table->commands) {
-//      if (command->platform) h.println("#ifdef ", command->platform->protect);
-//      std::string c = command->name;
-//      h.println("  V(dispatch_table, &", name, "::", c, ", \"", c, "\");");
-//      if (command->platform) h.println("#endif");
-//    }
-//    h.println("}");
-//    h.println();
-//  }
-//
-//  h.println(R"(
-//
-// inline std::unique_ptr<spk::global_dispatch_table>
-// load_global_dispatch_table(
-//    PFN_vkGetInstanceProcAddr pvkGetInstanceProcAddr) {
-//  auto global_dispatch_table = std::make_unique<spk::global_dispatch_table>();
-//
-//  spk::visit_dispatch_table(
-//      *global_dispatch_table,
-//      [pvkGetInstanceProcAddr](spk::global_dispatch_table& t, auto mf,
-//                               const char* name) {
-//        using PFN = strip_member_function_t<decltype(mf)>;
-//        (t.*mf) = (PFN)pvkGetInstanceProcAddr(VK_NULL_HANDLE, name);
-//      });
-//
-//  return global_dispatch_table;
-//}
-//
-// inline std::unique_ptr<spk::instance_dispatch_table>
-// load_instance_dispatch_table(
-//    PFN_vkGetInstanceProcAddr pvkGetInstanceProcAddr,
-//    spk::instance_ref instance) {
-//  auto instance_dispatch_table =
-//  std::make_unique<spk::instance_dispatch_table>();
-//
-//  instance_dispatch_table->instance = instance;
-//
-//  spk::visit_dispatch_table(
-//      *instance_dispatch_table,
-//      [pvkGetInstanceProcAddr, instance](spk::instance_dispatch_table& t,
-//                                         auto mf, const char* name) {
-//        using PFN = spk::strip_member_function_t<decltype(mf)>;
-//        (t.*mf) = (PFN)pvkGetInstanceProcAddr(instance, name);
-//      });
-//
-//  return instance_dispatch_table;
-//}
-//
-// inline std::unique_ptr<spk::device_dispatch_table>
-// load_device_dispatch_table(
-//    PFN_vkGetDeviceProcAddr pvkGetDeviceProcAddr, spk::device_ref device) {
-//  auto device_dispatch_table = std::make_unique<spk::device_dispatch_table>();
-//
-//  device_dispatch_table->device = device;
-//
-//  spk::visit_dispatch_table(
-//      *device_dispatch_table,
-//      [pvkGetDeviceProcAddr, device](spk::device_dispatch_table& t, auto mf,
-//                                     const char* name) {
-//        using PFN = spk::strip_member_function_t<decltype(mf)>;
-//        (t.*mf) = (PFN)pvkGetDeviceProcAddr(device, name);
-//      });
-//
-//  return device_dispatch_table;
-//}
-//
-//)");
-//
-//  static std::set<std::string> instance_handles = {"instance",
-//                                                   "physical_device",
-//                                                   "debug_report_callback_ext",
-//                                                   "debug_utils_messenger_ext",
-//                                                   "display_mode_khr",
-//                                                   "surface_khr",
-//                                                   "display_khr"};
-//
-//  h.println("// fwd declare loader");
-//  h.println("class loader;");
-//  h.println();
-//
-//  h.println("// fwd declare handles");
-//  for (const auto& handle : registry.handles) {
-//    std::string sname = handle->fullname;
-//    h.println("class ", sname, ";");
-//  }
-//
-//  h.println();
-//  h.println("// handles");
-//  for (const auto& handle : registry.handles) {
-//    std::string sname = handle->fullname;
-//    std::string rname = handle->name;
-//    std::string vname = handle->handle->name;
-//
-//    h.println("class ", sname, " ");
-//    h.println("{");
-//
-//    h.println(" public:");
-//    h.println("  operator ", rname, "() const { return handle_; }");
-//
-//    if (sname == "instance") {
-//      h.println(
-//          "  instance(spk::instance_ref handle, const spk::loader& loader, "
-//          "spk::allocation_callbacks const* allocation_callbacks "
-//          "= "
-//          "nullptr);");
-//    } else if (sname == "device") {
-//      h.println(
-//          "device(spk::device_ref handle, spk::physical_device& "
-//          "physical_device,"
-//          "spk::allocation_callbacks const* allocation_callbacks);");
-//    } else {
-//      h.print("  ", sname, "(", rname, " handle");
-//      if (handle->parent) h.print(", ", handle->parent->name, " parent");
-//
-//      if (instance_handles.count(sname))
-//        h.print(", const instance_dispatch_table& dispatch_table");
-//      else
-//        h.print(", const device_dispatch_table& dispatch_table");
-//      h.println(", const spk::allocation_callbacks* allocation_callbacks)");
-//      h.println("  : handle_(handle)");
-//      if (handle->parent) h.println("  , parent_(parent)");
-//      h.println("  , dispatch_table_(&dispatch_table)");
-//      h.println("  , allocation_callbacks_(allocation_callbacks) {}");
-//    }
-//    h.println("  ", sname, "(const ", sname, "&) = delete;");
-//    h.println("  ", sname, "(", sname, "&& that)");
-//    h.println("  : handle_(that.handle_)");
-//    if (handle->parent) h.println("  , parent_(that.parent_)");
-//    h.println("  , dispatch_table_(std::move(that.dispatch_table_))");
-//    h.println(
-//        "  , allocation_callbacks_(std::move(that.allocation_callbacks_)) { "
-//        "that.handle_ "
-//        "= VK_NULL_HANDLE; }");
-//    h.println();
-//    h.println("void release() { handle_ = VK_NULL_HANDLE; }");
-//    h.println();
-//    for (auto member_function : handle->member_functions) {
-//      if (member_function->command->command->platform)
-//        h.println(" #ifdef ",
-//                  member_function->command->command->platform->protect);
-//      h.println("  // ", member_function->command->command->name);
-//      if (member_function->manual_translation) {
-//        h.print(member_function->manual_translation->interface);
-//      } else {
-//        h.print("  inline ");
-//        std::string rtype;
-//        if (member_function->result_handle)
-//          rtype = "spk::" + member_function->result_handle->fullname;
-//        else if (member_function->res)
-//          rtype = member_function->res->to_string();
-//
-//        if (member_function->result) {
-//          h.print(rtype);
-//        } else if (member_function->resultvec_void ||
-//                   member_function->resultvec_incomplete) {
-//          h.print("std::vector<", rtype, ">");
-//        } else {
-//          h.print(member_function->command->sreturn_type->to_string());
-//        }
-//        h.print(" ", member_function->name, "(");
-//        bool first = true;
-//        for (size_t i = member_function->begin(); i < member_function->end();
-//             i++) {
-//          const sps::Param& param = member_function->command->params.at(i);
-//          if (param.stype->is_empty_enum() || param.is_allocation_callbacks())
-//            continue;
-//          if (first)
-//            first = false;
-//          else
-//            h.print(", ");
-//          if (member_function->szptrs.count(i)) {
-//            const sps::Param& param =
-//                member_function->command->params.at(i + 1);
-//            h.print("spk::array_view<",
-//                    sps::get_pointee(param.stype)->to_string(), "> ",
-//                    param.name);
-//            i++;
-//          } else if (auto ref = param.asref()) {
-//            h.print(ref->make_declaration("&" + param.name, 0));
-//          } else {
-//            h.print(param.stype->make_declaration(param.name, 0));
-//          }
-//        }
-//        h.println(");");
-//      }
-//      if (member_function->command->command->platform) h.println("#endif");
-//      h.println();
-//    }
-//
-//    h.println();
-//    if (instance_handles.count(sname))
-//      h.println(
-//          "  const instance_dispatch_table& dispatch_table() { return "
-//          "*dispatch_table_; }");
-//    else
-//      h.println(
-//          "  const device_dispatch_table& dispatch_table() { return "
-//          "*dispatch_table_; }");
-//
-//    if (handle->destructor) {
-//      h.print("  ~", sname,
-//              "() { if (handle_ != VK_NULL_HANDLE) dispatch_table().",
-//              handle->destructor->name, "(");
-//      if (handle->destructor_parent)
-//        h.print("parent_, handle_, allocation_callbacks_);");
-//      else
-//        h.print("handle_, allocation_callbacks_);");
-//      h.println("}");
-//    }
-//
-//    h.println(" private:");
-//    h.println("  ", rname, " handle_ = VK_NULL_HANDLE;");
-//    if (handle->parent)
-//      h.println("  ", handle->parent->name, " parent_ = VK_NULL_HANDLE;");
-//    if (sname == "instance")
-//      h.println(
-//          "  std::unique_ptr<const instance_dispatch_table>
-//          dispatch_table_;");
-//    else if (instance_handles.count(sname))
-//      h.println("  const instance_dispatch_table* dispatch_table_;");
-//    else if (sname == "device")
-//      h.println(
-//          "  std::unique_ptr<const device_dispatch_table> dispatch_table_;");
-//    else
-//      h.println("  const device_dispatch_table* dispatch_table_;");
-//    h.println(
-//        "  const spk::allocation_callbacks* allocation_callbacks_ =
-//        nullptr;");
-//    //    if (sname == "physical_device") h.println("\n  friend class
-//    device;"); h.println("};"); for (const auto& alias : handle->aliases) {
-//      h.println("using ", alias, " = ", handle->name, ";");
-//      h.println();
-//    }
-//    h.println();
-//  }
-//
-//  for (const auto& handle : registry.handles) {
-//    std::string sname = handle->fullname;
-//    std::string rname = handle->name;
-//
-//    for (auto member_function : handle->member_functions) {
-//      if (member_function->command->command->platform)
-//        h.println("#ifdef ",
-//                  member_function->command->command->platform->protect);
-//      if (member_function->manual_translation) {
-//        h.print(member_function->manual_translation->implementation);
-//      } else {
-//        h.print("inline ");
-//        std::string rtype;
-//        if (member_function->result_handle)
-//          rtype = "spk::" + member_function->result_handle->fullname;
-//        else if (member_function->res)
-//          rtype = member_function->res->to_string();
-//
-//        if (member_function->result) {
-//          h.print(rtype);
-//        } else if (member_function->resultvec_void ||
-//                   member_function->resultvec_incomplete) {
-//          h.print("std::vector<", rtype, ">");
-//        } else {
-//          h.print(member_function->command->sreturn_type->to_string());
-//        }
-//        h.print(" ", sname, "::", member_function->name, "(");
-//        bool first = true;
-//        for (size_t i = member_function->begin(); i < member_function->end();
-//             i++) {
-//          const sps::Param& param = member_function->command->params.at(i);
-//          if (param.stype->is_empty_enum() || param.is_allocation_callbacks())
-//            continue;
-//          if (first)
-//            first = false;
-//          else
-//            h.print(", ");
-//          if (member_function->szptrs.count(i)) {
-//            const sps::Param& param =
-//                member_function->command->params.at(i + 1);
-//            h.print("spk::array_view<",
-//                    sps::get_pointee(param.stype)->to_string(), "> ",
-//                    param.name);
-//            i++;
-//          } else if (auto ref = param.asref()) {
-//            h.print(ref->make_declaration("&" + param.name, 0));
-//          } else {
-//            h.print(param.stype->make_declaration(param.name, 0));
-//          }
-//        }
-//        h.println(") {");
-//        auto write_call = [&] {
-//          h.print("  dispatch_table().", member_function->command->name, "(");
-//          if (member_function->parent_dispatch)
-//            h.print("parent_, handle_");
-//          else
-//            h.print("handle_");
-//          for (size_t i = member_function->begin(); i <
-//          member_function->end();
-//               i++) {
-//            const sps::Param& param = member_function->command->params.at(i);
-//            if (param.stype->is_empty_enum()) continue;
-//            h.print(", ");
-//            if (param.is_allocation_callbacks())
-//              h.print("allocation_callbacks_");
-//            else if (member_function->szptrs.count(i)) {
-//              h.print(member_function->command->params.at(i + 1).name,
-//                      ".size()");
-//            } else if (member_function->szptrs.count(i - 1)) {
-//              h.print(param.name, ".data()");
-//            } else if (param.asref()) {
-//              h.print("&", param.name);
-//            } else {
-//              h.print(param.name);
-//            }
-//          }
-//        };
-//        if (member_function->result) {
-//          h.println("  ", member_function->res->to_string(), " result_;");
-//          write_call();
-//          h.println(", &result_);");
-//
-//          if (!member_function->result_handle) {
-//            h.println("  return result_;");
-//          } else {
-//            const sps::Handle* reshand = member_function->result_handle;
-//            h.print("  return {result_");
-//            if (reshand->parent) {
-//              if (reshand->parent != handle) {
-//                DVC_ERROR("mismatch parent: ", member_function->command->name,
-//                          " member of ", handle->name, " but parent ",
-//                          reshand->parent->name);
-//              }
-//              h.print(", handle_");
-//            }
-//            h.println(", dispatch_table(), allocation_callbacks_};");
-//          }
-//        } else if (member_function->resultvec_void ||
-//                   member_function->resultvec_incomplete) {
-//          h.println("  ", member_function->sz->to_string(), " size_;");
-//          for (int pass : {1, 2}) {
-//            if (member_function->resultvec_incomplete) {
-//              h.print("  spk::result success", pass, "_ = ");
-//            }
-//            write_call();
-//            if (pass == 1)
-//              h.println(", &size_, nullptr);");
-//            else if (pass == 2)
-//              h.println(", &size_, result_.data());");
-//            if (member_function->resultvec_incomplete) {
-//              h.println("  if (success", pass,
-//                        "_ != spk::result::success) throw "
-//                        "spk::unexpected_command_result(success",
-//                        pass, "_, \"",
-//                        member_function->command->command->name,
-//                        "\");");
-//            }
-//            if (pass == 1)
-//              h.println("  std::vector<", member_function->res->to_string(),
-//                        "> result_(size_);");
-//          }
-//          if (!member_function->result_handle) {
-//            h.println("  return result_;");
-//          } else {
-//            const sps::Handle* reshand = member_function->result_handle;
-//            h.println("  std::vector<", rtype, "> result2_;");
-//            h.println("  result2_.reserve(size_);");
-//            h.println("  for (auto ref : result_)");
-//            h.println("    result2_.emplace_back(ref");
-//            if (reshand->parent) {
-//              if (reshand->parent != handle) {
-//                DVC_ERROR("mismatch parent: ", member_function->command->name,
-//                          " member of ", handle->name, " but parent ",
-//                          reshand->parent->name);
-//              }
-//              h.print(", handle_");
-//            }
-//            h.println(", dispatch_table(), allocation_callbacks_);");
-//            h.println("  return result2_;");
-//          }
-//        } else {
-//          if (member_function->command->sreturn_type->to_string() != "void")
-//            h.print("  return ");
-//          write_call();
-//          h.println(");");
-//        }
-//        h.println("}");
-//      }
-//      if (member_function->command->command->platform) h.println("#endif");
-//      h.println();
-//    }
-//
-//    h.println();
-//  }
-//  h.println();
-//  h.println("}  // namespace spk");
+// Rewrites a len expression from vk.xml, such as "codeSize / 4", in terms of
+// the spk members of self.  API constants such as VK_UUID_SIZE are kept.
+// Returns an empty string for expressions that refer to anything else.
+std::string translate_len(const sps::Struct* struct_, const std::string& len) {
+  if (len.find("->") != std::string::npos) return "";
+  std::string result;
+  size_t i = 0;
+  while (i < len.size()) {
+    if (!std::isalpha(len[i]) && len[i] != '_') {
+      result += len[i++];
+      continue;
+    }
+    size_t j = i;
+    while (j < len.size() && (std::isalnum(len[j]) || len[j] == '_')) ++j;
+    std::string word = len.substr(i, j - i);
+    if (word.compare(0, 3, "VK_") == 0) {
+      result += word;
+      i = j;
+      continue;
+    }
+    const auto& vmembers = struct_->struct_->members;
+    auto it =
+        std::find_if(vmembers.begin(), vmembers.end(),
+                     [&](const vks::Member& m) { return m.name == word; });
+    if (it == vmembers.end()) return "";
+    result += "size_t(self." +
+              struct_->members.at(it - vmembers.begin()).name + ")";
+    i = j;
+  }
+  return result;
+}
+
+// Emits visit_members, which describes every member of the struct to a
+// visitor so that deep hashing, comparison and serialization can follow
+// pointers, counted arrays and pNext chains without per-struct code.  Fails
+// on a counted member whose count it cannot express, rather than leave it
+// to be encoded by address.
+void write_visit_members(dvc::file_writer& h, const sps::Struct* struct_) {
+  h.println("  template <typename Self, typename Visitor>");
+  h.println("  static void visit_members(Self& self, Visitor& v) {");
+
+  bool raw = struct_->struct_->is_union;
+  for (const sps::Member& member : struct_->members)
+    if (dynamic_cast<const vks::Bitfield*>(member.stype)) raw = true;
+  if (raw) {
+    h.println("    v.raw(self);");
+    h.println("  }");
+    return;
+  }
+
+  if (struct_->struct_->structured_type) h.println("    v.next(self.p_next_);");
+  for (size_t i = 0; i < struct_->members.size(); ++i) {
+    const sps::Member& member = struct_->members.at(i);
+    const std::string& vname = struct_->struct_->members.at(i).name;
+    std::string self = "self." + member.name;
+    if (member.empty_enum() || vname == "sType") continue;
+    if (vname == "pNext") {
+      h.println("    v.next(", self, ");");
+      continue;
+    }
+    auto pointer = dynamic_cast<const vks::Pointer*>(member.stype);
+    if (!pointer) {
+      h.println("    v.value(", self, ");");
+      continue;
+    }
+    const vks::Type* pointee = pointer->T;
+    if (auto c = dynamic_cast<const vks::Const*>(pointee)) pointee = c->T;
+    bool is_void = pointee->to_string() == "void";
+    bool is_pointer = dynamic_cast<const vks::Pointer*>(pointee);
+
+    if (member.null_terminated && member.len.empty()) {
+      h.println("    v.string(", self, ");");
+    } else if (member.len.empty()) {
+      if (is_void || is_pointer)
+        h.println("    v.opaque(", self, ");");
+      else
+        h.println("    v.pointer(", self, ");");
+    } else {
+      std::string count = translate_len(struct_, member.len.at(0));
+      if (count.empty())
+        DVC_FATAL("cannot follow ", struct_->struct_->name, "::", vname,
+                  " with len ", member.len.at(0));
+      if (member.null_terminated)
+        h.println("    v.strings(", self, ", ", count, ");");
+      else if (is_void)
+        h.println("    v.bytes(", self, ", ", count, ");");
+      else if (is_pointer)
+        h.println("    v.pointers(", self, ", ", count, ");");
+      else
+        h.println("    v.array(", self, ", ", count, ");");
+    }
+  }
+  h.println("  }");
+}
+
+void write_spock(const sps::Registry& registry) {
+  dvc::file_writer h(outspk, dvc::truncate);
+
+  h.println("#pragma once");
+  h.println();
+  h.println("#include <array>");
+  h.println("#include <cstring>");
+  h.println("#include <type_traits>");
+  h.println("#include <vulkan/vulkan.h>");
+  h.println();
+  h.println("#include \"spk/deep_hash.h\"");
+  h.println("#include \"spk/spock_fwd.h\"");
+  h.println();
+  h.println("namespace spk {");
+  h.println();
+
+  for (const sps::Bitmask* bitmask : registry.bitmasks) {
+    if (bitmask->enumerators.empty()) continue;
+    std::string name = bitmask->name;
+    h.println("// bitmask ", bitmask->bitmask->name);
+    h.print("enum class ", name, " {");
+    h.println();
+    for (const auto& enumerator : bitmask->enumerators)
+      h.println("  ", enumerator.name, " = ", enumerator.constant->name, ",");
+    h.println("};");
+    h.println("SPK_DEFINE_BITMASK_BITWISE_OPS(", name, ");");
+    h.println();
+    for (const auto& alias : bitmask->aliases) {
+      h.println("using ", alias, " = ", bitmask->name, ";");
+      h.println();
+    }
+    h.println("inline std::ostream& operator<<(std::ostream& o, ", name,
+              " e){");
+    h.println("  SPK_BEGIN_BITMASK_OUTPUT(", name, ")");
+    for (const auto& enumerator : bitmask->enumerators) {
+      h.println("  SPK_BITMASK_OUTPUT_ENUMERATOR(", name, ", ",
+                enumerator.name, ")");
+    }
+    h.println("  SPK_END_BITMASK_OUTPUT(", name, ")");
+    h.println("}");
+  }
+
+  for (const sps::Enumeration* enumeration : registry.enumerations) {
+    if (enumeration->enumerators.empty()) continue;
+    std::string name = enumeration->name;
+    h.println("// enumeration ", enumeration->enumeration->name);
+    h.println("enum class ", name, " {");
+    for (const auto& enumerator : enumeration->enumerators)
+      h.println("  ", enumerator.name, " = ", enumerator.constant->name, ",");
+    h.println("};");
+    h.println();
+    for (const auto& alias : enumeration->aliases) {
+      h.println("using ", alias, " = ", enumeration->name, ";");
+      h.println();
+    }
+    h.println("inline std::ostream& operator<<(std::ostream& o, ", name,
+              " e){");
+    h.println("  SPK_BEGIN_ENUMERATION_OUTPUT(", name, ")");
+    for (const auto& enumerator : enumeration->enumerators) {
+      h.println("  SPK_ENUMERATION_OUTPUT_ENUMERATOR(", name, ", ",
+                enumerator.name, ")");
+    }
+    h.println("  SPK_END_ENUMERATION_OUTPUT(", name, ")");
+    h.println("}");
+    if (enumeration->name == "result") {
+      h.println("SPK_BEGIN_RESULT_ERRORS");
+      for (const auto& enumerator : enumeration->enumerators)
+        if (dvc::startswith(enumerator.name, "error"))
+          h.println("SPK_DEFINE_RESULT_ERROR(", enumerator.name, ")");
+      h.println("SPK_END_RESULT_ERRORS");
+    }
+  }
+
+  for (const auto& constant : registry.constants) {
+    if (constant->constant->platform)
+      h.println("#ifdef ", constant->constant->platform->protect);
+    h.println("constexpr auto ", constant->name, " = ",
+              constant->constant->name, ";");
+    if (constant->constant->platform) h.println("#endif");
+  }
+
+  h.println();
+
+  h.println("// handle refs");
+  for (const auto& handle : registry.handles) {
+    h.println("using ", handle->name, " = ", handle->handle->name, ";");
+  }
+
+  h.println("// struct fwd decls");
+  for (const auto& struct_ : registry.structs) {
+    if (struct_->struct_->platform)
+      h.println("#ifdef ", struct_->struct_->platform->protect);
+    std::string keyword = (struct_->struct_->is_union ? "union" : "class");
+    h.println(keyword, " ", struct_->name, ";");
+    if (struct_->struct_->platform) h.println("#endif");
+  }
+  h.println();
+  for (const auto& struct_ : registry.structs) {
+    if (struct_->struct_->platform)
+      h.println("#ifdef ", struct_->struct_->platform->protect);
+    std::string keyword = (struct_->struct_->is_union ? "union" : "class");
+    h.println(keyword, " ", struct_->name, " {");
+    h.println(" public:");
+    h.println("  using underlying_type = ", struct_->struct_->name, ";");
+    h.println();
+    if (struct_->struct_->is_union) {
+      h.println("  ", struct_->name, "() { std::memset(this, 0, sizeof(",
+                struct_->name, ")); }");
+      h.println();
+    }
+    //    auto member_name = [&](size_t member_idx) {
+    //      return struct_->struct_->members.at(member_idx).name + "_";
+    //    };
+
+    for (bool mutator : {true, false}) {
+      if (mutator) {
+        h.println("  // mutators");
+      } else {
+        h.println("  // accessors");
+      }
+
+      for (const auto& accessor : struct_->accessors) {
+        if (auto value_accessor =
+                dynamic_cast<const sps::ValueAccessor*>(accessor)) {
+          DVC_ASSERT(dvc::endswith(value_accessor->member->name, "_"));
+          std::string mname = value_accessor->member->name;
+          std::string bname = mname.substr(0, mname.size() - 1);
+          bool large = value_accessor->large;
+
+          if (mutator) {
+            h.println("  void set_", bname, "(", (large ? "const " : ""),
+                      value_accessor->member->stype->make_declaration(
+                          (large ? "& value" : "value"), false),
+                      ") { ", mname, " = value; }");
+          } else {
+            h.println("  ", (large ? "const " : ""),
+                      value_accessor->member->stype->make_declaration(
+                          (large ? "& " : "") + bname, false),
+                      "() const { return ", mname, "; }");
+          }
+        } else if (auto string_accessor =
+                       dynamic_cast<const sps::StringAccessor*>(accessor)) {
+          std::string mname = string_accessor->member->name;
+          std::string aname = string_accessor->name;
+
+          if (mutator) {
+            h.println("  void set_", aname, "(spk::string_ptr str) { ", mname,
+                      " = str.get(); }");
+          } else {
+            h.println("  std::string_view ", aname, "() const { return ",
+                      mname, "; }");
+          }
+        } else if (auto bool_accessor =
+                       dynamic_cast<const sps::BoolAccessor*>(accessor)) {
+          std::string mname = bool_accessor->member->name;
+          std::string aname = bool_accessor->name;
+
+          if (mutator) {
+            h.println("  void set_", aname, "(bool val) { ", mname,
+                      " = val; }");
+          } else {
+            h.println("  bool ", aname, "() const { return ", mname, "; }");
+          }
+        } else if (auto span_accessor =
+                       dynamic_cast<const sps::SpanAccessor*>(accessor)) {
+          std::string mcount = span_accessor->count->name;
+          std::string msubject = span_accessor->subject->name;
+          const vks::Pointer* ptr_type =
+              dynamic_cast<const vks::Pointer*>(span_accessor->subject->stype);
+          DVC_ASSERT(ptr_type);
+          const vks::Type* element_type = ptr_type->T;
+          std::string aname = span_accessor->name;
+
+          if (mutator) {
+            h.println("  void set_", aname, "(spk::array_ptr<",
+                      element_type->to_string(), "> value) { ", msubject,
+                      " = value.data(); ", mcount, " = value.size(); }");
+          } else {
+            h.println("  spk::array_view<", element_type->to_string(), "> ",
+                      aname, "() const { return {", msubject, ", ", mcount,
+                      "};}");
+          }
+        } else {
+          DVC_FATAL("Unknown Accessor subclass ", typeid(accessor).name());
+        }
+      }
+      h.println();
+    }
+    if (struct_->struct_->structured_type) {
+      h.println("  void set_next(void* next) { p_next_ = next; }");
+    }
+    h.println();
+    write_visit_members(h, struct_);
+    h.println(" private:");
+    if (struct_->struct_->structured_type) {
+      h.println("  VkStructureType s_type_ = ",
+                struct_->struct_->structured_type->name, ";");
+      h.println("  void* p_next_ = nullptr;");
+      h.println();
+    }
+    for (const auto& member : struct_->members)
+      if (member.empty_enum())
+        h.println("  VkFlags ", member.name, " = {}; // reserved");
+      else
+        h.println("  ",
+                  member.stype->make_declaration(
+                      member.name, /*zero*/ !struct_->struct_->is_union),
+                  ";", (member.optional(0) ? "// optional" : ""));
+    h.println("};");
+    h.println("static_assert(sizeof(", struct_->name, ") == sizeof(",
+              struct_->name, "::underlying_type));");
+    for (const auto& alias : struct_->aliases) {
+      h.println("using ", alias, " = ", struct_->name, ";");
+      h.println();
+    }
+    if (struct_->struct_->platform) h.println("#endif");
+    h.println();
+  }
+
+  // Lets visitors of pNext chains recover the spk struct of each element.
+  h.println("// Calls v with a null pointer to the spk struct whose sType is");
+  h.println("// type, or returns false if there is none.");
+  h.println("template <typename Visitor>");
+  h.println("bool visit_structure_type(VkStructureType type, Visitor&& v) {");
+  h.println("  switch (type) {");
+  for (const auto& struct_ : registry.structs) {
+    if (!struct_->struct_->structured_type) continue;
+    if (struct_->struct_->platform)
+      h.println("#ifdef ", struct_->struct_->platform->protect);
+    h.println("    case ", struct_->struct_->structured_type->name, ":");
+    h.println("      v(static_cast<spk::", struct_->name, "*>(nullptr));");
+    h.println("      return true;");
+    if (struct_->struct_->platform) h.println("#endif");
+  }
+  h.println("    default:");
+  h.println("      return false;");
+  h.println("  }");
+  h.println("}");
+  h.println();
+
+  for (vks::DispatchTableKind kind :
+       {vks::DispatchTableKind::GLOBAL, vks::DispatchTableKind::INSTANCE,
+        vks::DispatchTableKind::DEVICE}) {
+    std::string name = std::string(vks::to_string(kind)) + "_dispatch_table";
+    const sps::DispatchTable* dispatch_table = registry.dispatch_table(kind);
+    h.println("struct ", name, " {");
+    if (kind == vks::DispatchTableKind::INSTANCE)
+      h.println("  spk::instance_ref instance;");
+    else if (kind == vks::DispatchTableKind::DEVICE)
+      h.println("  spk::device_ref device;");
+
+    h.println("  // spock commands");
+    for (const sps::Command* command : dispatch_table->commands) {
+      bool isresult = (command->vreturn_type->to_string() == "VkResult");
+      bool ismultisuccess =
+          (isresult && command->command->successcodes.size() > 1);
+      bool isonesuccess = (isresult && !ismultisuccess);
+      bool isvoid = command->vreturn_type->to_string() == "void";
+      bool isother = (!isvoid && !isresult);
+
+      if (command->command->platform)
+        h.println("#ifdef ", command->command->platform->protect);
+
+      if (ismultisuccess) {
+        h.println("  [[nodiscard]] spk::result ", command->name, "(");
+      } else {
+        h.println("  ", command->sreturn_type->to_string(), " ",
+                  command->name, "(");
+      }
+      bool first = true;
+      for (const sps::Param& param : command->params) {
+        if (param.stype->is_empty_enum()) continue;
+        if (first) {
+          first = false;
+        } else {
+          h.println(",");
+        }
+        h.print("    ", param.stype->make_declaration(param.name, 0));
+      }
+      h.println();
+      h.println("  ) const {");
+
+      if (isresult) h.println("    const VkResult res = ");
+      if (isother)
+        h.println("    return (", command->sreturn_type->to_string(), ")(");
+      h.println("    ", command->command->name, "(");
+      first = true;
+      for (const sps::Param& param : command->params) {
+        if (first) {
+          first = false;
+        } else {
+          h.println(",");
+        }
+        if (param.stype->is_empty_enum())
+          h.print("      (", param.vtype->to_string(), ") 0 /*", param.name,
+                  "*/");
+        else if (dynamic_cast<const vks::Array*>(param.vtype))
+          h.print("      ", param.name, ".data()");
+        else
+          h.print("      (", param.vtype->to_string(), ") ", param.name);
+      }
+      h.println();
+      h.print("    )");
+      if (isother) h.print(")");
+      h.println(";");
+      if (isresult) {
+        h.println("    switch (res) {");
+        if (isonesuccess) {
+          DVC_ASSERT(command->command->successcodes.at(0)->name ==
+                     "VK_SUCCESS");
+          h.println("      case VK_SUCCESS: return;");
+        } else {
+          for (const sps::Enumerator* successcode : command->successcodes) {
+            h.println("      case ", successcode->constant->name,
+                      ": return spk::result::", successcode->name, ";");
+          }
+        }
+
+        for (const sps::Enumerator* errorcode : command->errorcodes) {
+          h.println("      case ", errorcode->constant->name,
+                    ": throw spk::", errorcode->name, "();");
+        }
+        h.println(
+            "      default: throw spk::unexpected_command_result((spk::result) "
+            "res, \"",
+            command->command->name, "\");");
+        h.println("    }");
+      }
+      h.println("  }");
+
+      if (command->command->platform) h.println("#endif");
+      h.println();
+    }
+
+    h.println("  // vulkan commands");
+    for (const vks::Command* command :
+         dispatch_table->dispatch_table->commands) {
+      if (command->platform) h.println("#ifdef ", command->platform->protect);
+      h.println("  PFN_", command->name, " ", command->name, " = nullptr;");
+      if (command->platform) h.println("#endif");
+    }
+    h.println("};");
+    h.println();
+    h.println("template<class Visitor> void visit_dispatch_table(", name,
+              "& dispatch_table, const Visitor& V) {");
+    for (const vks::Command* command :
+         dispatch_table->dispatch_table->commands) {
+      if (command->platform) h.println("#ifdef ", command->platform->protect);
+      std::string c = command->name;
+      h.println("  V(dispatch_table, &", name, "::", c, ", \"", c, "\");");
+      if (command->platform) h.println("#endif");
+    }
+    h.println("}");
+    h.println();
+  }
+
+  // Ids are the positions of the commands in the registry, and do not
+  // depend on which platforms are enabled.
+  const vks::DispatchTable* device_table =
+      registry.dispatch_table(vks::DispatchTableKind::DEVICE)->dispatch_table;
+  h.println("// Every device command, for layers that keep per-command data.");
+  h.println("enum class command_id : uint16_t {");
+  for (const vks::Command* command : device_table->commands)
+    h.println("  ", command->name, ",");
+  h.println("};");
+  h.println();
+  h.println("inline constexpr size_t command_count = ",
+            device_table->commands.size(), ";");
+  h.println();
+  h.println("inline const char* command_name(uint16_t command) {");
+  h.println("  switch (command) {");
+  for (const vks::Command* command : device_table->commands)
+    h.println("    case uint16_t(command_id::", command->name, "): return \"",
+              command->name, "\";");
+  h.println("    default: return \"unknown\";");
+  h.println("  }");
+  h.println("}");
+  h.println();
+
+  h.println(R"(
+
+inline std::unique_ptr<spk::global_dispatch_table>
+load_global_dispatch_table(
+    PFN_vkGetInstanceProcAddr pvkGetInstanceProcAddr) {
+  auto global_dispatch_table = std::make_unique<spk::global_dispatch_table>();
+
+  spk::visit_dispatch_table(
+      *global_dispatch_table,
+      [pvkGetInstanceProcAddr](spk::global_dispatch_table& t, auto mf,
+                               const char* name) {
+        using PFN = strip_member_function_t<decltype(mf)>;
+        (t.*mf) = (PFN)pvkGetInstanceProcAddr(VK_NULL_HANDLE, name);
+      });
+
+  return global_dispatch_table;
+}
+
+inline std::unique_ptr<spk::instance_dispatch_table>
+load_instance_dispatch_table(
+    PFN_vkGetInstanceProcAddr pvkGetInstanceProcAddr,
+    spk::instance_ref instance) {
+  auto instance_dispatch_table =
+  std::make_unique<spk::instance_dispatch_table>();
+
+  instance_dispatch_table->instance = instance;
+
+  spk::visit_dispatch_table(
+      *instance_dispatch_table,
+      [pvkGetInstanceProcAddr, instance](spk::instance_dispatch_table& t,
+                                         auto mf, const char* name) {
+        using PFN = spk::strip_member_function_t<decltype(mf)>;
+        (t.*mf) = (PFN)pvkGetInstanceProcAddr(instance, name);
+      });
+
+  return instance_dispatch_table;
+}
+
+inline std::unique_ptr<spk::device_dispatch_table>
+load_device_dispatch_table(
+    PFN_vkGetDeviceProcAddr pvkGetDeviceProcAddr, spk::device_ref device) {
+  auto device_dispatch_table = std::make_unique<spk::device_dispatch_table>();
+
+  device_dispatch_table->device = device;
+
+  spk::visit_dispatch_table(
+      *device_dispatch_table,
+      [pvkGetDeviceProcAddr, device](spk::device_dispatch_table& t, auto mf,
+                                     const char* name) {
+        using PFN = spk::strip_member_function_t<decltype(mf)>;
+        (t.*mf) = (PFN)pvkGetDeviceProcAddr(device, name);
+      });
+
+  return device_dispatch_table;
+}
+
+)");
+
+  static std::set<std::string> instance_handles = {"instance",
+                                                   "physical_device",
+                                                   "debug_report_callback_ext",
+                                                   "debug_utils_messenger_ext",
+                                                   "display_mode_khr",
+                                                   "surface_khr",
+                                                   "display_khr"};
+
+  // In --thin_handles mode the children of spk::device keep only their raw
+  // handle and a pointer to the device_context owned by their device.
+  auto is_thin = [](const sps::Handle* handle) {
+    if (!thin_handles) return false;
+    std::string sname = handle->fullname;
+    if (sname == "device" || instance_handles.count(sname)) return false;
+    return handle->parent == nullptr || handle->parent->fullname == "device";
+  };
+  // Handles that can construct device children through adopt<>().
+  auto can_adopt = [&](const sps::Handle* handle) {
+    return handle->fullname == "device" || is_thin(handle) ||
+           (handle->parent && handle->parent->fullname == "device");
+  };
+
+  h.println("// fwd declare loader");
+  h.println("class loader;");
+  h.println();
+
+  h.println("// fwd declare handles");
+  for (const auto& handle : registry.handles) {
+    std::string sname = handle->fullname;
+    h.println("class ", sname, ";");
+    if (handle->batch_destructor) h.println("class ", sname, "_array;");
+  }
+
+  h.println();
+  h.println("// handles");
+  for (const auto& handle : registry.handles) {
+    std::string sname = handle->fullname;
+    std::string rname = handle->name;
+    std::string vname = handle->handle->name;
+    bool thin = is_thin(handle);
+
+    h.println("class ", sname, " ");
+    h.println("{");
+
+    h.println(" public:");
+    h.println("  using ref_type = ", rname, ";");
+    h.println("  operator ", rname, "() const { return handle_; }");
+
+    if (sname == "instance") {
+      h.println(
+          "  instance(spk::instance_ref handle, const spk::loader& loader, "
+          "spk::allocation_callbacks const* allocation_callbacks "
+          "= "
+          "nullptr);");
+    } else if (sname == "device") {
+      h.println(
+          "device(spk::device_ref handle, spk::physical_device& "
+          "physical_device,"
+          "spk::allocation_callbacks const* allocation_callbacks, "
+          "const spk::device_layer& layer = {});");
+    } else if (thin) {
+      h.println("  ", sname, "(", rname,
+                " handle, const spk::device_context& context)");
+      h.println("  : handle_(handle), context_(&context) {}");
+    } else {
+      h.print("  ", sname, "(", rname, " handle");
+      if (handle->parent) h.print(", ", handle->parent->name, " parent");
+
+      if (instance_handles.count(sname))
+        h.print(", const instance_dispatch_table& dispatch_table");
+      else
+        h.print(", const device_dispatch_table& dispatch_table");
+      h.println(", const spk::allocation_callbacks* allocation_callbacks)");
+      h.println("  : handle_(handle)");
+      if (handle->parent) h.println("  , parent_(parent)");
+      h.println("  , dispatch_table_(&dispatch_table)");
+      h.println("  , allocation_callbacks_(allocation_callbacks) {}");
+    }
+    h.println("  ", sname, "(const ", sname, "&) = delete;");
+    h.println("  ", sname, "(", sname, "&& that)");
+    h.println("  : handle_(that.handle_)");
+    if (thin) {
+      h.println(
+          "  , context_(that.context_) { that.handle_ = VK_NULL_HANDLE; }");
+    } else {
+      if (handle->parent) h.println("  , parent_(that.parent_)");
+      h.println("  , dispatch_table_(std::move(that.dispatch_table_))");
+      h.print(
+          "  , allocation_callbacks_(std::move(that.allocation_callbacks_))");
+      if (sname == "device") h.print(", context_(std::move(that.context_))");
+      h.println(" { that.handle_ = VK_NULL_HANDLE; }");
+    }
+    h.println();
+    h.println("void release() { handle_ = VK_NULL_HANDLE; }");
+    h.println();
+    for (auto member_function : handle->member_functions) {
+      if (member_function->command->command->platform)
+        h.println(" #ifdef ",
+                  member_function->command->command->platform->protect);
+      h.println("  // ", member_function->command->command->name);
+      if (member_function->manual_translation) {
+        h.print(member_function->manual_translation->interface);
+      } else {
+        h.print("  inline ");
+        std::string rtype;
+        if (member_function->result_handle)
+          rtype = "spk::" + member_function->result_handle->fullname;
+        else if (member_function->res)
+          rtype = member_function->res->to_string();
+
+        if (member_function->result) {
+          h.print(rtype);
+        } else if (member_function->resultvec_void ||
+                   member_function->resultvec_incomplete) {
+          h.print("std::vector<", rtype, ">");
+        } else {
+          h.print(member_function->command->sreturn_type->to_string());
+        }
+        h.print(" ", member_function->name, "(");
+        bool first = true;
+        for (size_t i = member_function->begin(); i < member_function->end();
+             i++) {
+          const sps::Param& param = member_function->command->params.at(i);
+          if (param.stype->is_empty_enum() || param.is_allocation_callbacks())
+            continue;
+          if (first)
+            first = false;
+          else
+            h.print(", ");
+          if (member_function->szptrs.count(i)) {
+            const sps::Param& param =
+                member_function->command->params.at(i + 1);
+            h.print("spk::array_view<",
+                    sps::get_pointee(param.stype)->to_string(), "> ",
+                    param.name);
+            i++;
+          } else if (auto ref = param.asref()) {
+            h.print(ref->make_declaration("&" + param.name, 0));
+          } else {
+            h.print(param.stype->make_declaration(param.name, 0));
+          }
+        }
+        h.println(");");
+      }
+      if (member_function->command->command->platform) h.println("#endif");
+      h.println();
+    }
+
+    h.println();
+    if (instance_handles.count(sname))
+      h.println(
+          "  const instance_dispatch_table& dispatch_table() { return "
+          "*dispatch_table_; }");
+    else if (thin)
+      h.println(
+          "  const device_dispatch_table& dispatch_table() { return "
+          "context_->dispatch_table(); }");
+    else
+      h.println(
+          "  const device_dispatch_table& dispatch_table() { return "
+          "*dispatch_table_; }");
+
+    if (sname == "device" || thin)
+      h.println(
+          "  const spk::device_context& context() const { return "
+          "*context_; }");
+
+    if (can_adopt(handle)) {
+      h.println("  template <typename Child>");
+      h.println("  Child adopt(typename Child::ref_type ref) const {");
+      if (sname == "device") {
+        if (thin_handles)
+          h.println("    return {ref, *context_};");
+        else
+          h.println(
+              "    return {ref, handle_, *dispatch_table_, "
+              "allocation_callbacks_};");
+      } else if (thin) {
+        h.println("    return {ref, *context_};");
+      } else {
+        h.println(
+            "    return {ref, parent_, *dispatch_table_, "
+            "allocation_callbacks_};");
+      }
+      h.println("  }");
+    }
+
+    if (handle->destructor) {
+      h.print("  ~", sname,
+              "() { if (handle_ != VK_NULL_HANDLE) dispatch_table().",
+              handle->destructor->name, "(");
+      if (thin && handle->destructor_parent)
+        h.print(
+            "context_->device(), handle_, "
+            "context_->allocation_callbacks());");
+      else if (thin)
+        h.print("handle_, context_->allocation_callbacks());");
+      else if (handle->destructor_parent)
+        h.print("parent_, handle_, allocation_callbacks_);");
+      else
+        h.print("handle_, allocation_callbacks_);");
+      h.println("}");
+    }
+
+    h.println(" private:");
+    h.println("  ", rname, " handle_ = VK_NULL_HANDLE;");
+    if (thin) {
+      h.println("  const spk::device_context* context_ = nullptr;");
+    } else {
+      if (handle->parent)
+        h.println("  ", handle->parent->name, " parent_ = VK_NULL_HANDLE;");
+      if (sname == "instance")
+        h.println(
+            "  std::unique_ptr<const instance_dispatch_table> "
+            "dispatch_table_;");
+      else if (instance_handles.count(sname))
+        h.println("  const instance_dispatch_table* dispatch_table_;");
+      else if (sname == "device")
+        h.println(
+            "  std::unique_ptr<const device_dispatch_table> "
+            "dispatch_table_;");
+      else
+        h.println("  const device_dispatch_table* dispatch_table_;");
+      h.println(
+          "  const spk::allocation_callbacks* allocation_callbacks_ = "
+          "nullptr;");
+    }
+    if (sname == "device")
+      h.println(
+          "  std::unique_ptr<spk::device_context> context_ = "
+          "std::make_unique<spk::device_context>(handle_, "
+          "dispatch_table_.get(), allocation_callbacks_);");
+    h.println("};");
+    for (const auto& alias : handle->aliases) {
+      h.println("using ", alias, " = ", handle->name, ";");
+      h.println();
+    }
+    h.println();
+  }
+
+  // Owning batches of handles that are released from their pool with a
+  // single free_* call, rather than one wrapper per handle.
+  h.println("// handle arrays");
+  for (const auto& handle : registry.handles) {
+    if (!handle->batch_destructor) continue;
+    std::string sname = handle->fullname;
+    std::string rname = handle->name;
+    std::string aname = sname + "_array";
+
+    // A descriptor pool only accepts vkFreeDescriptorSets if it was created
+    // with VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT.
+    h.println("// Frees its handles with ", handle->batch_destructor->name,
+              " when destroyed, unless they");
+    h.println("// were release()d first, as they must be if the pool does not "
+              "allow it and");
+    h.println("// is reset as a whole instead.");
+    h.println("class ", aname, " : public spk::handle_vector<spk::", sname,
+              "> {");
+    h.println(" public:");
+    h.println("  ", aname, "(", handle->pool->name, " pool, std::vector<",
+              rname, "> refs, const spk::device_context& context)");
+    h.println("  : handle_vector(std::move(refs), context), pool_(pool) {}");
+    h.println("  ", aname, "(", aname, "&&) = default;");
+    h.println();
+    if (is_thin(handle)) {
+      h.println("  spk::", sname,
+                " handle(size_t i) const { return {at(i), context()}; }");
+    } else if (!handle->parent) {
+      h.println("  spk::", sname, " handle(size_t i) const {");
+      h.println(
+          "    return {at(i), context().dispatch_table(), "
+          "context().allocation_callbacks()};");
+      h.println("  }");
+    } else if (handle->parent->fullname == "device") {
+      h.println("  spk::", sname, " handle(size_t i) const {");
+      h.println(
+          "    return {at(i), context().device(), context().dispatch_table(), "
+          "context().allocation_callbacks()};");
+      h.println("  }");
+    }
+    h.println();
+    h.println("  std::vector<", rname, "> release() {");
+    h.println("    std::vector<", rname, "> refs;");
+    h.println("    refs.swap(refs_);");
+    h.println("    return refs;");
+    h.println("  }");
+    h.println();
+    h.println("  ~", aname, "() {");
+    h.println("    if (!empty())");
+    h.println("      context().dispatch_table().",
+              handle->batch_destructor->name,
+              "(context().device(), pool_, size(), data());");
+    h.println("  }");
+    h.println();
+    h.println(" private:");
+    h.println("  ", handle->pool->name, " pool_;");
+    h.println("};");
+    h.println();
+  }
+
+  for (const auto& handle : registry.handles) {
+    std::string sname = handle->fullname;
+    std::string rname = handle->name;
+    bool thin = is_thin(handle);
+    std::string parent = thin ? "context_->device()" : "parent_";
+    std::string allocation_callbacks =
+        thin ? "context_->allocation_callbacks()" : "allocation_callbacks_";
+
+    for (auto member_function : handle->member_functions) {
+      if (member_function->command->command->platform)
+        h.println("#ifdef ",
+                  member_function->command->command->platform->protect);
+      if (member_function->manual_translation) {
+        h.print(member_function->manual_translation->implementation);
+      } else {
+        h.print("inline ");
+        std::string rtype;
+        if (member_function->result_handle)
+          rtype = "spk::" + member_function->result_handle->fullname;
+        else if (member_function->res)
+          rtype = member_function->res->to_string();
+
+        if (member_function->result) {
+          h.print(rtype);
+        } else if (member_function->resultvec_void ||
+                   member_function->resultvec_incomplete) {
+          h.print("std::vector<", rtype, ">");
+        } else {
+          h.print(member_function->command->sreturn_type->to_string());
+        }
+        h.print(" ", sname, "::", member_function->name, "(");
+        bool first = true;
+        for (size_t i = member_function->begin(); i < member_function->end();
+             i++) {
+          const sps::Param& param = member_function->command->params.at(i);
+          if (param.stype->is_empty_enum() || param.is_allocation_callbacks())
+            continue;
+          if (first)
+            first = false;
+          else
+            h.print(", ");
+          if (member_function->szptrs.count(i)) {
+            const sps::Param& param =
+                member_function->command->params.at(i + 1);
+            h.print("spk::array_view<",
+                    sps::get_pointee(param.stype)->to_string(), "> ",
+                    param.name);
+            i++;
+          } else if (auto ref = param.asref()) {
+            h.print(ref->make_declaration("&" + param.name, 0));
+          } else {
+            h.print(param.stype->make_declaration(param.name, 0));
+          }
+        }
+        h.println(") {");
+        auto write_call = [&] {
+          h.print("  dispatch_table().", member_function->command->name, "(");
+          if (member_function->parent_dispatch)
+            h.print(parent, ", handle_");
+          else
+            h.print("handle_");
+          for (size_t i = member_function->begin(); i < member_function->end();
+               i++) {
+            const sps::Param& param = member_function->command->params.at(i);
+            if (param.stype->is_empty_enum()) continue;
+            h.print(", ");
+            if (param.is_allocation_callbacks())
+              h.print(allocation_callbacks);
+            else if (member_function->szptrs.count(i)) {
+              h.print(member_function->command->params.at(i + 1).name,
+                      ".size()");
+            } else if (member_function->szptrs.count(i - 1)) {
+              h.print(param.name, ".data()");
+            } else if (param.asref()) {
+              h.print("&", param.name);
+            } else {
+              h.print(param.name);
+            }
+          }
+        };
+        if (member_function->result) {
+          h.println("  ", member_function->res->to_string(), " result_;");
+          write_call();
+          h.println(", &result_);");
+
+          if (!member_function->result_handle) {
+            h.println("  return result_;");
+          } else if (is_thin(member_function->result_handle)) {
+            DVC_ASSERT(can_adopt(handle), member_function->command->name);
+            h.println("  return adopt<", rtype, ">(result_);");
+          } else {
+            const sps::Handle* reshand = member_function->result_handle;
+            h.print("  return {result_");
+            if (reshand->parent) {
+              if (reshand->parent != handle) {
+                DVC_ERROR("mismatch parent: ", member_function->command->name,
+                          " member of ", handle->name, " but parent ",
+                          reshand->parent->name);
+              }
+              h.print(", handle_");
+            }
+            h.println(", dispatch_table(), ", allocation_callbacks, "};");
+          }
+        } else if (member_function->resultvec_void ||
+                   member_function->resultvec_incomplete) {
+          h.println("  ", member_function->sz->to_string(), " size_;");
+          for (int pass : {1, 2}) {
+            if (member_function->resultvec_incomplete) {
+              h.print("  spk::result success", pass, "_ = ");
+            }
+            write_call();
+            if (pass == 1)
+              h.println(", &size_, nullptr);");
+            else if (pass == 2)
+              h.println(", &size_, result_.data());");
+            if (member_function->resultvec_incomplete) {
+              h.println("  if (success", pass,
+                        "_ != spk::result::success) throw "
+                        "spk::unexpected_command_result(success",
+                        pass, "_, \"",
+                        member_function->command->command->name,
+                        "\");");
+            }
+            if (pass == 1)
+              h.println("  std::vector<", member_function->res->to_string(),
+                        "> result_(size_);");
+          }
+          if (!member_function->result_handle) {
+            h.println("  return result_;");
+          } else if (is_thin(member_function->result_handle)) {
+            DVC_ASSERT(can_adopt(handle), member_function->command->name);
+            h.println("  std::vector<", rtype, "> result2_;");
+            h.println("  result2_.reserve(size_);");
+            h.println("  for (auto ref : result_)");
+            h.println("    result2_.push_back(adopt<", rtype, ">(ref));");
+            h.println("  return result2_;");
+          } else {
+            const sps::Handle* reshand = member_function->result_handle;
+            h.println("  std::vector<", rtype, "> result2_;");
+            h.println("  result2_.reserve(size_);");
+            h.println("  for (auto ref : result_)");
+            h.println("    result2_.emplace_back(ref");
+            if (reshand->parent) {
+              if (reshand->parent != handle) {
+                DVC_ERROR("mismatch parent: ", member_function->command->name,
+                          " member of ", handle->name, " but parent ",
+                          reshand->parent->name);
+              }
+              h.print(", handle_");
+            }
+            h.println(", dispatch_table(), ", allocation_callbacks, ");");
+            h.println("  return result2_;");
+          }
+        } else {
+          if (member_function->command->sreturn_type->to_string() != "void")
+            h.print("  return ");
+          write_call();
+          h.println(");");
+        }
+        h.println("}");
+      }
+      if (member_function->command->command->platform) h.println("#endif");
+      h.println();
+    }
+
+    h.println();
+  }
+  h.println();
+  h.println("}  // namespace spk");
+  h.println();
+
+  h.println("namespace std {");
+  for (const auto& struct_ : registry.structs) {
+    if (struct_->struct_->platform)
+      h.println("#ifdef ", struct_->struct_->platform->protect);
+    h.println("template <>");
+    h.println("struct hash<spk::", struct_->name, "> : spk::deep_hasher<spk::",
+              struct_->name, "> {};");
+    if (struct_->struct_->platform) h.println("#endif");
+  }
+  h.println("}  // namespace std");
+}
+
+// Rewrites a len expression of a command parameter from vk.xml so that it
+// can be evaluated where the parameters are in scope, dereferencing counts
+// passed by pointer.  Pointers to structs whose member is the count, as in
+// pAllocateInfo->commandBufferCount, are left as they are.  Returns an empty
+// string for latexmath expressions.
+std::string translate_param_len(const vks::Command* command,
+                                const std::string& len) {
+  if (len.find("latexmath") != std::string::npos) return "";
+  auto is_identifier = [](char c) { return std::isalnum(c) || c == '_'; };
+  std::string result;
+  size_t i = 0;
+  while (i < len.size()) {
+    if (len.compare(i, 2, "->") == 0) {
+      size_t j = i + 2;
+      while (j < len.size() && is_identifier(len[j])) ++j;
+      result += len.substr(i, j - i);
+      i = j;
+      continue;
+    }
+    if (!std::isalpha(len[i]) && len[i] != '_') {
+      result += len[i++];
+      continue;
+    }
+    size_t j = i;
+    while (j < len.size() && is_identifier(len[j])) ++j;
+    std::string word = len.substr(i, j - i);
+    bool by_pointer = false;
+    if (len.compare(j, 2, "->") != 0)
+      for (const vks::Param& param : command->params)
+        if (param.name == word &&
+            dynamic_cast<const vks::Pointer*>(param.type))
+          by_pointer = true;
+    result += (by_pointer ? "(*" + word + ")" : word);
+    i = j;
+  }
+  return "size_t(" + result + ")";
+}
+
+std::string join_list(const std::vector<std::string>& parts) {
+  std::string result;
+  for (size_t i = 0; i < parts.size(); ++i)
+    result += (i ? ", " : "") + parts.at(i);
+  return result;
+}
+
+// Commands the replayer never issues: they need the original device, a
+// window system, or return function pointers.
+bool replay_skipped(const std::string& name) {
+  for (const char* part : {"Swapchain", "Present", "AcquireNextImage",
+                           "FullScreenExclusive", "ProcAddr"})
+    if (name.find(part) != std::string::npos) return true;
+  return name == "vkDestroyDevice";
+}
+
+// Emits spk/spock_capture.h: a function per device command that records
+// the command through spk::capture_writer, and replay_command, which decodes
+// such a record and reissues it through spk::replayer.  See spk/capture.h.
+void write_capture(const sps::Registry& registry) {
+  dvc::file_writer h(outcapture, dvc::truncate);
+
+  const vks::DispatchTable* dispatch_table =
+      registry.dispatch_table(vks::DispatchTableKind::DEVICE)->dispatch_table;
+
+  h.println("#pragma once");
+  h.println();
+  h.println("#include \"spk/capture.h\"");
+  h.println();
+  h.println("namespace spk {");
+  h.println();
+
+  std::ostringstream capture, replay;
+  for (const vks::Command* command : dispatch_table->commands) {
+    std::string name = command->name;
+    std::string return_type = command->return_type->to_string();
+    bool returns = (return_type != "void");
+
+    // Parameters whose value another parameter's len names.
+    std::set<std::string> counts;
+    for (const vks::Param& param : command->params)
+      if (param.len) counts.insert(dvc::split(",", param.len.value()).at(0));
+
+    std::vector<std::string> signature, encode_inputs, encode_outputs,
+        decode_inputs, decode_outputs, prepare, args, finish;
+    bool has_outputs = false;
+    bool replayable = !replay_skipped(name);
+
+    for (const vks::Param& param : command->params) {
+      const std::string& pname = param.name;
+      signature.push_back(param.type->to_string(pname));
+      std::vector<std::string> len;
+      if (param.len) len = dvc::split(",", param.len.value());
+      std::string count;
+      if (!len.empty() && len.at(0) != "null-terminated") {
+        count = translate_param_len(command, len.at(0));
+        if (count.empty()) replayable = false;
+      }
+
+      auto spk_struct = [&](const vks::Type* type) -> std::string {
+        auto type_name = dynamic_cast<const vks::Name*>(type);
+        if (!type_name) return "";
+        auto vstruct = dynamic_cast<const vks::Struct*>(type_name->entity);
+        if (!vstruct) return "";
+        return "spk::" + registry.struct_map.at(vstruct)->name;
+      };
+
+      if (pname == "pAllocator") {
+        args.push_back("nullptr");
+        continue;
+      }
+      if (auto array = dynamic_cast<const vks::Array*>(param.type)) {
+        std::string n = "size_t(" + array->N->to_string() + ")";
+        encode_inputs.push_back("e.array(" + pname + ", " + n + ");");
+        decode_inputs.push_back(array->T->to_string() + " * " + pname +
+                                "; d.array(" + pname + ", 0);");
+        args.push_back(pname);
+        continue;
+      }
+      auto pointer = dynamic_cast<const vks::Pointer*>(param.type);
+      if (!pointer) {
+        std::string sstruct = spk_struct(param.type);
+        if (sstruct.empty()) {
+          encode_inputs.push_back("e.value(" + pname + ");");
+          decode_inputs.push_back(param.type->to_string(pname) + "; d.value(" +
+                                  pname + ");");
+          args.push_back(pname);
+        } else {
+          encode_inputs.push_back("e.value(reinterpret_cast<const " +
+                                  sstruct + "&>(" + pname + "));");
+          decode_inputs.push_back(sstruct + " " + pname + "; d.value(" +
+                                  pname + ");");
+          args.push_back("reinterpret_cast<" + param.type->to_string() +
+                         "&>(" + pname + ")");
+        }
+        continue;
+      }
+
+      if (auto const_ = dynamic_cast<const vks::Const*>(pointer->T)) {
+        // Inputs.
+        const vks::Type* pointee = const_->T;
+        std::string sstruct = spk_struct(pointee);
+        std::string decl = param.type->to_string(pname);
+        args.push_back(pname);
+        if (!len.empty() && len.at(0) == "null-terminated") {
+          encode_inputs.push_back("e.string(" + pname + ");");
+          decode_inputs.push_back(decl + "; d.string(" + pname + ");");
+        } else if (dynamic_cast<const vks::Pointer*>(pointee)) {
+          if (len.size() == 2 && len.at(1) == "null-terminated" &&
+              !count.empty()) {
+            encode_inputs.push_back("e.strings(" + pname + ", " + count +
+                                    ");");
+            decode_inputs.push_back(decl + "; d.strings(" + pname + ", 0);");
+          } else {
+            encode_inputs.push_back("e.opaque(" + pname + ");");
+            replayable = false;
+          }
+        } else if (pointee->to_string() == "void") {
+          if (count.empty()) {
+            encode_inputs.push_back("e.opaque(" + pname + ");");
+            replayable = false;
+          } else {
+            encode_inputs.push_back("e.bytes(" + pname + ", " + count + ");");
+            decode_inputs.push_back(decl + "; d.bytes(" + pname + ", 0);");
+          }
+        } else if (!sstruct.empty()) {
+          std::string cast = "reinterpret_cast<const " + sstruct + "*>(" +
+                             pname + ")";
+          std::string decode =
+              "const " + sstruct + "* " + pname + "_; d." +
+              (count.empty() ? "pointer(" + pname + "_);"
+                             : "array(" + pname + "_, 0);") +
+              " auto " + pname + " = reinterpret_cast<" +
+              param.type->to_string() + ">(" + pname + "_);";
+          encode_inputs.push_back(
+              count.empty() ? "e.pointer(" + cast + ");"
+                            : "e.array(" + cast + ", " + count + ");");
+          decode_inputs.push_back(decode);
+        } else {
+          encode_inputs.push_back(
+              count.empty() ? "e.pointer(" + pname + ");"
+                            : "e.array(" + pname + ", " + count + ");");
+          decode_inputs.push_back(decl + "; d." +
+                                  (count.empty() ? "pointer(" + pname + ");"
+                                                 : "array(" + pname + ", 0);"));
+        }
+        continue;
+      }
+
+      // Outputs, including counts that are also inputs.
+      has_outputs = true;
+      const vks::Type* pointee = pointer->T;
+      std::string ptype = pointee->to_string();
+      std::string n = (count.empty() ? "size_t(1)" : count);
+      auto pointee_name = dynamic_cast<const vks::Name*>(pointee);
+      args.push_back(pname);
+      if (pointee_name &&
+          dynamic_cast<const vks::Handle*>(pointee_name->entity)) {
+        encode_outputs.push_back("e.array(" + pname + ", " + pname + " ? " +
+                                 n + " : 0);");
+        decode_outputs.push_back(ptype + "* " + pname +
+                                 "_recorded; r.read_new_handles(" + pname +
+                                 "_recorded);");
+        prepare.push_back(ptype + "* " + pname + " = " + pname +
+                          "_recorded ? r.scratch<" + ptype + ">(" + n +
+                          ") : nullptr;");
+        finish.push_back("r.add_handles(" + pname + "_recorded, " + pname +
+                         ", " + pname + " ? " + n + " : 0);");
+      } else if (counts.count(pname)) {
+        encode_outputs.push_back("e.pointer(" + pname + ");");
+        decode_outputs.push_back(ptype + "* " + pname + "; d.pointer(" +
+                                 pname + ");");
+      } else {
+        // Scratch storage for results the replay has no use for.
+        std::string sstruct = spk_struct(pointee);
+        std::string element = (ptype == "void" ? "uint8_t" : ptype);
+        if (!sstruct.empty()) element = sstruct;
+        encode_outputs.push_back("e.value(uint8_t(" + pname +
+                                 " != nullptr));");
+        decode_outputs.push_back("uint8_t " + pname + "_present; d.value(" +
+                                 pname + "_present);");
+        prepare.push_back("auto " + pname + " = reinterpret_cast<" + ptype +
+                          "*>(" + pname + "_present ? r.scratch<" + element +
+                          ">(" + n + ") : nullptr);");
+      }
+    }
+
+    // Destroy and free commands are recorded before the driver can reuse
+    // their handles.
+    bool record_first = !has_outputs && (dvc::startswith(name, "vkDestroy") ||
+                                         dvc::startswith(name, "vkFree"));
+
+    if (command->platform)
+      capture << "#ifdef " << command->platform->protect << "\n";
+    capture << "  static VKAPI_ATTR " << return_type << " VKAPI_CALL " << name
+            << "(" << join_list(signature) << ") {\n";
+    capture << "    spk::capture_writer& writer = "
+               "spk::capture_writer::active();\n";
+    std::string call = "writer.next()." + name + "(";
+    for (size_t i = 0; i < command->params.size(); ++i)
+      call += (i ? ", " : "") + command->params.at(i).name;
+    call += ")";
+    if (!record_first)
+      capture << "    " << (returns ? "auto result = " : "") << call << ";\n";
+    capture << "    {\n";
+    capture << "      spk::capture_record record(writer, "
+               "uint16_t(command_id::"
+            << name << "));\n";
+    capture << "      auto& e = record.encoder();\n";
+    for (const std::string& line : encode_inputs)
+      capture << "      " << line << "\n";
+    if (!record_first) {
+      if (returns) capture << "      e.value(result);\n";
+      for (const std::string& line : encode_outputs)
+        capture << "      " << line << "\n";
+    }
+    capture << "    }\n";
+    if (record_first)
+      capture << "    " << (returns ? "return " : "") << call << ";\n";
+    else if (returns)
+      capture << "    return result;\n";
+    capture << "  }\n";
+    if (command->platform) capture << "#endif\n";
+
+    if (!replayable) continue;
+    if (command->platform)
+      replay << "#ifdef " << command->platform->protect << "\n";
+    replay << "    case uint16_t(command_id::" << name << "): {\n";
+    replay << "      auto& d = r.decoder();\n";
+    for (const std::string& line : decode_inputs)
+      replay << "      " << line << "\n";
+    if (!record_first) {
+      if (returns) {
+        replay << "      " << return_type << " recorded_result; "
+               << "d.value(recorded_result);\n";
+        replay << "      (void)recorded_result;\n";
+      }
+      for (const std::string& line : decode_outputs)
+        replay << "      " << line << "\n";
+    }
+    for (const std::string& line : prepare) replay << "      " << line << "\n";
+    if (name == "vkUnmapMemory" || name == "vkFreeMemory")
+      replay << "      r.unmap_memory(memory);\n";
+    replay << "      r.table()." << name << "(" << join_list(args) << ");\n";
+    for (const std::string& line : finish) replay << "      " << line << "\n";
+    if (name == "vkMapMemory")
+      replay << "      r.map_memory(memory, offset, *ppData);\n";
+    replay << "      return true;\n";
+    replay << "    }\n";
+    if (command->platform) replay << "#endif\n";
+  }
+
+  h.println("// Forwards to capture_writer::active().next() and records.");
+  h.println("struct capture_commands {");
+  h.print(capture.str());
+  h.println();
+  h.println("  static void install(spk::device_dispatch_table& table) {");
+  for (const vks::Command* command : dispatch_table->commands) {
+    if (command->platform) h.println("#ifdef ", command->platform->protect);
+    h.println("    table.", command->name, " = ", command->name, ";");
+    if (command->platform) h.println("#endif");
+  }
+  h.println("  }");
+  h.println("};");
+  h.println();
+
+  h.println("// Decodes one record and reissues its command, or returns false");
+  h.println("// if the command cannot be replayed.");
+  h.println("inline bool replay_command(uint16_t command, spk::replayer& r) {");
+  h.println("  switch (command) {");
+  h.print(replay.str());
+  h.println("    default:");
+  h.println("      return false;");
+  h.println("  }");
+  h.println("}");
+  h.println();
+  h.println("}  // namespace spk");
+}
+
+// Emits spk/spock_instrumentation.h: a function per device command that
+// times a call to the original entry.  See spk/instrumentation.h.
+void write_instrumentation(const sps::Registry& registry) {
+  dvc::file_writer h(outinstrumentation, dvc::truncate);
+
+  const vks::DispatchTable* dispatch_table =
+      registry.dispatch_table(vks::DispatchTableKind::DEVICE)->dispatch_table;
+
+  h.println("#pragma once");
+  h.println();
+  h.println("#include \"spk/instrumentation.h\"");
+  h.println();
+  h.println("namespace spk {");
+  h.println();
+  h.println("// Forwards to command_instrumentation::next() under a timer.");
+  h.println("struct instrumented_commands {");
+  for (const vks::Command* command : dispatch_table->commands) {
+    std::string name = command->name;
+    std::vector<std::string> signature, args;
+    for (const vks::Param& param : command->params) {
+      signature.push_back(param.type->to_string(param.name));
+      args.push_back(param.name);
+    }
+    if (command->platform) h.println("#ifdef ", command->platform->protect);
+    h.println("  static VKAPI_ATTR ", command->return_type->to_string(),
+              " VKAPI_CALL ", name, "(", join_list(signature), ") {");
+    h.println("    spk::command_timer timer(uint16_t(command_id::", name,
+              "));");
+    h.println("    return spk::command_instrumentation::next().", name, "(",
+              join_list(args), ");");
+    h.println("  }");
+    if (command->platform) h.println("#endif");
+  }
+  h.println();
+  h.println("  static void install(spk::device_dispatch_table& table) {");
+  for (const vks::Command* command : dispatch_table->commands) {
+    if (command->platform) h.println("#ifdef ", command->platform->protect);
+    h.println("    table.", command->name, " = ", command->name, ";");
+    if (command->platform) h.println("#endif");
+  }
+  h.println("  }");
+  h.println("};");
+  h.println();
+  h.println("}  // namespace spk");
+}
+
+// Commands of the null driver that spk/null_driver.cc defines, because they
+// hand out memory or describe the device.
+const std::set<std::string> null_driver_manual_commands = {
+    "vkGetInstanceProcAddr",
+    "vkGetDeviceProcAddr",
+    "vkEnumerateInstanceVersion",
+    "vkGetPhysicalDeviceProperties",
+    "vkGetPhysicalDeviceProperties2",
+    "vkGetPhysicalDeviceMemoryProperties",
+    "vkGetPhysicalDeviceMemoryProperties2",
+    "vkGetPhysicalDeviceQueueFamilyProperties",
+    "vkGetPhysicalDeviceQueueFamilyProperties2",
+    "vkCreateBuffer",
+    "vkDestroyBuffer",
+    "vkCreateImage",
+    "vkDestroyImage",
+    "vkGetBufferMemoryRequirements",
+    "vkGetBufferMemoryRequirements2",
+    "vkGetImageMemoryRequirements",
+    "vkGetImageMemoryRequirements2",
+    "vkAllocateMemory",
+    "vkFreeMemory",
+    "vkMapMemory",
+    "vkGetSemaphoreCounterValue",
+};
+
+// Emits spk/spock_null_driver.h: a function for every command of every
+// dispatch table that succeeds without doing anything.  Outputs are zeroed,
+// created handles are fresh, and counted outputs follow the two-call
+// enumeration protocol with nothing to enumerate except handles, of which
+// there is one.  See spk/null_driver.h.
+void write_null_driver(const sps::Registry& registry) {
+  dvc::file_writer h(outnulldriver, dvc::truncate);
+
+  std::vector<const vks::Command*> commands;
+  for (vks::DispatchTableKind kind :
+       {vks::DispatchTableKind::GLOBAL, vks::DispatchTableKind::INSTANCE,
+        vks::DispatchTableKind::DEVICE})
+    for (const vks::Command* command :
+         registry.dispatch_table(kind)->dispatch_table->commands)
+      commands.push_back(command);
+
+  h.println("#pragma once");
+  h.println();
+  h.println("#include <string_view>");
+  h.println("#include <unordered_map>");
+  h.println();
+  h.println("#include \"spk/null_driver.h\"");
+  h.println();
+  h.println("namespace spk {");
+  h.println();
+  h.println("// Those only declared here are defined in spk/null_driver.cc.");
+  h.println("struct null_commands {");
+  for (const vks::Command* command : commands) {
+    std::string name = command->name;
+    std::string return_type = command->return_type->to_string();
+    std::vector<std::string> signature;
+    for (const vks::Param& param : command->params)
+      signature.push_back(param.type->to_string(param.name));
+
+    if (command->platform) h.println("#ifdef ", command->platform->protect);
+    h.print("  static VKAPI_ATTR ", return_type, " VKAPI_CALL ", name, "(",
+            join_list(signature), ")");
+    if (null_driver_manual_commands.count(name)) {
+      h.println(";");
+      if (command->platform) h.println("#endif");
+      continue;
+    }
+    h.println(" {");
+
+    auto output = [](const vks::Param& param) -> const vks::Type* {
+      auto pointer = dynamic_cast<const vks::Pointer*>(param.type);
+      if (!pointer || dynamic_cast<const vks::Const*>(pointer->T))
+        return nullptr;
+      return pointer->T;
+    };
+    auto is_handle = [](const vks::Type* type) {
+      auto type_name = dynamic_cast<const vks::Name*>(type);
+      return type_name && dynamic_cast<const vks::Handle*>(type_name->entity);
+    };
+    auto fill = [&](const vks::Param& param, const std::string& count) {
+      const vks::Type* pointee = output(param);
+      std::string function = "null_fill";
+      if (is_handle(pointee))
+        function = "null_handles";
+      else if (pointee->to_string() == "void")
+        function = "null_fill_bytes";
+      return "if (" + param.name + ") spk::" + function + "(" + param.name +
+             ", " + count + ");";
+    };
+
+    // Outputs counted by another output are enumerations.
+    std::map<std::string, std::vector<const vks::Param*>> enumerations;
+    for (const vks::Param& param : command->params) {
+      if (!output(param) || !param.len) continue;
+      std::string count = dvc::split(",", param.len.value()).at(0);
+      for (const vks::Param& count_param : command->params)
+        if (count_param.name == count && output(count_param))
+          enumerations[count].push_back(&param);
+    }
+
+    std::vector<std::string> complete;
+    for (const vks::Param& param : command->params) {
+      if (!output(param)) continue;
+      if (enumerations.count(param.name)) {
+        const auto& arrays = enumerations.at(param.name);
+        bool handles = false;
+        for (const vks::Param* array : arrays)
+          handles = handles || is_handle(output(*array));
+        h.println("    bool ", param.name, "_complete = spk::null_enumerate(",
+                  param.name, ", ", (handles ? 1 : 0), ", ",
+                  arrays.at(0)->name, " == nullptr);");
+        for (const vks::Param* array : arrays)
+          h.println("    ", fill(*array, "size_t(*" + param.name + ")"));
+        complete.push_back(param.name + "_complete");
+        continue;
+      }
+      std::string count = "size_t(1)";
+      if (param.len) {
+        std::string len = dvc::split(",", param.len.value()).at(0);
+        if (enumerations.count(len)) continue;
+        std::string translated = translate_param_len(command, len);
+        if (len != "null-terminated" && !translated.empty()) count = translated;
+      }
+      h.println("    ", fill(param, count));
+    }
+
+    if (return_type == "VkResult") {
+      std::string all;
+      for (const std::string& c : complete)
+        all += (all.empty() ? "" : " && ") + c;
+      if (all.empty())
+        h.println("    return VK_SUCCESS;");
+      else
+        h.println("    return ", all, " ? VK_SUCCESS : VK_INCOMPLETE;");
+    } else if (return_type == "VkBool32") {
+      h.println("    return VK_TRUE;");
+    } else if (return_type != "void") {
+      h.println("    return ", return_type, "();");
+    }
+    h.println("  }");
+    if (command->platform) h.println("#endif");
+  }
+  h.println("};");
+  h.println();
+
+  h.println("inline PFN_vkVoidFunction null_proc_addr(const char* name) {");
+  h.println("  static const std::unordered_map<std::string_view, "
+            "PFN_vkVoidFunction> commands = {");
+  for (const vks::Command* command : commands) {
+    if (command->platform) h.println("#ifdef ", command->platform->protect);
+    h.println("      {\"", command->name,
+              "\", reinterpret_cast<PFN_vkVoidFunction>(null_commands::",
+              command->name, ")},");
+    if (command->platform) h.println("#endif");
+  }
+  h.println("  };");
+  h.println("  auto it = commands.find(name);");
+  h.println("  return it == commands.end() ? nullptr : it->second;");
+  h.println("}");
+  h.println();
+  h.println("}  // namespace spk");
+}
 
 int main(int argc, char** argv) {
   dvc::init_options(argc, argv);
@@ -944,4 +1764,36 @@ int main(int argc, char** argv) {
                                   outh + " " + outcc)
                                      .c_str()));
   }
+
+  if (!outspk.empty()) {
+    sps::Registry spsregistry = build_spock_registry(vksregistry);
+    write_spock(spsregistry);
+    DVC_ASSERT_EQ(0, std::system(("/usr/bin/clang-format -i -style=Google " +
+                                  outspk)
+                                     .c_str()));
+  }
+
+  if (!outcapture.empty()) {
+    sps::Registry spsregistry = build_spock_registry(vksregistry);
+    write_capture(spsregistry);
+    DVC_ASSERT_EQ(0, std::system(("/usr/bin/clang-format -i -style=Google " +
+                                  outcapture)
+                                     .c_str()));
+  }
+
+  if (!outnulldriver.empty()) {
+    sps::Registry spsregistry = build_spock_registry(vksregistry);
+    write_null_driver(spsregistry);
+    DVC_ASSERT_EQ(0, std::system(("/usr/bin/clang-format -i -style=Google " +
+                                  outnulldriver)
+                                     .c_str()));
+  }
+
+  if (!outinstrumentation.empty()) {
+    sps::Registry spsregistry = build_spock_registry(vksregistry);
+    write_instrumentation(spsregistry);
+    DVC_ASSERT_EQ(0, std::system(("/usr/bin/clang-format -i -style=Google " +
+                                  outinstrumentation)
+                                     .c_str()));
+  }
 }